@@ -0,0 +1,91 @@
+/**
+ * @file admission.c
+ * @brief Per-connection token buckets and load shedding by message class.
+ *
+ * Every connection gets a token bucket; a message that finds it empty, or
+ * that arrives while the server is above its class's load level, is not
+ * admitted. Connection tasks then coalesce a shed STATUS_UPDATE (only the
+ * newest is kept) and drop a shed HEARTBEAT_RESPONSE. MISSION_COMPLETE is
+ * always admitted, and HANDSHAKE and RESUME only refused, with a 503 and a
+ * retry hint, once the server is far past its limits.
+ */
+#include "headers/admission.h"
+#include "headers/region.h"
+#include "headers/workpool.h"
+#include "headers/metrics.h"
+#include <string.h>
+
+static uint64_t latency_avg_ns = 0;   // exponentially weighted, 1/16 per sample
+static uint64_t latency_at_ns = 0;
+static long refused = 0, coalesced = 0, dropped = 0;
+
+void token_bucket_init(TokenBucket *b, uint64_t now_ns) {
+    b->tokens = ADMIT_CONN_BURST;
+    b->refill_ns = now_ns;
+}
+
+int token_bucket_take(TokenBucket *b, uint64_t now_ns) {
+    if (now_ns > b->refill_ns) {
+        b->tokens += (now_ns - b->refill_ns) * ADMIT_CONN_RATE / 1e9;
+        if (b->tokens > ADMIT_CONN_BURST) b->tokens = ADMIT_CONN_BURST;
+        b->refill_ns = now_ns;
+    }
+    if (b->tokens < 1) return 0;
+    b->tokens -= 1;
+    return 1;
+}
+
+AdmitClass admission_class(const char *type) {
+    if (!type) return ADMIT_NORMAL;
+    if (strcmp(type, "HANDSHAKE") == 0 || strcmp(type, "RESUME") == 0 || strcmp(type, "MISSION_COMPLETE") == 0) {
+        return ADMIT_CRITICAL;
+    }
+    if (strcmp(type, "STATUS_UPDATE") == 0) return ADMIT_BULK;
+    return ADMIT_NORMAL;
+}
+
+// Whichever of queue depth and handler latency is further over its limit.
+double admission_load() {
+    double load = (double)(regions_queued_messages() + workpool_queued()) / ADMIT_INFLIGHT_LIMIT;
+    uint64_t now = metrics_now_ns();
+    if (now - __atomic_load_n(&latency_at_ns, __ATOMIC_RELAXED) < ADMIT_LATENCY_STALE_NS) {
+        double latency = (double)__atomic_load_n(&latency_avg_ns, __ATOMIC_RELAXED) / ADMIT_LATENCY_LIMIT_NS;
+        if (latency > load) load = latency;
+    }
+    return load;
+}
+
+// Critical messages still spend a token when there is one, so a drone that
+// floods MISSION_COMPLETE starves its own status updates first.
+int admission_admit(AdmitClass cls, TokenBucket *b, uint64_t now_ns) {
+    int token = token_bucket_take(b, now_ns);
+    if (cls == ADMIT_CRITICAL) return 1;
+    if (!token) return 0;
+    return admission_load() < (cls == ADMIT_BULK ? ADMIT_SHED_BULK : ADMIT_SHED_NORMAL);
+}
+
+int admission_accept_handshake() {
+    return admission_load() < ADMIT_REFUSE_HANDSHAKE;
+}
+
+// Seconds a refused drone should wait: longer the deeper the overload.
+int admission_retry_after() {
+    int seconds = 1 + (int)admission_load();
+    return seconds < ADMIT_RETRY_MAX_S ? seconds : ADMIT_RETRY_MAX_S;
+}
+
+// Fed with every handler latency; racing updates may lose a sample, which
+// the average absorbs.
+void admission_observe(uint64_t latency_ns) {
+    uint64_t avg = __atomic_load_n(&latency_avg_ns, __ATOMIC_RELAXED);
+    avg = avg - avg / 16 + latency_ns / 16;
+    __atomic_store_n(&latency_avg_ns, avg, __ATOMIC_RELAXED);
+    __atomic_store_n(&latency_at_ns, metrics_now_ns(), __ATOMIC_RELAXED);
+}
+
+void admission_count_refused() { __atomic_add_fetch(&refused, 1, __ATOMIC_RELAXED); }
+void admission_count_coalesced() { __atomic_add_fetch(&coalesced, 1, __ATOMIC_RELAXED); }
+void admission_count_dropped() { __atomic_add_fetch(&dropped, 1, __ATOMIC_RELAXED); }
+long admission_refused() { return __atomic_load_n(&refused, __ATOMIC_RELAXED); }
+long admission_coalesced() { return __atomic_load_n(&coalesced, __ATOMIC_RELAXED); }
+long admission_dropped() { return __atomic_load_n(&dropped, __ATOMIC_RELAXED); }
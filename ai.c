@@ -1,4 +1,10 @@
 #include "headers/ai.h"
+#include "headers/metrics.h"
+#include "headers/server.h"
+#include "headers/globals.h"
+#include "headers/deadreckon.h"
+#include "headers/lockprof.h"
+#include "headers/replication.h"
 #include <limits.h>
 #include <stdio.h>
 #include <string.h> 
@@ -6,84 +12,230 @@
 #include <unistd.h>
 #include <sys/socket.h>
 #include <json-c/json.h>
-#include <signal.h>
 
-extern volatile sig_atomic_t global_shutdown_flag;
-
-void assign_mission(Drone *drone, Coord target, const char *mission_id) {
-    pthread_mutex_lock(&drone->lock);
-    drone->target = target;
-    drone->status = ON_MISSION;
+// Sends ASSIGN_MISSION for the stops of the current tour not yet reached.
+// Call with drone->lock held.
+int send_mission(Drone *drone) {
     struct json_object *mission = json_object_new_object();
     json_object_object_add(mission, "type", json_object_new_string("ASSIGN_MISSION"));
-    json_object_object_add(mission, "mission_id", json_object_new_string(mission_id));
-    json_object_object_add(mission, "priority", json_object_new_string("high"));
+    json_object_object_add(mission, "mission_id", json_object_new_string(drone->mission_id));
+    json_object_object_add(mission, "priority", json_object_new_string(drone->repositioning ? "low" : "high"));
+    if (drone->repositioning) json_object_object_add(mission, "reposition", json_object_new_boolean(1));
     struct json_object *target_obj = json_object_new_object();
-    json_object_object_add(target_obj, "x", json_object_new_int(target.x));
-    json_object_object_add(target_obj, "y", json_object_new_int(target.y));
+    json_object_object_add(target_obj, "x", json_object_new_int(drone->target.x));
+    json_object_object_add(target_obj, "y", json_object_new_int(drone->target.y));
     json_object_object_add(mission, "target", target_obj);
+    struct json_object *waypoints = json_object_new_array();
+    for (int i = drone->tour_stop; i < drone->tour_len; i++) {
+        struct json_object *stop = json_object_new_object();
+        json_object_object_add(stop, "x", json_object_new_int(drone->tour[i].x));
+        json_object_object_add(stop, "y", json_object_new_int(drone->tour[i].y));
+        json_object_array_add(waypoints, stop);
+    }
+    json_object_object_add(mission, "waypoints", waypoints);
+    struct json_object *origin_obj = json_object_new_object();
+    json_object_object_add(origin_obj, "x", json_object_new_int(drone->anchor.x));
+    json_object_object_add(origin_obj, "y", json_object_new_int(drone->anchor.y));
+    json_object_object_add(mission, "origin", origin_obj);
     json_object_object_add(mission, "expiry", json_object_new_int64(time(NULL) + 3600));
     json_object_object_add(mission, "checksum", json_object_new_string("a1b2c3"));
-    
-    // Add newline to ensure proper message framing
-    const char *json_str = json_object_to_json_string_ext(mission, JSON_C_TO_STRING_PLAIN);
-    char *msg = malloc(strlen(json_str) + 2);  // +2 for newline and null terminator
-    if (msg) {
-        sprintf(msg, "%s\n", json_str);
-        send(drone->sock, msg, strlen(msg), 0);
-        free(msg);
-    }
-    
+    int result = send_json(drone->sock, mission);
     json_object_put(mission);
-    pthread_mutex_unlock(&drone->lock);
+    if (result != 0) {
+        // The tour stays assigned; RESUME sends it again on the new connection
+        fprintf(stderr, "ASSIGN_MISSION %s not delivered to drone %d\n", drone->mission_id, drone->id);
+    }
+    return result;
+}
+
+// Starts the tour and sends ASSIGN_MISSION. Call with drone->lock held.
+static void start_mission(Drone *drone, const Coord *stops, int count, const char *mission_id, int reposition) {
+    // Idle drones hold still, so coord is exact; one being repositioned is
+    // taken over from where it is predicted to be
+    uint64_t now = metrics_now_ns();
+    drone_reanchor(drone, drone_position(drone, now), now);
+    memcpy(drone->tour, stops, sizeof(Coord) * count);
+    drone->tour_len = count;
+    drone->tour_stop = 0;
+    drone->target = stops[0];
+    drone->status = ON_MISSION;
+    drone->repositioning = reposition;
+    snprintf(drone->mission_id, sizeof(drone->mission_id), "%s", mission_id);
+    replicate_drone(drone);
+    send_mission(drone);
+}
+
+// Sends the drone on a tour of count stops, visited in order. Claims the
+// drone only if it is still free, since regions dispatch concurrently; a
+// drone being repositioned is free.
+int assign_mission(Drone *drone, const Coord *stops, int count, const char *mission_id) {
+    if (count < 1 || count > DRONE_TOUR_MAX) return -1;
+    LOCK(&drone->lock);
+    if (drone->status != IDLE && !drone->repositioning) {
+        UNLOCK(&drone->lock);
+        return -1;
+    }
+    start_mission(drone, stops, count, mission_id, 0);
+    UNLOCK(&drone->lock);
+    return 0;
+}
+
+// Sends an idle drone to wait at `to` instead of where it is.
+int reposition_drone(Drone *drone, Coord to) {
+    char mission_id[32];
+    LOCK(&drone->lock);
+    if (drone->status != IDLE) {
+        UNLOCK(&drone->lock);
+        return -1;
+    }
+    snprintf(mission_id, sizeof(mission_id), "REPOSITION-%d", drone->id);
+    start_mission(drone, &to, 1, mission_id, 1);
+    drone->repositioned_ns = drone->anchor_ns;
+    UNLOCK(&drone->lock);
+    return 0;
+}
+
+static const char *payload_names[PAYLOAD_COUNT] = {"general", "medical", "food", "water"};
+
+Payload payload_parse(const char *name) {
+    for (int p = 0; name && p < PAYLOAD_COUNT; p++) {
+        if (strcmp(name, payload_names[p]) == 0) return (Payload)p;
+    }
+    return PAYLOAD_ANY;
+}
+
+const char *payload_name(Payload payload) {
+    return payload >= 0 && payload < PAYLOAD_COUNT ? payload_names[payload] : payload_names[PAYLOAD_ANY];
 }
 
-Drone *find_closest_idle_drone(Coord target) {
-    Drone *closest = NULL;
-    int min_distance = INT_MAX;
-    pthread_mutex_lock(&drones->lock);
+int payload_serves(Payload carried, Payload need) {
+    return carried == PAYLOAD_ANY || need == PAYLOAD_ANY || carried == need;
+}
+
+// Lower is better; -1 if d cannot take s. Only drones that carry what the
+// survivor needs and have the charge to fly there and home again qualify;
+// the score is the ETA in seconds, or the distance under --dispatch nearest.
+// Distances are flown around obstacles when field, the distance field of
+// s's cell, is given. Call with d->lock held.
+double dispatch_score(const Drone *d, const Survivor *s, const PathField *field) {
+    if (d->status != IDLE && !d->repositioning) return -1;
+    if (!payload_serves(d->payload, s->need)) return -1;
+    int dist = path_distance(field, d->coord, s->coord);
+    if (dist < 0) return -1;
+    if (d->battery_capacity > 0) {
+        Coord home = d->has_home ? d->home : d->coord;
+        int back = path_distance(field, home, s->coord);
+        double range = (double)d->battery * d->battery_capacity / 100;
+        if (back < 0) return -1;
+        if (dist + back + DISPATCH_RESERVE_CELLS > range) return -1;
+    }
+    if (config.dispatch_nearest) return dist;
+    double speed = d->speed > 0 ? d->speed : DEADRECKON_DEFAULT_SPEED;
+    return dist / speed;
+}
+
+Drone *find_best_idle_drone(const Survivor *s) {
+    Drone *best = NULL;
+    double best_score = 0;
+    const PathField *field = path_field_acquire(&map_paths, s->coord);
+    metrics_lock(&drones->lock, LOCK_DRONES);
     Node *node = drones->head;
     while (node != NULL) {
         Drone *d = (Drone *)node->data;
-        pthread_mutex_lock(&d->lock);
-        if (d->status == IDLE) {
-            int dist = abs(d->coord.x - target.x) + abs(d->coord.y - target.y);
-            if (dist < min_distance) {
-                min_distance = dist;
-                closest = d;
-            }
+        LOCK(&d->lock);
+        double score = dispatch_score(d, s, field);
+        if (score >= 0 && (!best || score < best_score)) {
+            best_score = score;
+            best = d;
         }
-        pthread_mutex_unlock(&d->lock);
+        UNLOCK(&d->lock);
         node = node->next;
     }
-    pthread_mutex_unlock(&drones->lock);
-    return closest;
+    UNLOCK(&drones->lock);
+    path_field_release(&map_paths, field);
+    return best;
+}
+
+static int cells(Coord a, Coord b) {
+    return abs(a.x - b.x) + abs(a.y - b.y);
+}
+
+// Length of the open path start -> stops[order[0]] -> ... -> stops[order[n-1]].
+static int tour_length(Coord start, const Coord *stops, const int *order, int n) {
+    int length = 0;
+    Coord at = start;
+    for (int i = 0; i < n; i++) {
+        length += cells(at, stops[order[i]]);
+        at = stops[order[i]];
+    }
+    return length;
 }
 
-void *ai_controller(void *arg) {
-    printf("AI controller thread started.\n");
-    while (!global_shutdown_flag) {
-        pthread_mutex_lock(&survivors->lock);
-        Node *node = survivors->head;
-        
-        if (node && node->data) {
-            Survivor *s = (Survivor *)node->data;
-            Coord target = s->coord;
-            char mission_id[25];
-            strncpy(mission_id, s->info, sizeof(mission_id) - 1);
-            mission_id[sizeof(mission_id) - 1] = '\0';
-            
-            Drone *closest = find_closest_idle_drone(target);
-            if (closest) {
-                printf("Drone %d assigned to survivor %s at (%d, %d)\n",
-                       closest->id, mission_id, target.x, target.y);
-                       
-                assign_mission(closest, target, mission_id);
+// Orders count stops into a short open tour from start and returns its
+// length in cells: nearest insertion builds it, 2-opt then uncrosses it.
+// order receives the visiting order as indices into stops.
+int plan_tour(Coord start, const Coord *stops, int count, int *order) {
+    if (count <= 0) return 0;
+    int in_tour[DRONE_TOUR_MAX] = {0};
+    int n = 0;
+    if (count > DRONE_TOUR_MAX) count = DRONE_TOUR_MAX;
+
+    while (n < count) {
+        // The stop nearest to anything already on the tour (or the start)...
+        int pick = -1, pick_dist = INT_MAX;
+        for (int k = 0; k < count; k++) {
+            if (in_tour[k]) continue;
+            int dist = cells(start, stops[k]);
+            for (int i = 0; i < n; i++) {
+                int d = cells(stops[order[i]], stops[k]);
+                if (d < dist) dist = d;
+            }
+            if (dist < pick_dist) {
+                pick_dist = dist;
+                pick = k;
+            }
+        }
+        // ...goes in wherever it lengthens the tour least; the end is open
+        int best_at = n;
+        int best_cost = n > 0 ? cells(stops[order[n - 1]], stops[pick]) : cells(start, stops[pick]);
+        for (int i = 0; i < n; i++) {
+            Coord prev = i > 0 ? stops[order[i - 1]] : start;
+            int cost = cells(prev, stops[pick]) + cells(stops[pick], stops[order[i]]) - cells(prev, stops[order[i]]);
+            if (cost < best_cost) {
+                best_cost = cost;
+                best_at = i;
+            }
+        }
+        memmove(&order[best_at + 1], &order[best_at], sizeof(int) * (n - best_at));
+        order[best_at] = pick;
+        in_tour[pick] = 1;
+        n++;
+    }
+
+    // 2-opt: reverse order[i..j] while that shortens the path. The start is
+    // fixed and the tail open, so reversing a suffix only changes one edge.
+    int improved = 1;
+    while (improved) {
+        improved = 0;
+        for (int i = 0; i < n - 1; i++) {
+            Coord prev = i > 0 ? stops[order[i - 1]] : start;
+            for (int j = i + 1; j < n; j++) {
+                int before = cells(prev, stops[order[i]]);
+                int after = cells(prev, stops[order[j]]);
+                if (j + 1 < n) {
+                    before += cells(stops[order[j]], stops[order[j + 1]]);
+                    after += cells(stops[order[i]], stops[order[j + 1]]);
+                }
+                if (after < before) {
+                    for (int a = i, b = j; a < b; a++, b--) {
+                        int t = order[a];
+                        order[a] = order[b];
+                        order[b] = t;
+                    }
+                    improved = 1;
+                }
             }
         }
-        pthread_mutex_unlock(&survivors->lock);
-        sleep(1);  // Prevent busy-waiting
     }
-    printf("AI controller thread exiting.\n");
-    return NULL;
-}
\ No newline at end of file
+    return tour_length(start, stops, order, n);
+}
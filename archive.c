@@ -0,0 +1,305 @@
+/**
+ * @file archive.c
+ * @brief Append-only columnar archive of helped survivors.
+ *
+ * Rescues are appended to fixed-size segment files under ARCHIVE_DIR. Each
+ * segment is mmap'd and laid out column by column after a small header
+ * (discovered, helped, x, y, drone_id; 64-bit columns first so they stay
+ * aligned), so analytics can scan millions of records without touching the
+ * heap. Only the last HELPED_WINDOW rescues are kept in the in-memory
+ * helpedsurvivors list for the view.
+ *
+ * A segment that fails to open (disk full, permissions) is retried on later
+ * appends with a backoff; rescues in between are skipped and counted.
+ */
+#include "headers/archive.h"
+#include "headers/globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ARCHIVE_MAGIC "EDCSARC1"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_HEADER_SIZE 64
+#define ARCHIVE_RETRY_MIN_S 1
+#define ARCHIVE_RETRY_MAX_S 60
+
+typedef struct archive_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t capacity;
+    uint64_t count;  // published with release semantics after the columns are written
+} ArchiveHeader;
+
+typedef struct archive_segment {
+    unsigned index;
+    int fd;
+    size_t size;
+    char *base;
+    ArchiveHeader *header;
+    int32_t *x;
+    int32_t *y;
+    int64_t *discovered;
+    int64_t *helped;
+    int32_t *drone_id;
+} ArchiveSegment;
+
+static pthread_mutex_t archive_lock = PTHREAD_MUTEX_INITIALIZER;
+static char archive_dir[256];
+static ArchiveSegment active = {.fd = -1};
+// While active is closed after a failed open: the segment to try again, and
+// when. retry_backoff is 0 while nothing has failed.
+static unsigned retry_index;
+static time_t retry_at;
+static int retry_backoff;
+static uint64_t skipped_records;
+
+static size_t segment_size(uint32_t capacity) {
+    return ARCHIVE_HEADER_SIZE + (size_t)capacity * (2 * sizeof(int32_t) + 2 * sizeof(int64_t) + sizeof(int32_t));
+}
+
+static void segment_path(const char *dir, unsigned index, char *path, size_t len) {
+    snprintf(path, len, "%s/helped-%06u.seg", dir, index);
+}
+
+static void map_columns(ArchiveSegment *seg, uint32_t capacity) {
+    char *p = seg->base + ARCHIVE_HEADER_SIZE;
+    seg->header = (ArchiveHeader *)seg->base;
+    seg->discovered = (int64_t *)p;
+    p += capacity * sizeof(int64_t);
+    seg->helped = (int64_t *)p;
+    p += capacity * sizeof(int64_t);
+    seg->x = (int32_t *)p;
+    p += capacity * sizeof(int32_t);
+    seg->y = (int32_t *)p;
+    p += capacity * sizeof(int32_t);
+    seg->drone_id = (int32_t *)p;
+}
+
+static void close_segment(ArchiveSegment *seg) {
+    if (seg->base) {
+        msync(seg->base, seg->size, MS_ASYNC);
+        munmap(seg->base, seg->size);
+    }
+    if (seg->fd >= 0) close(seg->fd);
+    memset(seg, 0, sizeof(*seg));
+    seg->fd = -1;
+}
+
+// Opens (or creates) segment `index` for appending. The file is sized up
+// front; unwritten columns stay sparse on disk until records land in them.
+static int open_segment(ArchiveSegment *seg, unsigned index) {
+    char path[300];
+    segment_path(archive_dir, index, path, sizeof(path));
+
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+        perror("archive: open segment");
+        return -1;
+    }
+    size_t size = segment_size(ARCHIVE_SEGMENT_RECORDS);
+    struct stat st;
+    if (fstat(fd, &st) < 0 || ((size_t)st.st_size < size && ftruncate(fd, size) < 0)) {
+        perror("archive: size segment");
+        close(fd);
+        return -1;
+    }
+    char *base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (base == MAP_FAILED) {
+        perror("archive: mmap segment");
+        close(fd);
+        return -1;
+    }
+
+    seg->index = index;
+    seg->fd = fd;
+    seg->size = size;
+    seg->base = base;
+    map_columns(seg, ARCHIVE_SEGMENT_RECORDS);
+
+    if (memcmp(seg->header->magic, ARCHIVE_MAGIC, 8) != 0) {
+        memcpy(seg->header->magic, ARCHIVE_MAGIC, 8);
+        seg->header->version = ARCHIVE_VERSION;
+        seg->header->capacity = ARCHIVE_SEGMENT_RECORDS;
+        __atomic_store_n(&seg->header->count, 0, __ATOMIC_RELEASE);
+    } else if (seg->header->capacity != ARCHIVE_SEGMENT_RECORDS) {
+        fprintf(stderr, "archive: %s has capacity %u, expected %u\n",
+                path, seg->header->capacity, ARCHIVE_SEGMENT_RECORDS);
+        close_segment(seg);
+        return -1;
+    }
+    return 0;
+}
+
+// Makes segment index the active one, or schedules another try with a
+// doubling backoff. Only the first failure and the recovery are logged.
+// Call with archive_lock held.
+static int reopen_segment(unsigned index, time_t now) {
+    if (open_segment(&active, index) == 0) {
+        if (retry_backoff) {
+            printf("Archive segment %u opened, %lu rescues were not archived\n", index,
+                   (unsigned long)__atomic_load_n(&skipped_records, __ATOMIC_RELAXED));
+        }
+        retry_backoff = 0;
+        return 0;
+    }
+    if (!retry_backoff) {
+        fprintf(stderr, "archive: cannot open segment %u, rescues are not archived until it opens\n", index);
+    }
+    retry_index = index;
+    retry_backoff = retry_backoff ? retry_backoff * 2 : ARCHIVE_RETRY_MIN_S;
+    if (retry_backoff > ARCHIVE_RETRY_MAX_S) retry_backoff = ARCHIVE_RETRY_MAX_S;
+    retry_at = now + retry_backoff;
+    return -1;
+}
+
+// Highest existing segment index in dir, or -1 if there is none.
+static long last_segment_index(const char *dir) {
+    DIR *d = opendir(dir);
+    if (!d) return -1;
+    long last = -1;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        unsigned index;
+        if (sscanf(ent->d_name, "helped-%6u.seg", &index) == 1 && (long)index > last) {
+            last = index;
+        }
+    }
+    closedir(d);
+    return last;
+}
+
+int archive_open(const char *dir) {
+    pthread_mutex_lock(&archive_lock);
+    strncpy(archive_dir, dir, sizeof(archive_dir) - 1);
+    archive_dir[sizeof(archive_dir) - 1] = '\0';
+    if (mkdir(archive_dir, 0755) < 0 && errno != EEXIST) {
+        perror("archive: mkdir");
+        pthread_mutex_unlock(&archive_lock);
+        return -1;
+    }
+
+    long last = last_segment_index(archive_dir);
+    int rc = reopen_segment(last < 0 ? 0 : (unsigned)last, time(NULL));
+    if (rc == 0) {
+        printf("Archive opened: %s, segment %u holds %lu records\n", archive_dir, active.index,
+               (unsigned long)__atomic_load_n(&active.header->count, __ATOMIC_ACQUIRE));
+    }
+    pthread_mutex_unlock(&archive_lock);
+    return rc;
+}
+
+void archive_close() {
+    pthread_mutex_lock(&archive_lock);
+    close_segment(&active);
+    retry_backoff = 0;
+    archive_dir[0] = '\0';
+    pthread_mutex_unlock(&archive_lock);
+}
+
+uint64_t archive_skipped() {
+    return __atomic_load_n(&skipped_records, __ATOMIC_RELAXED);
+}
+
+// Appends the rescue to the active segment and pushes it into the recent
+// window, evicting the oldest entry once HELPED_WINDOW is reached.
+int archive_helped_survivor(const Survivor *s, int drone_id) {
+    Survivor helped = *s;
+    time_t now = time(NULL);
+    helped.state = SURVIVOR_WORD(SURVIVOR_RESCUED, drone_id);
+    localtime_r(&now, &helped.helped_time);
+
+    pthread_mutex_lock(&archive_lock);
+    int rc = -1;
+    if (!active.base && retry_backoff && archive_dir[0] && now >= retry_at) {
+        reopen_segment(retry_index, now);
+    }
+    if (active.base) {
+        uint64_t n = __atomic_load_n(&active.header->count, __ATOMIC_RELAXED);
+        if (n >= ARCHIVE_SEGMENT_RECORDS) {
+            unsigned next = active.index + 1;
+            close_segment(&active);
+            if (reopen_segment(next, now) == 0) {
+                printf("Archive rotated to segment %u\n", next);
+            }
+            n = 0;
+        }
+        if (active.base) {
+            struct tm discovered = helped.discovery_time;
+            active.x[n] = helped.coord.x;
+            active.y[n] = helped.coord.y;
+            active.discovered[n] = (int64_t)mktime(&discovered);
+            active.helped[n] = (int64_t)now;
+            active.drone_id[n] = drone_id;
+            __atomic_store_n(&active.header->count, n + 1, __ATOMIC_RELEASE);
+            rc = 0;
+        }
+    }
+    if (rc != 0) __atomic_add_fetch(&skipped_records, 1, __ATOMIC_RELAXED);
+
+    if (helpedsurvivors->number_of_elements >= helpedsurvivors->capacity) {
+        helpedsurvivors->removenode(helpedsurvivors, helpedsurvivors->tail);
+    }
+    helpedsurvivors->add(helpedsurvivors, &helped);
+    pthread_mutex_unlock(&archive_lock);
+    return rc;
+}
+
+// Walks every segment in dir in order, handing each one's columns to fn.
+// Returns the number of records visited or -1 if dir cannot be read.
+long archive_scan(const char *dir, archive_scan_fn fn, void *ctx) {
+    struct stat dst;
+    if (stat(dir, &dst) < 0 || !S_ISDIR(dst.st_mode)) return -1;
+    long last = last_segment_index(dir);
+
+    long total = 0;
+    for (long index = 0; index <= last; index++) {
+        char path[300];
+        segment_path(dir, (unsigned)index, path, sizeof(path));
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) continue;  // a missing segment is a hole, not an error
+
+        struct stat st;
+        if (fstat(fd, &st) < 0 || (size_t)st.st_size < ARCHIVE_HEADER_SIZE) {
+            close(fd);
+            continue;
+        }
+        char *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) continue;
+
+        ArchiveSegment seg = {.index = (unsigned)index, .fd = -1, .size = st.st_size, .base = base};
+        ArchiveHeader *hdr = (ArchiveHeader *)base;
+        if (memcmp(hdr->magic, ARCHIVE_MAGIC, 8) != 0 ||
+            (size_t)st.st_size < segment_size(hdr->capacity)) {
+            fprintf(stderr, "archive: skipping malformed segment %s\n", path);
+            munmap(base, st.st_size);
+            continue;
+        }
+        map_columns(&seg, hdr->capacity);
+
+        ArchiveBatch batch = {
+            .segment = (unsigned)index,
+            .count = __atomic_load_n(&hdr->count, __ATOMIC_ACQUIRE),
+            .x = seg.x,
+            .y = seg.y,
+            .discovered = seg.discovered,
+            .helped = seg.helped,
+            .drone_id = seg.drone_id
+        };
+        if (batch.count > hdr->capacity) batch.count = hdr->capacity;
+        total += batch.count;
+        int stop = fn(&batch, ctx);
+        munmap(base, st.st_size);
+        if (stop) break;
+    }
+    return total;
+}
@@ -0,0 +1,729 @@
+/**
+ * @file bench.c
+ * @brief Microbenchmarks for the core data structures and protocol kernels.
+ *
+ * Each case is warmed up, calibrated to run for at least BENCH_MIN_NS, then
+ * measured over several runs on a pinned CPU. Results (median and best
+ * ns/op, heap allocations/op) go to stderr and, one JSON object per line,
+ * to the output file so runs from different commits can be diffed.
+ *
+ * Usage: edcs_bench [--filter substr] [--out file] [--cpu n] [--runs n]
+ */
+#define _GNU_SOURCE
+#include "headers/globals.h"
+#include "headers/ai.h"
+#include "headers/deadreckon.h"
+#include "headers/metrics.h"
+#include "headers/scenario.h"
+#include "headers/span.h"
+#include "headers/query.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sched.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <json-c/json.h>
+
+#ifndef BENCH_COMMIT
+#define BENCH_COMMIT "unknown"
+#endif
+
+#define BENCH_MIN_NS 200000000ULL  // each measured run lasts at least 200ms
+#define BENCH_WARMUP_NS 50000000ULL
+#define BENCH_MAX_TARGETS 4096
+
+volatile sig_atomic_t global_shutdown_flag = 0;
+struct json_object *receive_json(int sock);  // server.c
+
+/* ---- allocation counting (glibc interposition) ---- */
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t nmemb, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static unsigned long long alloc_count = 0;
+
+void *malloc(size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t nmemb, size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_calloc(nmemb, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+    __atomic_add_fetch(&alloc_count, 1, __ATOMIC_RELAXED);
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) {
+    __libc_free(ptr);
+}
+
+/* ---- cases ---- */
+
+typedef struct bench_case {
+    const char *name;
+    int size;
+    void (*setup)(int size);
+    void (*run)(int size, long iters);
+    void (*teardown)(int size);
+} BenchCase;
+
+static List *bench_list = NULL;
+static Coord targets[BENCH_MAX_TARGETS];
+static unsigned rng_state = 12345;
+static volatile long sink = 0;  // keeps results observable to the compiler
+
+static unsigned next_rand() {
+    rng_state = rng_state * 1103515245u + 12345u;
+    return rng_state >> 8;
+}
+
+static void list_setup(int size) {
+    bench_list = create_list(sizeof(Survivor), size + 1);
+    Survivor s;
+    memset(&s, 0, sizeof(s));
+    for (int i = 0; i < size; i++) {
+        s.coord.x = i;
+        bench_list->add(bench_list, &s);
+    }
+}
+
+static void list_teardown(int size) {
+    (void)size;
+    bench_list->destroy(bench_list);
+    bench_list = NULL;
+}
+
+static void run_list_add_pop(int size, long iters) {
+    Survivor s, out;
+    memset(&s, 0, sizeof(s));
+    for (long i = 0; i < iters; i++) {
+        s.coord.x = (int)i;
+        bench_list->add(bench_list, &s);
+        bench_list->pop(bench_list, &out);
+    }
+    sink += out.coord.x;
+}
+
+// Removes the tail by value (a full scan from head), then re-adds it at head.
+static void run_list_removedata(int size, long iters) {
+    Survivor s;
+    for (long i = 0; i < iters; i++) {
+        memcpy(&s, bench_list->tail->data, sizeof(s));
+        bench_list->removedata(bench_list, &s);
+        bench_list->add(bench_list, &s);
+    }
+}
+
+static void run_list_removenode(int size, long iters) {
+    Survivor s;
+    for (long i = 0; i < iters; i++) {
+        memcpy(&s, bench_list->tail->data, sizeof(s));
+        bench_list->removenode(bench_list, bench_list->tail);
+        bench_list->add(bench_list, &s);
+    }
+}
+
+static Survivor bench_survivors[BENCH_MAX_TARGETS];
+
+// A quarter of the drones idle. A mixed fleet varies speed, payload and
+// range the way the loadtest's --mixed-fleet does; otherwise every drone is
+// the same general-purpose one.
+static void fleet_setup(int size, int mixed) {
+    static const double speeds[] = {1.0, 2.0, 4.0};
+    static const int capacities[] = {60, 100, 200};
+    init_map(30, 40);
+    drones = create_list(sizeof(Drone), size);
+    for (int i = 0; i < size; i++) {
+        Drone d;
+        memset(&d, 0, sizeof(d));
+        d.id = i;
+        d.status = (i % 4 == 0) ? IDLE : ON_MISSION;
+        d.coord.x = next_rand() % map.width;
+        d.coord.y = next_rand() % map.height;
+        d.home = d.coord;
+        d.has_home = 1;
+        d.speed = mixed ? speeds[next_rand() % 3] : DEADRECKON_DEFAULT_SPEED;
+        d.battery_capacity = mixed ? capacities[next_rand() % 3] : 0;
+        d.battery = mixed ? 30 + next_rand() % 71 : 100;
+        d.payload = mixed ? (Payload)(1 + next_rand() % (PAYLOAD_COUNT - 1)) : PAYLOAD_ANY;
+        pthread_mutex_init(&d.lock, NULL);
+        drones->add(drones, &d);
+    }
+    for (int i = 0; i < BENCH_MAX_TARGETS; i++) {
+        targets[i].x = next_rand() % map.width;
+        targets[i].y = next_rand() % map.height;
+        memset(&bench_survivors[i], 0, sizeof(Survivor));
+        bench_survivors[i].coord = targets[i];
+        bench_survivors[i].need = (Payload)(1 + next_rand() % (PAYLOAD_COUNT - 1));
+    }
+}
+
+static void drones_setup(int size) {
+    fleet_setup(size, 0);
+}
+
+static void mixed_fleet_setup(int size) {
+    fleet_setup(size, 1);
+}
+
+// Random no-fly blocks of up to 8x8 cells over about a tenth of the map.
+static void scatter_obstacles() {
+    int count = map.width * map.height / 200 + 1;
+    Rect *areas = malloc(sizeof(Rect) * count);
+    for (int i = 0; i < count; i++) {
+        areas[i].from.x = next_rand() % map.width;
+        areas[i].from.y = next_rand() % map.height;
+        areas[i].to.x = areas[i].from.x + next_rand() % 8;
+        areas[i].to.y = areas[i].from.y + next_rand() % 8;
+    }
+    obstacles_set(&map.obstacles, areas, count);
+    free(areas);
+}
+
+static void obstacle_fleet_setup(int size) {
+    fleet_setup(size, 0);
+    scatter_obstacles();
+}
+
+static void drones_teardown(int size) {
+    (void)size;
+    drones->destroy(drones);
+    drones = NULL;
+    freemap();
+}
+
+static void run_find_best_idle_drone(int size, long iters) {
+    for (long i = 0; i < iters; i++) {
+        Drone *d = find_best_idle_drone(&bench_survivors[i & (BENCH_MAX_TARGETS - 1)]);
+        sink += d ? d->id : 0;
+    }
+}
+
+static void map_setup(int size) {
+    init_map(size, size);
+    for (int i = 0; i < BENCH_MAX_TARGETS; i++) {
+        targets[i].x = next_rand() % map.width;
+        targets[i].y = next_rand() % map.height;
+    }
+}
+
+static void map_teardown(int size) {
+    (void)size;
+    freemap();
+}
+
+static void run_map_insert(int size, long iters) {
+    Survivor s;
+    memset(&s, 0, sizeof(s));
+    for (long i = 0; i < iters; i++) {
+        s.coord = targets[i & (BENCH_MAX_TARGETS - 1)];
+        map_add_survivor(&s);
+        map_remove_survivor(&s);
+    }
+}
+
+// A survivor placed on the map and claimed back off it, as a rescue does.
+static void run_map_claim(int size, long iters) {
+    Survivor s;
+    memset(&s, 0, sizeof(s));
+    for (long i = 0; i < iters; i++) {
+        s.coord = targets[i & (BENCH_MAX_TARGETS - 1)];
+        s.state = SURVIVOR_WORD(SURVIVOR_OPEN, -1);
+        map_add_survivor(&s);
+        sink += map_claim_survivor(s.coord.x, s.coord.y, 1, PAYLOAD_ANY) != NULL;
+    }
+}
+
+static void run_map_lookup(int size, long iters) {
+    for (long i = 0; i < iters; i++) {
+        Coord c = targets[i & (BENCH_MAX_TARGETS - 1)];
+        map_lock_cell(c.x, c.y);
+        sink += map_cell_survivors(c.x, c.y, 0) != NULL;
+        map_unlock_cell(c.x, c.y);
+    }
+}
+
+static uint16_t *bench_field = NULL;
+
+// A size x size map with obstacles; targets are open cells.
+static void path_setup(int size) {
+    init_map(size, size);
+    scatter_obstacles();
+    bench_field = malloc(sizeof(uint16_t) * PATH_CELLS(size, size));
+    for (int i = 0; i < BENCH_MAX_TARGETS; i++) {
+        do {
+            targets[i].x = next_rand() % size;
+            targets[i].y = next_rand() % size;
+        } while (obstacles_blocked(&map.obstacles, targets[i].x, targets[i].y));
+    }
+}
+
+static void path_teardown(int size) {
+    (void)size;
+    free(bench_field);
+    bench_field = NULL;
+    freemap();
+}
+
+// One BFS distance field, as a dispatch to a new survivor costs.
+static void run_path_field_fill(int size, long iters) {
+    for (long i = 0; i < iters; i++) {
+        sink += path_field_fill(&map.obstacles, targets[i & (BENCH_MAX_TARGETS - 1)], bench_field);
+    }
+}
+
+// A whole route to one of a few cached targets, stepped cell by cell.
+static void run_path_route(int size, long iters) {
+    for (long i = 0; i < iters; i++) {
+        Coord to = targets[i & 7];
+        Coord at = targets[8 + (i & (BENCH_MAX_TARGETS - 9))];
+        const PathField *f = path_field_acquire(&map_paths, to);
+        for (Coord next = path_step(f, at); next.x != at.x || next.y != at.y; next = path_step(f, at)) at = next;
+        path_field_release(&map_paths, f);
+        sink += at.x;
+    }
+}
+
+// Tours of size stops drawn from a cluster the size of TOUR_RADIUS_CELLS.
+static void tour_setup(int size) {
+    (void)size;
+    for (int i = 0; i < BENCH_MAX_TARGETS; i++) {
+        targets[i].x = next_rand() % (2 * TOUR_RADIUS_CELLS);
+        targets[i].y = next_rand() % (2 * TOUR_RADIUS_CELLS);
+    }
+}
+
+static void run_plan_tour(int size, long iters) {
+    int order[DRONE_TOUR_MAX];
+    Coord start = {0, 0};
+    for (long i = 0; i < iters; i++) {
+        const Coord *stops = &targets[(i * size) & (BENCH_MAX_TARGETS - 1) & ~(DRONE_TOUR_MAX - 1)];
+        sink += plan_tour(start, stops, size, order);
+    }
+}
+
+/* ---- workload generation ---- */
+
+static Scenario bench_scenario;
+
+// size selects the placement: 0 uniform, 1 gaussian clusters, 2 sweeping front
+static void scenario_setup(int size) {
+    scenario_default(&bench_scenario, 20000, size == 1 ? 8 : 0);
+    if (size == 2) bench_scenario.phases[0].placement = PLACE_FRONT;
+    scenario_start(&bench_scenario, 2000, 2000, 1);
+}
+
+static void run_scenario_place(int size, long iters) {
+    (void)size;
+    ScenarioArrival a;
+    for (long i = 0; i < iters; i++) {
+        if ((i & 1023) == 0) scenario_tick(&bench_scenario);
+        scenario_place(&bench_scenario, NULL, &a);
+        sink += a.coord.x;
+    }
+}
+
+/* ---- latency spans ---- */
+
+#define BENCH_SPAN_FILE "/tmp/edcs_bench_spans.json"
+
+// size is --span-sample; 0 leaves spans disabled
+static void span_setup(int size) {
+    if (size > 0) span_open(BENCH_SPAN_FILE, size);
+}
+
+static void span_teardown(int size) {
+    if (size == 0) return;
+    span_close();
+    unlink(BENCH_SPAN_FILE);
+}
+
+// A root span with one nested span, as a connection task and its handler
+static void run_span(int size, long iters) {
+    (void)size;
+    for (long i = 0; i < iters; i++) {
+        Span outer, inner;
+        span_begin(&outer, "bench outer");
+        span_begin(&inner, "bench inner");
+        sink += inner.start_ns;
+        span_end(&inner);
+        span_end(&outer);
+    }
+}
+
+/* ---- spatial queries ---- */
+
+#define BENCH_QUERY_MAP 2000
+#define BENCH_QUERY_DRONES 10000
+
+static QuerySnapshot *bench_snapshot = NULL;
+static QueryHit bench_hits[QUERY_MAX_LIMIT];
+
+// size survivors, a quarter of them assigned, and BENCH_QUERY_DRONES drones
+// spread over a 2000x2000 map
+static void query_setup(int size) {
+    QueryDrone *ds = calloc(BENCH_QUERY_DRONES, sizeof(QueryDrone));
+    QuerySurvivor *ss = calloc(size, sizeof(QuerySurvivor));
+    for (int i = 0; i < BENCH_QUERY_DRONES; i++) {
+        ds[i] = (QueryDrone){.id = i, .coord = {next_rand() % BENCH_QUERY_MAP, next_rand() % BENCH_QUERY_MAP},
+                             .status = i % 3 == 0 ? ON_MISSION : IDLE};
+    }
+    for (int i = 0; i < size; i++) {
+        ss[i] = (QuerySurvivor){.id = i + 1, .coord = {next_rand() % BENCH_QUERY_MAP, next_rand() % BENCH_QUERY_MAP},
+                                .state = i % 4 == 0 ? SURVIVOR_ASSIGNED : SURVIVOR_OPEN, .drone = -1};
+    }
+    bench_snapshot = query_snapshot_new(BENCH_QUERY_MAP, BENCH_QUERY_MAP, ds, BENCH_QUERY_DRONES, ss, size);
+    for (int i = 0; i < BENCH_MAX_TARGETS; i++) {
+        targets[i].x = next_rand() % BENCH_QUERY_MAP;
+        targets[i].y = next_rand() % BENCH_QUERY_MAP;
+    }
+}
+
+static void query_teardown(int size) {
+    (void)size;
+    query_snapshot_free(bench_snapshot);
+    bench_snapshot = NULL;
+}
+
+// Open survivors within 10 cells
+static void run_query_radius(int size, long iters) {
+    (void)size;
+    QueryRequest req = {.target = QUERY_SURVIVORS, .shape = QUERY_RADIUS, .r = 10,
+                        .status_mask = 1u << SURVIVOR_OPEN, .limit = QUERY_DEFAULT_LIMIT};
+    for (long i = 0; i < iters; i++) {
+        req.x = targets[i & (BENCH_MAX_TARGETS - 1)].x;
+        req.y = targets[i & (BENCH_MAX_TARGETS - 1)].y;
+        sink += query_run(bench_snapshot, &req, bench_hits);
+    }
+}
+
+// Survivors in a 50x50 box
+static void run_query_bbox(int size, long iters) {
+    (void)size;
+    QueryRequest req = {.target = QUERY_SURVIVORS, .shape = QUERY_BBOX, .limit = QUERY_DEFAULT_LIMIT};
+    for (long i = 0; i < iters; i++) {
+        req.x0 = targets[i & (BENCH_MAX_TARGETS - 1)].x;
+        req.y0 = targets[i & (BENCH_MAX_TARGETS - 1)].y;
+        req.x1 = req.x0 + 50;
+        req.y1 = req.y0 + 50;
+        sink += query_run(bench_snapshot, &req, bench_hits);
+    }
+}
+
+// The 10 nearest open survivors
+static void run_query_nearest(int size, long iters) {
+    (void)size;
+    QueryRequest req = {.target = QUERY_SURVIVORS, .shape = QUERY_NEAREST,
+                        .status_mask = 1u << SURVIVOR_OPEN, .limit = 10};
+    for (long i = 0; i < iters; i++) {
+        req.x = targets[i & (BENCH_MAX_TARGETS - 1)].x;
+        req.y = targets[i & (BENCH_MAX_TARGETS - 1)].y;
+        sink += query_run(bench_snapshot, &req, bench_hits);
+    }
+}
+
+// The nearest idle drone, among far fewer entities than survivors
+static void run_query_nearest_drone(int size, long iters) {
+    (void)size;
+    QueryRequest req = {.target = QUERY_DRONES, .shape = QUERY_NEAREST, .status_mask = 1u << IDLE, .limit = 1};
+    for (long i = 0; i < iters; i++) {
+        req.x = targets[i & (BENCH_MAX_TARGETS - 1)].x;
+        req.y = targets[i & (BENCH_MAX_TARGETS - 1)].y;
+        sink += query_run(bench_snapshot, &req, bench_hits);
+    }
+}
+
+/* ---- protocol messages ---- */
+
+static struct json_object *make_message(int kind) {
+    struct json_object *msg = json_object_new_object();
+    struct json_object *obj;
+    switch (kind) {
+    case 0:
+        json_object_object_add(msg, "type", json_object_new_string("HANDSHAKE"));
+        json_object_object_add(msg, "drone_id", json_object_new_string("D17"));
+        obj = json_object_new_object();
+        json_object_object_add(obj, "max_speed", json_object_new_int(30));
+        json_object_object_add(obj, "battery_capacity", json_object_new_int(100));
+        json_object_object_add(obj, "payload", json_object_new_string("medical"));
+        json_object_object_add(msg, "capabilities", obj);
+        break;
+    case 1:
+        json_object_object_add(msg, "type", json_object_new_string("HANDSHAKE_ACK"));
+        json_object_object_add(msg, "session_id", json_object_new_string("S123"));
+        obj = json_object_new_object();
+        json_object_object_add(obj, "status_update_interval", json_object_new_int(5));
+        json_object_object_add(obj, "heartbeat_interval", json_object_new_int(10));
+        json_object_object_add(msg, "config", obj);
+        break;
+    case 2:
+        json_object_object_add(msg, "type", json_object_new_string("STATUS_UPDATE"));
+        json_object_object_add(msg, "drone_id", json_object_new_string("D17"));
+        json_object_object_add(msg, "timestamp", json_object_new_int64(1620000000));
+        obj = json_object_new_object();
+        json_object_object_add(obj, "x", json_object_new_int(10));
+        json_object_object_add(obj, "y", json_object_new_int(20));
+        json_object_object_add(msg, "location", obj);
+        json_object_object_add(msg, "status", json_object_new_string("busy"));
+        json_object_object_add(msg, "battery", json_object_new_int(85));
+        json_object_object_add(msg, "speed", json_object_new_int(5));
+        break;
+    case 3:
+        json_object_object_add(msg, "type", json_object_new_string("ASSIGN_MISSION"));
+        json_object_object_add(msg, "mission_id", json_object_new_string("SURV-0042"));
+        json_object_object_add(msg, "priority", json_object_new_string("high"));
+        obj = json_object_new_object();
+        json_object_object_add(obj, "x", json_object_new_int(45));
+        json_object_object_add(obj, "y", json_object_new_int(12));
+        json_object_object_add(msg, "target", obj);
+        json_object_object_add(msg, "expiry", json_object_new_int64(1620003600));
+        json_object_object_add(msg, "checksum", json_object_new_string("a1b2c3"));
+        break;
+    case 4:
+        json_object_object_add(msg, "type", json_object_new_string("MISSION_COMPLETE"));
+        json_object_object_add(msg, "drone_id", json_object_new_string("D17"));
+        json_object_object_add(msg, "mission_id", json_object_new_string("SURV-0042"));
+        json_object_object_add(msg, "timestamp", json_object_new_int64(1620000000));
+        json_object_object_add(msg, "success", json_object_new_boolean(1));
+        json_object_object_add(msg, "details", json_object_new_string("Reached survivor location"));
+        break;
+    case 5:
+        json_object_object_add(msg, "type", json_object_new_string("HEARTBEAT"));
+        json_object_object_add(msg, "timestamp", json_object_new_int64(1620000000));
+        break;
+    case 6:
+        json_object_object_add(msg, "type", json_object_new_string("HEARTBEAT_RESPONSE"));
+        json_object_object_add(msg, "drone_id", json_object_new_string("D17"));
+        json_object_object_add(msg, "timestamp", json_object_new_int64(1620000000));
+        break;
+    default:
+        json_object_object_add(msg, "type", json_object_new_string("ERROR"));
+        json_object_object_add(msg, "code", json_object_new_int(400));
+        json_object_object_add(msg, "message", json_object_new_string("Invalid message type"));
+        json_object_object_add(msg, "timestamp", json_object_new_int64(1620000000));
+        break;
+    }
+    return msg;
+}
+
+#define NUM_MESSAGES 8
+static const char *message_names[NUM_MESSAGES] = {
+    "HANDSHAKE", "HANDSHAKE_ACK", "STATUS_UPDATE", "ASSIGN_MISSION",
+    "MISSION_COMPLETE", "HEARTBEAT", "HEARTBEAT_RESPONSE", "ERROR"
+};
+static char encoded[NUM_MESSAGES][512];
+static int socks[2] = {-1, -1};
+
+static void messages_setup(int size) {
+    (void)size;
+    for (int kind = 0; kind < NUM_MESSAGES; kind++) {
+        struct json_object *msg = make_message(kind);
+        snprintf(encoded[kind], sizeof(encoded[kind]), "%s",
+                 json_object_to_json_string_ext(msg, JSON_C_TO_STRING_PLAIN));
+        json_object_put(msg);
+    }
+}
+
+static void run_json_encode(int kind, long iters) {
+    for (long i = 0; i < iters; i++) {
+        struct json_object *msg = make_message(kind);
+        const char *str = json_object_to_json_string_ext(msg, JSON_C_TO_STRING_PLAIN);
+        sink += str[0];
+        json_object_put(msg);
+    }
+}
+
+// Parses the message and reads the fields the server handlers read.
+static void run_json_decode(int kind, long iters) {
+    for (long i = 0; i < iters; i++) {
+        struct json_object *msg = json_tokener_parse(encoded[kind]);
+        const char *type = json_object_get_string(json_object_object_get(msg, "type"));
+        struct json_object *loc = json_object_object_get(msg, "location");
+        sink += type[0] + json_object_get_int(json_object_object_get(loc, "x"));
+        json_object_put(msg);
+    }
+}
+
+static void socket_setup(int size) {
+    messages_setup(size);
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, socks) < 0) {
+        perror("socketpair");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static void socket_teardown(int size) {
+    (void)size;
+    close(socks[0]);
+    close(socks[1]);
+}
+
+// One STATUS_UPDATE line through a socket and the server's framing + parse.
+static void run_receive_json(int size, long iters) {
+    char line[520];
+    int len = snprintf(line, sizeof(line), "%s\n", encoded[2]);
+    for (long i = 0; i < iters; i++) {
+        if (send(socks[0], line, len, 0) != len) break;
+        struct json_object *msg = receive_json(socks[1]);
+        sink += msg != NULL;
+        json_object_put(msg);
+    }
+}
+
+/* ---- harness ---- */
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static long calibrate(BenchCase *c) {
+    long iters = 1;
+    for (;;) {
+        uint64_t start = metrics_now_ns();
+        c->run(c->size, iters);
+        uint64_t elapsed = metrics_now_ns() - start;
+        if (elapsed >= BENCH_MIN_NS / 4) {
+            return (long)(iters * (double)BENCH_MIN_NS / elapsed) + 1;
+        }
+        iters *= elapsed < 1000000 ? 10 : 2;
+    }
+}
+
+static void run_case(BenchCase *c, const char *label, int runs, FILE *out) {
+    if (c->setup) c->setup(c->size);
+
+    uint64_t warm_start = metrics_now_ns();
+    while (metrics_now_ns() - warm_start < BENCH_WARMUP_NS) {
+        c->run(c->size, 64);
+    }
+    long iters = calibrate(c);
+
+    double ns_per_op[16];
+    double allocs_per_op = 0;
+    for (int r = 0; r < runs; r++) {
+        unsigned long long allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED);
+        uint64_t start = metrics_now_ns();
+        c->run(c->size, iters);
+        uint64_t elapsed = metrics_now_ns() - start;
+        allocs = __atomic_load_n(&alloc_count, __ATOMIC_RELAXED) - allocs;
+        ns_per_op[r] = (double)elapsed / iters;
+        allocs_per_op = (double)allocs / iters;
+    }
+    qsort(ns_per_op, runs, sizeof(double), compare_double);
+
+    fprintf(stderr, "%-32s %8d %12.1f ns/op %12.1f best %8.2f allocs/op\n",
+            label, c->size, ns_per_op[runs / 2], ns_per_op[0], allocs_per_op);
+    if (out) {
+        fprintf(out, "{\"commit\":\"%s\",\"bench\":\"%s\",\"size\":%d,\"iterations\":%ld,"
+                     "\"runs\":%d,\"ns_per_op\":%.2f,\"best_ns_per_op\":%.2f,\"allocs_per_op\":%.3f}\n",
+                BENCH_COMMIT, label, c->size, iters, runs, ns_per_op[runs / 2], ns_per_op[0], allocs_per_op);
+        fflush(out);
+    }
+
+    if (c->teardown) c->teardown(c->size);
+}
+
+static void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        fprintf(stderr, "warning: could not pin to CPU %d\n", cpu);
+    }
+}
+
+int main(int argc, char **argv) {
+    const char *filter = NULL;
+    const char *out_path = "bench_results.jsonl";
+    int cpu = 0;
+    int runs = 5;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) filter = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (strcmp(argv[i], "--cpu") == 0 && i + 1 < argc) cpu = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) runs = atoi(argv[++i]);
+        else {
+            fprintf(stderr, "Usage: %s [--filter substr] [--out file] [--cpu n] [--runs n]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (runs < 1) runs = 1;
+    if (runs > 16) runs = 16;
+
+    FILE *out = fopen(out_path, "a");
+    if (!out) perror("bench output");
+    pin_to_cpu(cpu);
+    // The code under test logs with printf; keep that off the terminal and out of the timings' variance
+    if (!freopen("/dev/null", "w", stdout)) perror("freopen");
+
+    BenchCase cases[] = {
+        {"list_add_pop", 16, list_setup, run_list_add_pop, list_teardown},
+        {"list_add_pop", 1024, list_setup, run_list_add_pop, list_teardown},
+        {"list_add_pop", 65536, list_setup, run_list_add_pop, list_teardown},
+        {"list_removedata", 16, list_setup, run_list_removedata, list_teardown},
+        {"list_removedata", 1024, list_setup, run_list_removedata, list_teardown},
+        {"list_removedata", 65536, list_setup, run_list_removedata, list_teardown},
+        {"list_removenode", 16, list_setup, run_list_removenode, list_teardown},
+        {"list_removenode", 1024, list_setup, run_list_removenode, list_teardown},
+        {"list_removenode", 65536, list_setup, run_list_removenode, list_teardown},
+        {"find_best_idle_drone", 10, drones_setup, run_find_best_idle_drone, drones_teardown},
+        {"find_best_idle_drone", 100, drones_setup, run_find_best_idle_drone, drones_teardown},
+        {"find_best_idle_drone", 1000, drones_setup, run_find_best_idle_drone, drones_teardown},
+        {"find_best_idle_drone_mixed", 1000, mixed_fleet_setup, run_find_best_idle_drone, drones_teardown},
+        {"find_best_idle_drone_obstacles", 1000, obstacle_fleet_setup, run_find_best_idle_drone, drones_teardown},
+        {"path_field_fill", 40, path_setup, run_path_field_fill, path_teardown},
+        {"path_field_fill", 2000, path_setup, run_path_field_fill, path_teardown},
+        {"path_route", 2000, path_setup, run_path_route, path_teardown},
+        {"plan_tour", 4, tour_setup, run_plan_tour, NULL},
+        {"plan_tour", 8, tour_setup, run_plan_tour, NULL},
+        {"scenario_place", 0, scenario_setup, run_scenario_place, NULL},
+        {"scenario_place", 1, scenario_setup, run_scenario_place, NULL},
+        {"scenario_place", 2, scenario_setup, run_scenario_place, NULL},
+        {"span", 0, span_setup, run_span, span_teardown},
+        {"span", 100, span_setup, run_span, span_teardown},
+        {"span", 1, span_setup, run_span, span_teardown},
+        {"map_insert", 40, map_setup, run_map_insert, map_teardown},
+        {"map_insert", 400, map_setup, run_map_insert, map_teardown},
+        {"map_insert", 10000, map_setup, run_map_insert, map_teardown},
+        {"map_claim", 400, map_setup, run_map_claim, map_teardown},
+        {"map_claim", 10000, map_setup, run_map_claim, map_teardown},
+        {"map_lookup", 40, map_setup, run_map_lookup, map_teardown},
+        {"map_lookup", 400, map_setup, run_map_lookup, map_teardown},
+        {"map_lookup", 10000, map_setup, run_map_lookup, map_teardown},
+        {"query_radius", 10000, query_setup, run_query_radius, query_teardown},
+        {"query_radius", 1000000, query_setup, run_query_radius, query_teardown},
+        {"query_bbox", 1000000, query_setup, run_query_bbox, query_teardown},
+        {"query_nearest", 10000, query_setup, run_query_nearest, query_teardown},
+        {"query_nearest", 1000000, query_setup, run_query_nearest, query_teardown},
+        {"query_nearest_drone", 1000000, query_setup, run_query_nearest_drone, query_teardown},
+        {"receive_json", 1, socket_setup, run_receive_json, socket_teardown},
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        if (filter && !strstr(cases[i].name, filter)) continue;
+        run_case(&cases[i], cases[i].name, runs, out);
+    }
+
+    // JSON cases take the message kind as their "size"
+    for (int kind = 0; kind < NUM_MESSAGES; kind++) {
+        char label[64];
+        BenchCase encode = {"json_encode", kind, messages_setup, run_json_encode, NULL};
+        BenchCase decode = {"json_decode", kind, messages_setup, run_json_decode, NULL};
+        snprintf(label, sizeof(label), "json_encode/%s", message_names[kind]);
+        if (!filter || strstr(label, filter)) run_case(&encode, label, runs, out);
+        snprintf(label, sizeof(label), "json_decode/%s", message_names[kind]);
+        if (!filter || strstr(label, filter)) run_case(&decode, label, runs, out);
+    }
+
+    if (out) fclose(out);
+    return 0;
+}
@@ -5,9 +5,21 @@
 #include "headers/ai.h"
 #include "headers/view.h"
 #include "headers/server.h"
+#include "headers/archive.h"
+#include "headers/metrics.h"
+#include "headers/region.h"
+#include "headers/workpool.h"
+#include "headers/heatmap.h"
+#include "headers/trace.h"
+#include "headers/span.h"
+#include "headers/lockprof.h"
+#include "headers/federation.h"
+#include "headers/replication.h"
+#include "headers/query.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <pthread.h>
 #include <time.h>
 #include <signal.h>
@@ -17,18 +29,58 @@
 volatile sig_atomic_t global_shutdown_flag = 0;
 
 // Thread IDs for cleanup
-static pthread_t survivor_thread_id;
-static pthread_t ai_thread_id;
 static pthread_t server_thread_id;
+static pthread_t metrics_thread_id;
+
+static volatile sig_atomic_t reload_obstacles_flag = 0;
+static volatile sig_atomic_t dump_spans_flag = 0;
 
 // Signal handler
 void handle_signal(int signum) {
     if (signum == SIGINT || signum == SIGTERM) {
         printf("\nReceived shutdown signal. Initiating graceful shutdown...\n");
         global_shutdown_flag = 1;
+    } else if (signum == SIGHUP) {
+        reload_obstacles_flag = 1;
+    } else if (signum == SIGUSR1) {
+        dump_spans_flag = 1;
+    }
+}
+
+// Re-reads --obstacles after a SIGHUP and tells the drones. Distance fields
+// built from the old obstacles are rebuilt as they are next asked for.
+static void poll_obstacle_reload() {
+    if (!reload_obstacles_flag) return;
+    reload_obstacles_flag = 0;
+    if (!config.obstacles) return;
+    if (obstacles_load(&map.obstacles, config.obstacles) == 0) {
+        broadcast_obstacles();
+    } else {
+        fprintf(stderr, "Keeping the previous obstacles\n");
     }
 }
 
+// Writes the spans recorded so far after a SIGUSR1.
+static void poll_span_dump() {
+    if (!dump_spans_flag) return;
+    dump_spans_flag = 0;
+    span_dump();
+}
+
+#ifdef LOCK_PROFILE
+// Ranks the mutexes taken through LOCK() by total wait.
+static void write_lock_profile() {
+    FILE *out = fopen(LOCKPROF_REPORT_FILE, "w");
+    if (!out) {
+        perror("Failed to write lock profile");
+        return;
+    }
+    lockprof_report(out);
+    fclose(out);
+    printf("Lock profile written to %s\n", LOCKPROF_REPORT_FILE);
+}
+#endif
+
 // Cleanup function
 void cleanup_resources() {
     printf("Cleaning up resources...\n");
@@ -36,97 +88,253 @@ void cleanup_resources() {
     
     // Wait for threads to finish
     if (server_thread_id) pthread_join(server_thread_id, NULL);
-    if (survivor_thread_id) pthread_join(survivor_thread_id, NULL);
-    if (ai_thread_id) pthread_join(ai_thread_id, NULL);
+    if (metrics_thread_id) pthread_join(metrics_thread_id, NULL);
+    federation_stop();
+    query_stop();
+    // The server has closed every connection; run what is still queued, then stop
+    workpool_stop();
+    replication_stop();
+    regions_stop();
+    trace_close();
+    span_close();
     
     // Cleanup SDL
     quit_all();
     
-    // Cleanup lists
-    if (survivors) {
-        pthread_mutex_lock(&survivors->lock);
-        Node *node = survivors->head;
-        while (node) {
-            free(node->data);
-            Node *next = node->next;
-            free(node);
-            node = next;
-        }
-        pthread_mutex_unlock(&survivors->lock);
-        pthread_mutex_destroy(&survivors->lock);
-        free(survivors);
+    // Cleanup lists (survivors and drones are stored by value in list storage)
+    if (map.tiles) {
+        freemap();
     }
+    heatmap_free();
     
+    // Helped survivors are stored by value in a small window; the archive holds the rest
+    archive_close();
     if (helpedsurvivors) {
-        pthread_mutex_lock(&helpedsurvivors->lock);
-        Node *node = helpedsurvivors->head;
-        while (node) {
-            free(node->data);
-            Node *next = node->next;
-            free(node);
-            node = next;
-        }
-        pthread_mutex_unlock(&helpedsurvivors->lock);
-        pthread_mutex_destroy(&helpedsurvivors->lock);
-        free(helpedsurvivors);
+        helpedsurvivors->destroy(helpedsurvivors);
+        helpedsurvivors = NULL;
     }
     
     if (drones) {
         pthread_mutex_lock(&drones->lock);
-        Node *node = drones->head;
-        while (node) {
-            Drone *d = (Drone *)node->data;
-            pthread_mutex_destroy(&d->lock);
-            free(d);
-            Node *next = node->next;
-            free(node);
-            node = next;
+        for (Node *node = drones->head; node != NULL; node = node->next) {
+            pthread_mutex_destroy(&((Drone *)node->data)->lock);
         }
         pthread_mutex_unlock(&drones->lock);
-        pthread_mutex_destroy(&drones->lock);
-        free(drones);
+        drones->destroy(drones);
+        drones = NULL;
     }
+#ifdef LOCK_PROFILE
+    write_lock_profile();
+#endif
 }
 
-int main() {
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--headless] [--port n] [--metrics-port n] [--max-drones n] [--survivor-rate r] [--map WxH]\n"
+            "          [--regions CxR] [--workers n] [--pin-workers] [--acceptors n] [--backlog n]\n"
+            "          [--update-budget r]\n"
+            "          [--dispatch eta|nearest] [--tour-stops n] [--rebalance-moves n] [--hotspots n] [--seed n]\n"
+            "          [--obstacles file] [--scenario file] [--trace file] [--spans file] [--span-sample n]\n"
+            "          [--federation file --node name] [--replicate port] [--query-socket path]\n"
+            "  --headless         run without the SDL window\n"
+            "  --port n           drone listener port (default %d)\n"
+            "  --metrics-port n   metrics endpoint port (default %d)\n"
+            "  --max-drones n     drone registry capacity (default %d)\n"
+            "  --survivor-rate r  survivors generated per second (default: one every 2-4s)\n"
+            "  --map WxH          map size in cells (default %dx%d)\n"
+            "  --regions CxR      split the map into CxR regions, each drained by one pool task at a time\n"
+            "                     (default %dx%d)\n"
+            "  --workers n        worker threads in the task pool (default: one per CPU)\n"
+            "  --pin-workers      pin each worker thread to its own CPU\n"
+            "  --acceptors n      accept drone connections on n threads, each with its own SO_REUSEPORT\n"
+            "                     listener (default: the reactor thread accepts)\n"
+            "  --backlog n        pending connections each listener queues (default %d)\n"
+            "  --update-budget r  status updates per second to size drone report intervals for,\n"
+            "                     0 for no limit (default %d)\n"
+            "  --dispatch mode    eta: fastest capable drone (default); nearest: closest capable drone\n"
+            "  --tour-stops n     most survivors batched into one mission, 1 to send one at a time\n"
+            "                     (default %d, max %d)\n"
+            "  --rebalance-moves n  idle drones moved towards busy areas per pass, 0 to disable (default %d)\n"
+            "  --hotspots n       cluster survivors around n hotspots that move over time (default: uniform)\n"
+            "  --seed n           seed for survivor arrivals and placement, to replay a run (default: clock)\n"
+            "  --scenario file    survivor workload phases (arrival process, rate, placement); replaces\n"
+            "                     --survivor-rate and --hotspots, see scenario.c for the format\n"
+            "  --obstacles file   no-fly areas, one \"x0 y0 x1 y1\" rectangle per line; SIGHUP reloads it\n"
+            "  --trace file       record every drone connection and message to file for edcs_replay\n"
+            "  --spans file       write sampled latency spans as Chrome trace JSON at exit and on SIGUSR1\n"
+            "  --span-sample n    record one in n messages, dispatch passes and survivors (default %d)\n"
+            "  --federation file  run as one server of several sharing the map, see federation.c for the\n"
+            "                     format; the drone port comes from the file\n"
+            "  --node name        this server's node in the federation file\n"
+            "  --replicate port   stream drone and survivor changes to edcs_replica processes\n"
+            "  --query-socket path  answer radius, bbox and nearest queries on a UNIX socket, see query.c\n",
+            prog, DEFAULT_SERVER_PORT, METRICS_PORT, DEFAULT_MAX_DRONES, DEFAULT_MAP_WIDTH, DEFAULT_MAP_HEIGHT,
+            DEFAULT_REGION_COLS, DEFAULT_REGION_ROWS, DEFAULT_LISTEN_BACKLOG, DEFAULT_UPDATE_BUDGET, DEFAULT_TOUR_STOPS, DRONE_TOUR_MAX,
+            DEFAULT_REBALANCE_MOVES, SPAN_DEFAULT_SAMPLE);
+}
+
+static int parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        if (strcmp(arg, "--headless") == 0) {
+            config.headless = 1;
+        } else if (strcmp(arg, "--port") == 0 && value) {
+            config.port = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--metrics-port") == 0 && value) {
+            config.metrics_port = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--max-drones") == 0 && value) {
+            config.max_drones = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--survivor-rate") == 0 && value) {
+            config.survivor_rate = atof(value);
+            i++;
+        } else if (strcmp(arg, "--map") == 0 && value &&
+                   sscanf(value, "%dx%d", &config.map_width, &config.map_height) == 2) {
+            i++;
+        } else if (strcmp(arg, "--regions") == 0 && value &&
+                   sscanf(value, "%dx%d", &config.region_cols, &config.region_rows) == 2) {
+            i++;
+        } else if (strcmp(arg, "--pin-workers") == 0) {
+            config.pin_workers = 1;
+        } else if (strcmp(arg, "--workers") == 0 && value) {
+            config.workers = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--acceptors") == 0 && value) {
+            config.acceptors = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--backlog") == 0 && value) {
+            config.backlog = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--dispatch") == 0 && value &&
+                   (strcmp(value, "eta") == 0 || strcmp(value, "nearest") == 0)) {
+            config.dispatch_nearest = strcmp(value, "nearest") == 0;
+            i++;
+        } else if (strcmp(arg, "--tour-stops") == 0 && value && atoi(value) >= 1) {
+            config.tour_stops = atoi(value);
+            if (config.tour_stops > DRONE_TOUR_MAX) config.tour_stops = DRONE_TOUR_MAX;
+            i++;
+        } else if (strcmp(arg, "--rebalance-moves") == 0 && value) {
+            config.rebalance_moves = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--hotspots") == 0 && value) {
+            config.hotspots = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--seed") == 0 && value) {
+            config.seed = (unsigned int)strtoul(value, NULL, 10);
+            i++;
+        } else if (strcmp(arg, "--scenario") == 0 && value) {
+            config.scenario = value;
+            i++;
+        } else if (strcmp(arg, "--trace") == 0 && value) {
+            config.trace = value;
+            i++;
+        } else if (strcmp(arg, "--spans") == 0 && value) {
+            config.spans = value;
+            i++;
+        } else if (strcmp(arg, "--span-sample") == 0 && value && atoi(value) >= 1) {
+            config.span_sample = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--federation") == 0 && value) {
+            config.federation = value;
+            i++;
+        } else if (strcmp(arg, "--node") == 0 && value) {
+            config.node = value;
+            i++;
+        } else if (strcmp(arg, "--replicate") == 0 && value && atoi(value) > 0) {
+            config.replicate_port = atoi(value);
+            i++;
+        } else if (strcmp(arg, "--query-socket") == 0 && value) {
+            config.query_socket = value;
+            i++;
+        } else if (strcmp(arg, "--obstacles") == 0 && value) {
+            config.obstacles = value;
+            i++;
+        } else if (strcmp(arg, "--update-budget") == 0 && value) {
+            config.update_budget = atof(value);
+            i++;
+        } else {
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (config.port <= 0 || config.metrics_port <= 0 || config.max_drones <= 0 || config.survivor_rate < 0 ||
+        config.workers < 0 || config.acceptors < 0 || config.backlog <= 0 || config.update_budget < 0 || config.rebalance_moves < 0 || config.hotspots < 0 ||
+        config.map_width <= 0 || config.map_height <= 0 ||
+        config.region_cols <= 0 || config.region_rows <= 0 ||
+        config.region_cols > config.map_width || config.region_rows > config.map_height) {
+        usage(argv[0]);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (parse_args(argc, argv) != 0) {
+        return 1;
+    }
+
     // Initialize random seed
     srand(time(NULL));
     
     // Set up signal handlers
     signal(SIGINT, handle_signal);
     signal(SIGTERM, handle_signal);
+    signal(SIGHUP, handle_signal);
+    signal(SIGUSR1, handle_signal);
     
     // Initialize map
     printf("Initializing map...\n");
-    init_map(30, 40);  // height=30, width=40 cells
+    init_map(config.map_height, config.map_width);
     printf("Map initialized: %dx%d\n", map.width, map.height);
     printf("Map dimensions: width=%d, height=%d\n", map.width, map.height);
+    if ((config.obstacles && obstacles_load(&map.obstacles, config.obstacles) != 0) ||
+        (config.federation && federation_load(config.federation, config.node) != 0)) {
+        freemap();
+        return 1;
+    }
+    if ((config.trace && trace_open(config.trace) != 0) ||
+        (config.spans && span_open(config.spans, config.span_sample) != 0)) {
+        trace_close();
+        freemap();
+        return 1;
+    }
+    if (heatmap_init(map.width, map.height) != 0) {
+        fprintf(stderr, "Running without drone pre-positioning\n");
+    }
     
-    // Initialize lists
-    printf("Creating survivor list...\n");
-    survivors = create_list(sizeof(Survivor), 1000);  // Max 1000 survivors
-    printf("Survivor list created: %p\n", (void*)survivors);
-    helpedsurvivors = create_list(sizeof(Survivor), 1000);  // Max 1000 helped survivors
-    drones = create_list(sizeof(Drone), 100);  // Max 100 drones
+    // Initialize lists; waiting survivors live in their regions
+    helpedsurvivors = create_list(sizeof(Survivor), HELPED_WINDOW);  // Recent rescues only
+    if (archive_open(ARCHIVE_DIR) != 0) {
+        fprintf(stderr, "Failed to open helped survivor archive in %s\n", ARCHIVE_DIR);
+    }
+    drones = create_list(sizeof(Drone), config.max_drones);
     printf("Helped survivors list: %p, drones list: %p\n", (void*)helpedsurvivors, (void*)drones);
     printf("Global lists initialized.\n");
-    
-    // Start survivor generator thread
-    printf("Starting survivor generator thread...\n");
-    if (pthread_create(&survivor_thread_id, NULL, survivor_generator, NULL) != 0) {
-        perror("Failed to create survivor generator thread");
+
+    // All message handling, dispatch and survivor generation runs on the pool;
+    // regions must exist before anything posts survivors or drones to them
+    if (workpool_start(config.workers, config.pin_workers) != 0 ||
+        regions_start(config.region_cols, config.region_rows) != 0) {
+        fprintf(stderr, "Failed to start the work pool and regions\n");
+        global_shutdown_flag = 1;
         cleanup_resources();
         return 1;
     }
-    printf("Survivor generator thread started.\n");
-    
-    // Start AI controller thread
-    if (pthread_create(&ai_thread_id, NULL, ai_controller, NULL) != 0) {
-        perror("Failed to create AI controller thread");
+    if (survivor_start() != 0) {
+        global_shutdown_flag = 1;
+        cleanup_resources();
+        return 1;
+    }
+    rebalance_start();
+    if (federation_start() != 0 || (config.replicate_port && replication_start(config.replicate_port) != 0) ||
+        (config.query_socket && query_start(config.query_socket) != 0)) {
+        global_shutdown_flag = 1;
         cleanup_resources();
         return 1;
     }
-    printf("AI controller thread started.\n");
     
     // Start server thread
     if (pthread_create(&server_thread_id, NULL, run_server_loop, NULL) != 0) {
@@ -136,6 +344,22 @@ int main() {
     }
     printf("Server thread started. Waiting for drone connections...\n");
     
+    // Start metrics endpoint thread
+    if (pthread_create(&metrics_thread_id, NULL, metrics_http_server, NULL) != 0) {
+        perror("Failed to create metrics thread");
+    }
+    
+    if (config.headless) {
+        printf("Running headless. Waiting for shutdown signal...\n");
+        while (!global_shutdown_flag) {
+            poll_obstacle_reload();
+            poll_span_dump();
+            usleep(100000);
+        }
+        cleanup_resources();
+        return 0;
+    }
+    
     // Initialize SDL window
     if (init_sdl_window() != 0) {
         fprintf(stderr, "Failed to initialize SDL window\n");
@@ -160,6 +384,9 @@ int main() {
             break;
         }
         
+        poll_obstacle_reload();
+        poll_span_dump();
+
         // Draw the map and entities
         draw_map();
         
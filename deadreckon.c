@@ -0,0 +1,27 @@
+#include "headers/deadreckon.h"
+#include <stdlib.h>
+
+// Where a drone that left `from` elapsed_ns ago should be on its x-then-y
+// path to `to`. Partial cells are not counted, since drones move in whole
+// steps.
+Coord deadreckon_position(Coord from, Coord to, double speed, uint64_t elapsed_ns) {
+    if (speed <= 0) return from;
+    double cells = speed * (double)elapsed_ns / 1e9;
+    long steps = cells > (double)(abs(to.x - from.x) + abs(to.y - from.y)) ? -1 : (long)cells;
+    if (steps < 0) return to;
+
+    Coord at = from;
+    int dx = abs(to.x - from.x);
+    if (steps <= dx) {
+        at.x += (to.x > from.x ? 1 : -1) * (int)steps;
+        return at;
+    }
+    at.x = to.x;
+    steps -= dx;
+    at.y += (to.y > from.y ? 1 : -1) * (int)steps;
+    return at;
+}
+
+int deadreckon_deviation(Coord a, Coord b) {
+    return abs(a.x - b.x) + abs(a.y - b.y);
+}
@@ -1,96 +1,36 @@
 #include "headers/drone.h"
 #include "headers/globals.h"
 #include "headers/map.h"
-#include "headers/survivor.h"
+#include "headers/deadreckon.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <pthread.h>
-#include <unistd.h>
 #include <string.h>
 #include <time.h>
 
-Drone *drone_fleet = NULL;
-int num_drones = 10;
-
-void initialize_drones() {
-    drone_fleet = malloc(sizeof(Drone) * num_drones);
-    srand(time(NULL));
-
-    for (int i = 0; i < num_drones; i++) {
-        drone_fleet[i].id = i;
-        drone_fleet[i].status = IDLE;
-        drone_fleet[i].coord = (Coord){rand() % map.width, rand() % map.height};
-        drone_fleet[i].target = drone_fleet[i].coord;
-        pthread_mutex_init(&drone_fleet[i].lock, NULL);
-
-        pthread_mutex_lock(&drones->lock);
-        drones->add(drones, &drone_fleet[i]);
-        pthread_mutex_unlock(&drones->lock);
-
-        pthread_create(&drone_fleet[i].thread_id, NULL, drone_behavior, &drone_fleet[i]);
-    }
+// Where the drone should be at now_ns, extrapolated along its path from the
+// last reported position. Call with d->lock held.
+Coord drone_position(const Drone *d, uint64_t now_ns) {
+    if (d->status != ON_MISSION || d->speed <= 0 || now_ns < d->anchor_ns) return d->coord;
+    return path_position(&map_paths, d->anchor, d->target, d->speed, now_ns - d->anchor_ns);
 }
 
-void *drone_behavior(void *arg) {
-    Drone *d = (Drone*)arg;
-    while (1) {
-        pthread_mutex_lock(&d->lock);
-        if (d->status == ON_MISSION) {
-            printf("[DEBUG] Drone %d at (%d,%d), target (%d,%d)\n", d->id, d->coord.x, d->coord.y, d->target.x, d->target.y);
-            if (d->coord.x < d->target.x) d->coord.x++;
-            else if (d->coord.x > d->target.x) d->coord.x--;
-            else if (d->coord.y < d->target.y) d->coord.y++;
-            else if (d->coord.y > d->target.y) d->coord.y--;
-            
-            // Check if drone has reached its target
-            if (d->coord.x == d->target.x && d->coord.y == d->target.y) {
-                printf("[DEBUG] Drone %d reached target (%d,%d)\n", d->id, d->coord.x, d->coord.y);
-                Survivor *found_survivor = NULL;
-                pthread_mutex_lock(&map.cells[d->coord.y][d->coord.x].survivors->lock);
-                Node *current = map.cells[d->coord.y][d->coord.x].survivors->head;
-                while (current != NULL) {
-                    Survivor *s = (Survivor *)current->data;
-                    printf("[DEBUG] Checking survivor at (%d,%d)\n", s->coord.x, s->coord.y);
-                    if (s && s->coord.x == d->coord.x && s->coord.y == d->coord.y) {
-                        found_survivor = s;
-                        break;
-                    }
-                    current = current->next;
-                }
-                pthread_mutex_unlock(&map.cells[d->coord.y][d->coord.x].survivors->lock);
-                if (found_survivor) {
-                    printf("[DEBUG] Drone %d found survivor to rescue at (%d,%d)\n", d->id, d->coord.x, d->coord.y);
-                    pthread_mutex_lock(&map.cells[d->coord.y][d->coord.x].survivors->lock);
-                    map.cells[d->coord.y][d->coord.x].survivors->removedata(
-                        map.cells[d->coord.y][d->coord.x].survivors, found_survivor);
-                    pthread_mutex_unlock(&map.cells[d->coord.y][d->coord.x].survivors->lock);
-
-                    pthread_mutex_lock(&survivors->lock);
-                    survivors->removedata(survivors, found_survivor);
-                    pthread_mutex_unlock(&survivors->lock);
-
-                    pthread_mutex_lock(&helpedsurvivors->lock);
-                    helpedsurvivors->add(helpedsurvivors, found_survivor);
-                    pthread_mutex_unlock(&helpedsurvivors->lock);
-
-                    printf("Drone %d: Rescued survivor at (%d, %d)\n", d->id, d->coord.x, d->coord.y);
-                } else {
-                    printf("[DEBUG] Drone %d did NOT find a survivor to rescue at (%d,%d)\n", d->id, d->coord.x, d->coord.y);
-                }
-                d->status = IDLE;
-                printf("Drone %d: Mission completed!\n", d->id);
-            }
-        }
-        pthread_mutex_unlock(&d->lock);
-        usleep(1000); // Sleep for 1ms (even faster movement)
+// Heads for the next waypoint of the tour; returns 0 once the tour is done.
+// Call with d->lock held.
+int drone_next_stop(Drone *d) {
+    if (d->tour_stop + 1 < d->tour_len) {
+        d->target = d->tour[++d->tour_stop];
+        return 1;
     }
-    return NULL;
+    d->tour_len = 0;
+    d->tour_stop = 0;
+    d->repositioning = 0;
+    return 0;
 }
 
-void cleanup_drones() {
-    for (int i = 0; i < num_drones; i++) {
-        pthread_cancel(drone_fleet[i].thread_id);
-        pthread_mutex_destroy(&drone_fleet[i].lock);
-    }
-    free(drone_fleet);
-}
\ No newline at end of file
+// Takes a known position as the new starting point. Call with d->lock held.
+void drone_reanchor(Drone *d, Coord at, uint64_t now_ns) {
+    d->coord = at;
+    d->anchor = at;
+    d->anchor_ns = now_ns;
+}
@@ -11,107 +11,358 @@
 #include <sys/time.h>
 #include "headers/drone.h"
 #include "headers/coord.h"
+#include "headers/deadreckon.h"
+#include "headers/path.h"
 
 #define SERVER_IP "127.0.0.1"
 #define PORT 8080
-#define BUFFER_SIZE 4096
+#define BUFFER_SIZE 65536       // HANDSHAKE_ACK carries the obstacle list
+#define STEP_MS 500            // one cell per step
+#define RANGE_CELLS 200        // cells flown on a full charge
+#define RECHARGE_PERCENT 2     // charge regained per idle step
+#define PATH_FIELDS 2          // the leg being flown, and the one before
+#define RECONNECT_BASE_MS 200  // first reconnect waits up to this long
+#define RECONNECT_MAX_MS 10000 // and the wait doubles up to this
+#define SESSION_STABLE_MS 30000 // a session up this long resets the reconnect wait
+
+// No-fly areas as the server last sent them; routes step down their fields
+static ObstacleGrid obstacles;
+static PathCache paths;
+
+static const char *payloads[] = {"medical", "food", "water"};
+
+// Where to register; a REDIRECT from a federated server moves it
+static char server_host[64] = SERVER_IP;
+static int server_port = PORT;
+
+// Token from the last HANDSHAKE_ACK; a reconnect sends it in a RESUME
+static char session_id[DRONE_SESSION_BYTES * 2 + 1];
+
+// Connections opened since the last session that stayed up, and when the
+// current session was acked. Every reconnect waits on the first.
+static int reconnects;
+static uint64_t session_ns;
+
+// Reporting settings from HANDSHAKE_ACK, replaced by CONFIG_UPDATE
+typedef struct report_config {
+    double status_interval;    // seconds of silence before a STATUS_UPDATE is due
+    double heartbeat_interval;
+    int deviation_threshold;   // cells off the server's prediction before reporting
+} ReportConfig;
 
 void send_json(int sock, struct json_object *jobj);
 struct json_object *receive_json(int sock);
+static void receive_reset();
 void navigate_to_target(Drone *drone);
 
-int main() {
-    srand(time(NULL));
-    Drone drone = {
-        .id = rand() % 1000,
-        .status = IDLE,
-        .coord = {rand() % 40, rand() % 30},
-        .target = {0, 0}
-    };
-    pthread_mutex_init(&drone.lock, NULL);
-
-    int sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock < 0) {
-        perror("Socket creation failed");
-        exit(EXIT_FAILURE);
+static void apply_config(ReportConfig *rc, struct json_object *config) {
+    struct json_object *value, *reckoning;
+    if (json_object_object_get_ex(config, "obstacles", &value) && obstacles_from_json(&obstacles, value) == 0) {
+        printf("Obstacles: %d areas\n", obstacles.count);
+    }
+    if (json_object_object_get_ex(config, "status_update_interval", &value)) {
+        rc->status_interval = json_object_get_double(value);
+    }
+    if (json_object_object_get_ex(config, "heartbeat_interval", &value)) {
+        rc->heartbeat_interval = json_object_get_double(value);
+    }
+    if (json_object_object_get_ex(config, "dead_reckoning", &reckoning) &&
+        json_object_object_get_ex(reckoning, "deviation_threshold", &value)) {
+        rc->deviation_threshold = json_object_get_int(value);
     }
+    printf("Report config: status every %.1fs, heartbeat %.1fs, deviation %d\n",
+           rc->status_interval, rc->heartbeat_interval, rc->deviation_threshold);
+}
+
+// Longest the drone may stay silent under rc.
+static uint64_t quiet_ns(const ReportConfig *rc) {
+    double secs = rc->status_interval < rc->heartbeat_interval ? rc->status_interval : rc->heartbeat_interval;
+    return (uint64_t)(secs * 1e9);
+}
 
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Waits a random part of a window that doubles with every reconnect since
+// the last session that stayed up (exponential backoff, full jitter), so a
+// fleet that lost the server together does not come back together and a
+// refused RESUME or HANDSHAKE is not retried in a tight loop.
+static void reconnect_backoff() {
+    int cap = reconnects < 16 ? RECONNECT_BASE_MS << reconnects : RECONNECT_MAX_MS;
+    if (cap > RECONNECT_MAX_MS) cap = RECONNECT_MAX_MS;
+    reconnects++;
+    usleep((useconds_t)(rand() % cap) * 1000);
+}
+
+// Counts the session as up; reconnects go back to short waits once it has
+// lasted SESSION_STABLE_MS.
+static void session_started() {
+    session_ns = now_ns();
+}
+
+// Connects to the server, backing off before every attempt but the very
+// first connection of the drone.
+static int connect_with_backoff() {
     struct sockaddr_in server_addr = {
         .sin_family = AF_INET,
-        .sin_port = htons(PORT),
-        .sin_addr.s_addr = inet_addr(SERVER_IP)
+        .sin_port = htons(server_port),
+        .sin_addr.s_addr = inet_addr(server_host)
     };
-
-    if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    static int connected_before;
+    for (;;) {
+        if (connected_before) reconnect_backoff();
+        connected_before = 1;
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        if (sock < 0) {
+            perror("Socket creation failed");
+            exit(EXIT_FAILURE);
+        }
+        if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) == 0) {
+            printf("Connected to server at %s:%d\n", server_host, server_port);
+            // Waiting for server messages paces the flight, one step per timeout
+            struct timeval tv;
+            tv.tv_sec = 0;
+            tv.tv_usec = STEP_MS * 1000;
+            setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+            receive_reset();
+            return sock;
+        }
         perror("Connection failed");
         close(sock);
-        exit(EXIT_FAILURE);
     }
+}
 
-    drone.sock = sock;
-    printf("Connected to server at %s:%d\n", SERVER_IP, PORT);
-
-    // Set socket to non-blocking mode with a timeout
-    struct timeval tv;
-    tv.tv_sec = 1;  // 1 second timeout
-    tv.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
-    
-    char drone_id[10];
-    snprintf(drone_id, sizeof(drone_id), "D%d", drone.id);
-    struct json_object *handshake = json_object_new_object();
-    json_object_object_add(handshake, "type", json_object_new_string("HANDSHAKE"));
-    json_object_object_add(handshake, "drone_id", json_object_new_string(drone_id));
-    struct json_object *capabilities = json_object_new_object();
-    json_object_object_add(capabilities, "max_speed", json_object_new_int(30));
-    json_object_object_add(capabilities, "battery_capacity", json_object_new_int(100));
-    json_object_object_add(capabilities, "payload", json_object_new_string("medical"));
-    json_object_object_add(handshake, "capabilities", capabilities);
-    send_json(sock, handshake);
-    printf("Sent HANDSHAKE: drone_id=%s\n", drone_id);
-    json_object_put(handshake);
-
-    struct json_object *ack = receive_json(sock);
-    if (!ack || strcmp(json_object_get_string(json_object_object_get(ack, "type")), "HANDSHAKE_ACK") != 0) {
+// Waits a few steps for the server to answer on sock.
+static struct json_object *await_reply(int sock) {
+    struct json_object *reply = NULL;
+    for (int waited = 0; !reply && waited < 10; waited++) {
+        reply = receive_json(sock);
+        if (!reply && !(errno == EAGAIN || errno == EWOULDBLOCK)) break;
+    }
+    return reply;
+}
+
+// The ERROR code of reply, 0 if it is not an ERROR.
+static int error_code(struct json_object *reply) {
+    const char *type = json_object_get_string(json_object_object_get(reply, "type"));
+    if (!type || strcmp(type, "ERROR") != 0) return 0;
+    return json_object_get_int(json_object_object_get(reply, "code"));
+}
+
+// If reply is a 503, closes sock and waits out its retry_after plus jitter,
+// so refused drones do not return all at once. Returns 1 if it was.
+static int wait_if_overloaded(int sock, struct json_object *reply) {
+    if (error_code(reply) != 503) return 0;
+    int retry_after = json_object_get_int(json_object_object_get(reply, "retry_after"));
+    if (retry_after < 1) retry_after = 1;
+    printf("Server overloaded, retrying in %ds\n", retry_after);
+    close(sock);
+    usleep((useconds_t)retry_after * 1000000 + (rand() % 1000) * 1000);
+    return 1;
+}
+
+// Connects and sends HANDSHAKE until the server accepts it, waiting out
+// the retry_after of every 503. An ID another live drone holds (409) is
+// swapped for a new random one. Returns the socket and the HANDSHAKE_ACK.
+static int register_with_server(Drone *drone, char *drone_id, size_t id_len, const char *payload, Coord home,
+                                struct json_object **ack_out) {
+    while (1) {
+        int sock = connect_with_backoff();
+        struct json_object *handshake = json_object_new_object();
+        json_object_object_add(handshake, "type", json_object_new_string("HANDSHAKE"));
+        json_object_object_add(handshake, "drone_id", json_object_new_string(drone_id));
+        struct json_object *capabilities = json_object_new_object();
+        json_object_object_add(capabilities, "max_speed", json_object_new_int(30));
+        json_object_object_add(capabilities, "battery_capacity", json_object_new_int(RANGE_CELLS));
+        json_object_object_add(capabilities, "payload", json_object_new_string(payload));
+        json_object_object_add(capabilities, "cells_per_second", json_object_new_double(1000.0 / STEP_MS));
+        json_object_object_add(handshake, "capabilities", capabilities);
+        struct json_object *home_obj = json_object_new_object();
+        json_object_object_add(home_obj, "x", json_object_new_int(home.x));
+        json_object_object_add(home_obj, "y", json_object_new_int(home.y));
+        json_object_object_add(handshake, "home", home_obj);
+        send_json(sock, handshake);
+        printf("Sent HANDSHAKE: drone_id=%s\n", drone_id);
+        json_object_put(handshake);
+
+        // A loaded server may take a few steps to answer
+        struct json_object *reply = await_reply(sock);
+        const char *type = reply ? json_object_get_string(json_object_object_get(reply, "type")) : NULL;
+        if (type && strcmp(type, "HANDSHAKE_ACK") == 0) {
+            const char *session = json_object_get_string(json_object_object_get(reply, "session_id"));
+            snprintf(session_id, sizeof(session_id), "%s", session ? session : "");
+            session_started();
+            *ack_out = reply;
+            return sock;
+        }
+        if (reply && wait_if_overloaded(sock, reply)) {
+            json_object_put(reply);
+            continue;
+        }
+        if (reply && error_code(reply) == 409) {
+            drone->id = rand() % 1000;
+            snprintf(drone_id, id_len, "D%d", drone->id);
+            printf("Drone ID in use, registering as %s\n", drone_id);
+            json_object_put(reply);
+            close(sock);
+            continue;
+        }
         fprintf(stderr, "Handshake failed\n");
-        if (ack) json_object_put(ack);
+        if (reply) json_object_put(reply);
         close(sock);
         exit(EXIT_FAILURE);
     }
+}
+
+// Picks the session back up after a dropped connection. The server keeps
+// our record and mission, so RESUME_ACK carries no config; a mission we do
+// not hold follows as an ASSIGN_MISSION. Returns -1 if the server does not
+// know the session, and the drone has to HANDSHAKE again.
+static int resume_session(const char *drone_id, Drone *drone) {
+    while (session_id[0] != '\0') {
+        int sock = connect_with_backoff();
+        struct json_object *resume = json_object_new_object();
+        json_object_object_add(resume, "type", json_object_new_string("RESUME"));
+        json_object_object_add(resume, "drone_id", json_object_new_string(drone_id));
+        json_object_object_add(resume, "session_id", json_object_new_string(session_id));
+        json_object_object_add(resume, "mission_id",
+                               drone->status == ON_MISSION ? json_object_new_string(drone->mission_id) : NULL);
+        send_json(sock, resume);
+        printf("Sent RESUME: drone_id=%s session_id=%s\n", drone_id, session_id);
+        json_object_put(resume);
+
+        struct json_object *reply = await_reply(sock);
+        const char *type = reply ? json_object_get_string(json_object_object_get(reply, "type")) : NULL;
+        if (type && strcmp(type, "RESUME_ACK") == 0) {
+            // No mission on the server's side means ours ended while we were away
+            if (!json_object_get_string(json_object_object_get(reply, "mission_id")) &&
+                drone->status == ON_MISSION) {
+                drone->status = IDLE;
+                drone->tour_len = 0;
+            }
+            json_object_put(reply);
+            session_started();
+            return sock;
+        }
+        if (reply && wait_if_overloaded(sock, reply)) {
+            json_object_put(reply);
+            continue;
+        }
+        fprintf(stderr, "Resume refused: %s\n",
+                reply ? json_object_get_string(json_object_object_get(reply, "message")) : "no answer");
+        if (reply) json_object_put(reply);
+        close(sock);
+        break;
+    }
+    return -1;
+}
+
+// Usage: drone [server-ip [port]]
+int main(int argc, char **argv) {
+    if (argc > 1) snprintf(server_host, sizeof(server_host), "%s", argv[1]);
+    if (argc > 2) server_port = atoi(argv[2]);
+    // Drones started in the same second must not draw the same ID
+    srand((unsigned)time(NULL) ^ ((unsigned)getpid() << 16));
+    Drone drone = {
+        .id = rand() % 1000,
+        .status = IDLE,
+        .coord = {rand() % 40, rand() % 30},
+        .target = {0, 0}
+    };
+    pthread_mutex_init(&drone.lock, NULL);
+    obstacles_init(&obstacles, 0, 0);
+    if (path_cache_init(&paths, &obstacles, PATH_FIELDS) != 0) exit(EXIT_FAILURE);
+
+    char drone_id[10];
+    snprintf(drone_id, sizeof(drone_id), "D%d", drone.id);
+    const char *payload = payloads[rand() % 3];
+    double battery = 100;  // percent of RANGE_CELLS
+    struct json_object *ack = NULL;
+    Coord home = drone.coord;
+    int sock = register_with_server(&drone, drone_id, sizeof(drone_id), payload, home, &ack);
+    drone.sock = sock;
     printf("Received HANDSHAKE_ACK\n");
+
+    // The server predicts our position between reports; only report when
+    // we drift from that prediction, change state, or have been quiet too long
+    ReportConfig rc = {5.0, 10.0, DEADRECKON_DEVIATION_CELLS};
+    struct json_object *config;
+    if (json_object_object_get_ex(ack, "config", &config)) apply_config(&rc, config);
     json_object_put(ack);
 
+    double speed = 1000.0 / STEP_MS;
+    int reported_status = -1;  // forces a first report
+    uint64_t reported_ns = 0;
+    drone.anchor = drone.coord;
+    drone.anchor_ns = now_ns();
+
     while (1) {
         // Move the drone if it's on a mission
         pthread_mutex_lock(&drone.lock);
         if (drone.status == ON_MISSION) {
             navigate_to_target(&drone);
+            battery -= 100.0 / RANGE_CELLS;
+            if (battery < 0) battery = 0;
+        } else if (battery < 100) {
+            battery += RECHARGE_PERCENT;
+            if (battery > 100) battery = 100;
         }
         
+        uint64_t now = now_ns();
+        if (reconnects && now - session_ns >= SESSION_STABLE_MS * 1000000ULL) reconnects = 0;
+        Coord predicted = drone.anchor;
+        if (drone.status == ON_MISSION) {
+            predicted = path_position(&paths, drone.anchor, drone.target, speed, now - drone.anchor_ns);
+        }
+        int due = drone.status != reported_status ||
+                  deadreckon_deviation(predicted, drone.coord) > rc.deviation_threshold ||
+                  now - reported_ns >= quiet_ns(&rc);
+
         // Send status update
-        struct json_object *status = json_object_new_object();
-        json_object_object_add(status, "type", json_object_new_string("STATUS_UPDATE"));
-        json_object_object_add(status, "drone_id", json_object_new_string(drone_id));
-        json_object_object_add(status, "timestamp", json_object_new_int64(time(NULL)));
-        struct json_object *loc = json_object_new_object();
-        json_object_object_add(loc, "x", json_object_new_int(drone.coord.x));
-        json_object_object_add(loc, "y", json_object_new_int(drone.coord.y));
-        json_object_object_add(status, "location", loc);
-        json_object_object_add(status, "status", json_object_new_string(drone.status == IDLE ? "idle" : "busy"));
-        json_object_object_add(status, "battery", json_object_new_int(85));
-        json_object_object_add(status, "speed", json_object_new_int(5));
-        send_json(sock, status);
-        printf("Sent STATUS_UPDATE: x=%d, y=%d, status=%s\n",
-               drone.coord.x, drone.coord.y, drone.status == IDLE ? "idle" : "busy");
-        json_object_put(status);
+        if (due) {
+            struct json_object *status = json_object_new_object();
+            json_object_object_add(status, "type", json_object_new_string("STATUS_UPDATE"));
+            json_object_object_add(status, "drone_id", json_object_new_string(drone_id));
+            json_object_object_add(status, "timestamp", json_object_new_int64(time(NULL)));
+            struct json_object *loc = json_object_new_object();
+            json_object_object_add(loc, "x", json_object_new_int(drone.coord.x));
+            json_object_object_add(loc, "y", json_object_new_int(drone.coord.y));
+            json_object_object_add(status, "location", loc);
+            json_object_object_add(status, "status", json_object_new_string(drone.status == IDLE ? "idle" : "busy"));
+            json_object_object_add(status, "battery", json_object_new_int((int)battery));
+            json_object_object_add(status, "speed", json_object_new_double(speed));
+            send_json(sock, status);
+            printf("Sent STATUS_UPDATE: x=%d, y=%d, status=%s\n",
+                   drone.coord.x, drone.coord.y, drone.status == IDLE ? "idle" : "busy");
+            json_object_put(status);
+            drone.anchor = drone.coord;
+            drone.anchor_ns = now;
+            reported_status = drone.status;
+            reported_ns = now;
+        }
         pthread_mutex_unlock(&drone.lock);
 
         // Check for messages from server
         struct json_object *msg = receive_json(sock);
         if (!msg) {
             if (!(errno == EAGAIN || errno == EWOULDBLOCK)) {
-                fprintf(stderr, "Server disconnected\n");
-                break;
+                fprintf(stderr, "Server disconnected, reconnecting\n");
+                close(sock);
+                pthread_mutex_lock(&drone.lock);
+                sock = resume_session(drone_id, &drone);
+                if (sock < 0) {
+                    sock = register_with_server(&drone, drone_id, sizeof(drone_id), payload, home, &ack);
+                    if (json_object_object_get_ex(ack, "config", &config)) apply_config(&rc, config);
+                    json_object_put(ack);
+                    drone.status = IDLE;
+                    drone.tour_len = 0;
+                }
+                drone.sock = sock;
+                reported_status = -1;  // tell the server where we are now
+                pthread_mutex_unlock(&drone.lock);
             }
         } else {
             const char *type = json_object_get_string(json_object_object_get(msg, "type"));
@@ -123,12 +374,40 @@ int main() {
                 pthread_mutex_lock(&drone.lock);
                 drone.target.x = json_object_get_int(json_object_object_get(target, "x"));
                 drone.target.y = json_object_get_int(json_object_object_get(target, "y"));
+                // A tour lists every stop in order, the first being target
+                struct json_object *waypoints;
+                drone.tour[0] = drone.target;
+                drone.tour_len = 1;
+                if (json_object_object_get_ex(msg, "waypoints", &waypoints)) {
+                    int n = json_object_array_length(waypoints);
+                    if (n > DRONE_TOUR_MAX) n = DRONE_TOUR_MAX;
+                    for (int i = 0; i < n; i++) {
+                        struct json_object *stop = json_object_array_get_idx(waypoints, i);
+                        drone.tour[i].x = json_object_get_int(json_object_object_get(stop, "x"));
+                        drone.tour[i].y = json_object_get_int(json_object_object_get(stop, "y"));
+                    }
+                    if (n > 0) drone.tour_len = n;
+                }
+                drone.tour_stop = 0;
+                drone.target = drone.tour[0];
                 drone.status = ON_MISSION;
+                // The server predicts our flight from where it believes we set off
+                struct json_object *origin;
+                drone.anchor = drone.coord;
+                if (json_object_object_get_ex(msg, "origin", &origin)) {
+                    drone.anchor.x = json_object_get_int(json_object_object_get(origin, "x"));
+                    drone.anchor.y = json_object_get_int(json_object_object_get(origin, "y"));
+                }
+                drone.anchor_ns = now_ns();
                 strncpy(drone.mission_id, mission_id, sizeof(drone.mission_id) - 1);
                 drone.mission_id[sizeof(drone.mission_id) - 1] = '\0';
-                printf("Received ASSIGN_MISSION: mission_id=%s, target=(%d, %d)\n",
-                       mission_id, drone.target.x, drone.target.y);
+                printf("Received ASSIGN_MISSION: mission_id=%s, target=(%d, %d), %d stops%s\n",
+                       mission_id, drone.target.x, drone.target.y, drone.tour_len,
+                       json_object_get_boolean(json_object_object_get(msg, "reposition")) ? " (reposition)" : "");
                 pthread_mutex_unlock(&drone.lock);
+            } else if (strcmp(type, "CONFIG_UPDATE") == 0) {
+                struct json_object *update;
+                if (json_object_object_get_ex(msg, "config", &update)) apply_config(&rc, update);
             } else if (strcmp(type, "HEARTBEAT") == 0) {
                 struct json_object *response = json_object_new_object();
                 json_object_object_add(response, "type", json_object_new_string("HEARTBEAT_RESPONSE"));
@@ -140,15 +419,29 @@ int main() {
             } else if (strcmp(type, "ERROR") == 0) {
                 fprintf(stderr, "Error from server: %s\n",
                         json_object_get_string(json_object_object_get(msg, "message")));
+            } else if (strcmp(type, "REDIRECT") == 0) {
+                // We are idle over another server's area; register there instead
+                const char *host = json_object_get_string(json_object_object_get(msg, "host"));
+                snprintf(server_host, sizeof(server_host), "%s", host ? host : SERVER_IP);
+                server_port = json_object_get_int(json_object_object_get(msg, "port"));
+                printf("Redirected to %s at %s:%d\n",
+                       json_object_get_string(json_object_object_get(msg, "node")), server_host, server_port);
+                close(sock);
+                sock = register_with_server(&drone, drone_id, sizeof(drone_id), payload, home, &ack);
+                drone.sock = sock;
+                if (json_object_object_get_ex(ack, "config", &config)) apply_config(&rc, config);
+                json_object_put(ack);
+                reported_status = -1;
             }
             
             json_object_put(msg);
+            usleep(STEP_MS * 1000); // a timed-out receive already waited one step
         }
-        
-        usleep(500000); // Slow down to 0.5 seconds between updates
     }
 
     close(sock);
+    path_cache_free(&paths);
+    obstacles_free(&obstacles);
     pthread_mutex_destroy(&drone.lock);
     return 0;
 }
@@ -158,14 +451,20 @@ void send_json(int sock, struct json_object *jobj) {
     size_t len = strlen(json_str);
     char *msg = malloc(len + 2);
     snprintf(msg, len + 2, "%s\n", json_str);
-    send(sock, msg, strlen(msg), 0);
+    send(sock, msg, strlen(msg), MSG_NOSIGNAL);  // a dropped server is noticed on receive
     free(msg);
 }
 
-struct json_object *receive_json(int sock) {
-    static char buffer[BUFFER_SIZE] = {0};
-    static size_t buf_pos = 0;
+static char buffer[BUFFER_SIZE];
+static size_t buf_pos = 0;
+
+// Drops whatever the last connection left half received.
+static void receive_reset() {
+    buf_pos = 0;
+    buffer[0] = '\0';
+}
 
+struct json_object *receive_json(int sock) {
     while (1) {
         char *newline = strchr(buffer, '\n');
         if (newline) {
@@ -203,33 +502,16 @@ struct json_object *receive_json(int sock) {
 void navigate_to_target(Drone *drone) {
     // Only move if not already at target
     if (drone->coord.x != drone->target.x || drone->coord.y != drone->target.y) {
-        // Move horizontally first, then vertically
-        if (drone->coord.x < drone->target.x) {
-            drone->coord.x++;
-        } 
-        else if (drone->coord.x > drone->target.x) {
-            drone->coord.x--;
-        }
-        // Only move vertically if we're aligned horizontally
-        else if (drone->coord.y < drone->target.y) {
-            drone->coord.y++;
-        } 
-        else if (drone->coord.y > drone->target.y) {
-            drone->coord.y--;
-        }
+        // Horizontally first, then vertically, unless an obstacle is in the way
+        drone->coord = path_next(&paths, drone->coord, drone->target);
     }
 
-    // Now check if we have arrived - but don't send MISSION_COMPLETE yet
-    // We'll let the next status update send our exact position first
+    // Every stop of the tour is reported with a MISSION_COMPLETE carrying our
+    // position; the drone goes idle after the last one
     if (drone->coord.x == drone->target.x && drone->coord.y == drone->target.y) {
-        printf("[DEBUG] Drone reached target coordinates (%d,%d)\n", 
+        printf("[DEBUG] Drone reached stop %d of %d at (%d,%d)\n", drone->tour_stop + 1, drone->tour_len,
                drone->target.x, drone->target.y);
-        
-        // Set status to IDLE immediately
-        drone->status = IDLE;
-        
-        // Send MISSION_COMPLETE in the main thread after the status update
-        // so the server knows our exact position first
+
         char drone_id[10];
         snprintf(drone_id, sizeof(drone_id), "D%d", drone->id);
         struct json_object *complete = json_object_new_object();
@@ -239,10 +521,22 @@ void navigate_to_target(Drone *drone) {
         json_object_object_add(complete, "timestamp", json_object_new_int64(time(NULL)));
         json_object_object_add(complete, "success", json_object_new_boolean(1));
         json_object_object_add(complete, "details", json_object_new_string("Reached survivor location"));
-        
-        // Send the message now - our STATUS_UPDATE will be sent first in the main loop
+        struct json_object *loc = json_object_new_object();
+        json_object_object_add(loc, "x", json_object_new_int(drone->coord.x));
+        json_object_object_add(loc, "y", json_object_new_int(drone->coord.y));
+        json_object_object_add(complete, "location", loc);
         send_json(drone->sock, complete);
         printf("Sent MISSION_COMPLETE: mission_id=%s\n", drone->mission_id);
         json_object_put(complete);
+
+        // The server predicts the next leg from this stop
+        drone->anchor = drone->coord;
+        drone->anchor_ns = now_ns();
+        if (drone->tour_stop + 1 < drone->tour_len) {
+            drone->target = drone->tour[++drone->tour_stop];
+        } else {
+            drone->tour_len = 0;
+            drone->status = IDLE;
+        }
     }
 }
\ No newline at end of file
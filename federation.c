@@ -0,0 +1,629 @@
+/**
+ * @file federation.c
+ * @brief Links regional server processes that share one map.
+ *
+ * The federation file lists every server, one per line:
+ *
+ *     node <name> <host> <drone-port> <peer-port> <x0> <y0> <x1> <y1>
+ *
+ * and --node says which one this process is. A server only generates the
+ * survivors that fall in its rectangle (all servers run the same workload
+ * with the same --seed, so together they reproduce a single server's
+ * arrivals) and redirects idle drones that report from another server's
+ * rectangle to that server.
+ *
+ * One federation thread owns every peer socket. It keeps an outbound link
+ * to each peer (reconnecting every FEDERATION_RETRY_MS), sends each one a
+ * PEER_SUMMARY of this server's idle drones near its border every
+ * FEDERATION_SUMMARY_MS, and delivers the survivors queued for it by region
+ * dispatch. Inbound links carry the peers' summaries and survivors. A
+ * survivor that has waited FEDERATION_OFFER_NS with no local drone able to
+ * serve it is handed to the peer whose summarised drone would reach it
+ * soonest; it leaves this server entirely and is taken back if the link
+ * fails before it is sent.
+ */
+#define _GNU_SOURCE
+#include "headers/federation.h"
+#include "headers/globals.h"
+#include "headers/ai.h"
+#include "headers/map.h"
+#include "headers/metrics.h"
+#include "headers/region.h"
+#include "headers/server.h"
+#include "headers/lockprof.h"
+#include "headers/replication.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <json-c/json.h>
+
+extern volatile sig_atomic_t global_shutdown_flag;
+
+typedef struct fed_msg {
+    struct fed_msg *next;
+    char *line;            // newline-terminated JSON
+    Survivor survivor;     // taken back if the message cannot be sent
+} FedMsg;
+
+typedef struct fed_peer {
+    FedNode node;
+    int fd;                // outbound link, -1 when down; federation thread only
+    uint64_t retry_ns;
+    pthread_mutex_t lock;  // outbox and summary
+    FedMsg *outbox, *outbox_tail;
+    PeerDrone drones[FEDERATION_SUMMARY_DRONES];
+    int drone_count;
+    int idle;              // idle drones it has in total
+    uint64_t summary_ns;   // when its last summary arrived, 0 if never
+} FedPeer;
+
+typedef struct fed_inbound {
+    int fd;
+    size_t len;
+    char data[FEDERATION_BUFFER_SIZE];
+} FedInbound;
+
+static FedPeer peers[FEDERATION_MAX_NODES];
+static int node_count = 0;
+static int self_node = -1;
+static int listen_fd = -1;
+static pthread_t fed_thread;
+static int fed_running = 0;
+static FedInbound *inbound[FEDERATION_MAX_NODES * 2];
+static int inbound_count = 0;
+static int connected = 0;
+static long sent = 0, received = 0, redirects = 0;
+
+int federation_load(const char *path, const char *self) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Failed to open federation file");
+        return -1;
+    }
+    char line[256];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), file)) {
+        lineno++;
+        char *p = line + strspn(line, " \t");
+        if (*p == '#' || *p == '\n' || *p == '\0') continue;
+        FedNode n;
+        if (sscanf(p, "node %31s %63s %d %d %d %d %d %d", n.name, n.host, &n.port, &n.peer_port, &n.x0, &n.y0,
+                   &n.x1, &n.y1) != 8 || n.x0 >= n.x1 || n.y0 >= n.y1 || n.port <= 0 || n.peer_port <= 0) {
+            fprintf(stderr, "%s:%d: expected \"node name host port peer-port x0 y0 x1 y1\"\n", path, lineno);
+            fclose(file);
+            return -1;
+        }
+        if (node_count == FEDERATION_MAX_NODES) {
+            fprintf(stderr, "%s: more than %d nodes\n", path, FEDERATION_MAX_NODES);
+            fclose(file);
+            return -1;
+        }
+        FedPeer *peer = &peers[node_count];
+        memset(peer, 0, sizeof(*peer));
+        peer->node = n;
+        peer->fd = -1;
+        pthread_mutex_init(&peer->lock, NULL);
+        if (self && strcmp(n.name, self) == 0) self_node = node_count;
+        node_count++;
+    }
+    fclose(file);
+    if (self_node < 0) {
+        fprintf(stderr, "%s: no node named %s (--node)\n", path, self ? self : "(none)");
+        return -1;
+    }
+    FedNode *me = &peers[self_node].node;
+    config.port = me->port;
+    printf("Federation: node %s of %d, cells [%d,%d) x [%d,%d), drones on port %d, peers on %d\n", me->name,
+           node_count, me->x0, me->x1, me->y0, me->y1, me->port, me->peer_port);
+    return 0;
+}
+
+int federation_active() {
+    return self_node >= 0;
+}
+
+// The node whose rectangle holds (x, y), -1 if none does.
+int federation_owner(int x, int y) {
+    for (int i = 0; i < node_count; i++) {
+        const FedNode *n = &peers[i].node;
+        if (x >= n->x0 && x < n->x1 && y >= n->y0 && y < n->y1) return i;
+    }
+    return -1;
+}
+
+// Whether this server is responsible for (x, y); always without a federation.
+int federation_local(int x, int y) {
+    if (self_node < 0) return 1;
+    int owner = federation_owner(x, y);
+    return owner < 0 || owner == self_node;
+}
+
+/* ---- links ---- */
+
+static int write_all(int fd, const char *data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = send(fd, data + done, len - done, MSG_NOSIGNAL);
+        if (n > 0) {
+            done += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            if (poll(&pfd, 1, FEDERATION_POLL_MS) <= 0) return -1;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static char *json_line(struct json_object *jobj, size_t *len) {
+    const char *text = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PLAIN);
+    *len = strlen(text) + 1;
+    char *line = malloc(*len + 1);
+    if (line) snprintf(line, *len + 1, "%s\n", text);
+    return line;
+}
+
+static void link_down(FedPeer *p) {
+    if (p->fd < 0) return;
+    printf("Federation: lost link to %s\n", p->node.name);
+    close(p->fd);
+    p->fd = -1;
+    p->retry_ns = metrics_now_ns() + FEDERATION_RETRY_MS * 1000000ULL;
+    __atomic_sub_fetch(&connected, 1, __ATOMIC_RELAXED);
+}
+
+static void link_up(FedPeer *p) {
+    uint64_t now = metrics_now_ns();
+    if (now < p->retry_ns) return;
+    p->retry_ns = now + FEDERATION_RETRY_MS * 1000000ULL;
+    char port[16];
+    snprintf(port, sizeof(port), "%d", p->node.peer_port);
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM}, *addr;
+    if (getaddrinfo(p->node.host, port, &hints, &addr) != 0) return;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int ok = fd >= 0 && (connect(fd, addr->ai_addr, addr->ai_addrlen) == 0 || errno == EINPROGRESS);
+    freeaddrinfo(addr);
+    if (ok) {
+        struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+        int error = 0;
+        socklen_t len = sizeof(error);
+        ok = poll(&pfd, 1, FEDERATION_POLL_MS) == 1 &&
+             getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0 && error == 0;
+    }
+    if (!ok) {
+        if (fd >= 0) close(fd);
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    struct json_object *hello = json_object_new_object();
+    json_object_object_add(hello, "type", json_object_new_string("PEER_HELLO"));
+    json_object_object_add(hello, "node", json_object_new_string(peers[self_node].node.name));
+    size_t n;
+    char *line = json_line(hello, &n);
+    json_object_put(hello);
+    if (!line || write_all(fd, line, n) != 0) {
+        free(line);
+        close(fd);
+        return;
+    }
+    free(line);
+    p->fd = fd;
+    __atomic_add_fetch(&connected, 1, __ATOMIC_RELAXED);
+    printf("Federation: linked to %s at %s:%d\n", p->node.name, p->node.host, p->node.peer_port);
+}
+
+/* ---- survivors ---- */
+
+// Queues s for the region that owns its cell, as if it had just arrived.
+static void adopt_survivor(const Survivor *from) {
+    time_t t = time(NULL);
+    struct tm now;
+    localtime_r(&t, &now);
+    Coord at = from->coord;
+    char info[sizeof(from->info)];
+    memcpy(info, from->info, sizeof(info));
+    Survivor *s = create_survivor(&at, info, &now);
+    RegionMsg *m = s ? region_msg_new(REGION_MSG_SURVIVOR, NULL) : NULL;
+    if (!m) {
+        free(s);
+        return;
+    }
+    s->need = from->need;
+    s->transfers = from->transfers;
+    s->discovered_ns = from->discovered_ns;  // latency metrics span the whole wait
+    m->survivor = s;
+    region_post(region_at(at.x, at.y), m);
+}
+
+// Sends what region dispatch queued for p, and takes back the survivors
+// of anything that cannot go.
+static void flush_outbox(FedPeer *p) {
+    LOCK(&p->lock);
+    FedMsg *m = p->outbox;
+    p->outbox = p->outbox_tail = NULL;
+    UNLOCK(&p->lock);
+    while (m) {
+        FedMsg *next = m->next;
+        if (p->fd >= 0 && write_all(p->fd, m->line, strlen(m->line)) == 0) {
+            __atomic_add_fetch(&sent, 1, __ATOMIC_RELAXED);
+        } else {
+            link_down(p);
+            adopt_survivor(&m->survivor);
+        }
+        free(m->line);
+        free(m);
+        m = next;
+    }
+}
+
+// Hands s over to node. Region dispatch calls this after taking s off the
+// map and out of its queue; s can be freed as soon as it returns.
+void federation_transfer(int node, const Survivor *s) {
+    uint64_t now = metrics_now_ns();
+    struct json_object *msg = json_object_new_object();
+    json_object_object_add(msg, "type", json_object_new_string("PEER_SURVIVOR"));
+    json_object_object_add(msg, "node", json_object_new_string(peers[self_node].node.name));
+    json_object_object_add(msg, "info", json_object_new_string(s->info));
+    json_object_object_add(msg, "x", json_object_new_int(s->coord.x));
+    json_object_object_add(msg, "y", json_object_new_int(s->coord.y));
+    json_object_object_add(msg, "need", json_object_new_string(payload_name(s->need)));
+    json_object_object_add(msg, "waited_ms", json_object_new_int64((int64_t)((now - s->discovered_ns) / 1000000)));
+    json_object_object_add(msg, "transfers", json_object_new_int(s->transfers + 1));
+    size_t len;
+    FedMsg *m = calloc(1, sizeof(FedMsg));
+    if (m) m->line = json_line(msg, &len);
+    json_object_put(msg);
+    if (m) m->survivor = *s;
+    if (!m || !m->line) {
+        perror("Failed to queue survivor for a peer");
+        if (m) adopt_survivor(&m->survivor);
+        free(m);
+        return;
+    }
+    m->survivor.transfers++;
+    printf("Federation: handing survivor %s at (%d,%d) to %s\n", s->info, s->coord.x, s->coord.y,
+           peers[node].node.name);
+    FedPeer *p = &peers[node];
+    LOCK(&p->lock);
+    if (p->outbox_tail) p->outbox_tail->next = m;
+    else p->outbox = m;
+    p->outbox_tail = m;
+    UNLOCK(&p->lock);
+}
+
+// The peer whose summarised idle drone would serve s soonest, if s has
+// waited long enough here for one; -1 otherwise. That drone is taken out of
+// the summary so the same pass does not send it a second survivor.
+int federation_offer(const Survivor *s) {
+    if (self_node < 0 || s->transfers >= FEDERATION_MAX_TRANSFERS) return -1;
+    uint64_t now = metrics_now_ns();
+    if (now - s->discovered_ns < FEDERATION_OFFER_NS * (uint64_t)(s->transfers + 1)) return -1;
+    int best = -1, best_drone = -1;
+    double best_score = 0;
+    const PathField *field = path_field_acquire(&map_paths, s->coord);
+    for (int i = 0; i < node_count; i++) {
+        FedPeer *p = &peers[i];
+        if (i == self_node) continue;
+        LOCK(&p->lock);
+        if (p->summary_ns && now - p->summary_ns < FEDERATION_STALE_NS) {
+            for (int k = 0; k < p->drone_count; k++) {
+                const PeerDrone *pd = &p->drones[k];
+                Drone d = {.status = IDLE, .coord = pd->coord, .home = pd->home, .has_home = 1,
+                           .payload = pd->payload, .battery = pd->battery,
+                           .battery_capacity = pd->battery_capacity, .speed = pd->speed};
+                double score = dispatch_score(&d, s, field);
+                if (score >= 0 && (best < 0 || score < best_score)) {
+                    best = i;
+                    best_drone = k;
+                    best_score = score;
+                }
+            }
+        }
+        UNLOCK(&p->lock);
+    }
+    path_field_release(&map_paths, field);
+    if (best >= 0) {
+        FedPeer *p = &peers[best];
+        LOCK(&p->lock);
+        if (best_drone < p->drone_count) p->drones[best_drone] = p->drones[--p->drone_count];
+        UNLOCK(&p->lock);
+    }
+    return best;
+}
+
+/* ---- drones ---- */
+
+// Cells from c to the nearest other node's rectangle.
+static int border_distance(Coord c) {
+    int best = -1;
+    for (int i = 0; i < node_count; i++) {
+        if (i == self_node) continue;
+        const FedNode *n = &peers[i].node;
+        int dx = c.x < n->x0 ? n->x0 - c.x : c.x >= n->x1 ? c.x - n->x1 + 1 : 0;
+        int dy = c.y < n->y0 ? n->y0 - c.y : c.y >= n->y1 ? c.y - n->y1 + 1 : 0;
+        if (best < 0 || dx + dy < best) best = dx + dy;
+    }
+    return best;
+}
+
+static char *build_summary(size_t *len) {
+    struct json_object *msg = json_object_new_object();
+    struct json_object *list = json_object_new_array();
+    int idle = 0, listed = 0;
+    uint64_t now = metrics_now_ns();
+    metrics_lock(&drones->lock, LOCK_DRONES);
+    for (Node *node = drones->head; node != NULL; node = node->next) {
+        Drone *d = (Drone *)node->data;
+        LOCK(&d->lock);
+        if (d->sock >= 0 && (d->status == IDLE || d->repositioning)) {
+            idle++;
+            Coord at = drone_position(d, now);
+            int border = border_distance(at);
+            if (listed < FEDERATION_SUMMARY_DRONES && border >= 0 && border <= FEDERATION_BORDER_CELLS) {
+                struct json_object *entry = json_object_new_object();
+                json_object_object_add(entry, "x", json_object_new_int(at.x));
+                json_object_object_add(entry, "y", json_object_new_int(at.y));
+                Coord home = d->has_home ? d->home : at;
+                json_object_object_add(entry, "home_x", json_object_new_int(home.x));
+                json_object_object_add(entry, "home_y", json_object_new_int(home.y));
+                json_object_object_add(entry, "payload", json_object_new_string(payload_name(d->payload)));
+                json_object_object_add(entry, "battery", json_object_new_int(d->battery));
+                json_object_object_add(entry, "range", json_object_new_int(d->battery_capacity));
+                json_object_object_add(entry, "speed", json_object_new_double(d->speed));
+                json_object_array_add(list, entry);
+                listed++;
+            }
+        }
+        UNLOCK(&d->lock);
+    }
+    UNLOCK(&drones->lock);
+    json_object_object_add(msg, "type", json_object_new_string("PEER_SUMMARY"));
+    json_object_object_add(msg, "node", json_object_new_string(peers[self_node].node.name));
+    json_object_object_add(msg, "idle", json_object_new_int(idle));
+    json_object_object_add(msg, "drones", list);
+    char *line = json_line(msg, len);
+    json_object_put(msg);
+    return line;
+}
+
+static int node_named(const char *name) {
+    for (int i = 0; name && i < node_count; i++) {
+        if (strcmp(peers[i].node.name, name) == 0) return i;
+    }
+    return -1;
+}
+
+static int field_int(struct json_object *obj, const char *key) {
+    return json_object_get_int(json_object_object_get(obj, key));
+}
+
+static void peer_message(struct json_object *msg) {
+    const char *type = json_object_get_string(json_object_object_get(msg, "type"));
+    int from = node_named(json_object_get_string(json_object_object_get(msg, "node")));
+    if (!type || from < 0 || from == self_node) return;
+    FedPeer *p = &peers[from];
+    if (strcmp(type, "PEER_SUMMARY") == 0) {
+        struct json_object *list = json_object_object_get(msg, "drones");
+        int n = list ? (int)json_object_array_length(list) : 0;
+        if (n > FEDERATION_SUMMARY_DRONES) n = FEDERATION_SUMMARY_DRONES;
+        LOCK(&p->lock);
+        for (int i = 0; i < n; i++) {
+            struct json_object *e = json_object_array_get_idx(list, i);
+            p->drones[i] = (PeerDrone){
+                .coord = {field_int(e, "x"), field_int(e, "y")},
+                .home = {field_int(e, "home_x"), field_int(e, "home_y")},
+                .payload = payload_parse(json_object_get_string(json_object_object_get(e, "payload"))),
+                .battery = field_int(e, "battery"),
+                .battery_capacity = field_int(e, "range"),
+                .speed = json_object_get_double(json_object_object_get(e, "speed")),
+            };
+        }
+        p->drone_count = n;
+        p->idle = field_int(msg, "idle");
+        p->summary_ns = metrics_now_ns();
+        UNLOCK(&p->lock);
+    } else if (strcmp(type, "PEER_SURVIVOR") == 0) {
+        Survivor s = {0};
+        s.coord.x = field_int(msg, "x");
+        s.coord.y = field_int(msg, "y");
+        if (!map_in_bounds(s.coord.x, s.coord.y)) return;
+        snprintf(s.info, sizeof(s.info), "%s", json_object_get_string(json_object_object_get(msg, "info")));
+        s.need = payload_parse(json_object_get_string(json_object_object_get(msg, "need")));
+        s.transfers = field_int(msg, "transfers");
+        uint64_t waited = (uint64_t)json_object_get_int64(json_object_object_get(msg, "waited_ms")) * 1000000ULL;
+        uint64_t now = metrics_now_ns();
+        s.discovered_ns = waited < now ? now - waited : now;
+        printf("Federation: survivor %s at (%d,%d) handed over by %s\n", s.info, s.coord.x, s.coord.y,
+               p->node.name);
+        adopt_survivor(&s);
+        __atomic_add_fetch(&received, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Reads what an inbound link has; returns -1 once it has closed.
+static int inbound_read(FedInbound *in) {
+    ssize_t n = recv(in->fd, in->data + in->len, sizeof(in->data) - in->len - 1, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    if (n <= 0) return -1;
+    in->len += n;
+    in->data[in->len] = '\0';
+    char *start = in->data, *newline;
+    while ((newline = memchr(start, '\n', in->data + in->len - start)) != NULL) {
+        *newline = '\0';
+        struct json_object *msg = json_tokener_parse(start);
+        if (msg) {
+            peer_message(msg);
+            json_object_put(msg);
+        }
+        start = newline + 1;
+    }
+    in->len -= start - in->data;
+    memmove(in->data, start, in->len);
+    if (in->len >= sizeof(in->data) - 1) return -1;  // a line longer than any peer sends
+    return 0;
+}
+
+static void inbound_accept() {
+    int fd;
+    while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        FedInbound *in = inbound_count < FEDERATION_MAX_NODES * 2 ? calloc(1, sizeof(FedInbound)) : NULL;
+        if (!in) {
+            close(fd);
+            continue;
+        }
+        in->fd = fd;
+        inbound[inbound_count++] = in;
+    }
+}
+
+static void *federation_main(void *arg) {
+    (void)arg;
+    uint64_t next_summary = 0;
+    while (!global_shutdown_flag) {
+        uint64_t now = metrics_now_ns();
+        for (int i = 0; i < node_count; i++) {
+            if (i == self_node) continue;
+            if (peers[i].fd < 0) link_up(&peers[i]);
+            flush_outbox(&peers[i]);
+        }
+        if (now >= next_summary) {
+            size_t len;
+            char *summary = build_summary(&len);
+            for (int i = 0; summary && i < node_count; i++) {
+                if (i != self_node && peers[i].fd >= 0 && write_all(peers[i].fd, summary, len) != 0) {
+                    link_down(&peers[i]);
+                }
+            }
+            free(summary);
+            next_summary = now + FEDERATION_SUMMARY_MS * 1000000ULL;
+        }
+
+        struct pollfd pfds[1 + FEDERATION_MAX_NODES * 2];
+        pfds[0] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+        for (int i = 0; i < inbound_count; i++) pfds[1 + i] = (struct pollfd){.fd = inbound[i]->fd, .events = POLLIN};
+        int count = inbound_count;
+        if (poll(pfds, 1 + count, FEDERATION_POLL_MS) <= 0) continue;
+        for (int i = count - 1; i >= 0; i--) {
+            if (!pfds[1 + i].revents || inbound_read(inbound[i]) == 0) continue;
+            close(inbound[i]->fd);
+            free(inbound[i]);
+            inbound[i] = inbound[--inbound_count];
+        }
+        if (pfds[0].revents) inbound_accept();
+    }
+    return NULL;
+}
+
+// Call with the regions started.
+int federation_start() {
+    if (self_node < 0) return 0;
+    listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = INADDR_ANY,
+                               .sin_port = htons(peers[self_node].node.peer_port)};
+    if (listen_fd < 0 || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, SOMAXCONN) != 0) {
+        perror("Failed to listen for federation peers");
+        if (listen_fd >= 0) close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    if (pthread_create(&fed_thread, NULL, federation_main, NULL) != 0) {
+        perror("Failed to start federation thread");
+        close(listen_fd);
+        listen_fd = -1;
+        return -1;
+    }
+    fed_running = 1;
+    return 0;
+}
+
+// Call after setting global_shutdown_flag and before stopping the regions.
+void federation_stop() {
+    if (!fed_running) return;
+    pthread_join(fed_thread, NULL);
+    fed_running = 0;
+    for (int i = 0; i < node_count; i++) {
+        if (i == self_node) continue;
+        link_down(&peers[i]);
+        // Undelivered survivors are dropped with the rest of this server's state
+        LOCK(&peers[i].lock);
+        for (FedMsg *m = peers[i].outbox, *next; m; m = next) {
+            next = m->next;
+            free(m->line);
+            free(m);
+        }
+        peers[i].outbox = peers[i].outbox_tail = NULL;
+        UNLOCK(&peers[i].lock);
+    }
+    for (int i = 0; i < inbound_count; i++) {
+        close(inbound[i]->fd);
+        free(inbound[i]);
+    }
+    inbound_count = 0;
+    close(listen_fd);
+    listen_fd = -1;
+}
+
+// Sends an idle drone over another server's rectangle there. Returns 1 if
+// it was redirected; its connection is then shut down.
+int federation_redirect(Drone *d, Coord at) {
+    if (self_node < 0) return 0;
+    int owner = federation_owner(at.x, at.y);
+    if (owner < 0 || owner == self_node) return 0;
+    const FedNode *n = &peers[owner].node;
+    LOCK(&d->lock);
+    if (d->sock < 0 || d->status != IDLE) {
+        UNLOCK(&d->lock);
+        return 0;
+    }
+    struct json_object *msg = json_object_new_object();
+    json_object_object_add(msg, "type", json_object_new_string("REDIRECT"));
+    json_object_object_add(msg, "node", json_object_new_string(n->name));
+    json_object_object_add(msg, "host", json_object_new_string(n->host));
+    json_object_object_add(msg, "port", json_object_new_int(n->port));
+    int delivered = send_json(d->sock, msg) == 0;
+    json_object_put(msg);
+    if (!delivered) {
+        // The connection is already shut down; the drone resumes here and is redirected again
+        fprintf(stderr, "Federation: REDIRECT not delivered to drone %d\n", d->id);
+    }
+    // No longer ours to dispatch; the connection task sees the shutdown as EOF
+    d->status = DISCONNECTED;
+    replicate_drone(d);
+    shutdown(d->sock, SHUT_RDWR);
+    UNLOCK(&d->lock);
+    __atomic_add_fetch(&redirects, 1, __ATOMIC_RELAXED);
+    printf("Federation: drone %d at (%d,%d) redirected to %s\n", d->id, at.x, at.y, n->name);
+    return 1;
+}
+
+long federation_sent() {
+    return __atomic_load_n(&sent, __ATOMIC_RELAXED);
+}
+
+long federation_received() {
+    return __atomic_load_n(&received, __ATOMIC_RELAXED);
+}
+
+long federation_redirects() {
+    return __atomic_load_n(&redirects, __ATOMIC_RELAXED);
+}
+
+int federation_peers_connected() {
+    return __atomic_load_n(&connected, __ATOMIC_RELAXED);
+}
@@ -1,6 +1,39 @@
 #include "headers/globals.h"
+#include "headers/metrics.h"
+#include "headers/span.h"
+
+ServerConfig config = {
+    .port = DEFAULT_SERVER_PORT,
+    .metrics_port = METRICS_PORT,
+    .headless = 0,
+    .max_drones = DEFAULT_MAX_DRONES,
+    .map_width = DEFAULT_MAP_WIDTH,
+    .map_height = DEFAULT_MAP_HEIGHT,
+    .survivor_rate = 0,
+    .region_cols = DEFAULT_REGION_COLS,
+    .region_rows = DEFAULT_REGION_ROWS,
+    .workers = 0,
+    .pin_workers = 0,
+    .acceptors = 0,
+    .backlog = DEFAULT_LISTEN_BACKLOG,
+    .update_budget = DEFAULT_UPDATE_BUDGET,
+    .dispatch_nearest = 0,
+    .tour_stops = DEFAULT_TOUR_STOPS,
+    .rebalance_moves = DEFAULT_REBALANCE_MOVES,
+    .hotspots = 0,
+    .seed = 0,
+    .scenario = NULL,
+    .obstacles = NULL,
+    .trace = NULL,
+    .spans = NULL,
+    .span_sample = SPAN_DEFAULT_SAMPLE,
+    .federation = NULL,
+    .node = NULL,
+    .replicate_port = 0,
+    .query_socket = NULL
+};
 
 Map map;
-List *survivors = NULL;
+PathCache map_paths;
 List *helpedsurvivors = NULL;
 List *drones = NULL;
\ No newline at end of file
@@ -0,0 +1,48 @@
+#ifndef ADMISSION_H
+#define ADMISSION_H
+#include <stdint.h>
+
+// Admission control for drone traffic. Load is 1.0 when either the queued
+// work (region inbox messages plus pool tasks) or the recent handler
+// latency reaches its limit. Each class of message is shed above its own
+// load level; critical messages are never shed.
+#define ADMIT_CONN_RATE 20.0                  // messages/s one connection may sustain
+#define ADMIT_CONN_BURST 40.0
+#define ADMIT_INFLIGHT_LIMIT 4096             // queued messages and tasks at load 1.0
+#define ADMIT_LATENCY_LIMIT_NS 20000000ULL    // handler latency average at load 1.0
+#define ADMIT_LATENCY_STALE_NS 1000000000ULL  // latency samples older than this are ignored
+#define ADMIT_SHED_BULK 1.0                   // STATUS_UPDATE coalesced above this load
+#define ADMIT_SHED_NORMAL 1.5                 // HEARTBEAT_RESPONSE and the rest dropped
+#define ADMIT_REFUSE_HANDSHAKE 2.0            // new sessions refused with 503
+#define ADMIT_CONN_SLACK 16                   // connections allowed beyond --max-drones
+#define ADMIT_ACCEPT_BATCH 64                 // accepts per reactor wakeup
+#define ADMIT_RETRY_MAX_S 30
+
+typedef enum {
+    ADMIT_CRITICAL,   // HANDSHAKE, RESUME, MISSION_COMPLETE
+    ADMIT_NORMAL,     // HEARTBEAT_RESPONSE, anything unrecognised
+    ADMIT_BULK        // STATUS_UPDATE: only the latest one matters
+} AdmitClass;
+
+typedef struct token_bucket {
+    double tokens;
+    uint64_t refill_ns;
+} TokenBucket;
+
+void token_bucket_init(TokenBucket *b, uint64_t now_ns);
+int token_bucket_take(TokenBucket *b, uint64_t now_ns);
+
+AdmitClass admission_class(const char *type);
+double admission_load();
+int admission_admit(AdmitClass cls, TokenBucket *b, uint64_t now_ns);
+int admission_accept_handshake();
+int admission_retry_after();
+void admission_observe(uint64_t latency_ns);
+
+void admission_count_refused();
+void admission_count_coalesced();
+void admission_count_dropped();
+long admission_refused();
+long admission_coalesced();
+long admission_dropped();
+#endif
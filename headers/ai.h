@@ -2,7 +2,17 @@
 #define AI_H
 #include "drone.h"
 #include "survivor.h"
-void *ai_controller(void *args);
-void assign_mission(Drone *drone, Coord target, const char *mission_id);
-Drone *find_closest_idle_drone(Coord target);
+#include "path.h"
+int assign_mission(Drone *drone, const Coord *stops, int count, const char *mission_id);
+int reposition_drone(Drone *drone, Coord to);
+int send_mission(Drone *drone);
+// Dispatch keeps this much range in hand after the flight out and home
+#define DISPATCH_RESERVE_CELLS 5
+// Survivors this close to a dispatched one may join its drone's tour
+#define TOUR_RADIUS_CELLS 8
+
+int plan_tour(Coord start, const Coord *stops, int count, int *order);
+
+double dispatch_score(const Drone *d, const Survivor *s, const PathField *field);
+Drone *find_best_idle_drone(const Survivor *s);
 #endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+#include <stdint.h>
+#include <stddef.h>
+#include "survivor.h"
+
+#define ARCHIVE_DIR "archive"
+#define ARCHIVE_SEGMENT_RECORDS 65536  // records per segment file before rotation
+#define HELPED_WINDOW 64               // recent helped survivors kept in RAM
+
+// One segment's worth of columns, pointing straight into the mmap'd file.
+typedef struct archive_batch {
+    unsigned segment;
+    size_t count;
+    const int32_t *x;
+    const int32_t *y;
+    const int64_t *discovered;  // epoch seconds
+    const int64_t *helped;      // epoch seconds
+    const int32_t *drone_id;    // -1 if unknown
+} ArchiveBatch;
+
+// Return non-zero from the callback to stop the scan early.
+typedef int (*archive_scan_fn)(const ArchiveBatch *batch, void *ctx);
+
+int archive_open(const char *dir);
+void archive_close();
+// -1 if the rescue could not be archived; it is counted in archive_skipped()
+// and still kept in the recent window.
+int archive_helped_survivor(const Survivor *s, int drone_id);
+uint64_t archive_skipped();
+long archive_scan(const char *dir, archive_scan_fn fn, void *ctx);
+#endif
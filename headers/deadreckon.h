@@ -0,0 +1,15 @@
+#ifndef DEADRECKON_H
+#define DEADRECKON_H
+#include <stdint.h>
+#include "coord.h"
+
+// Drones fly the grid x first, then y, one cell at a time. Given where a
+// drone was, where it is heading and its speed, both the server and the
+// drone can compute where it should be now; the drone only reports when
+// the two drift apart, or when its status_update_interval runs out.
+#define DEADRECKON_DEFAULT_SPEED 2.0       // cells per second when the handshake gives none
+#define DEADRECKON_DEVIATION_CELLS 1       // report once off the prediction by more than this
+
+Coord deadreckon_position(Coord from, Coord to, double speed, uint64_t elapsed_ns);
+int deadreckon_deviation(Coord a, Coord b);
+#endif
@@ -2,8 +2,13 @@
 #define DRONE_H
 #include "coord.h"
 #include <time.h>
+#include <stdint.h>
 #include <pthread.h>
 #include "list.h"
+#include "payload.h"
+
+#define DRONE_TOUR_MAX 8  // waypoints one mission can carry
+#define DRONE_SESSION_BYTES 16  // random bytes in a session token, sent as hex
 
 typedef enum {
     IDLE,
@@ -13,7 +18,6 @@ typedef enum {
 
 typedef struct drone {
     int id;
-    pthread_t thread_id; // Used in Phase 1
     int status;
     Coord coord;
     Coord target;
@@ -21,12 +25,32 @@ typedef struct drone {
     pthread_mutex_t lock;
     int sock; // Socket descriptor for client communication
     char mission_id[32]; // Store current mission ID
+    char session[DRONE_SESSION_BYTES * 2 + 1];  // token from the last HANDSHAKE_ACK, for RESUME
+    int region;          // owning region id, -1 until joined
+    Coord anchor;        // last known position; coord is predicted from it while on a mission
+    uint64_t anchor_ns;  // metrics_now_ns() when anchor was taken
+    double speed;        // cells per second, 0 for drones that report every move
+    double status_interval;     // seconds, as last pushed to the drone
+    double heartbeat_interval;
+    // Capabilities from the HANDSHAKE and the latest STATUS_UPDATE
+    double max_speed;           // as advertised; ETAs use speed
+    int battery_capacity;       // cells flown on a full charge, 0 if unknown
+    int battery;                // percent
+    double reported_speed;
+    Payload payload;
+    Coord home;                 // where the drone returns to recharge
+    int has_home;
+    int capacity;               // survivors served per mission
+    // Current mission: target is tour[tour_stop]
+    Coord tour[DRONE_TOUR_MAX];
+    int tour_len;
+    int tour_stop;
+    int repositioning;          // flying to wait elsewhere; still free for dispatch
+    uint64_t repositioned_ns;   // last sent to reposition, 0 if never
 } Drone;
 
 extern List *drones;
-extern Drone *drone_fleet;
-extern int num_drones;
-void initialize_drones();
-void *drone_behavior(void *arg);
-void cleanup_drones();
+Coord drone_position(const Drone *d, uint64_t now_ns);
+void drone_reanchor(Drone *d, Coord at, uint64_t now_ns);
+int drone_next_stop(Drone *d);
 #endif
\ No newline at end of file
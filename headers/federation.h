@@ -0,0 +1,56 @@
+#ifndef FEDERATION_H
+#define FEDERATION_H
+#include <stdint.h>
+#include "coord.h"
+#include "drone.h"
+#include "survivor.h"
+
+// Several server processes can share one map (--federation file --node
+// name), each authoritative for a rectangle of it and listening on its own
+// drone port. Servers keep a TCP link to every peer over which they send
+// summaries of their idle drones near the borders, and hand over survivors
+// that none of their own drones can serve. Idle drones over another
+// server's rectangle are sent a REDIRECT to it.
+#define FEDERATION_MAX_NODES 16
+#define FEDERATION_SUMMARY_MS 500
+#define FEDERATION_SUMMARY_DRONES 64           // idle drones per summary
+#define FEDERATION_BORDER_CELLS 20             // only idle drones this close to a border are summarised
+#define FEDERATION_STALE_NS 3000000000ULL      // summaries older than this are ignored
+#define FEDERATION_OFFER_NS 2000000000ULL      // survivor wait before it is offered to a peer
+#define FEDERATION_MAX_TRANSFERS 3             // a survivor changes server at most this often
+#define FEDERATION_OFFERS_PER_PASS 16          // survivors one region dispatch pass hands over
+#define FEDERATION_RETRY_MS 1000               // peer reconnect interval
+#define FEDERATION_POLL_MS 100
+#define FEDERATION_BUFFER_SIZE 65536
+
+typedef struct peer_drone {
+    Coord coord;
+    Coord home;
+    Payload payload;
+    int battery;
+    int battery_capacity;
+    double speed;
+} PeerDrone;
+
+typedef struct fed_node {
+    char name[32];
+    char host[64];
+    int port;              // drone listener
+    int peer_port;         // server-to-server listener
+    int x0, y0, x1, y1;    // cells [x0, x1) x [y0, y1)
+} FedNode;
+
+int federation_load(const char *path, const char *self);
+int federation_start();
+void federation_stop();
+int federation_active();
+int federation_owner(int x, int y);
+int federation_local(int x, int y);
+int federation_offer(const Survivor *s);
+void federation_transfer(int node, const Survivor *s);
+int federation_redirect(Drone *d, Coord at);
+long federation_sent();
+long federation_received();
+long federation_redirects();
+int federation_peers_connected();
+#endif
@@ -6,6 +6,48 @@
 #include "list.h"
 #include "coord.h"
 
+#define DEFAULT_SERVER_PORT 8080
+#define DEFAULT_MAX_DRONES 100
+#define DEFAULT_MAP_WIDTH 40
+#define DEFAULT_MAP_HEIGHT 30
+#define DEFAULT_REGION_COLS 2
+#define DEFAULT_REGION_ROWS 2
+#define DEFAULT_UPDATE_BUDGET 1000  // STATUS_UPDATE/s the report intervals are sized for
+#define DEFAULT_TOUR_STOPS 4        // survivors per mission, capped by each drone's capacity
+#define DEFAULT_REBALANCE_MOVES 2   // idle drones repositioned per rebalancing pass
+#define DEFAULT_LISTEN_BACKLOG 4096 // pending connections per listener, capped by net.core.somaxconn
+
+// Runtime settings, filled from the command line in controller.c
+typedef struct server_config {
+    int port;
+    int metrics_port;
+    int headless;          // no SDL window, for load tests and servers without a display
+    int max_drones;
+    int map_width, map_height;
+    double survivor_rate;  // survivors generated per second, 0 = about one every 3s
+    int region_cols, region_rows;
+    int workers;           // task pool size, 0 = one per online CPU
+    int pin_workers;       // pin pool workers to CPUs
+    int acceptors;         // threads accepting on their own SO_REUSEPORT listener, 0 = the reactor accepts
+    int backlog;           // listen() backlog of each drone listener
+    double update_budget;  // planned inbound STATUS_UPDATE/s across all drones, 0 = unlimited
+    int dispatch_nearest;  // rank capable drones by distance instead of ETA
+    int tour_stops;        // most survivors batched into one mission, 1 = one at a time
+    int rebalance_moves;   // cap on repositioning per pass, 0 = never reposition
+    int hotspots;          // survivors cluster around this many moving hotspots, 0 = uniform
+    unsigned int seed;     // survivor workload stream, 0 = seeded from the clock
+    const char *scenario;  // survivor workload file; NULL = --survivor-rate and --hotspots
+    const char *obstacles; // no-fly areas file, reloaded on SIGHUP; NULL = open sky
+    const char *trace;     // record all drone traffic to this file; NULL = off
+    const char *spans;     // Chrome trace of sampled latency spans; NULL = off
+    int span_sample;       // record one in this many root spans and survivors
+    const char *federation; // node list of a multi-server federation; NULL = single server
+    const char *node;      // this server's name in the federation file
+    int replicate_port;    // stream state changes to read replicas on this port; 0 = off
+    const char *query_socket; // UNIX socket answering spatial queries; NULL = off
+} ServerConfig;
+
+extern ServerConfig config;
 extern Map map;
-extern List *survivors, *helpedsurvivors, *drones;
+extern List *helpedsurvivors, *drones;
 #endif
\ No newline at end of file
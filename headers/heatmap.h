@@ -0,0 +1,29 @@
+#ifndef HEATMAP_H
+#define HEATMAP_H
+#include <stdint.h>
+#include "coord.h"
+
+// Survivor arrivals per heat tile, decayed exponentially so recent demand
+// counts most. Heat tiles are much finer than the map's storage tiles.
+#define HEATMAP_TILE_CELLS 8
+#define HEATMAP_HALF_LIFE_S 60.0
+#define HEATMAP_MIN_HEAT 2.0                   // total heat below which nothing is rebalanced
+
+// The rebalancing pass moves idle drones towards tiles whose share of the
+// heat asks for more idle drones than they have.
+#define REBALANCE_MS 2000
+#define REBALANCE_MIN_DEFICIT 1.0              // drones a tile must be short before one is sent
+#define REBALANCE_COOLDOWN_NS 15000000000ULL   // least time between two moves of one drone
+
+typedef struct heat_tile {
+    double heat;
+    uint64_t at_ns;        // when heat was last decayed
+} HeatTile;
+
+int heatmap_init(int width, int height);
+void heatmap_free();
+void heatmap_record(Coord c, uint64_t now_ns);
+double heatmap_total(uint64_t now_ns);
+void rebalance_start();
+long rebalance_moves();
+#endif
@@ -2,12 +2,14 @@
 #define LIST_H
 #include <time.h>
 #include <pthread.h>
+#include <stddef.h>
 
 typedef struct node {
     struct node *prev;
     struct node *next;
     char occupied;
-    char data[];
+    // Payloads can hold mutexes and atomics, which must be naturally aligned
+    _Alignas(max_align_t) char data[];
 } Node;
 
 typedef struct list {
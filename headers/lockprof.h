@@ -0,0 +1,31 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+// Lock contention profiler, swapped in with `make LOCK_PROFILE=1` (after a
+// `make clean`). LOCK()/UNLOCK() are plain pthread calls otherwise. In a
+// profiling build each acquisition records its wait and hold time against
+// both the mutex (by address) and the call site, and lockprof_report()
+// ranks them by total wait. A mutex is named after the expression at the
+// first site that took it; one freed and reused at the same address keeps
+// accumulating under that name.
+#define LOCKPROF_SITES 1024        // distinct call sites, power of two
+#define LOCKPROF_LOCKS 16384       // distinct mutexes, power of two
+#define LOCKPROF_BUCKETS 32        // wait histogram, bucket b holds waits < 2^b ns
+#define LOCKPROF_REPORT_ROWS 20
+#define LOCKPROF_REPORT_FILE "lock_profile.txt"
+
+#ifdef LOCK_PROFILE
+#define LOCK(m) lockprof_lock((m), #m, __FILE__, __LINE__)
+#define UNLOCK(m) lockprof_unlock(m)
+#else
+#define LOCK(m) pthread_mutex_lock(m)
+#define UNLOCK(m) pthread_mutex_unlock(m)
+#endif
+
+uint64_t lockprof_lock(pthread_mutex_t *m, const char *name, const char *file, int line);
+void lockprof_unlock(pthread_mutex_t *m);
+int lockprof_report(FILE *out);
+#endif
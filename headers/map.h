@@ -1,20 +1,44 @@
 #ifndef MAP_H
 #define MAP_H
+#include <pthread.h>
 #include "survivor.h"
 #include "list.h"
 #include "coord.h"
+#include "path.h"
 
-typedef struct mapcell {
-    Coord coord;
-    List *survivors;
-} MapCell;
+// The map is split into square tiles. A tile, and the survivor list of each
+// cell in it, is only allocated once a survivor lands there, so memory
+// follows occupancy rather than area. Cells hold Survivor pointers; the
+// survivors themselves belong to their region.
+#define MAP_TILE_SHIFT 6
+#define MAP_TILE_SIZE (1 << MAP_TILE_SHIFT)  // cells per tile side
+#define MAP_CELL_CAPACITY 10                 // survivors per cell list
+#define MAP_LOCK_STRIPES 256                 // tile locks, shared by tile index
+
+typedef struct maptile {
+    int live_cells;  // cells with a survivor list
+    List *cells[MAP_TILE_SIZE * MAP_TILE_SIZE];
+} MapTile;
 
 typedef struct map {
     int height, width;
-    MapCell **cells;
+    int tiles_x, tiles_y;
+    MapTile **tiles;  // tiles_x * tiles_y, NULL until first survivor
+    long live_tiles;
+    pthread_mutex_t stripes[MAP_LOCK_STRIPES];
+    ObstacleGrid obstacles;  // no-fly cells, from --obstacles
 } Map;
 
 extern Map map;
+extern PathCache map_paths;  // distance fields over map.obstacles
 void init_map(int height, int width);
 void freemap();
-#endif
\ No newline at end of file
+int map_in_bounds(int x, int y);
+void map_lock_cell(int x, int y);
+void map_unlock_cell(int x, int y);
+// Caller holds the cell lock. Returns NULL for an empty cell unless create is set.
+List *map_cell_survivors(int x, int y, int create);
+int map_add_survivor(Survivor *s);
+int map_remove_survivor(const Survivor *s);
+Survivor *map_claim_survivor(int x, int y, int drone_id, Payload carried);
+#endif
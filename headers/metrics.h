@@ -0,0 +1,54 @@
+#ifndef METRICS_H
+#define METRICS_H
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define METRICS_PORT 9100
+
+typedef enum {
+    MSG_HANDSHAKE,
+    MSG_STATUS_UPDATE,
+    MSG_MISSION_COMPLETE,
+    MSG_HEARTBEAT_RESPONSE,
+    MSG_RESUME,
+    MSG_INVALID,
+    MSG_TYPE_COUNT
+} MetricMsgType;
+
+typedef enum {
+    LOCK_DRONES,
+    LOCK_SURVIVORS,
+    LOCK_COUNT
+} MetricLock;
+
+// Histograms are indexed as HIST_HANDLER + message type, HIST_LOCK_WAIT + lock.
+typedef enum {
+    HIST_HANDLER = 0,
+    HIST_LOCK_WAIT = HIST_HANDLER + MSG_TYPE_COUNT,
+    HIST_DISCOVERY_TO_ASSIGN = HIST_LOCK_WAIT + LOCK_COUNT,
+    HIST_ASSIGN_TO_RESCUE,
+    HIST_DISCOVERY_TO_RESCUE,
+    HIST_COUNT
+} MetricHist;
+
+// Gauges are sampled when the endpoint is scraped.
+typedef double (*metrics_gauge_fn)(void);
+
+uint64_t metrics_now_ns();
+MetricMsgType metrics_msg_type(const char *type);
+void metrics_count_message(MetricMsgType type);
+void metrics_observe(MetricHist hist, uint64_t value_ns);
+// Call sites go through metrics_lock() so a LOCK_PROFILE build attributes
+// each acquisition to them rather than to metrics.c.
+#define metrics_lock(lock, which) metrics_lock_at((lock), (which), __FILE__, __LINE__)
+void metrics_lock_at(pthread_mutex_t *lock, MetricLock which, const char *file, int line);
+void metrics_register_gauge(const char *name, const char *help, metrics_gauge_fn fn);
+void metrics_connection_opened();
+void metrics_connection_closed();
+uint64_t metrics_hist_quantile(MetricHist hist, double q);
+uint64_t metrics_message_total(MetricMsgType type);
+char *metrics_render(size_t *len);
+char *metrics_render_raw(size_t *len);
+void *metrics_http_server(void *args);
+#endif
@@ -0,0 +1,92 @@
+#ifndef PATH_H
+#define PATH_H
+#include <stdint.h>
+#include <pthread.h>
+#include "coord.h"
+
+struct json_object;
+
+// No-fly areas, as inclusive rectangles of cells. Drones fly four ways, one
+// cell at a time, and never through a blocked cell; the target cell itself
+// may be blocked (a survivor inside a building).
+typedef struct rect {
+    Coord from, to;
+} Rect;
+
+// Grids are stored with a blocked border one cell wide, so a search never
+// bounds-checks a neighbour: cell (x, y) is at (y + 1) * (width + 2) + x + 1.
+#define PATH_INDEX(width, x, y) ((size_t)((y) + 1) * ((width) + 2) + (x) + 1)
+#define PATH_CELLS(width, height) ((size_t)((width) + 2) * ((height) + 2))
+
+typedef struct obstacle_grid {
+    int width, height;
+    unsigned char *blocked;   // PATH_CELLS, NULL while there are no obstacles
+    Rect *areas;              // as loaded, to hand on to drones
+    int count;
+    unsigned long version;    // bumped on every change; older distance fields are rebuilt
+    pthread_rwlock_t lock;
+} ObstacleGrid;
+
+// A distance field holds, for every cell, the cells left to fly to its
+// target (BFS over the open cells). It serves both dispatch, where one field
+// gives the true cost from every drone to a survivor, and routing, where a
+// drone steps to the neighbour one cell closer. Only the cells beyond
+// PATH_UNREACHABLE - 1 of the target are treated as unreachable.
+#define PATH_UNREACHABLE 0xFFFF
+#define PATH_CACHE_BYTES (64u << 20)   // memory given to cached fields by default
+#define PATH_CACHE_MIN_FIELDS 8
+#define PATH_CACHE_MAX_FIELDS 1024
+// Cells of BFS per second the server spends on predictions (path_position)
+// for the map's cache. A 40x30 map never reaches it; on a 2000x2000 map it
+// is about five builds a second.
+#define PATH_PREDICT_CELLS_PER_S 20000000.0
+
+typedef struct path_field {
+    Coord target;
+    int width, height;
+    unsigned long version;    // of the obstacles it was built from
+    uint16_t *dist;           // PATH_CELLS of width and height
+    size_t cells;             // allocated length of dist
+    int refs;
+    int ready;
+    uint64_t used;            // LRU stamp
+    int owned;                // built for one caller outside the cache, freed on release
+} PathField;
+
+typedef struct path_cache {
+    ObstacleGrid *grid;
+    PathField *fields;
+    int count;
+    uint64_t clock;
+    long builds, hits;
+    double predict_cells_per_s;  // BFS budget of path_position, 0 = unlimited
+    double predict_tokens;       // cells it may still build
+    uint64_t predict_refill_ns;
+    pthread_mutex_t lock;
+    pthread_cond_t built;
+} PathCache;
+
+void obstacles_init(ObstacleGrid *g, int width, int height);
+void obstacles_free(ObstacleGrid *g);
+int obstacles_set(ObstacleGrid *g, const Rect *areas, int count);
+int obstacles_load(ObstacleGrid *g, const char *path);
+int obstacles_active(const ObstacleGrid *g);
+int obstacles_blocked(ObstacleGrid *g, int x, int y);
+struct json_object *obstacles_json(ObstacleGrid *g);
+int obstacles_from_json(ObstacleGrid *g, struct json_object *obj);
+
+// count 0 sizes the cache to PATH_CACHE_BYTES for the grid's current size.
+int path_cache_init(PathCache *c, ObstacleGrid *g, int count);
+void path_cache_free(PathCache *c);
+// NULL when there are no obstacles, the target is off the grid, or memory
+// runs out. With every cached field in use, the caller gets a field of its
+// own, built outside the cache and freed on release.
+const PathField *path_field_acquire(PathCache *c, Coord target);
+void path_field_release(PathCache *c, const PathField *f);
+unsigned long path_field_fill(ObstacleGrid *g, Coord target, uint16_t *dist);
+
+int path_distance(const PathField *f, Coord from, Coord to);
+Coord path_step(const PathField *f, Coord at);
+Coord path_next(PathCache *c, Coord at, Coord to);
+Coord path_position(PathCache *c, Coord from, Coord to, double speed, uint64_t elapsed_ns);
+#endif
@@ -0,0 +1,17 @@
+#ifndef PAYLOAD_H
+#define PAYLOAD_H
+
+// What a drone carries and what a survivor needs. A drone carrying
+// PAYLOAD_ANY, or a payload the server does not know, serves every need.
+typedef enum {
+    PAYLOAD_ANY,
+    PAYLOAD_MEDICAL,
+    PAYLOAD_FOOD,
+    PAYLOAD_WATER,
+    PAYLOAD_COUNT
+} Payload;
+
+Payload payload_parse(const char *name);
+const char *payload_name(Payload payload);
+int payload_serves(Payload carried, Payload need);
+#endif
@@ -0,0 +1,99 @@
+#ifndef QUERY_H
+#define QUERY_H
+#include <stdint.h>
+#include "coord.h"
+#include "payload.h"
+#include "survivor.h"
+
+// Spatial queries over drones and waiting survivors (--query-socket path).
+// A builder thread copies the world into an immutable snapshot, indexed by
+// a grid of QUERY_BUCKET_SIZE cell buckets, and publishes it; queries run
+// against the latest snapshot without taking any lock the regions or the
+// connection tasks use. Snapshots are rebuilt every QUERY_SNAPSHOT_MS while
+// a client is connected, so answers are at most that old plus a build.
+#define QUERY_SNAPSHOT_MS 200
+#define QUERY_FRESH_WAIT_MS 2000   // longest a request waits for a stale snapshot's rebuild
+#define QUERY_BUCKET_SHIFT 4
+#define QUERY_BUCKET_SIZE (1 << QUERY_BUCKET_SHIFT)  // cells per bucket side
+#define QUERY_DEFAULT_LIMIT 100                      // results per answer unless asked
+#define QUERY_MAX_LIMIT 10000
+#define QUERY_MAX_CLIENTS 64
+#define QUERY_LINE_MAX 4096                          // longest request line
+
+typedef enum {
+    QUERY_DRONES,
+    QUERY_SURVIVORS
+} QueryTarget;
+
+typedef enum {
+    QUERY_RADIUS,    // within r cells of (x, y)
+    QUERY_BBOX,      // in [x0, x1) x [y0, y1)
+    QUERY_NEAREST    // the limit closest to (x, y), nearest first
+} QueryShape;
+
+typedef struct query_request {
+    QueryTarget target;
+    QueryShape shape;
+    int x, y, r;
+    int x0, y0, x1, y1;
+    unsigned status_mask;  // bit DroneStatus or SurvivorState; 0 = any
+    int limit;
+} QueryRequest;
+
+typedef struct query_drone {
+    int id;
+    Coord coord;
+    int status;            // DroneStatus
+    Payload payload;
+    int battery;
+} QueryDrone;
+
+typedef struct query_survivor {
+    uint64_t id;
+    Coord coord;
+    Payload need;
+    SurvivorState state;
+    int drone;             // assigned drone, -1 if open
+    char info[25];
+} QuerySurvivor;
+
+// Where an entity sits in the index: bucket order, with what filters need
+typedef struct query_point {
+    int32_t x, y;
+    uint32_t item;         // index into the snapshot's drones or survivors
+    uint32_t status;
+} QueryPoint;
+
+typedef struct query_index {
+    int count;
+    QueryPoint *points;    // count, sorted by bucket
+    uint32_t *start;       // cols * rows + 1 offsets into points
+} QueryIndex;
+
+typedef struct query_snapshot {
+    int refs;
+    uint64_t seq;          // builds since start
+    uint64_t built_ns;     // metrics_now_ns() when the copy was taken
+    int width, height;
+    int cols, rows;        // buckets
+    QueryDrone *drones;
+    QuerySurvivor *survivors;
+    QueryIndex drone_index;
+    QueryIndex survivor_index;
+} QuerySnapshot;
+
+typedef struct query_hit {
+    uint32_t item;
+    int64_t distance2;     // squared distance to (x, y); 0 for bounding boxes
+} QueryHit;
+
+QuerySnapshot *query_snapshot_new(int width, int height, QueryDrone *drones, int drone_count,
+                                  QuerySurvivor *survivors, int survivor_count);
+void query_snapshot_free(QuerySnapshot *s);
+int query_run(const QuerySnapshot *s, const QueryRequest *req, QueryHit *hits);
+int query_start(const char *path);
+void query_stop();
+long query_requests();
+double query_snapshot_age();
+double query_build_seconds();
+#endif
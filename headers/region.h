@@ -0,0 +1,85 @@
+#ifndef REGION_H
+#define REGION_H
+#include <stdint.h>
+#include <pthread.h>
+#include "drone.h"
+#include "survivor.h"
+#include "list.h"
+
+// The map is split into a grid of rectangular regions. At most one pool
+// worker at a time drains a region's MPSC inbox, so only that drain task
+// mutates the region's survivors and drone membership.
+#define REGION_TICK_MS 100                         // dispatch cadence when idle
+#define REGION_DRAIN_BATCH 64                      // messages per drain task before yielding
+#define REGION_REDISPATCH_NS 10000000000ULL        // re-offer a mission after 10s
+#define REGION_SURVIVOR_CAPACITY 1000
+#define REGION_ADAPT_MS 1000                       // report interval review cadence
+
+// Per-drone STATUS_UPDATE intervals, in seconds, before budget scaling
+#define REPORT_STATUS_DEFAULT_S 5.0    // until the first review
+#define REPORT_HEARTBEAT_S 10.0        // also the longest status interval
+#define REPORT_MIN_S 0.5               // drones about to arrive
+#define REPORT_IDLE_NEAR_S 2.0         // idle with an open survivor nearby
+#define REPORT_NEAR_CELLS 10
+#define REPORT_CHANGE_FACTOR 2.0       // push only intervals halved or doubled
+
+typedef enum {
+    REGION_MSG_JOIN,              // newly registered drone
+    REGION_MSG_HANDOFF,           // drone crossed into this region
+    REGION_MSG_STATUS,
+    REGION_MSG_MISSION_COMPLETE,
+    REGION_MSG_HEARTBEAT,
+    REGION_MSG_SURVIVOR,          // new survivor discovered in this region
+    REGION_MSG_RESCUED            // survivor of this region claimed by another one
+} RegionMsgType;
+
+typedef struct region_msg {
+    struct region_msg *next;
+    RegionMsgType type;
+    Drone *drone;
+    Coord coord;           // reported position (STATUS, HANDOFF, MISSION_COMPLETE), -1 if unknown
+    int status;            // reported DroneStatus (STATUS)
+    int predicted;         // HANDOFF of a dead-reckoned position: nothing to rescue yet
+    int battery;           // reported percent (STATUS), -1 if not given
+    double speed;          // reported speed (STATUS), -1 if not given
+    int success;           // MISSION_COMPLETE
+    int metric_type;       // MetricMsgType for handler latency, -1 if none
+    uint64_t received_ns;
+    uint64_t trace_id;     // span trace of the message or survivor, 0 if not sampled
+    Survivor *survivor;    // SURVIVOR, RESCUED
+} RegionMsg;
+
+typedef struct region {
+    int id;
+    int x0, y0, x1, y1;    // cells [x0, x1) x [y0, y1)
+
+    // Vyukov intrusive MPSC queue: producers swap head, the owner pops tail
+    RegionMsg *head;
+    RegionMsg *tail;
+    RegionMsg stub;
+    int depth;
+    int scheduled;         // a drain task is queued or running
+
+    List *survivors;       // Survivor* waiting here, owned; only the drain task writes
+    List *drones;          // Drone* of member drones; only the drain task writes
+    uint64_t last_dispatch_ns;
+    uint64_t last_adapt_ns;
+    uint64_t desired_mrate;  // members' wanted STATUS_UPDATE/s x 1000, before scaling
+} Region;
+
+extern Region *regions;
+extern int region_count;
+
+int regions_start(int cols, int rows);
+void regions_stop();
+Region *region_at(int x, int y);
+RegionMsg *region_msg_new(RegionMsgType type, Drone *drone);
+void region_post(Region *r, RegionMsg *m);
+void region_post_batch(Region *r, RegionMsg *first, RegionMsg *last, int count);
+void region_post_drone(Drone *d, RegionMsg *m);
+long regions_waiting_survivors();
+long regions_queued_messages();
+double regions_position_error();
+double regions_desired_report_rate();
+double regions_report_scale();
+#endif
@@ -0,0 +1,81 @@
+#ifndef REPLICATION_H
+#define REPLICATION_H
+#include <stdint.h>
+#include "drone.h"
+#include "survivor.h"
+
+// State replication to read-only replicas (--replicate port, edcs_replica).
+// Every change to a drone or a waiting survivor appends a full copy of that
+// entity to a bounded lock-free log; a replication thread streams the log to
+// each connected replica after a snapshot of the world. Records are upserts,
+// so a replica that applies the log after its snapshot converges on the
+// primary's state whatever the two overlap by. A replica that falls more
+// than REPL_REPLICA_BUFFER behind is disconnected, and a record that finds
+// the log full is dropped and every replica resynced, so neither ever slows
+// the threads that make the changes.
+//
+// The stream is a ReplHeader and then ReplRecords, in host byte order.
+#define REPL_MAGIC "EDCSREP1"
+#define REPL_VERSION 1
+#define REPL_LOG_RECORDS 65536                  // power of two
+#define REPL_REPLICA_BUFFER (8u << 20)          // bytes queued for one replica
+#define REPL_MAX_REPLICAS 16
+#define REPL_HEARTBEAT_MS 100
+#define REPL_IDLE_US 1000                       // replication thread sleep when idle
+#define REPL_DEFAULT_PORT 8090
+
+typedef enum {
+    REPL_DRONE,
+    REPL_SURVIVOR,
+    REPL_SURVIVOR_REMOVED,
+    REPL_HEARTBEAT,
+    REPL_SNAPSHOT_BEGIN,     // the replica drops its world
+    REPL_SNAPSHOT_END
+} ReplKind;
+
+typedef struct repl_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+} ReplHeader;
+
+typedef struct repl_drone {
+    int32_t id;
+    int32_t x, y;
+    int32_t status;          // DroneStatus
+    int32_t payload;         // Payload
+    int32_t battery;
+    int32_t target_x, target_y;
+    int32_t stops;           // tour stops left, the target included
+    int32_t repositioning;
+} ReplDrone;
+
+typedef struct repl_survivor {
+    uint64_t id;
+    int32_t x, y;
+    int32_t need;            // Payload
+    int32_t state;           // SurvivorState
+    int32_t drone;           // assigned or rescuing drone, -1 if none
+    char info[28];
+} ReplSurvivor;
+
+typedef struct repl_record {
+    uint32_t kind;           // ReplKind
+    uint32_t reserved;
+    uint64_t seq;            // position in the primary's log; heartbeats carry the next one
+    int64_t unix_ns;         // primary wall clock when the change was logged
+    union {
+        ReplDrone drone;
+        ReplSurvivor survivor;
+    };
+} ReplRecord;
+
+int replication_start(int port);
+void replication_stop();
+void replicate_drone(const Drone *d);
+void replicate_survivor(const Survivor *s);
+void replicate_survivor_removed(const Survivor *s);
+uint64_t replication_records();
+uint64_t replication_dropped();
+int replication_replicas();
+#endif
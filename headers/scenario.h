@@ -0,0 +1,76 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+#include "coord.h"
+#include "payload.h"
+#include "path.h"
+
+// Seeded survivor workload. A scenario is a list of phases, each with an
+// arrival process, a rate that may ramp linearly over the phase, and a
+// spatial distribution. Time advances in whole ticks and every draw comes
+// from one rand_r() stream, so a seed and a file replay the same survivors
+// in the same ticks however late the ticks actually run.
+#define SCENARIO_MAX_PHASES 64
+#define SCENARIO_MAX_CLUSTERS 16
+#define SCENARIO_TICK_MS 50          // default generation tick
+#define SCENARIO_NORMAL_LAMBDA 30.0  // Poisson counts above this use a normal approximation
+#define SCENARIO_PLACEMENT_TRIES 32  // draws before a survivor may land on an obstacle
+
+typedef enum {
+    ARRIVAL_STEADY,    // exactly the rate, fractions carried to the next tick
+    ARRIVAL_POISSON,
+    ARRIVAL_BURSTY     // Poisson at the rate for `on` seconds, then `off` seconds of nothing
+} ArrivalProcess;
+
+typedef enum {
+    PLACE_UNIFORM,
+    PLACE_CLUSTERS,    // gaussian around centres that jump now and then
+    PLACE_FRONT        // gaussian band around a line sweeping across the map
+} Placement;
+
+typedef enum { FRONT_EAST, FRONT_WEST, FRONT_SOUTH, FRONT_NORTH } FrontDirection;
+
+typedef struct scenario_phase {
+    double seconds;
+    ArrivalProcess arrivals;
+    double rate_from, rate_to;   // survivors per second at the start and end of the phase
+    double on, off;              // BURSTY cycle, seconds
+    Placement placement;
+    int clusters;
+    double sigma;                // cells, CLUSTERS and FRONT
+    int share;                   // percent placed at a cluster, the rest uniform
+    int shift_every;             // arrivals between two centre jumps, 0 = fixed centres
+    FrontDirection direction;
+    double front_speed;          // cells per second
+} ScenarioPhase;
+
+typedef struct scenario {
+    ScenarioPhase phases[SCENARIO_MAX_PHASES];
+    int count;
+    int loop;                    // start over after the last phase instead of stopping
+    double tick_ms;
+
+    // Generator state, reset by scenario_start()
+    int width, height;
+    unsigned int seed;
+    long tick;
+    int phase;
+    long phase_tick;             // tick the current phase began
+    double owed;                 // STEADY fractions
+    Coord centres[SCENARIO_MAX_CLUSTERS];
+    long placed;                 // in the current phase
+    long generated;
+} Scenario;
+
+typedef struct scenario_arrival {
+    Coord coord;
+    Payload need;
+    int tag;                     // 0-9999, for the survivor's name
+} ScenarioArrival;
+
+int scenario_load(Scenario *sc, const char *path);
+void scenario_default(Scenario *sc, double rate, int hotspots);
+void scenario_start(Scenario *sc, int width, int height, unsigned int seed);
+int scenario_done(const Scenario *sc);
+int scenario_tick(Scenario *sc);
+void scenario_place(Scenario *sc, ObstacleGrid *obstacles, ScenarioArrival *out);
+#endif
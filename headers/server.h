@@ -1,7 +1,20 @@
 #ifndef SERVER_H
 #define SERVER_H
 
+struct json_object;
+struct drone;
+
 // Function to start the server loop, typically in a new thread
 void *run_server_loop(void *args);
 
-#endif // SERVER_H 
\ No newline at end of file
+// Sends one newline-framed JSON message to a drone. Returns -1, with the
+// socket shut down, if the whole line could not be sent.
+int send_json(int sock, struct json_object *jobj);
+
+// Pushes the drone's current report intervals in a CONFIG_UPDATE; call with d->lock held
+int send_report_config(struct drone *d);
+
+// Sends the current obstacles to every connected drone in a CONFIG_UPDATE
+void broadcast_obstacles();
+
+#endif // SERVER_H 
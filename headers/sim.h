@@ -0,0 +1,78 @@
+#ifndef SIM_H
+#define SIM_H
+#include <stdint.h>
+#include <pthread.h>
+#include "scenario.h"
+
+// Fixed-timestep simulation of a whole fleet, for capacity planning without
+// sockets or a thread per drone. Drones live in parallel arrays indexed by
+// drone; every tick survivors arrive, waiting ones go to the nearest idle
+// drone, busy drones move (split over the workers by index range), and the
+// arrivals are committed in index order. The outcome depends only on the
+// seed, never on the number of workers.
+#define SIM_BUCKET_SHIFT 4        // idle drones are indexed by 16x16-cell bucket
+#define SIM_WAIT_SLOTS 4096       // wait histogram, in ticks; the last slot takes the rest
+#define SIM_MAX_WORKERS 64
+
+struct sim_world;
+
+typedef struct sim_worker {
+    pthread_t thread;
+    struct sim_world *world;
+    int from, to;                 // drone index range
+    int *arrived;                 // drones that reached their survivor this tick
+    int count;
+} SimWorker;
+
+typedef struct sim_world {
+    int width, height;
+    double dt;                    // simulated seconds per tick
+    long tick;
+
+    // Drones
+    int drones;
+    int *x, *y;
+    int *tx, *ty;
+    float *speed;                 // cells per second
+    float *progress;              // cells owed but not yet flown
+    int *mission;                 // survivor being flown to, -1 when idle
+
+    // Idle drones, doubly linked per bucket through the drone index
+    int buckets_x, buckets_y;
+    int *bucket_head;
+    int *idle_next, *idle_prev;
+    int idle;
+
+    // Survivors: a fixed pool, and a FIFO of the waiting ones
+    int survivors;                // pool size
+    int *sx, *sy;
+    long *born;                   // tick of arrival
+    int *free_list;
+    int free_count;
+    int *queue;
+    int queue_head, queue_count;
+    double rate;                  // arrivals per tick
+    double owed;                  // fractional arrivals carried to the next tick
+    unsigned int seed;
+    Scenario *scenario;           // arrivals and placement instead of rate and seed, NULL if none
+
+    // Outcome
+    long spawned, rescued, dropped;
+    long busy_ticks;              // drone-ticks spent on a mission
+    long wait[SIM_WAIT_SLOTS];    // ticks from arrival to rescue
+
+    // Workers; worker 0 is the caller of sim_step
+    int nworkers;
+    SimWorker workers[SIM_MAX_WORKERS];
+    pthread_barrier_t start, done;
+    pthread_mutex_t starting;  // held by sim_init until every worker exists
+    int stopping;
+} SimWorld;
+
+int sim_init(SimWorld *w, int width, int height, int drones, double speed, double dt,
+             double survivors_per_second, int max_waiting, unsigned int seed, int workers);
+void sim_step(SimWorld *w);
+void sim_free(SimWorld *w);
+double sim_wait_quantile(const SimWorld *w, double q);
+uint64_t sim_checksum(const SimWorld *w);
+#endif
@@ -0,0 +1,35 @@
+#ifndef SPAN_H
+#define SPAN_H
+#include <stdint.h>
+
+// Latency spans (--spans file), written as Chrome trace_event JSON for
+// chrome://tracing or Perfetto. Each thread appends to its own buffer, so
+// recording takes no shared lock. A span either belongs to a trace id or
+// is sampled: one in --span-sample root spans (those with no recorded
+// span around them on the thread) is recorded and gets a fresh trace id,
+// and spans nested inside a recorded one inherit it. Survivors are sampled
+// the same way when they are created, and every span that carries a
+// survivor's trace id is recorded, so its creation, dispatch, ASSIGN_MISSION
+// send and rescue show up linked across threads.
+#define SPAN_DEFAULT_SAMPLE 100
+#define SPAN_BUFFER_EVENTS 16384     // per thread; the oldest are overwritten
+
+typedef struct span {
+    const char *name;       // static string
+    uint64_t trace_id;
+    uint64_t start_ns;      // 0 if not recorded
+    uint64_t parent_id;     // the thread's trace id to restore at span_end
+} Span;
+
+extern int span_enabled;
+
+int span_open(const char *path, int sample);
+void span_close();
+int span_dump();
+uint64_t span_new_trace();
+uint64_t span_current();
+void span_begin(Span *sp, const char *name);
+void span_begin_trace(Span *sp, const char *name, uint64_t trace_id);
+void span_end(Span *sp);
+void span_async(const char *name, uint64_t trace_id, uint64_t start_ns, uint64_t end_ns);
+#endif
@@ -2,19 +2,44 @@
 #define SURVIVOR_H
 #include "coord.h"
 #include <time.h>
+#include <stdint.h>
 #include "list.h"
+#include "payload.h"
 
+// A survivor's lifecycle and the drone it belongs to share one atomic word,
+// so assigning and rescuing are single compare-and-swaps.
+typedef enum {
+    SURVIVOR_OPEN,
+    SURVIVOR_ASSIGNED,
+    SURVIVOR_RESCUED
+} SurvivorState;
+
+#define SURVIVOR_WORD(state, drone_id) (((uint64_t)(uint32_t)(drone_id) << 2) | (state))
+#define SURVIVOR_STATE(word) ((SurvivorState)((word) & 3))
+#define SURVIVOR_DRONE(word) ((int)(uint32_t)((word) >> 2))
+
+// Live survivors are allocated once and shared by pointer between their
+// region's queue and their map cell; the region frees them.
 typedef struct survivor {
-    int status;
+    uint64_t state;          // SURVIVOR_WORD(); use the survivor_* accessors
+    uint64_t id;             // unique in this process, from 1
     Coord coord;
     struct tm discovery_time;
     struct tm helped_time;
     char info[25];
+    uint64_t discovered_ns;  // monotonic, for pipeline latency metrics
+    uint64_t assigned_ns;    // last dispatch, 0 until first dispatched
+    Payload need;            // what a drone must carry to help
+    uint64_t trace_id;       // span trace from creation to rescue, 0 if not sampled
+    int transfers;           // times handed to another server of a federation
 } Survivor;
 
-extern List *survivors;
 extern List *helpedsurvivors;
 Survivor *create_survivor(Coord *coord, char *info, struct tm *discovery_time);
-void *survivor_generator(void *args);
+uint64_t survivor_state(const Survivor *s);
+int survivor_transition(Survivor *s, uint64_t expected, uint64_t desired);
+int survivor_claim(Survivor *s, int drone_id);
+int survivor_start();
+long survivors_generated();
 void survivor_cleanup(Survivor *s);
 #endif
\ No newline at end of file
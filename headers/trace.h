@@ -0,0 +1,45 @@
+#ifndef TRACE_H
+#define TRACE_H
+#include <stdint.h>
+#include <stddef.h>
+
+// Traffic recording (--trace file). Every accepted connection, every chunk
+// read from a drone and every message sent to one is appended to a
+// lock-free ring; a background thread writes the ring out. The file is a
+// TraceHeader followed by records, each a TraceRecord and then `len` bytes.
+// Connections are identified by their socket descriptor: an OPEN and a
+// CLOSE record bracket each use of it.
+#define TRACE_MAGIC "EDCSTRC1"
+#define TRACE_VERSION 1
+#define TRACE_RING_BYTES (16u << 20)      // power of two
+#define TRACE_MAX_RECORD (TRACE_RING_BYTES / 4)
+#define TRACE_IDLE_US 1000                // writer sleep when the ring is empty
+
+typedef enum {
+    TRACE_OPEN,
+    TRACE_CLOSE,
+    TRACE_IN,       // bytes as received from the drone, not split into messages
+    TRACE_OUT       // one message sent to the drone
+} TraceKind;
+
+typedef struct trace_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    int64_t started_unix_ns;  // wall clock when recording began
+} TraceHeader;
+
+typedef struct trace_record {
+    uint32_t size;            // this header plus len
+    uint32_t conn;
+    uint64_t ns;              // monotonic, since recording began
+    uint32_t kind;            // TraceKind
+    uint32_t len;
+} TraceRecord;
+
+int trace_open(const char *path);
+void trace_close();
+void trace_record(TraceKind kind, int conn, const void *data, size_t len);
+uint64_t trace_records();
+uint64_t trace_dropped();
+#endif
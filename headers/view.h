@@ -6,6 +6,7 @@ extern void draw_cell(int x, int y, SDL_Color color);
 extern void draw_drones();
 extern void draw_survivors();
 extern void draw_grid();
+extern void draw_obstacles();
 extern int draw_map();
 extern int check_events();
 extern void quit_all();
@@ -0,0 +1,39 @@
+#ifndef WORKPOOL_H
+#define WORKPOOL_H
+#include <stdint.h>
+#include <pthread.h>
+
+// Fixed-size work-stealing pool. Every worker owns a deque: tasks are pushed
+// at the back, the owner runs them from the front (oldest first) and idle
+// workers steal the newest from the back of the others'. Tasks submitted
+// from outside the pool are spread round-robin.
+#define WORKPOOL_DEQUE_INITIAL 256
+#define WORKPOOL_TIMER_INITIAL 64
+#define WORKPOOL_STEAL_ROUNDS 2     // full sweeps over the other deques before sleeping
+
+typedef void (*workpool_fn)(void *arg);
+
+typedef struct task {
+    workpool_fn fn;
+    void *arg;
+} Task;
+
+typedef struct worker {
+    int id;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    Task *tasks;           // ring buffer, grown when full
+    int capacity;
+    int head;              // front: where the owner takes from
+    int count;
+    unsigned int seed;     // victim selection
+} Worker;
+
+int workpool_start(int workers, int pin_cpus);
+void workpool_stop();
+int workpool_submit(workpool_fn fn, void *arg);
+int workpool_after(uint64_t delay_ns, workpool_fn fn, void *arg);
+int workpool_size();
+long workpool_queued();
+long workpool_steals();
+#endif
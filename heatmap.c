@@ -0,0 +1,186 @@
+/**
+ * @file heatmap.c
+ * @brief Survivor arrival heatmap and pre-positioning of idle drones.
+ *
+ * Every arrival adds one to its heat tile; heat decays with a half-life of
+ * HEATMAP_HALF_LIFE_S, applied lazily when a tile is next touched. Every
+ * REBALANCE_MS a pass splits the idle drones over the tiles in proportion
+ * to their heat and sends at most --rebalance-moves drones from tiles with
+ * more idle drones than their share to the tiles furthest below theirs.
+ * Repositioned drones stay dispatchable while they fly.
+ */
+#include "headers/heatmap.h"
+#include "headers/globals.h"
+#include "headers/ai.h"
+#include "headers/metrics.h"
+#include "headers/lockprof.h"
+#include "headers/workpool.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+
+extern volatile sig_atomic_t global_shutdown_flag;
+
+static HeatTile *tiles = NULL;
+static int tiles_x = 0, tiles_y = 0;
+static pthread_mutex_t heat_lock = PTHREAD_MUTEX_INITIALIZER;
+static long moves = 0;
+
+// Idle drones the pass may move, and where repositioning ones are headed.
+typedef struct idle_drone {
+    Drone *drone;
+    Coord at;
+    int tile;
+    int movable;
+} IdleDrone;
+
+int heatmap_init(int width, int height) {
+    tiles_x = (width + HEATMAP_TILE_CELLS - 1) / HEATMAP_TILE_CELLS;
+    tiles_y = (height + HEATMAP_TILE_CELLS - 1) / HEATMAP_TILE_CELLS;
+    tiles = calloc((size_t)tiles_x * tiles_y, sizeof(HeatTile));
+    if (!tiles) {
+        perror("Failed to allocate heatmap");
+        return -1;
+    }
+    return 0;
+}
+
+void heatmap_free() {
+    free(tiles);
+    tiles = NULL;
+}
+
+static int tile_of(Coord c) {
+    return (c.y / HEATMAP_TILE_CELLS) * tiles_x + c.x / HEATMAP_TILE_CELLS;
+}
+
+// Brings a tile's heat forward to now. Call with heat_lock held.
+static double decayed(HeatTile *t, uint64_t now_ns) {
+    if (now_ns > t->at_ns) {
+        t->heat *= exp2(-(double)(now_ns - t->at_ns) / 1e9 / HEATMAP_HALF_LIFE_S);
+        t->at_ns = now_ns;
+    }
+    return t->heat;
+}
+
+void heatmap_record(Coord c, uint64_t now_ns) {
+    if (!tiles || !map_in_bounds(c.x, c.y)) return;
+    pthread_mutex_lock(&heat_lock);
+    HeatTile *t = &tiles[tile_of(c)];
+    t->heat = decayed(t, now_ns) + 1;
+    pthread_mutex_unlock(&heat_lock);
+}
+
+double heatmap_total(uint64_t now_ns) {
+    double total = 0;
+    pthread_mutex_lock(&heat_lock);
+    for (int i = 0; tiles && i < tiles_x * tiles_y; i++) total += decayed(&tiles[i], now_ns);
+    pthread_mutex_unlock(&heat_lock);
+    return total;
+}
+
+long rebalance_moves() {
+    return __atomic_load_n(&moves, __ATOMIC_RELAXED);
+}
+
+// The middle of a tile, pulled inside the map for partial edge tiles.
+static Coord tile_centre(int tile) {
+    Coord c = {(tile % tiles_x) * HEATMAP_TILE_CELLS + HEATMAP_TILE_CELLS / 2,
+               (tile / tiles_x) * HEATMAP_TILE_CELLS + HEATMAP_TILE_CELLS / 2};
+    if (c.x >= map.width) c.x = map.width - 1;
+    if (c.y >= map.height) c.y = map.height - 1;
+    return c;
+}
+
+static void rebalance_pass() {
+    int ntiles = tiles_x * tiles_y;
+    uint64_t now = metrics_now_ns();
+    double *deficit = calloc(ntiles, sizeof(double));
+    IdleDrone *idle = NULL;
+    int nidle = 0;
+    if (!deficit) return;
+
+    double total = 0;
+    pthread_mutex_lock(&heat_lock);
+    for (int i = 0; i < ntiles; i++) {
+        deficit[i] = decayed(&tiles[i], now);
+        total += deficit[i];
+    }
+    pthread_mutex_unlock(&heat_lock);
+    if (total < HEATMAP_MIN_HEAT) goto done;
+
+    // Supply: idle drones where they are, repositioning ones where they go
+    metrics_lock(&drones->lock, LOCK_DRONES);
+    idle = malloc(sizeof(IdleDrone) * (drones->number_of_elements + 1));
+    for (Node *node = drones->head; idle && node != NULL; node = node->next) {
+        Drone *d = (Drone *)node->data;
+        LOCK(&d->lock);
+        if (d->status == IDLE || d->repositioning) {
+            Coord at = d->repositioning ? d->target : d->coord;
+            if (map_in_bounds(at.x, at.y)) {
+                idle[nidle].drone = d;
+                idle[nidle].at = at;
+                idle[nidle].tile = tile_of(at);
+                idle[nidle].movable = d->status == IDLE && now - d->repositioned_ns >= REBALANCE_COOLDOWN_NS;
+                nidle++;
+            }
+        }
+        UNLOCK(&d->lock);
+    }
+    UNLOCK(&drones->lock);
+    if (nidle == 0) goto done;
+
+    // A tile's share of the idle drones follows its share of the heat
+    for (int i = 0; i < ntiles; i++) deficit[i] = deficit[i] / total * nidle;
+    for (int i = 0; i < nidle; i++) deficit[idle[i].tile] -= 1;
+
+    for (int m = 0; m < config.rebalance_moves; m++) {
+        int to = 0;
+        for (int i = 1; i < ntiles; i++) {
+            if (deficit[i] > deficit[to]) to = i;
+        }
+        if (deficit[to] < REBALANCE_MIN_DEFICIT) break;
+
+        // The nearest movable drone whose tile stays better off than the target
+        Coord dest = tile_centre(to);
+        int pick = -1, pick_dist = 0;
+        for (int i = 0; i < nidle; i++) {
+            if (!idle[i].movable || deficit[idle[i].tile] + 1 > deficit[to] - 1) continue;
+            int dist = abs(idle[i].at.x - dest.x) + abs(idle[i].at.y - dest.y);
+            if (pick < 0 || dist < pick_dist) {
+                pick = i;
+                pick_dist = dist;
+            }
+        }
+        if (pick < 0) break;
+
+        idle[pick].movable = 0;
+        if (reposition_drone(idle[pick].drone, dest) != 0) continue;  // dispatched meanwhile
+        deficit[idle[pick].tile] += 1;
+        deficit[to] -= 1;
+        __atomic_add_fetch(&moves, 1, __ATOMIC_RELAXED);
+        printf("Repositioning drone %d from (%d,%d) to (%d,%d)\n", idle[pick].drone->id, idle[pick].at.x,
+               idle[pick].at.y, dest.x, dest.y);
+    }
+
+done:
+    free(idle);
+    free(deficit);
+}
+
+static void rebalance_tick(void *arg) {
+    (void)arg;
+    if (global_shutdown_flag) return;
+    rebalance_pass();
+    workpool_after(REBALANCE_MS * 1000000ULL, rebalance_tick, NULL);
+}
+
+// Call with the work pool started.
+void rebalance_start() {
+    if (config.rebalance_moves <= 0 || !tiles) return;
+    if (workpool_after(REBALANCE_MS * 1000000ULL, rebalance_tick, NULL) != 0) {
+        fprintf(stderr, "Failed to schedule drone rebalancing\n");
+    }
+}
@@ -7,6 +7,7 @@
  * @copyright Copyright (c) 2024-2025
  */
 #include "headers/list.h"
+#include "headers/lockprof.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -17,9 +18,17 @@ List *create_list(size_t datasize, int capacity) {
     if (!list) return NULL;
     memset(list, 0, sizeof(List));
 
-    pthread_mutex_init(&list->lock, NULL);
+    // Recursive: callers lock the list around add()/removenode(), and pop()
+    // calls removenode() with the lock already held.
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&list->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
     list->datasize = datasize;
-    list->nodesize = sizeof(Node) + datasize;
+    // Round up so every node, and so every payload, stays aligned
+    size_t align = _Alignof(max_align_t);
+    list->nodesize = sizeof(Node) + (datasize + align - 1) / align * align;
     list->startaddress = malloc(list->nodesize * capacity);
     if (!list->startaddress) {
         pthread_mutex_destroy(&list->lock);
@@ -77,10 +86,10 @@ static Node *find_memcell_fornode(List *list) {
 
 Node *add(List *list, void *data) {
     printf("[DEBUG] add() start: list=%p, data=%p\n", (void*)list, data);
-    pthread_mutex_lock(&list->lock);
+    LOCK(&list->lock);
     if (list->number_of_elements >= list->capacity) {
         perror("list is full!");
-        pthread_mutex_unlock(&list->lock);
+        UNLOCK(&list->lock);
         return NULL;
     }
 
@@ -88,11 +97,11 @@ Node *add(List *list, void *data) {
     if (node != NULL) {
         node->occupied = 1;
         memcpy(node->data, data, list->datasize);
+        // A recycled node still carries its free-list link, so always reset both
+        node->prev = NULL;
+        node->next = list->head;
         if (list->head != NULL) {
-            Node *oldhead = list->head;
-            oldhead->prev = node;
-            node->prev = NULL;
-            node->next = oldhead;
+            list->head->prev = node;
         }
         list->head = node;
         list->lastprocessed = node;
@@ -103,13 +112,13 @@ Node *add(List *list, void *data) {
     } else {
         perror("list is full!");
     }
-    pthread_mutex_unlock(&list->lock);
+    UNLOCK(&list->lock);
     printf("[DEBUG] add() end: list=%p, node=%p\n", (void*)list, (void*)node);
     return node;
 }
 
 int removedata(List *list, void *data) {
-    pthread_mutex_lock(&list->lock);
+    LOCK(&list->lock);
     Node *temp = list->head;
     while (temp != NULL && memcmp(temp->data, data, list->datasize) != 0) {
         temp = temp->next;
@@ -135,36 +144,36 @@ int removedata(List *list, void *data) {
             list->head = nextnode;
         }
         list->lastprocessed = temp;
-        pthread_mutex_unlock(&list->lock);
+        UNLOCK(&list->lock);
         return 0;
     }
-    pthread_mutex_unlock(&list->lock);
+    UNLOCK(&list->lock);
     return 1;
 }
 
 void *pop(List *list, void *dest) {
-    pthread_mutex_lock(&list->lock);
+    LOCK(&list->lock);
     if (list->head != NULL) {
         Node *node = list->head;
         if (removenode(list, node) == 0) {
             memcpy(dest, node->data, list->datasize);
-            pthread_mutex_unlock(&list->lock);
+            UNLOCK(&list->lock);
             return dest;
         }
     }
-    pthread_mutex_unlock(&list->lock);
+    UNLOCK(&list->lock);
     return NULL;
 }
 
 void *peek(List *list) {
-    pthread_mutex_lock(&list->lock);
+    LOCK(&list->lock);
     void *data = (list->head != NULL) ? list->head->data : NULL;
-    pthread_mutex_unlock(&list->lock);
+    UNLOCK(&list->lock);
     return data;
 }
 
 int removenode(List *list, Node *node) {
-    pthread_mutex_lock(&list->lock);
+    LOCK(&list->lock);
     if (node != NULL) {
         Node *prevnode = node->prev;
         Node *nextnode = node->next;
@@ -186,15 +195,15 @@ int removenode(List *list, Node *node) {
             list->head = nextnode;
         }
         list->lastprocessed = node;
-        pthread_mutex_unlock(&list->lock);
+        UNLOCK(&list->lock);
         return 0;
     }
-    pthread_mutex_unlock(&list->lock);
+    UNLOCK(&list->lock);
     return 1;
 }
 
 void destroy(List *list) {
-    pthread_mutex_lock(&list->lock);
+    LOCK(&list->lock);
     free(list->startaddress);
     list->startaddress = NULL;
     list->endaddress = NULL;
@@ -203,27 +212,27 @@ void destroy(List *list) {
     list->lastprocessed = NULL;
     list->free_list = NULL;
     list->number_of_elements = 0;
-    pthread_mutex_unlock(&list->lock);
+    UNLOCK(&list->lock);
     pthread_mutex_destroy(&list->lock);
     free(list);
 }
 
 void printlist(List *list, void (*print)(void *)) {
-    pthread_mutex_lock(&list->lock);
+    LOCK(&list->lock);
     Node *temp = list->head;
     while (temp != NULL) {
         print(temp->data);
         temp = temp->next;
     }
-    pthread_mutex_unlock(&list->lock);
+    UNLOCK(&list->lock);
 }
 
 void printlistfromtail(List *list, void (*print)(void *)) {
-    pthread_mutex_lock(&list->lock);
+    LOCK(&list->lock);
     Node *temp = list->tail;
     while (temp != NULL) {
         print(temp->data);
         temp = temp->prev;
     }
-    pthread_mutex_unlock(&list->lock);
+    UNLOCK(&list->lock);
 }
\ No newline at end of file
@@ -0,0 +1,1176 @@
+/**
+ * @file loadtest.c
+ * @brief End-to-end capacity test for the drone server over real TCP.
+ *
+ * Starts `server --headless` on loopback ports, then ramps up simulated
+ * drones that speak the normal protocol (HANDSHAKE, periodic STATUS_UPDATE,
+ * fly ASSIGN_MISSION tours one cell per tick, MISSION_COMPLETE at each stop).
+ * After every ramp step it scrapes the server's metrics endpoint and /proc
+ * to report sustained STATUS_UPDATE/s, windowed handler latency, CPU and
+ * RSS. The first step whose p99 handler latency exceeds the limit is the
+ * breaking point. Survivor time-to-assign and time-to-rescue are taken over
+ * the whole run. A JSON report is written for release-to-release comparison.
+ * With --dead-reckoning the drones still move every tick but only report
+ * when they leave the server's predicted path, change state, or stay quiet
+ * for the status interval the server last pushed (HANDSHAKE_ACK and
+ * CONFIG_UPDATE).
+ * --storm n opens n extra connections at once on every step, past the
+ * server's connection limit, to check that refusals come back as 503 and
+ * that MISSION_COMPLETE latency holds.
+ * --mixed-fleet gives drones different speeds, ranges and payloads (see
+ * lt_speeds and friends); a drone whose battery runs flat mid-flight reports
+ * a failed MISSION_COMPLETE. Pair it with --dispatch to compare rankings.
+ * --obstacles file is handed to the server; the drones take the obstacles
+ * from HANDSHAKE_ACK and route around them as a real drone would.
+ * --reconnect drops every drone's connection at once after the ramp. The
+ * drones come back after an exponential backoff with full jitter and RESUME
+ * the session from their HANDSHAKE_ACK (a HANDSHAKE if the server does not
+ * know it); the time from the drop to each ack is the recovery time.
+ * --connect-burst n opens n connections at once before the ramp and times
+ * how fast the server accepts them (edcs_connections_accepted); pair it with
+ * --acceptors and --backlog, which are passed to the server.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <json-c/json.h>
+#include "headers/deadreckon.h"
+#include "headers/path.h"
+
+#define LT_MAX_DRIVERS 8
+#define LT_BUFFER_SIZE 8192
+#define LT_HIST_SLOTS 4096  // >= the server's histogram bucket count
+#define LT_MAP_WIDTH 40
+#define LT_MAP_HEIGHT 30
+#define LT_STORM_ID_BASE 1000000
+#define LT_RECHARGE_PERCENT 2  // regained per idle tick
+#define LT_TOUR_MAX 8          // DRONE_TOUR_MAX
+#define LT_PATH_FIELDS 64      // distance fields shared by all simulated drones
+#define LT_RECONNECT_BASE_MS 200   // as drone_client.c
+#define LT_RECONNECT_MAX_MS 10000
+#define LT_RECOVERY_TIMEOUT_S 60
+#define LT_BURST_TIMEOUT_S 30
+
+// --mixed-fleet profiles, handed out round-robin
+static const double lt_speeds[] = {0.5, 1.0, 2.0};
+static const int lt_ranges[] = {60, 120, 240};
+static const char *lt_payloads[] = {"medical", "food", "water"};
+
+typedef struct loadtest_options {
+    const char *server_path;
+    const char *out_path;
+    int port;
+    int metrics_port;
+    int max_drones;
+    int step;
+    int step_seconds;
+    int update_interval_ms;
+    int drivers;
+    double survivor_rate;
+    double p99_limit_ms;
+    int dead_reckoning;
+    int storm;
+    int mixed_fleet;
+    int reconnect;
+    int connect_burst;
+    const char *acceptors;   // passed through to the server's --acceptors
+    const char *backlog;     // passed through to the server's --backlog
+    const char *dispatch;  // passed through to the server's --dispatch
+    const char *tour_stops;  // passed through to the server's --tour-stops
+    const char *obstacles;   // passed through to the server's --obstacles
+} LoadtestOptions;
+
+typedef struct sim_drone {
+    int fd;
+    int id;
+    int x, y;
+    int tx, ty;
+    int busy;
+    Coord tour[LT_TOUR_MAX];
+    int tour_len;
+    int tour_stop;
+    int repositioning;     // the mission is a move to wait elsewhere, not a rescue
+    char mission_id[32];
+    char rbuf[LT_BUFFER_SIZE];
+    size_t rlen;
+    uint64_t next_update_ns;
+    // Dead reckoning: the last reported state, which the server predicts from
+    Coord anchor;
+    uint64_t anchor_ns;
+    int reported_busy;
+    uint64_t reported_ns;
+    int deviation_threshold;
+    double quiet_s;        // min(status_update_interval, heartbeat_interval)
+    double status_interval;
+    double heartbeat_interval;
+    int refused;           // got a 503, the server is closing the connection
+    // Capabilities; a uniform fleet flies one cell a tick and never runs flat
+    double cells_per_tick;
+    double progress;       // fractional cells flown towards the next step
+    const char *payload;
+    int range_cells;       // battery_capacity, 0 for unlimited
+    double battery;        // percent
+    Coord home;
+    // --reconnect
+    char session[40];      // from HANDSHAKE_ACK
+    uint64_t dropped_ns;   // when the connection was dropped, 0 once recovered
+    uint64_t reconnect_at_ns;
+    int backoff_ms;        // current backoff window
+    int awaiting_ack;      // sent RESUME or HANDSHAKE, holding reports until the ack
+    int dropped_once;
+} SimDrone;
+
+typedef struct driver {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    SimDrone **drones;
+    int count;
+    int capacity;
+} Driver;
+
+// Histogram bucket counts scraped from /metrics/raw, indexed by bucket.
+typedef struct raw_hist {
+    uint64_t upper[LT_HIST_SLOTS];
+    uint64_t count[LT_HIST_SLOTS];
+} RawHist;
+
+typedef struct scrape {
+    double status_updates;
+    double position_error;
+    RawHist handler;
+    RawHist critical;
+    RawHist to_assign;
+    RawHist to_rescue;
+    unsigned long long cpu_ticks;
+    long rss_kb;
+    uint64_t at_ns;
+} Scrape;
+
+typedef struct step_result {
+    int drones;
+    double updates_per_sec;
+    double p50_ms;
+    double p99_ms;
+    double critical_p99_ms;
+    double cpu_percent;
+    long rss_kb;
+} StepResult;
+
+static LoadtestOptions opts = {
+    .server_path = "./server",
+    .out_path = "loadtest_report.json",
+    .port = 18080,
+    .metrics_port = 19100,
+    .max_drones = 200,
+    .step = 25,
+    .step_seconds = 5,
+    .update_interval_ms = 500,
+    .drivers = 4,
+    .survivor_rate = 5,
+    .p99_limit_ms = 50
+};
+
+static Driver drivers[LT_MAX_DRIVERS];
+static volatile int running = 1;
+static unsigned long long sent_updates = 0;
+static unsigned long long rescues_reported = 0;
+static unsigned long long config_updates = 0;
+static unsigned long long refusals = 0;
+static unsigned long long stranded = 0;
+static unsigned long long sent_messages = 0;  // everything the drones sent
+static unsigned long long cells_flown = 0;
+static unsigned long long repositions = 0;
+
+// --reconnect: set once to drop every connection, then recovery times (ns)
+static volatile uint64_t drop_ns = 0;
+static uint64_t *recovery_ns = NULL;
+static unsigned long long recovered = 0;
+static unsigned long long resumed = 0;
+static unsigned long long resume_fallbacks = 0;  // 401, registered again with a HANDSHAKE
+static unsigned long long reconnect_refusals = 0;
+
+// The server's obstacles, as every drone was sent them
+static ObstacleGrid obstacles;
+static PathCache paths;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void send_line(int fd, struct json_object *msg) {
+    size_t len;
+    const char *str = json_object_to_json_string_length(msg, JSON_C_TO_STRING_PLAIN, &len);
+    char *line = malloc(len + 1);
+    if (!line) return;
+    memcpy(line, str, len);
+    line[len] = '\n';
+    size_t off = 0;
+    while (off < len + 1) {
+        ssize_t n = send(fd, line + off, len + 1 - off, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            break;
+        }
+        off += n;
+    }
+    free(line);
+    __atomic_add_fetch(&sent_messages, 1, __ATOMIC_RELAXED);
+}
+
+static void send_status(SimDrone *d) {
+    char id[16];
+    snprintf(id, sizeof(id), "D%d", d->id);
+    struct json_object *msg = json_object_new_object();
+    json_object_object_add(msg, "type", json_object_new_string("STATUS_UPDATE"));
+    json_object_object_add(msg, "drone_id", json_object_new_string(id));
+    json_object_object_add(msg, "timestamp", json_object_new_int64(time(NULL)));
+    struct json_object *loc = json_object_new_object();
+    json_object_object_add(loc, "x", json_object_new_int(d->x));
+    json_object_object_add(loc, "y", json_object_new_int(d->y));
+    json_object_object_add(msg, "location", loc);
+    json_object_object_add(msg, "status", json_object_new_string(d->busy ? "busy" : "idle"));
+    json_object_object_add(msg, "battery", json_object_new_int((int)d->battery));
+    json_object_object_add(msg, "speed", json_object_new_double(d->cells_per_tick * 1000.0 / opts.update_interval_ms));
+    send_line(d->fd, msg);
+    json_object_put(msg);
+    __atomic_add_fetch(&sent_updates, 1, __ATOMIC_RELAXED);
+}
+
+static void send_mission_complete(SimDrone *d, int success) {
+    char id[16];
+    snprintf(id, sizeof(id), "D%d", d->id);
+    struct json_object *msg = json_object_new_object();
+    json_object_object_add(msg, "type", json_object_new_string("MISSION_COMPLETE"));
+    json_object_object_add(msg, "drone_id", json_object_new_string(id));
+    json_object_object_add(msg, "mission_id", json_object_new_string(d->mission_id));
+    json_object_object_add(msg, "timestamp", json_object_new_int64(time(NULL)));
+    json_object_object_add(msg, "success", json_object_new_boolean(success));
+    json_object_object_add(msg, "details", json_object_new_string(success ? "Reached survivor location" : "Battery depleted"));
+    struct json_object *loc = json_object_new_object();
+    json_object_object_add(loc, "x", json_object_new_int(d->x));
+    json_object_object_add(loc, "y", json_object_new_int(d->y));
+    json_object_object_add(msg, "location", loc);
+    send_line(d->fd, msg);
+    json_object_put(msg);
+    if (d->repositioning && success) __atomic_add_fetch(&repositions, 1, __ATOMIC_RELAXED);
+    else __atomic_add_fetch(success ? &rescues_reported : &stranded, 1, __ATOMIC_RELAXED);
+}
+
+static void send_handshake(SimDrone *d) {
+    char drone_id[16];
+    snprintf(drone_id, sizeof(drone_id), "D%d", d->id);
+    struct json_object *hs = json_object_new_object();
+    json_object_object_add(hs, "type", json_object_new_string("HANDSHAKE"));
+    json_object_object_add(hs, "drone_id", json_object_new_string(drone_id));
+    struct json_object *caps = json_object_new_object();
+    json_object_object_add(caps, "max_speed", json_object_new_int(30));
+    json_object_object_add(caps, "battery_capacity", json_object_new_int(d->range_cells));
+    json_object_object_add(caps, "payload", json_object_new_string(d->payload));
+    json_object_object_add(caps, "cells_per_second",
+                           json_object_new_double(d->cells_per_tick * 1000.0 / opts.update_interval_ms));
+    json_object_object_add(hs, "capabilities", caps);
+    struct json_object *home = json_object_new_object();
+    json_object_object_add(home, "x", json_object_new_int(d->home.x));
+    json_object_object_add(home, "y", json_object_new_int(d->home.y));
+    json_object_object_add(hs, "home", home);
+    send_line(d->fd, hs);
+    json_object_put(hs);
+}
+
+static void send_resume(SimDrone *d) {
+    char drone_id[16];
+    snprintf(drone_id, sizeof(drone_id), "D%d", d->id);
+    struct json_object *msg = json_object_new_object();
+    json_object_object_add(msg, "type", json_object_new_string("RESUME"));
+    json_object_object_add(msg, "drone_id", json_object_new_string(drone_id));
+    json_object_object_add(msg, "session_id", json_object_new_string(d->session));
+    json_object_object_add(msg, "mission_id", d->busy ? json_object_new_string(d->mission_id) : NULL);
+    send_line(d->fd, msg);
+    json_object_put(msg);
+}
+
+// The drone is back: count how long it took from the drop.
+static void reconnected(SimDrone *d) {
+    d->awaiting_ack = 0;
+    d->reported_busy = -1;  // report where we are now
+    if (!d->dropped_ns) return;
+    unsigned long long n = __atomic_fetch_add(&recovered, 1, __ATOMIC_RELAXED);
+    if (n < (unsigned long long)opts.max_drones) recovery_ns[n] = now_ns() - d->dropped_ns;
+    d->dropped_ns = 0;
+}
+
+static void handle_message(SimDrone *d, struct json_object *msg) {
+    const char *type = json_object_get_string(json_object_object_get(msg, "type"));
+    if (!type) return;
+    if (strcmp(type, "HANDSHAKE_ACK") == 0 || strcmp(type, "CONFIG_UPDATE") == 0) {
+        struct json_object *config, *reckoning, *value;
+        if (!json_object_object_get_ex(msg, "config", &config)) return;
+        if (json_object_object_get_ex(config, "status_update_interval", &value)) {
+            d->status_interval = json_object_get_double(value);
+        }
+        if (json_object_object_get_ex(config, "heartbeat_interval", &value)) {
+            d->heartbeat_interval = json_object_get_double(value);
+        }
+        if (json_object_object_get_ex(config, "dead_reckoning", &reckoning) &&
+            json_object_object_get_ex(reckoning, "deviation_threshold", &value)) {
+            d->deviation_threshold = json_object_get_int(value);
+        }
+        if (json_object_object_get_ex(config, "obstacles", &value)) obstacles_from_json(&obstacles, value);
+        d->quiet_s = d->status_interval < d->heartbeat_interval ? d->status_interval : d->heartbeat_interval;
+        if (type[0] == 'C') {
+            __atomic_add_fetch(&config_updates, 1, __ATOMIC_RELAXED);
+        } else {
+            const char *session = json_object_get_string(json_object_object_get(msg, "session_id"));
+            snprintf(d->session, sizeof(d->session), "%s", session ? session : "");
+            if (d->awaiting_ack) {
+                // A fresh registration: the server dropped whatever we were doing
+                d->busy = 0;
+                reconnected(d);
+            }
+        }
+    } else if (strcmp(type, "RESUME_ACK") == 0) {
+        // No mission on the server's side means ours ended while we were away
+        if (!json_object_get_string(json_object_object_get(msg, "mission_id"))) d->busy = 0;
+        __atomic_add_fetch(&resumed, 1, __ATOMIC_RELAXED);
+        reconnected(d);
+    } else if (strcmp(type, "ASSIGN_MISSION") == 0) {
+        struct json_object *target = json_object_object_get(msg, "target");
+        const char *mission_id = json_object_get_string(json_object_object_get(msg, "mission_id"));
+        d->tx = json_object_get_int(json_object_object_get(target, "x"));
+        d->ty = json_object_get_int(json_object_object_get(target, "y"));
+        struct json_object *waypoints;
+        d->tour[0] = (Coord){d->tx, d->ty};
+        d->tour_len = 1;
+        d->tour_stop = 0;
+        d->repositioning = json_object_get_boolean(json_object_object_get(msg, "reposition"));
+        if (json_object_object_get_ex(msg, "waypoints", &waypoints)) {
+            int n = json_object_array_length(waypoints);
+            if (n > LT_TOUR_MAX) n = LT_TOUR_MAX;
+            for (int i = 0; i < n; i++) {
+                struct json_object *stop = json_object_array_get_idx(waypoints, i);
+                d->tour[i].x = json_object_get_int(json_object_object_get(stop, "x"));
+                d->tour[i].y = json_object_get_int(json_object_object_get(stop, "y"));
+            }
+            if (n > 0) d->tour_len = n;
+            d->tx = d->tour[0].x;
+            d->ty = d->tour[0].y;
+        }
+        snprintf(d->mission_id, sizeof(d->mission_id), "%s", mission_id ? mission_id : "");
+        d->busy = 1;
+        struct json_object *origin;
+        d->anchor = (Coord){d->x, d->y};
+        if (json_object_object_get_ex(msg, "origin", &origin)) {
+            d->anchor.x = json_object_get_int(json_object_object_get(origin, "x"));
+            d->anchor.y = json_object_get_int(json_object_object_get(origin, "y"));
+        }
+        d->anchor_ns = now_ns();
+    } else if (strcmp(type, "ERROR") == 0) {
+        int code = json_object_get_int(json_object_object_get(msg, "code"));
+        if (code == 503) {
+            __atomic_add_fetch(d->dropped_ns ? &reconnect_refusals : &refusals, 1, __ATOMIC_RELAXED);
+            d->refused = 1;
+        } else if (code == 409 && d->awaiting_ack) {
+            // Our old connection is not closed on the server yet; retry after backoff
+            d->refused = 1;
+        } else if (code == 401 && d->awaiting_ack) {
+            __atomic_add_fetch(&resume_fallbacks, 1, __ATOMIC_RELAXED);
+            send_handshake(d);
+        }
+    } else if (strcmp(type, "HEARTBEAT") == 0) {
+        char id[16];
+        snprintf(id, sizeof(id), "D%d", d->id);
+        struct json_object *resp = json_object_new_object();
+        json_object_object_add(resp, "type", json_object_new_string("HEARTBEAT_RESPONSE"));
+        json_object_object_add(resp, "drone_id", json_object_new_string(id));
+        json_object_object_add(resp, "timestamp", json_object_new_int64(time(NULL)));
+        send_line(d->fd, resp);
+        json_object_put(resp);
+    }
+}
+
+// Drains whatever the server sent; returns -1 once the connection is gone.
+static int read_messages(SimDrone *d) {
+    for (;;) {
+        if (d->rlen >= sizeof(d->rbuf) - 1) d->rlen = 0;  // oversized line, drop it
+        ssize_t n = recv(d->fd, d->rbuf + d->rlen, sizeof(d->rbuf) - 1 - d->rlen, MSG_DONTWAIT);
+        if (n == 0) return -1;
+        if (n < 0) return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : -1;
+        d->rlen += n;
+        d->rbuf[d->rlen] = '\0';
+
+        char *start = d->rbuf;
+        char *newline;
+        while ((newline = strchr(start, '\n')) != NULL) {
+            *newline = '\0';
+            struct json_object *msg = json_tokener_parse(start);
+            if (msg) {
+                handle_message(d, msg);
+                json_object_put(msg);
+            }
+            start = newline + 1;
+        }
+        d->rlen -= start - d->rbuf;
+        memmove(d->rbuf, start, d->rlen + 1);
+        if (d->refused) return -1;
+    }
+}
+
+// Whether the server's prediction has gone stale enough to need a report.
+static int status_due(SimDrone *d, uint64_t now) {
+    if (!opts.dead_reckoning || d->busy != d->reported_busy) return 1;
+    if (now - d->reported_ns >= (uint64_t)(d->quiet_s * 1e9)) return 1;
+    Coord predicted = d->anchor;
+    if (d->busy) {
+        double speed = d->cells_per_tick * 1000.0 / opts.update_interval_ms;
+        predicted = path_position(&paths, d->anchor, (Coord){d->tx, d->ty}, speed, now - d->anchor_ns);
+    }
+    return deadreckon_deviation(predicted, (Coord){d->x, d->y}) > d->deviation_threshold;
+}
+
+static void tick(SimDrone *d, uint64_t now) {
+    if (d->busy) {
+        d->progress += d->cells_per_tick;
+        for (; d->progress >= 1 && (d->x != d->tx || d->y != d->ty); d->progress -= 1) {
+            Coord next = path_next(&paths, (Coord){d->x, d->y}, (Coord){d->tx, d->ty});
+            if (next.x == d->x && next.y == d->y) break;  // walled in
+            d->x = next.x;
+            d->y = next.y;
+            if (d->range_cells > 0) d->battery -= 100.0 / d->range_cells;
+            __atomic_add_fetch(&cells_flown, 1, __ATOMIC_RELAXED);
+        }
+        if (d->battery <= 0) {
+            // Flat battery: give the mission up and recharge where we landed
+            d->battery = 0;
+            d->busy = 0;
+            d->progress = 0;
+            send_mission_complete(d, 0);
+        }
+    } else if (d->battery < 100) {
+        d->battery += LT_RECHARGE_PERCENT;
+        if (d->battery > 100) d->battery = 100;
+    }
+    if (status_due(d, now)) {
+        send_status(d);
+        d->anchor = (Coord){d->x, d->y};
+        d->anchor_ns = now;
+        d->reported_busy = d->busy;
+        d->reported_ns = now;
+    }
+    if (d->busy && d->x == d->tx && d->y == d->ty) {
+        // One MISSION_COMPLETE per stop; the next leg is predicted from here
+        send_mission_complete(d, 1);
+        d->anchor = (Coord){d->x, d->y};
+        d->anchor_ns = now;
+        if (d->tour_stop + 1 < d->tour_len) {
+            d->tour_stop++;
+            d->tx = d->tour[d->tour_stop].x;
+            d->ty = d->tour[d->tour_stop].y;
+        } else {
+            d->busy = 0;
+            d->progress = 0;
+        }
+    }
+}
+
+// Waits a random part of the backoff window before the next attempt, and
+// widens the window for the one after.
+static void schedule_reconnect(SimDrone *d, uint64_t now) {
+    d->reconnect_at_ns = now + (uint64_t)(rand() % d->backoff_ms) * 1000000ULL;
+    d->backoff_ms = d->backoff_ms * 2 > LT_RECONNECT_MAX_MS ? LT_RECONNECT_MAX_MS : d->backoff_ms * 2;
+}
+
+static int connect_loopback(int port);
+
+// --reconnect: drops the connection once when told to, then reconnects with
+// backoff until the server acks. Returns 1 while the drone is away.
+static int reconnect_step(SimDrone *d, uint64_t now) {
+    if (drop_ns && !d->dropped_once && d->fd >= 0 && d->session[0]) {
+        close(d->fd);
+        d->fd = -1;
+        d->rlen = 0;
+        d->dropped_once = 1;
+        d->dropped_ns = drop_ns;
+        d->backoff_ms = LT_RECONNECT_BASE_MS;
+        schedule_reconnect(d, now);
+        return 1;
+    }
+    if (!d->dropped_ns) return 0;
+    if (d->fd >= 0 || now < d->reconnect_at_ns) return 1;
+    d->fd = connect_loopback(opts.port);
+    if (d->fd < 0) {
+        schedule_reconnect(d, now);
+        return 1;
+    }
+    d->rlen = 0;
+    d->refused = 0;
+    d->awaiting_ack = 1;
+    if (d->session[0]) send_resume(d);
+    else send_handshake(d);
+    return 1;
+}
+
+static void *driver_loop(void *arg) {
+    Driver *drv = (Driver *)arg;
+    struct pollfd *fds = NULL;
+    int fds_cap = 0;
+
+    while (running) {
+        pthread_mutex_lock(&drv->lock);
+        int count = drv->count;
+        if (count > fds_cap) {
+            fds_cap = drv->capacity;
+            fds = realloc(fds, sizeof(struct pollfd) * fds_cap);
+        }
+        for (int i = 0; i < count; i++) {
+            fds[i].fd = drv->drones[i]->fd;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        pthread_mutex_unlock(&drv->lock);
+
+        int ready = poll(fds, count, 10);
+        uint64_t now = now_ns();
+        for (int i = 0; i < count; i++) {
+            SimDrone *d = drv->drones[i];
+            if (opts.reconnect && reconnect_step(d, now)) {
+                // Only read while away: the fd may be new since the poll
+                if (d->fd >= 0 && fds[i].fd == d->fd && (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) &&
+                    read_messages(d) < 0) {
+                    close(d->fd);
+                    d->fd = -1;
+                    if (d->dropped_ns) schedule_reconnect(d, now);
+                }
+                continue;
+            }
+            if (d->fd < 0) continue;
+            if (ready > 0 && (fds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                if (read_messages(d) < 0) {
+                    close(d->fd);
+                    d->fd = -1;
+                    continue;
+                }
+            }
+            if (now >= d->next_update_ns) {
+                tick(d, now);
+                d->next_update_ns += (uint64_t)opts.update_interval_ms * 1000000ULL;
+                if (d->next_update_ns < now) d->next_update_ns = now;
+            }
+        }
+    }
+    free(fds);
+    return NULL;
+}
+
+static int connect_loopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static int add_drone(int id) {
+    SimDrone *d = calloc(1, sizeof(SimDrone));
+    if (!d) return -1;
+    d->id = id;
+    d->x = rand() % LT_MAP_WIDTH;
+    d->y = rand() % LT_MAP_HEIGHT;
+    d->reported_busy = -1;  // first tick always reports
+    d->deviation_threshold = DEADRECKON_DEVIATION_CELLS;
+    d->status_interval = 5;
+    d->heartbeat_interval = 10;
+    d->quiet_s = 5;
+    d->home = (Coord){d->x, d->y};
+    d->battery = 100;
+    d->cells_per_tick = 1;
+    d->payload = "general";
+    if (opts.mixed_fleet) {
+        d->cells_per_tick = lt_speeds[id % 3];
+        d->range_cells = lt_ranges[(id / 3) % 3];
+        d->payload = lt_payloads[(id / 9) % 3];
+    }
+    d->fd = connect_loopback(opts.port);
+    if (d->fd < 0) {
+        free(d);
+        return -1;
+    }
+    send_handshake(d);
+    // Spread first updates across the interval so the load is not lock-stepped
+    d->next_update_ns = now_ns() + (uint64_t)(rand() % opts.update_interval_ms) * 1000000ULL;
+
+    Driver *drv = &drivers[id % opts.drivers];
+    pthread_mutex_lock(&drv->lock);
+    if (drv->count == drv->capacity) {
+        drv->capacity = drv->capacity ? drv->capacity * 2 : 64;
+        drv->drones = realloc(drv->drones, sizeof(SimDrone *) * drv->capacity);
+    }
+    drv->drones[drv->count++] = d;
+    pthread_mutex_unlock(&drv->lock);
+    return 0;
+}
+
+/* ---- server process and scraping ---- */
+
+static pid_t start_server() {
+    char port[16], metrics_port[16], rate[32], max_drones[16];
+    snprintf(port, sizeof(port), "%d", opts.port);
+    snprintf(metrics_port, sizeof(metrics_port), "%d", opts.metrics_port);
+    snprintf(rate, sizeof(rate), "%g", opts.survivor_rate);
+    snprintf(max_drones, sizeof(max_drones), "%d", opts.max_drones + 16);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        char *argv[24] = {(char *)opts.server_path, "--headless", "--port", port, "--metrics-port", metrics_port,
+                          "--survivor-rate", rate, "--max-drones", max_drones, NULL};
+        int argc = 10;
+        if (opts.dispatch) {
+            argv[argc++] = "--dispatch";
+            argv[argc++] = (char *)opts.dispatch;
+        }
+        if (opts.tour_stops) {
+            argv[argc++] = "--tour-stops";
+            argv[argc++] = (char *)opts.tour_stops;
+        }
+        if (opts.obstacles) {
+            argv[argc++] = "--obstacles";
+            argv[argc++] = (char *)opts.obstacles;
+        }
+        if (opts.acceptors) {
+            argv[argc++] = "--acceptors";
+            argv[argc++] = (char *)opts.acceptors;
+        }
+        if (opts.backlog) {
+            argv[argc++] = "--backlog";
+            argv[argc++] = (char *)opts.backlog;
+        }
+        execv(opts.server_path, argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop_server(pid_t pid) {
+    if (kill(pid, SIGTERM) != 0) return;  // already exited and reaped
+    for (int i = 0; i < 100; i++) {
+        if (waitpid(pid, NULL, WNOHANG) == pid) return;
+        usleep(100000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+// Fetches path from the metrics endpoint; returns a malloc'd body or NULL.
+static char *http_get(const char *path) {
+    int fd = connect_loopback(opts.metrics_port);
+    if (fd < 0) return NULL;
+    char request[128];
+    int len = snprintf(request, sizeof(request), "GET %s HTTP/1.0\r\n\r\n", path);
+    if (send(fd, request, len, MSG_NOSIGNAL) != len) {
+        close(fd);
+        return NULL;
+    }
+    size_t cap = 65536, used = 0;
+    char *buf = malloc(cap);
+    ssize_t n;
+    while (buf && (n = recv(fd, buf + used, cap - used - 1, 0)) > 0) {
+        used += n;
+        if (used + 1 == cap) {
+            cap *= 2;
+            buf = realloc(buf, cap);
+        }
+    }
+    close(fd);
+    if (!buf) return NULL;
+    buf[used] = '\0';
+    char *body = strstr(buf, "\r\n\r\n");
+    if (!body) {
+        free(buf);
+        return NULL;
+    }
+    memmove(buf, body + 4, strlen(body + 4) + 1);
+    return buf;
+}
+
+static void parse_raw(const char *body, Scrape *s) {
+    const char *line = body;
+    while (line && *line) {
+        char name[64];
+        int index;
+        unsigned long long upper, count;
+        if (sscanf(line, "%63s %d %llu %llu", name, &index, &upper, &count) == 4 &&
+            index >= 0 && index < LT_HIST_SLOTS) {
+            RawHist *h = NULL;
+            if (strcmp(name, "handler:STATUS_UPDATE") == 0) h = &s->handler;
+            else if (strcmp(name, "handler:MISSION_COMPLETE") == 0) h = &s->critical;
+            else if (strcmp(name, "survivor:discovery_to_assign") == 0) h = &s->to_assign;
+            else if (strcmp(name, "survivor:discovery_to_rescue") == 0) h = &s->to_rescue;
+            if (h) {
+                h->upper[index] = upper;
+                h->count[index] = count;
+            }
+        }
+        line = strchr(line, '\n');
+        if (line) line++;
+    }
+}
+
+static void read_proc(pid_t pid, Scrape *s) {
+    char path[64], buf[4096];
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    FILE *f = fopen(path, "r");
+    if (f) {
+        if (fgets(buf, sizeof(buf), f)) {
+            // utime and stime are fields 14 and 15; skip past the parenthesised comm
+            char *p = strrchr(buf, ')');
+            unsigned long long utime = 0, stime = 0;
+            if (p && sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) == 2) {
+                s->cpu_ticks = utime + stime;
+            }
+        }
+        fclose(f);
+    }
+    snprintf(path, sizeof(path), "/proc/%d/status", (int)pid);
+    f = fopen(path, "r");
+    if (f) {
+        while (fgets(buf, sizeof(buf), f)) {
+            if (sscanf(buf, "VmRSS: %ld kB", &s->rss_kb) == 1) break;
+        }
+        fclose(f);
+    }
+}
+
+static int take_scrape(pid_t pid, Scrape *s) {
+    memset(s, 0, sizeof(*s));
+    s->at_ns = now_ns();
+    char *metrics = http_get("/metrics");
+    char *raw = http_get("/metrics/raw");
+    if (!metrics || !raw) {
+        free(metrics);
+        free(raw);
+        return -1;
+    }
+    const char *key = "edcs_messages_total{type=\"STATUS_UPDATE\"} ";
+    char *p = strstr(metrics, key);
+    if (p) s->status_updates = atof(p + strlen(key));
+    key = "edcs_position_error_mean_cells ";
+    p = strstr(metrics, key);
+    if (p) s->position_error = atof(p + strlen(key));
+    parse_raw(raw, s);
+    read_proc(pid, s);
+    free(metrics);
+    free(raw);
+    return 0;
+}
+
+// Current value of a gauge or counter on /metrics, -1 if it cannot be read.
+static double scrape_value(const char *name) {
+    char *metrics = http_get("/metrics");
+    if (!metrics) return -1;
+    char key[128];
+    snprintf(key, sizeof(key), "\n%s ", name);
+    char *p = strstr(metrics, key);
+    double value = p ? atof(p + strlen(key)) : -1;
+    free(metrics);
+    return value;
+}
+
+typedef struct burst {
+    pthread_t thread;
+    int *fds;
+    int count;
+    uint64_t slowest_ns;   // longest single connect()
+} Burst;
+
+static void *burst_connect(void *arg) {
+    Burst *b = (Burst *)arg;
+    for (int i = 0; i < b->count; i++) {
+        uint64_t start = now_ns();
+        b->fds[i] = connect_loopback(opts.port);
+        uint64_t took = now_ns() - start;
+        if (took > b->slowest_ns) b->slowest_ns = took;
+    }
+    return NULL;
+}
+
+// --connect-burst: opens n connections from every driver thread at once and
+// waits for the server to have accepted them all. A backlog that overflows
+// shows up as connects stalled for a SYN retransmit (1 s and up).
+static int connect_burst(int n, double *seconds, double *slowest_ms) {
+    double before = scrape_value("edcs_connections_accepted");
+    if (before < 0) return -1;
+    Burst bursts[LT_MAX_DRIVERS] = {0};
+    int *fds = malloc(sizeof(int) * n);
+    if (!fds) return -1;
+    uint64_t start = now_ns();
+    for (int i = 0, first = 0; i < opts.drivers; i++) {
+        bursts[i].fds = fds + first;
+        bursts[i].count = n / opts.drivers + (i < n % opts.drivers);
+        first += bursts[i].count;
+        pthread_create(&bursts[i].thread, NULL, burst_connect, &bursts[i]);
+    }
+    *slowest_ms = 0;
+    for (int i = 0; i < opts.drivers; i++) {
+        pthread_join(bursts[i].thread, NULL);
+        if (bursts[i].slowest_ns / 1e6 > *slowest_ms) *slowest_ms = bursts[i].slowest_ns / 1e6;
+    }
+    int opened = 0;
+    for (int i = 0; i < n; i++) opened += fds[i] >= 0;
+    double accepted = 0;
+    uint64_t deadline = start + LT_BURST_TIMEOUT_S * 1000000000ULL;
+    while ((accepted = scrape_value("edcs_connections_accepted") - before) < opened && now_ns() < deadline) {
+        usleep(1000);
+    }
+    *seconds = (now_ns() - start) / 1e9;
+    for (int i = 0; i < n; i++) {
+        if (fds[i] >= 0) close(fds[i]);
+    }
+    free(fds);
+    return (int)accepted;
+}
+
+// Quantile (ms) of the samples recorded between two scrapes.
+static double window_quantile(const RawHist *before, const RawHist *after, double q, uint64_t *total_out) {
+    uint64_t total = 0;
+    for (int i = 0; i < LT_HIST_SLOTS; i++) total += after->count[i] - (before ? before->count[i] : 0);
+    if (total_out) *total_out = total;
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < LT_HIST_SLOTS; i++) {
+        seen += after->count[i] - (before ? before->count[i] : 0);
+        if (seen >= rank) return after->upper[i] / 1e6;
+    }
+    return 0;
+}
+
+static void write_distribution(FILE *out, const char *name, const RawHist *h) {
+    uint64_t count;
+    double p50 = window_quantile(NULL, h, 0.5, &count);
+    fprintf(out, "  \"%s\": {\"count\": %llu, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f}",
+            name, (unsigned long long)count, p50, window_quantile(NULL, h, 0.9, NULL),
+            window_quantile(NULL, h, 0.99, NULL), window_quantile(NULL, h, 1.0, NULL));
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Drones that were dropped and have not been acked back yet.
+static int drones_away(int *dropped_out) {
+    int away = 0, dropped = 0;
+    for (int i = 0; i < opts.drivers; i++) {
+        pthread_mutex_lock(&drivers[i].lock);
+        for (int j = 0; j < drivers[i].count; j++) {
+            SimDrone *d = drivers[i].drones[j];
+            dropped += __atomic_load_n(&d->dropped_once, __ATOMIC_RELAXED);
+            away += __atomic_load_n(&d->dropped_ns, __ATOMIC_RELAXED) != 0;
+        }
+        pthread_mutex_unlock(&drivers[i].lock);
+    }
+    if (dropped_out) *dropped_out = dropped;
+    return away;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--server path] [--port n] [--metrics-port n] [--max-drones n] [--step n]\n"
+            "          [--step-seconds n] [--interval-ms n] [--survivor-rate r] [--p99-limit-ms x]\n"
+            "          [--drivers n] [--dead-reckoning] [--storm n] [--mixed-fleet]\n"
+            "          [--dispatch eta|nearest] [--tour-stops n] [--obstacles file] [--reconnect]\n"
+            "          [--connect-burst n] [--acceptors n] [--backlog n] [--out file]\n", prog);
+}
+
+static int parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--dead-reckoning") == 0) {
+            opts.dead_reckoning = 1;
+            continue;
+        }
+        if (strcmp(arg, "--mixed-fleet") == 0) {
+            opts.mixed_fleet = 1;
+            continue;
+        }
+        if (strcmp(arg, "--reconnect") == 0) {
+            opts.reconnect = 1;
+            continue;
+        }
+        const char *value = (i + 1 < argc) ? argv[++i] : NULL;
+        if (!value) return -1;
+        if (strcmp(arg, "--server") == 0) opts.server_path = value;
+        else if (strcmp(arg, "--out") == 0) opts.out_path = value;
+        else if (strcmp(arg, "--port") == 0) opts.port = atoi(value);
+        else if (strcmp(arg, "--metrics-port") == 0) opts.metrics_port = atoi(value);
+        else if (strcmp(arg, "--max-drones") == 0) opts.max_drones = atoi(value);
+        else if (strcmp(arg, "--step") == 0) opts.step = atoi(value);
+        else if (strcmp(arg, "--step-seconds") == 0) opts.step_seconds = atoi(value);
+        else if (strcmp(arg, "--interval-ms") == 0) opts.update_interval_ms = atoi(value);
+        else if (strcmp(arg, "--survivor-rate") == 0) opts.survivor_rate = atof(value);
+        else if (strcmp(arg, "--p99-limit-ms") == 0) opts.p99_limit_ms = atof(value);
+        else if (strcmp(arg, "--drivers") == 0) opts.drivers = atoi(value);
+        else if (strcmp(arg, "--storm") == 0) opts.storm = atoi(value);
+        else if (strcmp(arg, "--dispatch") == 0) opts.dispatch = value;
+        else if (strcmp(arg, "--tour-stops") == 0) opts.tour_stops = value;
+        else if (strcmp(arg, "--obstacles") == 0) opts.obstacles = value;
+        else if (strcmp(arg, "--connect-burst") == 0) opts.connect_burst = atoi(value);
+        else if (strcmp(arg, "--acceptors") == 0) opts.acceptors = value;
+        else if (strcmp(arg, "--backlog") == 0) opts.backlog = value;
+        else return -1;
+    }
+    if (opts.drivers < 1) opts.drivers = 1;
+    if (opts.drivers > LT_MAX_DRIVERS) opts.drivers = LT_MAX_DRIVERS;
+    if (opts.step < 1 || opts.max_drones < 1 || opts.step_seconds < 1 || opts.update_interval_ms < 1) return -1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (parse_args(argc, argv) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    srand(1);
+    obstacles_init(&obstacles, 0, 0);
+    if (path_cache_init(&paths, &obstacles, LT_PATH_FIELDS) != 0) return 1;
+    recovery_ns = calloc(opts.max_drones, sizeof(uint64_t));
+    if (!recovery_ns) return 1;
+
+    pid_t server = start_server();
+    if (server < 0) {
+        perror("fork");
+        return 1;
+    }
+    // Wait for the listener to come up
+    int probe = -1;
+    for (int i = 0; i < 50 && probe < 0; i++) {
+        usleep(100000);
+        probe = connect_loopback(opts.metrics_port);
+    }
+    if (probe < 0) {
+        fprintf(stderr, "server did not come up on metrics port %d\n", opts.metrics_port);
+        stop_server(server);
+        return 1;
+    }
+    close(probe);
+
+    int burst_accepted = 0;
+    double burst_seconds = 0, burst_slowest_ms = 0;
+    if (opts.connect_burst > 0) {
+        burst_accepted = connect_burst(opts.connect_burst, &burst_seconds, &burst_slowest_ms);
+        printf("connect burst: %d of %d connections accepted in %.3fs (%.0f/s), slowest connect %.1f ms\n\n",
+               burst_accepted, opts.connect_burst, burst_seconds,
+               burst_seconds > 0 ? burst_accepted / burst_seconds : 0, burst_slowest_ms);
+        // Let the server close them before the ramp
+        for (int i = 0; i < 100 && scrape_value("edcs_connections_open") > 0; i++) usleep(50000);
+    }
+
+    for (int i = 0; i < opts.drivers; i++) {
+        pthread_mutex_init(&drivers[i].lock, NULL);
+        pthread_create(&drivers[i].thread, NULL, driver_loop, &drivers[i]);
+    }
+
+    int steps_max = (opts.max_drones + opts.step - 1) / opts.step;
+    StepResult *results = calloc(steps_max, sizeof(StepResult));
+    Scrape *first = malloc(sizeof(Scrape)), *prev = malloc(sizeof(Scrape)), *cur = malloc(sizeof(Scrape));
+    if (!results || !first || !prev || !cur || take_scrape(server, first) != 0) {
+        fprintf(stderr, "could not scrape metrics\n");
+        running = 0;
+        stop_server(server);
+        return 1;
+    }
+    memcpy(prev, first, sizeof(Scrape));
+    long ticks_per_sec = sysconf(_SC_CLK_TCK);
+
+    printf("%8s %14s %10s %10s %12s %8s %10s\n", "drones", "updates/s", "p50 ms", "p99 ms", "crit p99 ms",
+           "cpu %", "rss kB");
+    int connected = 0, nsteps = 0, break_step = -1, stormed = 0;
+    while (connected < opts.max_drones) {
+        int target = connected + opts.step;
+        if (target > opts.max_drones) target = opts.max_drones;
+        while (connected < target) {
+            if (add_drone(connected + 1) != 0) {
+                fprintf(stderr, "connect failed at drone %d\n", connected + 1);
+                break;
+            }
+            connected++;
+        }
+        for (int i = 0; i < opts.storm; i++) {
+            if (add_drone(LT_STORM_ID_BASE + stormed) == 0) stormed++;
+        }
+        sleep(opts.step_seconds);
+        if (take_scrape(server, cur) != 0) {
+            int status;
+            if (waitpid(server, &status, WNOHANG) == server) {
+                if (WIFSIGNALED(status)) {
+                    fprintf(stderr, "server died with signal %d at %d drones\n", WTERMSIG(status), connected);
+                } else {
+                    fprintf(stderr, "server exited with status %d at %d drones\n", WEXITSTATUS(status), connected);
+                }
+            } else {
+                fprintf(stderr, "server stopped responding at %d drones\n", connected);
+            }
+            break;
+        }
+
+        double secs = (cur->at_ns - prev->at_ns) / 1e9;
+        StepResult *r = &results[nsteps++];
+        r->drones = connected;
+        r->updates_per_sec = (cur->status_updates - prev->status_updates) / secs;
+        r->p50_ms = window_quantile(&prev->handler, &cur->handler, 0.5, NULL);
+        r->p99_ms = window_quantile(&prev->handler, &cur->handler, 0.99, NULL);
+        r->critical_p99_ms = window_quantile(&prev->critical, &cur->critical, 0.99, NULL);
+        r->cpu_percent = 100.0 * (cur->cpu_ticks - prev->cpu_ticks) / ticks_per_sec / secs;
+        r->rss_kb = cur->rss_kb;
+        printf("%8d %14.1f %10.3f %10.3f %12.3f %8.1f %10ld\n", r->drones, r->updates_per_sec,
+               r->p50_ms, r->p99_ms, r->critical_p99_ms, r->cpu_percent, r->rss_kb);
+        fflush(stdout);
+        if (break_step < 0 && r->p99_ms > opts.p99_limit_ms) break_step = nsteps - 1;
+
+        Scrape *tmp = prev;
+        prev = cur;
+        cur = tmp;
+        if (connected < target) break;
+    }
+
+    // Every drone loses the server at once and has to find its way back
+    int dropped = 0;
+    double recovery_s = 0, recovery_p50 = 0, recovery_p99 = 0, reconnect_p99 = 0;
+    if (opts.reconnect) {
+        printf("\ndropping %d connections\n", connected);
+        drop_ns = now_ns();
+        uint64_t deadline = drop_ns + LT_RECOVERY_TIMEOUT_S * 1000000000ULL;
+        usleep(100000);  // every driver has passed over its drones
+        while (drones_away(&dropped) > 0 && now_ns() < deadline) usleep(10000);
+        unsigned long long n = recovered < (unsigned long long)opts.max_drones ? recovered : opts.max_drones;
+        qsort(recovery_ns, n, sizeof(uint64_t), compare_u64);
+        if (n > 0) {
+            recovery_s = recovery_ns[n - 1] / 1e9;
+            recovery_p50 = recovery_ns[(n - 1) / 2] / 1e6;
+            recovery_p99 = recovery_ns[(size_t)((n - 1) * 0.99)] / 1e6;
+        }
+        if (take_scrape(server, cur) == 0) {
+            reconnect_p99 = window_quantile(&prev->handler, &cur->handler, 0.99, NULL);
+            Scrape *tmp = prev;
+            prev = cur;
+            cur = tmp;
+        }
+    }
+
+    running = 0;
+    for (int i = 0; i < opts.drivers; i++) pthread_join(drivers[i].thread, NULL);
+    stop_server(server);
+
+    double sustained = 0;
+    for (int i = 0; i < nsteps && (break_step < 0 || i < break_step); i++) {
+        if (results[i].updates_per_sec > sustained) sustained = results[i].updates_per_sec;
+    }
+    printf("\nmax sustained STATUS_UPDATE/s below p99 %.1f ms: %.1f\n", opts.p99_limit_ms, sustained);
+    if (break_step >= 0) {
+        printf("p99 limit broken at %d drones (%.1f updates/s)\n",
+               results[break_step].drones, results[break_step].updates_per_sec);
+    } else {
+        printf("p99 limit not reached up to %d drones\n", connected);
+    }
+    printf("updates sent: %llu, missions completed: %llu, stranded: %llu, refused with 503: %llu\n",
+           sent_updates, rescues_reported, stranded, refusals);
+    double rescued = rescues_reported ? (double)rescues_reported : 1;
+    printf("per rescue: %.1f messages sent, %.1f cells flown; repositions: %llu\n", sent_messages / rescued,
+           cells_flown / rescued, repositions);
+    printf("mean position error at report: %.2f cells, config updates: %llu\n", prev->position_error,
+           config_updates);
+    if (opts.reconnect) {
+        printf("reconnect: %llu of %d dropped drones back in %.2fs (p50 %.1f ms, p99 %.1f ms), handler p99 %.3f ms\n",
+               recovered, dropped, recovery_s, recovery_p50, recovery_p99, reconnect_p99);
+        printf("reconnect: %llu resumed, %llu registered again after 401, %llu refused with 503\n", resumed,
+               resume_fallbacks, reconnect_refusals);
+    }
+
+    FILE *out = fopen(opts.out_path, "w");
+    if (out) {
+        fprintf(out, "{\n  \"survivor_rate\": %g,\n  \"update_interval_ms\": %d,\n  \"p99_limit_ms\": %g,\n",
+                opts.survivor_rate, opts.update_interval_ms, opts.p99_limit_ms);
+        fprintf(out, "  \"dead_reckoning\": %s,\n", opts.dead_reckoning ? "true" : "false");
+        fprintf(out, "  \"mixed_fleet\": %s,\n  \"dispatch\": \"%s\",\n", opts.mixed_fleet ? "true" : "false",
+                opts.dispatch ? opts.dispatch : "eta");
+        fprintf(out, "  \"steps\": [\n");
+        for (int i = 0; i < nsteps; i++) {
+            fprintf(out, "    {\"drones\": %d, \"status_updates_per_sec\": %.1f, \"handler_p50_ms\": %.3f, "
+                         "\"handler_p99_ms\": %.3f, \"mission_complete_p99_ms\": %.3f, \"cpu_percent\": %.1f, "
+                         "\"rss_kb\": %ld}%s\n",
+                    results[i].drones, results[i].updates_per_sec, results[i].p50_ms, results[i].p99_ms,
+                    results[i].critical_p99_ms, results[i].cpu_percent, results[i].rss_kb,
+                    i + 1 < nsteps ? "," : "");
+        }
+        fprintf(out, "  ],\n  \"max_sustained_status_updates_per_sec\": %.1f,\n", sustained);
+        fprintf(out, "  \"position_error_mean_cells\": %.3f,\n", prev->position_error);
+        fprintf(out, "  \"config_updates\": %llu,\n", config_updates);
+        fprintf(out, "  \"storm\": %d,\n  \"refused_503\": %llu,\n", opts.storm, refusals);
+        fprintf(out, "  \"missions_completed\": %llu,\n  \"missions_stranded\": %llu,\n", rescues_reported, stranded);
+        fprintf(out, "  \"messages_per_rescue\": %.2f,\n  \"cells_flown_per_rescue\": %.2f,\n",
+                sent_messages / rescued, cells_flown / rescued);
+        fprintf(out, "  \"repositions\": %llu,\n", repositions);
+        if (opts.connect_burst > 0) {
+            fprintf(out, "  \"connect_burst\": {\"connections\": %d, \"accepted\": %d, \"seconds\": %.3f, "
+                         "\"accepted_per_sec\": %.1f, \"slowest_connect_ms\": %.1f},\n",
+                    opts.connect_burst, burst_accepted, burst_seconds,
+                    burst_seconds > 0 ? burst_accepted / burst_seconds : 0, burst_slowest_ms);
+        }
+        if (opts.reconnect) {
+            fprintf(out, "  \"reconnect\": {\"dropped\": %d, \"recovered\": %llu, \"resumed\": %llu, "
+                         "\"handshake_fallbacks\": %llu, \"refused_503\": %llu, \"recovery_p50_ms\": %.3f, "
+                         "\"recovery_p99_ms\": %.3f, \"recovery_all_s\": %.3f, \"handler_p99_ms\": %.3f},\n",
+                    dropped, recovered, resumed, resume_fallbacks, reconnect_refusals, recovery_p50, recovery_p99,
+                    recovery_s, reconnect_p99);
+        }
+        if (break_step >= 0) {
+            fprintf(out, "  \"breaking_point\": {\"drones\": %d, \"status_updates_per_sec\": %.1f},\n",
+                    results[break_step].drones, results[break_step].updates_per_sec);
+        } else {
+            fprintf(out, "  \"breaking_point\": null,\n");
+        }
+        write_distribution(out, "time_to_assign_ms", &prev->to_assign);
+        fprintf(out, ",\n");
+        write_distribution(out, "time_to_rescue_ms", &prev->to_rescue);
+        fprintf(out, "\n}\n");
+        fclose(out);
+        printf("report written to %s\n", opts.out_path);
+    }
+
+    free(results);
+    free(recovery_ns);
+    free(first);
+    free(prev);
+    free(cur);
+    return 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * @file lockprof.c
+ * @brief Per-mutex and per-call-site lock statistics for LOCK_PROFILE builds.
+ *
+ * Mutexes and call sites live in two fixed open-addressing tables, claimed
+ * with a compare-and-swap on the key, so recording never takes a lock of
+ * its own. Counters are atomic adds. The acquisition time, owner and
+ * recursion depth of a mutex are only written by the thread holding it,
+ * which makes hold times exact for the recursive list and map locks too:
+ * only the outermost acquisition is timed. A mutex taken without LOCK()
+ * (e.g. through pthread_mutex_lock directly) is ignored by UNLOCK().
+ */
+#define _GNU_SOURCE
+#include "headers/lockprof.h"
+#include "headers/metrics.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+typedef struct lockprof_site {
+    uint64_t key;            // file pointer << 16 | line, 0 if free
+    const char *file;
+    int line;
+    const char *name;
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t wait_ns;
+    uint64_t hold_ns;
+    uint64_t max_wait_ns;
+    uint64_t wait_hist[LOCKPROF_BUCKETS];
+} LockprofSite;
+
+typedef struct lockprof_lock {
+    uintptr_t addr;          // 0 if free
+    const char *name;
+    LockprofSite *first;     // site that first took it
+    uint64_t acquisitions;
+    uint64_t contended;
+    uint64_t wait_ns;
+    uint64_t hold_ns;
+    uint64_t max_wait_ns;
+    uint64_t max_hold_ns;
+    // Written by the holder only
+    int owner;
+    int depth;
+    uint64_t acquired_ns;
+    LockprofSite *site;
+} LockprofLock;
+
+static LockprofSite sites[LOCKPROF_SITES];
+static LockprofLock locks[LOCKPROF_LOCKS];
+static uint64_t untracked = 0;     // acquisitions that found a table full
+static __thread int self_tid;
+
+static int self() {
+    if (!self_tid) self_tid = (int)syscall(SYS_gettid);
+    return self_tid;
+}
+
+static uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static LockprofSite *site_for(const char *file, int line, const char *name) {
+    uint64_t key = (uint64_t)(uintptr_t)file << 16 | (uint16_t)line;
+    for (uint64_t i = mix(key), n = 0; n < LOCKPROF_SITES; i++, n++) {
+        LockprofSite *s = &sites[i & (LOCKPROF_SITES - 1)];
+        uint64_t seen = __atomic_load_n(&s->key, __ATOMIC_ACQUIRE);
+        if (seen == key) return s;
+        if (seen == 0) {
+            if (__atomic_compare_exchange_n(&s->key, &seen, key, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                s->line = line;
+                s->name = name;
+                __atomic_store_n(&s->file, file, __ATOMIC_RELEASE);
+                return s;
+            }
+            if (seen == key) return s;
+        }
+    }
+    return NULL;
+}
+
+// Finds the record for m, creating it if create is set.
+static LockprofLock *lock_for(pthread_mutex_t *m, int create, const char *name, LockprofSite *site) {
+    uintptr_t addr = (uintptr_t)m;
+    for (uint64_t i = mix(addr), n = 0; n < LOCKPROF_LOCKS; i++, n++) {
+        LockprofLock *l = &locks[i & (LOCKPROF_LOCKS - 1)];
+        uintptr_t seen = __atomic_load_n(&l->addr, __ATOMIC_ACQUIRE);
+        if (seen == addr) return l;
+        if (seen != 0) continue;
+        if (!create) return NULL;
+        if (__atomic_compare_exchange_n(&l->addr, &seen, addr, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            l->name = name;
+            __atomic_store_n(&l->first, site, __ATOMIC_RELEASE);
+            return l;
+        }
+        if (seen == addr) return l;
+    }
+    return NULL;
+}
+
+static void update_max(uint64_t *max, uint64_t value) {
+    uint64_t seen = __atomic_load_n(max, __ATOMIC_RELAXED);
+    while (value > seen &&
+           !__atomic_compare_exchange_n(max, &seen, value, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Takes m like pthread_mutex_lock and returns how long it waited, in ns.
+uint64_t lockprof_lock(pthread_mutex_t *m, const char *name, const char *file, int line) {
+    uint64_t wait = 0;
+    int contended = pthread_mutex_trylock(m) != 0;
+    if (contended) {
+        uint64_t start = metrics_now_ns();
+        pthread_mutex_lock(m);
+        wait = metrics_now_ns() - start;
+    }
+    LockprofSite *site = site_for(file, line, name);
+    LockprofLock *l = lock_for(m, 1, name, site);
+    if (!site || !l) {
+        __atomic_add_fetch(&untracked, 1, __ATOMIC_RELAXED);
+        return wait;
+    }
+    __atomic_add_fetch(&site->acquisitions, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&l->acquisitions, 1, __ATOMIC_RELAXED);
+    if (l->depth > 0 && l->owner == self()) {
+        l->depth++;  // recursive: timed by the outermost acquisition
+        return 0;
+    }
+    if (contended) {
+        __atomic_add_fetch(&site->contended, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&l->contended, 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&site->wait_ns, wait, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&l->wait_ns, wait, __ATOMIC_RELAXED);
+        update_max(&site->max_wait_ns, wait);
+        update_max(&l->max_wait_ns, wait);
+    }
+    int bucket = wait ? 64 - __builtin_clzll(wait) : 0;
+    if (bucket >= LOCKPROF_BUCKETS) bucket = LOCKPROF_BUCKETS - 1;
+    __atomic_add_fetch(&site->wait_hist[bucket], 1, __ATOMIC_RELAXED);
+    l->owner = self();
+    l->depth = 1;
+    l->site = site;
+    l->acquired_ns = metrics_now_ns();
+    return wait;
+}
+
+void lockprof_unlock(pthread_mutex_t *m) {
+    LockprofLock *l = lock_for(m, 0, NULL, NULL);
+    if (l && l->depth > 0 && l->owner == self() && --l->depth == 0) {
+        uint64_t hold = metrics_now_ns() - l->acquired_ns;
+        l->owner = 0;
+        __atomic_add_fetch(&l->hold_ns, hold, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&l->site->hold_ns, hold, __ATOMIC_RELAXED);
+        update_max(&l->max_hold_ns, hold);
+    }
+    pthread_mutex_unlock(m);
+}
+
+// Upper bound of the bucket holding quantile q of the site's waits, in ns.
+static uint64_t site_wait_quantile(const LockprofSite *s, double q) {
+    uint64_t total = 0, seen = 0;
+    for (int b = 0; b < LOCKPROF_BUCKETS; b++) total += s->wait_hist[b];
+    if (total == 0) return 0;
+    for (int b = 0; b < LOCKPROF_BUCKETS; b++) {
+        seen += s->wait_hist[b];
+        if (seen >= q * total) return b == 0 ? 0 : 1ULL << b;
+    }
+    return 1ULL << (LOCKPROF_BUCKETS - 1);
+}
+
+static int compare_lock_wait(const void *a, const void *b) {
+    const LockprofLock *x = *(LockprofLock *const *)a, *y = *(LockprofLock *const *)b;
+    if (x->wait_ns != y->wait_ns) return x->wait_ns > y->wait_ns ? -1 : 1;
+    return (x->acquisitions < y->acquisitions) - (x->acquisitions > y->acquisitions);
+}
+
+static int compare_site_wait(const void *a, const void *b) {
+    const LockprofSite *x = *(LockprofSite *const *)a, *y = *(LockprofSite *const *)b;
+    if (x->wait_ns != y->wait_ns) return x->wait_ns > y->wait_ns ? -1 : 1;
+    return (x->acquisitions < y->acquisitions) - (x->acquisitions > y->acquisitions);
+}
+
+// Mutexes of the same name (e.g. every drone's lock) are listed one by
+// one; their call sites add up in the second table. Returns the number of
+// call sites seen, 0 in builds without LOCK_PROFILE.
+int lockprof_report(FILE *out) {
+    static LockprofLock *by_lock[LOCKPROF_LOCKS];
+    static LockprofSite *by_site[LOCKPROF_SITES];
+    int nlocks = 0, nsites = 0;
+    for (int i = 0; i < LOCKPROF_LOCKS; i++) {
+        // A slot whose first site is not set yet is still being claimed
+        if (__atomic_load_n(&locks[i].first, __ATOMIC_ACQUIRE)) by_lock[nlocks++] = &locks[i];
+    }
+    for (int i = 0; i < LOCKPROF_SITES; i++) {
+        if (__atomic_load_n(&sites[i].file, __ATOMIC_ACQUIRE)) by_site[nsites++] = &sites[i];
+    }
+    if (nsites == 0) return 0;
+    qsort(by_lock, nlocks, sizeof(LockprofLock *), compare_lock_wait);
+    qsort(by_site, nsites, sizeof(LockprofSite *), compare_site_wait);
+
+    fprintf(out, "Lock contention by mutex (%d seen, top %d by total wait)\n", nlocks, LOCKPROF_REPORT_ROWS);
+    fprintf(out, "%12s %12s %10s %12s %12s %12s  %s\n", "wait ms", "acquired", "contended", "max wait us",
+            "hold ms", "max hold us", "mutex (first taken at)");
+    for (int i = 0; i < nlocks && i < LOCKPROF_REPORT_ROWS; i++) {
+        const LockprofLock *l = by_lock[i];
+        fprintf(out, "%12.3f %12llu %9.2f%% %12.1f %12.3f %12.1f  %s %p (%s:%d)\n", l->wait_ns / 1e6,
+                (unsigned long long)l->acquisitions, l->acquisitions ? 100.0 * l->contended / l->acquisitions : 0,
+                l->max_wait_ns / 1e3, l->hold_ns / 1e6, l->max_hold_ns / 1e3, l->name, (void *)l->addr,
+                l->first->file, l->first->line);
+    }
+    fprintf(out, "\nLock contention by call site (%d seen, top %d by total wait)\n", nsites, LOCKPROF_REPORT_ROWS);
+    fprintf(out, "%12s %12s %10s %12s %12s %12s  %s\n", "wait ms", "acquired", "contended", "p50 wait us",
+            "p99 wait us", "hold ms", "site");
+    for (int i = 0; i < nsites && i < LOCKPROF_REPORT_ROWS; i++) {
+        const LockprofSite *s = by_site[i];
+        fprintf(out, "%12.3f %12llu %9.2f%% %12.1f %12.1f %12.3f  %s:%d %s\n", s->wait_ns / 1e6,
+                (unsigned long long)s->acquisitions, s->acquisitions ? 100.0 * s->contended / s->acquisitions : 0,
+                site_wait_quantile(s, 0.5) / 1e3, site_wait_quantile(s, 0.99) / 1e3, s->hold_ns / 1e6, s->file,
+                s->line, s->name);
+    }
+    uint64_t lost = __atomic_load_n(&untracked, __ATOMIC_RELAXED);
+    if (lost) fprintf(out, "\n%llu acquisitions not tracked (tables full)\n", (unsigned long long)lost);
+    return nsites;
+}
@@ -1,50 +1,174 @@
 #include "headers/map.h"
 #include "headers/list.h"
+#include "headers/lockprof.h"
 #include <stdlib.h>
 #include <stdio.h>
 
 // Global map instance (defined here, declared extern in map.h)
 //Map map;
 
+static int tile_index(int x, int y) {
+    return (y >> MAP_TILE_SHIFT) * map.tiles_x + (x >> MAP_TILE_SHIFT);
+}
+
+static int cell_index(int x, int y) {
+    return (y & (MAP_TILE_SIZE - 1)) * MAP_TILE_SIZE + (x & (MAP_TILE_SIZE - 1));
+}
+
+static pthread_mutex_t *cell_stripe(int x, int y) {
+    return &map.stripes[tile_index(x, y) % MAP_LOCK_STRIPES];
+}
+
 void init_map(int height, int width) {
     map.height = height;
     map.width = width;
+    map.tiles_x = (width + MAP_TILE_SIZE - 1) / MAP_TILE_SIZE;
+    map.tiles_y = (height + MAP_TILE_SIZE - 1) / MAP_TILE_SIZE;
+    map.live_tiles = 0;
 
-    // Allocate rows (height)
-    map.cells = (MapCell**)malloc(sizeof(MapCell*) * height);
-    if (!map.cells) {
-        perror("Failed to allocate map rows");
+    // Only the tile directory is allocated up front; tiles come on first survivor
+    map.tiles = (MapTile**)calloc((size_t)map.tiles_x * map.tiles_y, sizeof(MapTile*));
+    if (!map.tiles) {
+        perror("Failed to allocate map tile directory");
         exit(EXIT_FAILURE);
     }
 
-    // Allocate columns (width) for each row
-    for (int i = 0; i < height; i++) {
-        map.cells[i] = (MapCell*)malloc(sizeof(MapCell) * width);
-        if (!map.cells[i]) {
-            perror("Failed to allocate map columns");
-            exit(EXIT_FAILURE);
-        }
+    // Recursive so a holder of the cell lock can call map_add/remove_survivor
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    for (int i = 0; i < MAP_LOCK_STRIPES; i++) {
+        pthread_mutex_init(&map.stripes[i], &attr);
+    }
+    pthread_mutexattr_destroy(&attr);
 
-        // Initialize each cell
-        for (int j = 0; j < width; j++) {
-            map.cells[i][j].coord.x = j;  // x is horizontal (column)
-            map.cells[i][j].coord.y = i;  // y is vertical (row)
-            // Create a survivor list for this cell (capacity 10)
-            map.cells[i][j].survivors = create_list(sizeof(Survivor), 10);
-        }
+    obstacles_init(&map.obstacles, width, height);
+    if (path_cache_init(&map_paths, &map.obstacles, 0) != 0) {
+        exit(EXIT_FAILURE);
     }
+    // Predictions run under drone locks; keep large maps from rebuilding
+    // fields for them on every call
+    map_paths.predict_cells_per_s = PATH_PREDICT_CELLS_PER_S;
 
-    printf("Map initialized: %dx%d (width x height)\n", width, height);
+    printf("Map initialized: %dx%d (width x height), %dx%d tiles of %d cells\n",
+           width, height, map.tiles_x, map.tiles_y, MAP_TILE_SIZE * MAP_TILE_SIZE);
 }
 
 void freemap() {
-    for (int i = 0; i < map.height; i++) {
-        for (int j = 0; j < map.width; j++) {
-            // Destroy the survivor list in each cell
-            map.cells[i][j].survivors->destroy(map.cells[i][j].survivors);
+    for (int t = 0; t < map.tiles_x * map.tiles_y; t++) {
+        MapTile *tile = map.tiles[t];
+        if (!tile) continue;
+        for (int c = 0; c < MAP_TILE_SIZE * MAP_TILE_SIZE; c++) {
+            // Destroy the survivor list in each occupied cell
+            if (tile->cells[c]) tile->cells[c]->destroy(tile->cells[c]);
         }
-        free(map.cells[i]);
+        free(tile);
+    }
+    free(map.tiles);
+    map.tiles = NULL;
+    for (int i = 0; i < MAP_LOCK_STRIPES; i++) {
+        pthread_mutex_destroy(&map.stripes[i]);
     }
-    free(map.cells);
+    path_cache_free(&map_paths);
+    obstacles_free(&map.obstacles);
     printf("Map destroyed\n");
-}
\ No newline at end of file
+}
+
+int map_in_bounds(int x, int y) {
+    return x >= 0 && x < map.width && y >= 0 && y < map.height;
+}
+
+void map_lock_cell(int x, int y) {
+    LOCK(cell_stripe(x, y));
+}
+
+void map_unlock_cell(int x, int y) {
+    UNLOCK(cell_stripe(x, y));
+}
+
+List *map_cell_survivors(int x, int y, int create) {
+    if (!map_in_bounds(x, y)) return NULL;
+    MapTile **slot = &map.tiles[tile_index(x, y)];
+    if (!*slot) {
+        if (!create) return NULL;
+        *slot = (MapTile*)calloc(1, sizeof(MapTile));
+        if (!*slot) {
+            perror("Failed to allocate map tile");
+            return NULL;
+        }
+        __atomic_add_fetch(&map.live_tiles, 1, __ATOMIC_RELAXED);
+    }
+
+    MapTile *tile = *slot;
+    List **cell = &tile->cells[cell_index(x, y)];
+    if (!*cell && create) {
+        *cell = create_list(sizeof(Survivor *), MAP_CELL_CAPACITY);
+        if (*cell) tile->live_cells++;
+    }
+    return *cell;
+}
+
+int map_add_survivor(Survivor *s) {
+    int x = s->coord.x, y = s->coord.y;
+    if (!map_in_bounds(x, y)) return -1;
+    map_lock_cell(x, y);
+    List *cell = map_cell_survivors(x, y, 1);
+    Node *node = cell ? cell->add(cell, &s) : NULL;
+    map_unlock_cell(x, y);
+    return node ? 0 : -1;
+}
+
+// Removes s from its cell; an emptied cell gives its list back, and an
+// emptied tile its storage.
+int map_remove_survivor(const Survivor *s) {
+    int x = s->coord.x, y = s->coord.y;
+    if (!map_in_bounds(x, y)) return -1;
+    map_lock_cell(x, y);
+    List *cell = map_cell_survivors(x, y, 0);
+    int result = 1;
+    for (Node *node = cell ? cell->head : NULL; node != NULL; node = node->next) {
+        if (*(Survivor **)node->data == s) {
+            result = cell->removenode(cell, node);
+            break;
+        }
+    }
+    if (result == 0 && cell->number_of_elements == 0) {
+        MapTile **slot = &map.tiles[tile_index(x, y)];
+        cell->destroy(cell);
+        (*slot)->cells[cell_index(x, y)] = NULL;
+        if (--(*slot)->live_cells == 0) {
+            free(*slot);
+            *slot = NULL;
+            __atomic_sub_fetch(&map.live_tiles, 1, __ATOMIC_RELAXED);
+        }
+    }
+    map_unlock_cell(x, y);
+    return result;
+}
+
+// Rescues a survivor at (x, y) for drone_id and takes it off the map. A
+// survivor assigned to this drone is preferred over any other open one the
+// drone has the supplies for.
+// The claim is a CAS on the survivor, so a survivor is only ever returned
+// once however many drones and regions race for it.
+Survivor *map_claim_survivor(int x, int y, int drone_id, Payload carried) {
+    if (!map_in_bounds(x, y)) return NULL;
+    Survivor *won = NULL;
+    map_lock_cell(x, y);
+    List *cell = map_cell_survivors(x, y, 0);
+    for (int pass = 0; pass < 2 && !won && cell; pass++) {
+        for (Node *node = cell->head; node != NULL; node = node->next) {
+            Survivor *s = *(Survivor **)node->data;
+            uint64_t word = survivor_state(s);
+            if (pass == 0 && word != SURVIVOR_WORD(SURVIVOR_ASSIGNED, drone_id)) continue;
+            if (pass == 1 && !payload_serves(carried, s->need)) continue;
+            if (survivor_claim(s, drone_id) == 0) {
+                won = s;
+                break;
+            }
+        }
+    }
+    if (won) map_remove_survivor(won);
+    map_unlock_cell(x, y);
+    return won;
+}
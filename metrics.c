@@ -0,0 +1,463 @@
+/**
+ * @file metrics.c
+ * @brief Low-overhead server metrics exposed in Prometheus text format.
+ *
+ * Every recording thread owns a MetricsThread block, so the hot path is a
+ * plain load/store on memory no other thread writes. Latencies go into
+ * log-linear (HDR style) histograms with 64 sub-buckets per power of two,
+ * i.e. ~1.6% worst-case relative error from 1ns up to ~68s. Readers merge
+ * all thread blocks when the endpoint is scraped.
+ */
+#include "headers/metrics.h"
+#include "headers/lockprof.h"
+#include "headers/globals.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+extern volatile sig_atomic_t global_shutdown_flag;
+
+#define HIST_SUB_BITS 7
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_HALF_COUNT (HIST_SUB_COUNT / 2)
+#define HIST_MAX_VALUE ((1ULL << 36) - 1)
+#define HIST_BUCKETS (HIST_SUB_COUNT + (36 - HIST_SUB_BITS) * HIST_HALF_COUNT)
+#define MAX_GAUGES 48
+
+typedef struct hist_block {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+    uint64_t buckets[HIST_BUCKETS];
+} HistBlock;
+
+typedef struct metrics_thread {
+    struct metrics_thread *next;
+    int in_use;
+    uint64_t messages[MSG_TYPE_COUNT];
+    HistBlock *hists[HIST_COUNT];  // allocated on the first observation
+} MetricsThread;
+
+typedef struct gauge {
+    const char *name;
+    const char *help;
+    metrics_gauge_fn fn;
+} Gauge;
+
+static const char *msg_type_names[MSG_TYPE_COUNT] = {
+    "HANDSHAKE", "STATUS_UPDATE", "MISSION_COMPLETE", "HEARTBEAT_RESPONSE", "RESUME", "INVALID"
+};
+static const char *lock_names[LOCK_COUNT] = {"drones", "survivors"};
+static const char *survivor_stage_names[] = {"discovery_to_assign", "assign_to_rescue", "discovery_to_rescue"};
+static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+static MetricsThread *threads = NULL;
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t thread_key;
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static __thread MetricsThread *self = NULL;
+
+static Gauge gauges[MAX_GAUGES];
+static int num_gauges = 0;
+static int open_connections = 0;
+
+// Single-writer increment: only the owning thread stores, readers load.
+#define OWNER_ADD(field, v) \
+    __atomic_store_n(&(field), __atomic_load_n(&(field), __ATOMIC_RELAXED) + (v), __ATOMIC_RELAXED)
+
+static void release_thread(void *arg) {
+    MetricsThread *t = (MetricsThread *)arg;
+    // Counts are cumulative, so a retired block can be handed to a new thread as is
+    __atomic_store_n(&t->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void make_key() {
+    pthread_key_create(&thread_key, release_thread);
+}
+
+static MetricsThread *thread_block() {
+    if (self) return self;
+    pthread_once(&key_once, make_key);
+
+    pthread_mutex_lock(&registry_lock);
+    MetricsThread *t = threads;
+    while (t && __atomic_load_n(&t->in_use, __ATOMIC_ACQUIRE)) {
+        t = t->next;
+    }
+    if (!t) {
+        t = calloc(1, sizeof(MetricsThread));
+        if (!t) {
+            pthread_mutex_unlock(&registry_lock);
+            return NULL;
+        }
+        t->next = threads;
+        threads = t;
+    }
+    t->in_use = 1;
+    pthread_mutex_unlock(&registry_lock);
+
+    pthread_setspecific(thread_key, t);
+    self = t;
+    return t;
+}
+
+static int bucket_index(uint64_t v) {
+    if (v > HIST_MAX_VALUE) v = HIST_MAX_VALUE;
+    if (v < HIST_SUB_COUNT) return (int)v;
+    int msb = 63 - __builtin_clzll(v);
+    int shift = msb - (HIST_SUB_BITS - 1);
+    return HIST_SUB_COUNT + (shift - 1) * HIST_HALF_COUNT + (int)((v >> shift) - HIST_HALF_COUNT);
+}
+
+// Highest value that lands in bucket idx.
+static uint64_t bucket_value(int idx) {
+    if (idx < HIST_SUB_COUNT) return idx;
+    int shift = (idx - HIST_SUB_COUNT) / HIST_HALF_COUNT + 1;
+    uint64_t sub = (idx - HIST_SUB_COUNT) % HIST_HALF_COUNT + HIST_HALF_COUNT;
+    return ((sub + 1) << shift) - 1;
+}
+
+uint64_t metrics_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+MetricMsgType metrics_msg_type(const char *type) {
+    if (!type) return MSG_INVALID;
+    for (int i = 0; i < MSG_INVALID; i++) {
+        if (strcmp(type, msg_type_names[i]) == 0) return (MetricMsgType)i;
+    }
+    return MSG_INVALID;
+}
+
+void metrics_count_message(MetricMsgType type) {
+    MetricsThread *t = thread_block();
+    if (t) OWNER_ADD(t->messages[type], 1);
+}
+
+void metrics_observe(MetricHist hist, uint64_t value_ns) {
+    MetricsThread *t = thread_block();
+    if (!t) return;
+    HistBlock *h = t->hists[hist];
+    if (!h) {
+        h = calloc(1, sizeof(HistBlock));
+        if (!h) return;
+        __atomic_store_n(&t->hists[hist], h, __ATOMIC_RELEASE);
+    }
+    OWNER_ADD(h->buckets[bucket_index(value_ns)], 1);
+    OWNER_ADD(h->sum, value_ns);
+    OWNER_ADD(h->count, 1);
+    if (value_ns > h->max) __atomic_store_n(&h->max, value_ns, __ATOMIC_RELAXED);
+}
+
+// Locks `lock`, recording how long the caller waited. The uncontended path
+// skips the clock entirely and records a zero wait. file and line name the
+// caller for the lock profiler.
+void metrics_lock_at(pthread_mutex_t *lock, MetricLock which, const char *file, int line) {
+#ifdef LOCK_PROFILE
+    metrics_observe(HIST_LOCK_WAIT + which, lockprof_lock(lock, lock_names[which], file, line));
+    return;
+#else
+    (void)file;
+    (void)line;
+#endif
+    if (pthread_mutex_trylock(lock) == 0) {
+        metrics_observe(HIST_LOCK_WAIT + which, 0);
+        return;
+    }
+    uint64_t start = metrics_now_ns();
+    pthread_mutex_lock(lock);
+    metrics_observe(HIST_LOCK_WAIT + which, metrics_now_ns() - start);
+}
+
+void metrics_register_gauge(const char *name, const char *help, metrics_gauge_fn fn) {
+    pthread_mutex_lock(&registry_lock);
+    if (num_gauges < MAX_GAUGES) {
+        gauges[num_gauges].name = name;
+        gauges[num_gauges].help = help;
+        gauges[num_gauges].fn = fn;
+        num_gauges++;
+    } else {
+        fprintf(stderr, "metrics: gauge table full, dropping %s\n", name);
+    }
+    pthread_mutex_unlock(&registry_lock);
+}
+
+void metrics_connection_opened() {
+    __atomic_add_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+}
+
+void metrics_connection_closed() {
+    __atomic_sub_fetch(&open_connections, 1, __ATOMIC_RELAXED);
+}
+
+// Merges one histogram across all thread blocks. Caller holds registry_lock.
+static void merge_hist(MetricHist hist, HistBlock *out) {
+    memset(out, 0, sizeof(*out));
+    for (MetricsThread *t = threads; t; t = t->next) {
+        HistBlock *h = __atomic_load_n(&t->hists[hist], __ATOMIC_ACQUIRE);
+        if (!h) continue;
+        out->count += __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+        out->sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+        uint64_t max = __atomic_load_n(&h->max, __ATOMIC_RELAXED);
+        if (max > out->max) out->max = max;
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            out->buckets[i] += __atomic_load_n(&h->buckets[i], __ATOMIC_RELAXED);
+        }
+    }
+}
+
+static uint64_t quantile_of(const HistBlock *h, double q) {
+    uint64_t total = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) total += h->buckets[i];
+    if (total == 0) return 0;
+    uint64_t rank = (uint64_t)(q * total + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        seen += h->buckets[i];
+        if (seen >= rank) {
+            uint64_t v = bucket_value(i);
+            return v < h->max ? v : h->max;
+        }
+    }
+    return h->max;
+}
+
+uint64_t metrics_hist_quantile(MetricHist hist, double q) {
+    HistBlock *merged = malloc(sizeof(HistBlock));
+    if (!merged) return 0;
+    pthread_mutex_lock(&registry_lock);
+    merge_hist(hist, merged);
+    pthread_mutex_unlock(&registry_lock);
+    uint64_t v = quantile_of(merged, q);
+    free(merged);
+    return v;
+}
+
+uint64_t metrics_message_total(MetricMsgType type) {
+    uint64_t total = 0;
+    pthread_mutex_lock(&registry_lock);
+    for (MetricsThread *t = threads; t; t = t->next) {
+        total += __atomic_load_n(&t->messages[type], __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&registry_lock);
+    return total;
+}
+
+typedef struct text_buf {
+    char *data;
+    size_t len;
+    size_t cap;
+} TextBuf;
+
+static void appendf(TextBuf *b, const char *fmt, ...) {
+    va_list ap;
+    for (;;) {
+        va_start(ap, fmt);
+        int n = vsnprintf(b->data ? b->data + b->len : NULL, b->data ? b->cap - b->len : 0, fmt, ap);
+        va_end(ap);
+        if (n < 0) return;
+        if (b->data && b->len + n < b->cap) {
+            b->len += n;
+            return;
+        }
+        size_t cap = b->cap ? b->cap * 2 : 4096;
+        while (cap < b->len + n + 1) cap *= 2;
+        char *data = realloc(b->data, cap);
+        if (!data) return;
+        b->data = data;
+        b->cap = cap;
+    }
+}
+
+static void render_summary(TextBuf *b, const char *name, const char *label, const char *value,
+                           MetricHist hist, HistBlock *scratch) {
+    merge_hist(hist, scratch);
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); i++) {
+        appendf(b, "%s{%s=\"%s\",quantile=\"%g\"} %.9f\n", name, label, value, quantiles[i],
+                quantile_of(scratch, quantiles[i]) / 1e9);
+    }
+    appendf(b, "%s_sum{%s=\"%s\"} %.9f\n", name, label, value, scratch->sum / 1e9);
+    appendf(b, "%s_count{%s=\"%s\"} %llu\n", name, label, value, (unsigned long long)scratch->count);
+}
+
+// Renders all metrics in Prometheus text exposition format. Caller frees.
+char *metrics_render(size_t *len) {
+    TextBuf b = {0};
+    HistBlock *scratch = malloc(sizeof(HistBlock));
+    if (!scratch) return NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    appendf(&b, "# HELP edcs_messages_total Drone messages received, by type.\n");
+    appendf(&b, "# TYPE edcs_messages_total counter\n");
+    for (int type = 0; type < MSG_TYPE_COUNT; type++) {
+        uint64_t total = 0;
+        for (MetricsThread *t = threads; t; t = t->next) {
+            total += __atomic_load_n(&t->messages[type], __ATOMIC_RELAXED);
+        }
+        appendf(&b, "edcs_messages_total{type=\"%s\"} %llu\n", msg_type_names[type], (unsigned long long)total);
+    }
+
+    appendf(&b, "# HELP edcs_handler_latency_seconds Time spent handling one message, by type.\n");
+    appendf(&b, "# TYPE edcs_handler_latency_seconds summary\n");
+    for (int type = 0; type < MSG_TYPE_COUNT; type++) {
+        render_summary(&b, "edcs_handler_latency_seconds", "type", msg_type_names[type],
+                       HIST_HANDLER + type, scratch);
+    }
+
+    appendf(&b, "# HELP edcs_lock_wait_seconds Time spent waiting to acquire a global list lock.\n");
+    appendf(&b, "# TYPE edcs_lock_wait_seconds summary\n");
+    for (int lock = 0; lock < LOCK_COUNT; lock++) {
+        render_summary(&b, "edcs_lock_wait_seconds", "lock", lock_names[lock], HIST_LOCK_WAIT + lock, scratch);
+    }
+
+    appendf(&b, "# HELP edcs_survivor_latency_seconds Survivor pipeline latency, by stage.\n");
+    appendf(&b, "# TYPE edcs_survivor_latency_seconds summary\n");
+    render_summary(&b, "edcs_survivor_latency_seconds", "stage", "discovery_to_assign",
+                   HIST_DISCOVERY_TO_ASSIGN, scratch);
+    render_summary(&b, "edcs_survivor_latency_seconds", "stage", "assign_to_rescue",
+                   HIST_ASSIGN_TO_RESCUE, scratch);
+    render_summary(&b, "edcs_survivor_latency_seconds", "stage", "discovery_to_rescue",
+                   HIST_DISCOVERY_TO_RESCUE, scratch);
+
+    int ngauges = num_gauges;
+    pthread_mutex_unlock(&registry_lock);
+    free(scratch);
+
+    appendf(&b, "# HELP edcs_connections_open Drone connections currently open.\n");
+    appendf(&b, "# TYPE edcs_connections_open gauge\n");
+    appendf(&b, "edcs_connections_open %d\n", __atomic_load_n(&open_connections, __ATOMIC_RELAXED));
+    // Gauge callbacks may take list locks, so they run outside registry_lock
+    for (int i = 0; i < ngauges; i++) {
+        appendf(&b, "# HELP %s %s\n# TYPE %s gauge\n%s %g\n", gauges[i].name, gauges[i].help,
+                gauges[i].name, gauges[i].name, gauges[i].fn());
+    }
+
+    if (len) *len = b.len;
+    return b.data;
+}
+
+static void hist_name(int hist, char *name, size_t len) {
+    if (hist < HIST_LOCK_WAIT) {
+        snprintf(name, len, "handler:%s", msg_type_names[hist - HIST_HANDLER]);
+    } else if (hist < HIST_DISCOVERY_TO_ASSIGN) {
+        snprintf(name, len, "lock_wait:%s", lock_names[hist - HIST_LOCK_WAIT]);
+    } else {
+        snprintf(name, len, "survivor:%s", survivor_stage_names[hist - HIST_DISCOVERY_TO_ASSIGN]);
+    }
+}
+
+// Renders every non-empty histogram bucket as "<name> <index> <upper_ns> <count>",
+// so tools such as the load tester can diff two scrapes for exact windowed quantiles.
+char *metrics_render_raw(size_t *len) {
+    TextBuf b = {0};
+    HistBlock *scratch = malloc(sizeof(HistBlock));
+    if (!scratch) return NULL;
+
+    pthread_mutex_lock(&registry_lock);
+    for (int hist = 0; hist < HIST_COUNT; hist++) {
+        char name[64];
+        hist_name(hist, name, sizeof(name));
+        merge_hist(hist, scratch);
+        for (int i = 0; i < HIST_BUCKETS; i++) {
+            if (scratch->buckets[i] == 0) continue;
+            appendf(&b, "%s %d %llu %llu\n", name, i, (unsigned long long)bucket_value(i),
+                    (unsigned long long)scratch->buckets[i]);
+        }
+    }
+    pthread_mutex_unlock(&registry_lock);
+    free(scratch);
+
+    if (len) *len = b.len;
+    return b.data;
+}
+
+static void write_all(int sock, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(sock, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) continue;
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static void serve_request(int sock) {
+    char request[1024];
+    struct timeval tv = {.tv_sec = 1, .tv_usec = 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv);
+    ssize_t n = recv(sock, request, sizeof(request) - 1, 0);
+    if (n <= 0) return;
+    request[n] = '\0';
+
+    size_t body_len = 0;
+    char *body;
+    if (strncmp(request, "GET /metrics/raw", 16) == 0) {
+        body = metrics_render_raw(&body_len);
+    } else if (strncmp(request, "GET /metrics", 12) == 0 || strncmp(request, "GET / ", 6) == 0) {
+        body = metrics_render(&body_len);
+    } else {
+        const char *not_found = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        write_all(sock, not_found, strlen(not_found));
+        return;
+    }
+
+    char header[128];
+    int header_len = snprintf(header, sizeof(header),
+                              "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                              "Content-Length: %zu\r\n\r\n", body_len);
+    write_all(sock, header, header_len);
+    if (body) write_all(sock, body, body_len);
+    free(body);
+}
+
+// Serves GET /metrics (and /metrics/raw) on 127.0.0.1:config.metrics_port until shutdown.
+void *metrics_http_server(void *args) {
+    (void)args;
+    int server_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server_fd < 0) {
+        perror("metrics: socket");
+        return NULL;
+    }
+    int opt = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    struct sockaddr_in address = {0};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(config.metrics_port);
+    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0 || listen(server_fd, 16) < 0) {
+        perror("metrics: bind/listen");
+        close(server_fd);
+        return NULL;
+    }
+    printf("Metrics endpoint on http://127.0.0.1:%d/metrics\n", config.metrics_port);
+
+    while (!global_shutdown_flag) {
+        fd_set readfds;
+        struct timeval tv = {.tv_sec = 1, .tv_usec = 0};
+        FD_ZERO(&readfds);
+        FD_SET(server_fd, &readfds);
+        int activity = select(server_fd + 1, &readfds, NULL, NULL, &tv);
+        if (activity <= 0) continue;
+
+        int sock = accept(server_fd, NULL, NULL);
+        if (sock < 0) continue;
+        serve_request(sock);
+        close(sock);
+    }
+    close(server_fd);
+    return NULL;
+}
@@ -0,0 +1,472 @@
+/**
+ * @file path.c
+ * @brief Obstacle layer, cached BFS distance fields and routing around obstacles.
+ *
+ * A field is built by one BFS from its target over the open cells and kept
+ * in a small LRU cache keyed by target, so dispatching a survivor costs one
+ * BFS however many drones are ranked, and every drone flying there routes
+ * by stepping downhill in the same field. Steps prefer moving along x
+ * towards the target, then y, which is the x-then-y path of an empty grid;
+ * server and drones pick the same cell at every step, so dead reckoning
+ * stays exact. Fields remember the obstacle version they were built from
+ * and are rebuilt once the obstacles change. Without obstacles nothing is
+ * cached and everything falls back to Manhattan distance; with obstacles a
+ * route never does, since that would fly through them.
+ *
+ * Predictions (path_position) can be capped to a number of BFS cells per
+ * second. When there are more live targets than fields fit in the cache,
+ * large maps would otherwise rebuild a field on nearly every prediction;
+ * past the cap a prediction holds the drone at its last known position.
+ */
+#include "headers/path.h"
+#include "headers/deadreckon.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <json-c/json.h>
+
+void obstacles_init(ObstacleGrid *g, int width, int height) {
+    memset(g, 0, sizeof(*g));
+    g->width = width;
+    g->height = height;
+    pthread_rwlock_init(&g->lock, NULL);
+}
+
+void obstacles_free(ObstacleGrid *g) {
+    free(g->blocked);
+    free(g->areas);
+    g->blocked = NULL;
+    g->areas = NULL;
+    g->count = 0;
+    pthread_rwlock_destroy(&g->lock);
+}
+
+// Replaces every area. Call with g->lock held for writing.
+static int set_areas(ObstacleGrid *g, const Rect *areas, int count) {
+    Rect *copy = NULL;
+    unsigned char *blocked = NULL;
+    size_t cells = PATH_CELLS(g->width, g->height);
+    if (count > 0) {
+        copy = malloc(sizeof(Rect) * count);
+        blocked = calloc(cells, 1);
+        if (!copy || !blocked) {
+            perror("Failed to allocate obstacles");
+            free(copy);
+            free(blocked);
+            return -1;
+        }
+        memcpy(copy, areas, sizeof(Rect) * count);
+        memset(blocked, 1, (size_t)g->width + 3);
+        memset(blocked + cells - g->width - 3, 1, (size_t)g->width + 3);
+        for (int y = 0; y < g->height; y++) {
+            blocked[PATH_INDEX(g->width, -1, y)] = 1;
+            blocked[PATH_INDEX(g->width, g->width, y)] = 1;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        int x0 = areas[i].from.x < areas[i].to.x ? areas[i].from.x : areas[i].to.x;
+        int x1 = areas[i].from.x < areas[i].to.x ? areas[i].to.x : areas[i].from.x;
+        int y0 = areas[i].from.y < areas[i].to.y ? areas[i].from.y : areas[i].to.y;
+        int y1 = areas[i].from.y < areas[i].to.y ? areas[i].to.y : areas[i].from.y;
+        if (x0 < 0) x0 = 0;
+        if (y0 < 0) y0 = 0;
+        if (x1 >= g->width) x1 = g->width - 1;
+        if (y1 >= g->height) y1 = g->height - 1;
+        for (int y = y0; y <= y1; y++) {
+            if (x0 <= x1) memset(&blocked[PATH_INDEX(g->width, x0, y)], 1, x1 - x0 + 1);
+        }
+    }
+    free(g->blocked);
+    free(g->areas);
+    g->blocked = blocked;
+    g->areas = copy;
+    __atomic_store_n(&g->count, count, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&g->version, 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+int obstacles_set(ObstacleGrid *g, const Rect *areas, int count) {
+    pthread_rwlock_wrlock(&g->lock);
+    int result = set_areas(g, areas, count);
+    pthread_rwlock_unlock(&g->lock);
+    return result;
+}
+
+// One area per line: "x0 y0 x1 y1", corners inclusive; # starts a comment.
+int obstacles_load(ObstacleGrid *g, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Failed to open obstacle file");
+        return -1;
+    }
+    Rect *areas = NULL;
+    int count = 0, capacity = 0, line_no = 0;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        Rect r;
+        char extra;
+        int fields = sscanf(line, "%d %d %d %d %c", &r.from.x, &r.from.y, &r.to.x, &r.to.y, &extra);
+        if (fields <= 0) continue;  // blank or comment
+        if (fields != 4) {
+            fprintf(stderr, "%s:%d: expected \"x0 y0 x1 y1\"\n", path, line_no);
+            free(areas);
+            fclose(file);
+            return -1;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            Rect *grown = realloc(areas, sizeof(Rect) * capacity);
+            if (!grown) {
+                perror("Failed to allocate obstacles");
+                free(areas);
+                fclose(file);
+                return -1;
+            }
+            areas = grown;
+        }
+        areas[count++] = r;
+    }
+    fclose(file);
+    int result = obstacles_set(g, areas, count);
+    free(areas);
+    if (result == 0) printf("Loaded %d obstacle areas from %s\n", count, path);
+    return result;
+}
+
+int obstacles_active(const ObstacleGrid *g) {
+    return __atomic_load_n(&g->count, __ATOMIC_ACQUIRE) > 0;
+}
+
+int obstacles_blocked(ObstacleGrid *g, int x, int y) {
+    if (!obstacles_active(g)) return 0;
+    pthread_rwlock_rdlock(&g->lock);
+    int blocked = g->blocked && x >= 0 && x < g->width && y >= 0 && y < g->height &&
+                  g->blocked[PATH_INDEX(g->width, x, y)];
+    pthread_rwlock_unlock(&g->lock);
+    return blocked;
+}
+
+// {"width": w, "height": h, "areas": [[x0, y0, x1, y1], ...]}, as sent to drones.
+struct json_object *obstacles_json(ObstacleGrid *g) {
+    struct json_object *obj = json_object_new_object();
+    struct json_object *list = json_object_new_array();
+    pthread_rwlock_rdlock(&g->lock);
+    json_object_object_add(obj, "width", json_object_new_int(g->width));
+    json_object_object_add(obj, "height", json_object_new_int(g->height));
+    for (int i = 0; i < g->count; i++) {
+        struct json_object *area = json_object_new_array();
+        json_object_array_add(area, json_object_new_int(g->areas[i].from.x));
+        json_object_array_add(area, json_object_new_int(g->areas[i].from.y));
+        json_object_array_add(area, json_object_new_int(g->areas[i].to.x));
+        json_object_array_add(area, json_object_new_int(g->areas[i].to.y));
+        json_object_array_add(list, area);
+    }
+    pthread_rwlock_unlock(&g->lock);
+    json_object_object_add(obj, "areas", list);
+    return obj;
+}
+
+// Takes the obstacles a server sent; the same list twice changes nothing.
+int obstacles_from_json(ObstacleGrid *g, struct json_object *obj) {
+    struct json_object *list;
+    int width = json_object_get_int(json_object_object_get(obj, "width"));
+    int height = json_object_get_int(json_object_object_get(obj, "height"));
+    if (width <= 0 || height <= 0 || !json_object_object_get_ex(obj, "areas", &list)) return -1;
+    int count = json_object_array_length(list);
+    Rect *areas = count > 0 ? malloc(sizeof(Rect) * count) : NULL;
+    if (count > 0 && !areas) return -1;
+    for (int i = 0; i < count; i++) {
+        struct json_object *area = json_object_array_get_idx(list, i);
+        areas[i].from.x = json_object_get_int(json_object_array_get_idx(area, 0));
+        areas[i].from.y = json_object_get_int(json_object_array_get_idx(area, 1));
+        areas[i].to.x = json_object_get_int(json_object_array_get_idx(area, 2));
+        areas[i].to.y = json_object_get_int(json_object_array_get_idx(area, 3));
+    }
+
+    int result = 0;
+    pthread_rwlock_wrlock(&g->lock);
+    if (width != g->width || height != g->height || count != g->count ||
+        (count > 0 && memcmp(areas, g->areas, sizeof(Rect) * count) != 0)) {
+        g->width = width;
+        g->height = height;
+        result = set_areas(g, areas, count);
+    }
+    pthread_rwlock_unlock(&g->lock);
+    free(areas);
+    return result;
+}
+
+int path_cache_init(PathCache *c, ObstacleGrid *g, int count) {
+    memset(c, 0, sizeof(*c));
+    c->grid = g;
+    if (count <= 0) {
+        size_t field_bytes = PATH_CELLS(g->width, g->height) * sizeof(uint16_t);
+        size_t fit = field_bytes ? PATH_CACHE_BYTES / field_bytes : PATH_CACHE_MAX_FIELDS;
+        count = fit < PATH_CACHE_MIN_FIELDS ? PATH_CACHE_MIN_FIELDS
+              : fit > PATH_CACHE_MAX_FIELDS ? PATH_CACHE_MAX_FIELDS : (int)fit;
+    }
+    c->fields = calloc(count, sizeof(PathField));
+    if (!c->fields) {
+        perror("Failed to allocate path cache");
+        return -1;
+    }
+    c->count = count;
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_cond_init(&c->built, NULL);
+    return 0;
+}
+
+void path_cache_free(PathCache *c) {
+    if (!c->fields) return;
+    for (int i = 0; i < c->count; i++) free(c->fields[i].dist);
+    free(c->fields);
+    c->fields = NULL;
+    pthread_mutex_destroy(&c->lock);
+    pthread_cond_destroy(&c->built);
+}
+
+// BFS from target over the open cells into dist (PATH_CELLS entries).
+// Returns the obstacle version it saw, or 0 if it could not run.
+unsigned long path_field_fill(ObstacleGrid *g, Coord target, uint16_t *dist) {
+    pthread_rwlock_rdlock(&g->lock);
+    int w = g->width, h = g->height;
+    size_t cells = PATH_CELLS(w, h);
+    unsigned long version = g->version;
+    const unsigned char *blocked = g->blocked;
+    // Every cell is queued at most once; the slack lets the loop below store
+    // each neighbour unconditionally and only advance past the open ones
+    uint32_t *queue = blocked ? malloc(sizeof(uint32_t) * ((size_t)w * h + 4)) : NULL;
+    if (!queue || target.x < 0 || target.x >= w || target.y < 0 || target.y >= h) {
+        pthread_rwlock_unlock(&g->lock);
+        free(queue);
+        return 0;
+    }
+    memset(dist, 0xFF, sizeof(uint16_t) * cells);
+    const long around[4] = {-1, 1, -(long)(w + 2), w + 2};
+    size_t head = 0, tail = 0;
+    uint32_t start = PATH_INDEX(w, target.x, target.y);
+    dist[start] = 0;
+    queue[tail++] = start;
+    while (head < tail) {
+        uint32_t at = queue[head++];
+        uint16_t next = dist[at] + 1;
+        if (next >= PATH_UNREACHABLE) continue;
+        for (int i = 0; i < 4; i++) {
+            // Branch-free: whether a neighbour is new is a coin toss to the predictor
+            uint32_t cell = at + around[i];
+            int open = (dist[cell] == PATH_UNREACHABLE) & !blocked[cell];
+            dist[cell] = open ? next : dist[cell];
+            queue[tail] = cell;
+            tail += open;
+        }
+    }
+    pthread_rwlock_unlock(&g->lock);
+    free(queue);
+    return version;
+}
+
+static int same_coord(Coord a, Coord b) {
+    return a.x == b.x && a.y == b.y;
+}
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// Takes cells from the prediction budget; 0 if it cannot cover them now.
+// Call with c->lock held.
+static int predict_budget_take(PathCache *c, size_t cells) {
+    if (c->predict_cells_per_s <= 0) return 1;
+    uint64_t now = monotonic_ns();
+    // Up to a second of budget, and always enough for one field
+    double cap = c->predict_cells_per_s > cells ? c->predict_cells_per_s : (double)cells;
+    c->predict_tokens += c->predict_cells_per_s * (now - c->predict_refill_ns) / 1e9;
+    if (c->predict_tokens > cap) c->predict_tokens = cap;
+    c->predict_refill_ns = now;
+    if (c->predict_tokens < cells) return 0;
+    c->predict_tokens -= cells;
+    return 1;
+}
+
+// A field for one caller when every cached one is in use.
+static PathField *owned_field(ObstacleGrid *g, Coord target, int w, int h, unsigned long version) {
+    PathField *f = calloc(1, sizeof(PathField));
+    size_t cells = PATH_CELLS(w, h);
+    if (f) f->dist = malloc(sizeof(uint16_t) * cells);
+    if (!f || !f->dist || path_field_fill(g, target, f->dist) != version) {
+        if (f) free(f->dist);
+        free(f);
+        return NULL;
+    }
+    f->target = target;
+    f->width = w;
+    f->height = h;
+    f->version = version;
+    f->cells = cells;
+    f->refs = 1;
+    f->ready = 1;
+    f->owned = 1;
+    return f;
+}
+
+// budgeted: building counts against the prediction budget; NULL past it.
+static const PathField *field_acquire(PathCache *c, Coord target, int budgeted) {
+    ObstacleGrid *g = c->grid;
+    if (!obstacles_active(g) || !c->fields) return NULL;
+    pthread_rwlock_rdlock(&g->lock);
+    int w = g->width, h = g->height;
+    unsigned long version = g->version;
+    pthread_rwlock_unlock(&g->lock);
+    if (target.x < 0 || target.x >= w || target.y < 0 || target.y >= h) return NULL;
+
+    pthread_mutex_lock(&c->lock);
+    PathField *victim = NULL;
+    for (int i = 0; i < c->count; i++) {
+        PathField *f = &c->fields[i];
+        if (f->used && f->version == version && f->width == w && f->height == h && same_coord(f->target, target)) {
+            f->refs++;
+            f->used = ++c->clock;
+            c->hits++;
+            while (!f->ready) pthread_cond_wait(&c->built, &c->lock);
+            if (f->version != version) {  // its build failed
+                f->refs--;
+                f = NULL;
+            }
+            pthread_mutex_unlock(&c->lock);
+            return f;
+        }
+        if (f->refs == 0 && (!victim || f->used < victim->used)) victim = f;
+    }
+    size_t cells = PATH_CELLS(w, h);
+    if (budgeted && !predict_budget_take(c, cells)) {
+        pthread_mutex_unlock(&c->lock);
+        return NULL;
+    }
+    if (!victim) {
+        c->builds++;
+        pthread_mutex_unlock(&c->lock);
+        return owned_field(g, target, w, h, version);
+    }
+    // Ours to build: others asking for the same target wait for it
+    victim->target = target;
+    victim->width = w;
+    victim->height = h;
+    victim->version = version;
+    victim->refs = 1;
+    victim->ready = 0;
+    victim->used = ++c->clock;
+    c->builds++;
+    pthread_mutex_unlock(&c->lock);
+
+    unsigned long built = 0;
+    if (victim->cells < cells) {
+        free(victim->dist);
+        victim->dist = malloc(sizeof(uint16_t) * cells);
+        victim->cells = victim->dist ? cells : 0;
+    }
+    if (victim->dist) built = path_field_fill(g, target, victim->dist);
+
+    pthread_mutex_lock(&c->lock);
+    victim->ready = 1;
+    if (built != version) {
+        // Failed, or the obstacles changed under it: nobody may match it
+        victim->version = 0;
+        victim->used = 0;
+        victim->refs--;
+        victim = NULL;
+    }
+    pthread_cond_broadcast(&c->built);
+    pthread_mutex_unlock(&c->lock);
+    return victim;
+}
+
+const PathField *path_field_acquire(PathCache *c, Coord target) {
+    return field_acquire(c, target, 0);
+}
+
+void path_field_release(PathCache *c, const PathField *f) {
+    if (!f) return;
+    if (f->owned) {
+        free(f->dist);
+        free((PathField *)f);
+        return;
+    }
+    pthread_mutex_lock(&c->lock);
+    ((PathField *)f)->refs--;
+    pthread_mutex_unlock(&c->lock);
+}
+
+static uint16_t field_at(const PathField *f, int x, int y) {
+    if (x < 0 || x >= f->width || y < 0 || y >= f->height) return PATH_UNREACHABLE;
+    return f->dist[PATH_INDEX(f->width, x, y)];
+}
+
+// The next cell from at towards the field's target: the neighbour closest
+// to it, preferring x towards the target, then y, then the other ways.
+// Returns at itself at the target or when nothing is closer.
+Coord path_step(const PathField *f, Coord at) {
+    int sx = f->target.x >= at.x ? 1 : -1;
+    int sy = f->target.y >= at.y ? 1 : -1;
+    Coord around[4] = {{at.x + sx, at.y}, {at.x, at.y + sy}, {at.x - sx, at.y}, {at.x, at.y - sy}};
+    Coord best = at;
+    uint16_t best_dist = field_at(f, at.x, at.y);
+    for (int i = 0; i < 4; i++) {
+        uint16_t d = field_at(f, around[i].x, around[i].y);
+        if (d < best_dist) {
+            best_dist = d;
+            best = around[i];
+        }
+    }
+    return best;
+}
+
+// Cells to fly from `from` to f's target, -1 if it cannot be reached; the
+// Manhattan distance to `to` without a field. A drone on a blocked cell
+// takes off through its nearest open neighbour.
+int path_distance(const PathField *f, Coord from, Coord to) {
+    if (!f) return abs(from.x - to.x) + abs(from.y - to.y);
+    uint16_t d = field_at(f, from.x, from.y);
+    if (d != PATH_UNREACHABLE) return d;
+    Coord next = path_step(f, from);
+    if (same_coord(next, from)) return -1;
+    return field_at(f, next.x, next.y) + 1;
+}
+
+static Coord manhattan_step(Coord at, Coord to) {
+    if (at.x != to.x) at.x += at.x < to.x ? 1 : -1;
+    else if (at.y != to.y) at.y += at.y < to.y ? 1 : -1;
+    return at;
+}
+
+// Without a field under obstacles the drone waits a step rather than fly
+// straight through them.
+Coord path_next(PathCache *c, Coord at, Coord to) {
+    const PathField *f = path_field_acquire(c, to);
+    if (!f) return obstacles_active(c->grid) ? at : manhattan_step(at, to);
+    Coord next = path_step(f, at);
+    path_field_release(c, f);
+    return next;
+}
+
+// Where a drone that left `from` elapsed_ns ago should be on its route to
+// `to`; deadreckon_position() when there are no obstacles. Under obstacles
+// with no field to hand, within the prediction budget, it holds at `from`.
+Coord path_position(PathCache *c, Coord from, Coord to, double speed, uint64_t elapsed_ns) {
+    const PathField *f = speed > 0 ? field_acquire(c, to, 1) : NULL;
+    if (!f) return speed > 0 && obstacles_active(c->grid) ? from : deadreckon_position(from, to, speed, elapsed_ns);
+    long steps = (long)(speed * (double)elapsed_ns / 1e9);
+    Coord at = from;
+    for (long i = 0; i < steps && !same_coord(at, to); i++) {
+        Coord next = path_step(f, at);
+        if (same_coord(next, at)) break;
+        at = next;
+    }
+    path_field_release(c, f);
+    return at;
+}
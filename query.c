@@ -0,0 +1,694 @@
+/**
+ * @file query.c
+ * @brief Radius, bounding box and k-nearest queries over a world snapshot.
+ *
+ * A client connects to the UNIX socket given with --query-socket and sends
+ * one JSON object per line, for example
+ *
+ *     {"target":"survivors","query":"radius","x":120,"y":40,"r":10,"status":"open"}
+ *     {"target":"drones","query":"bbox","x0":0,"y0":0,"x1":50,"y1":50,"status":["idle"]}
+ *     {"target":"drones","query":"nearest","x":120,"y":40,"k":5,"status":"idle"}
+ *
+ * and gets one JSON object per line back: the snapshot's "seq" and "age_ms",
+ * "count" matches (radius and bbox count all of them, the list stops at
+ * "limit", default QUERY_DEFAULT_LIMIT) and the "drones" or "survivors"
+ * found, nearest first with their "distance" for nearest queries. A bad
+ * request gets {"error": "..."}.
+ *
+ * The builder thread copies the drones (each under its lock) and every
+ * region's waiting survivors (under the list lock, as replication and the
+ * SDL view read them) into flat arrays, then indexes each array by a
+ * counting sort of its entities into grid buckets. Nothing the write path
+ * touches is held while a snapshot is indexed or queried. The query thread
+ * takes a reference to the current snapshot per request, so a snapshot
+ * replaced while it is being read is freed by whichever side lets go last.
+ * Snapshots are only rebuilt while clients are connected, so a request
+ * that finds one older than QUERY_SNAPSHOT_MS waits for the next build.
+ */
+#define _GNU_SOURCE
+#include "headers/query.h"
+#include "headers/globals.h"
+#include "headers/region.h"
+#include "headers/metrics.h"
+#include "headers/lockprof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <json-c/json.h>
+
+#define QUERY_POLL_MS 100
+
+static const char *drone_status_names[] = {"idle", "on_mission", "disconnected"};
+static const char *survivor_state_names[] = {"open", "assigned", "rescued"};
+
+typedef struct query_client {
+    int fd;
+    size_t len;
+    char data[QUERY_LINE_MAX];
+} QueryClient;
+
+static struct {
+    int active;
+    int stopping;
+    int listen_fd;
+    char path[108];
+    pthread_t builder, server;
+    pthread_mutex_t lock;      // current and the builder's wakeup
+    pthread_cond_t wake;
+    pthread_cond_t built;      // a new current was published
+    QuerySnapshot *current;
+    QueryClient *clients[QUERY_MAX_CLIENTS];
+    int client_count;
+    int survivor_hint;         // survivors in the last snapshot, to size the next
+    uint64_t requests;
+    uint64_t build_ns;         // duration of the last build
+    QueryHit hits[QUERY_MAX_LIMIT];
+} q = {.lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .built = PTHREAD_COND_INITIALIZER,
+       .listen_fd = -1};
+
+/* ---- index ---- */
+
+static int bucket_col(const QuerySnapshot *s, int x) {
+    if (x < 0) return 0;
+    int b = x >> QUERY_BUCKET_SHIFT;
+    return b < s->cols ? b : s->cols - 1;
+}
+
+static int bucket_row(const QuerySnapshot *s, int y) {
+    if (y < 0) return 0;
+    int b = y >> QUERY_BUCKET_SHIFT;
+    return b < s->rows ? b : s->rows - 1;
+}
+
+// Sorts points (in item order) into bucket order. Returns -1 if out of memory.
+static int index_build(const QuerySnapshot *s, QueryIndex *ix, QueryPoint *points, int count) {
+    int buckets = s->cols * s->rows;
+    ix->count = count;
+    ix->start = calloc(buckets + 1, sizeof(uint32_t));
+    ix->points = malloc(sizeof(QueryPoint) * (count > 0 ? count : 1));
+    if (!ix->start || !ix->points) return -1;
+    for (int i = 0; i < count; i++) {
+        ix->start[bucket_row(s, points[i].y) * s->cols + bucket_col(s, points[i].x) + 1]++;
+    }
+    for (int b = 0; b < buckets; b++) ix->start[b + 1] += ix->start[b];
+    // Fill from the back of each bucket, so each keeps the items' order
+    for (int i = count - 1; i >= 0; i--) {
+        int b = bucket_row(s, points[i].y) * s->cols + bucket_col(s, points[i].x);
+        ix->points[--ix->start[b + 1]] = points[i];
+    }
+    // start[b + 1] now holds where bucket b begins; shift the offsets back
+    memmove(ix->start, ix->start + 1, sizeof(uint32_t) * buckets);
+    ix->start[buckets] = count;
+    return 0;
+}
+
+// Indexes the given entities, taking ownership of both arrays. Returns
+// NULL (and frees them) if out of memory.
+QuerySnapshot *query_snapshot_new(int width, int height, QueryDrone *drones, int drone_count,
+                                  QuerySurvivor *survivors, int survivor_count) {
+    QuerySnapshot *s = calloc(1, sizeof(QuerySnapshot));
+    int larger = drone_count > survivor_count ? drone_count : survivor_count;
+    QueryPoint *points = malloc(sizeof(QueryPoint) * (larger > 0 ? larger : 1));
+    if (!s || !points) {
+        free(s);
+        free(points);
+        free(drones);
+        free(survivors);
+        return NULL;
+    }
+    s->refs = 1;
+    s->width = width > 0 ? width : 1;
+    s->height = height > 0 ? height : 1;
+    s->cols = (s->width + QUERY_BUCKET_SIZE - 1) >> QUERY_BUCKET_SHIFT;
+    s->rows = (s->height + QUERY_BUCKET_SIZE - 1) >> QUERY_BUCKET_SHIFT;
+    s->drones = drones;
+    s->survivors = survivors;
+    for (int i = 0; i < drone_count; i++) {
+        points[i] = (QueryPoint){.x = drones[i].coord.x, .y = drones[i].coord.y, .item = i,
+                                 .status = drones[i].status};
+    }
+    int ok = index_build(s, &s->drone_index, points, drone_count) == 0;
+    for (int i = 0; i < survivor_count; i++) {
+        points[i] = (QueryPoint){.x = survivors[i].coord.x, .y = survivors[i].coord.y, .item = i,
+                                 .status = survivors[i].state};
+    }
+    ok = ok && index_build(s, &s->survivor_index, points, survivor_count) == 0;
+    free(points);
+    if (!ok) {
+        query_snapshot_free(s);
+        return NULL;
+    }
+    return s;
+}
+
+void query_snapshot_free(QuerySnapshot *s) {
+    if (!s) return;
+    free(s->drones);
+    free(s->survivors);
+    free(s->drone_index.points);
+    free(s->drone_index.start);
+    free(s->survivor_index.points);
+    free(s->survivor_index.start);
+    free(s);
+}
+
+/* ---- queries ---- */
+
+static int matches_status(const QueryRequest *req, const QueryPoint *p) {
+    return req->status_mask == 0 || (req->status_mask & (1u << p->status));
+}
+
+// Max-heap on distance2 over hits[0..n)
+static void heap_up(QueryHit *hits, int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+        if (hits[parent].distance2 >= hits[i].distance2) break;
+        QueryHit t = hits[parent];
+        hits[parent] = hits[i];
+        hits[i] = t;
+        i = parent;
+    }
+}
+
+static void heap_down(QueryHit *hits, int n) {
+    int i = 0;
+    for (;;) {
+        int largest = i, l = 2 * i + 1, r = l + 1;
+        if (l < n && hits[l].distance2 > hits[largest].distance2) largest = l;
+        if (r < n && hits[r].distance2 > hits[largest].distance2) largest = r;
+        if (largest == i) break;
+        QueryHit t = hits[largest];
+        hits[largest] = hits[i];
+        hits[i] = t;
+        i = largest;
+    }
+}
+
+static int64_t min64(int64_t a, int64_t b) {
+    return a < b ? a : b;
+}
+
+static int compare_hits(const void *a, const void *b) {
+    const QueryHit *x = a, *y = b;
+    if (x->distance2 != y->distance2) return x->distance2 < y->distance2 ? -1 : 1;
+    return (x->item > y->item) - (x->item < y->item);
+}
+
+// Offers every point of bucket (col, row) to the k-nearest heap.
+static int nearest_bucket(const QueryIndex *ix, const QuerySnapshot *s, const QueryRequest *req, int col, int row,
+                          QueryHit *hits, int n) {
+    int b = row * s->cols + col;
+    for (uint32_t i = ix->start[b]; i < ix->start[b + 1]; i++) {
+        const QueryPoint *p = &ix->points[i];
+        if (!matches_status(req, p)) continue;
+        int64_t dx = p->x - req->x, dy = p->y - req->y;
+        int64_t d2 = dx * dx + dy * dy;
+        if (n < req->limit) {
+            hits[n] = (QueryHit){.item = p->item, .distance2 = d2};
+            heap_up(hits, n++);
+        } else if (d2 < hits[0].distance2) {
+            hits[0] = (QueryHit){.item = p->item, .distance2 = d2};
+            heap_down(hits, n);
+        }
+    }
+    return n;
+}
+
+// Searches rings of buckets outwards from (x, y) until no unsearched
+// bucket can hold anything closer than the k-th best so far.
+static int run_nearest(const QueryIndex *ix, const QuerySnapshot *s, const QueryRequest *req, QueryHit *hits) {
+    int n = 0;
+    int bx = bucket_col(s, req->x), by = bucket_row(s, req->y);
+    int reach = s->cols > s->rows ? s->cols : s->rows;
+    for (int d = 0; d <= reach; d++) {
+        for (int row = by - d; row <= by + d; row++) {
+            if (row < 0 || row >= s->rows) continue;
+            int edge = row == by - d || row == by + d;
+            for (int col = bx - d; col <= bx + d; col += edge || d == 0 ? 1 : 2 * d) {
+                if (col >= 0 && col < s->cols) n = nearest_bucket(ix, s, req, col, row, hits, n);
+            }
+        }
+        // Closest anything outside the searched square can be; sides at the
+        // edge of the grid have nothing beyond them
+        int64_t bound = INT64_MAX;
+        if (bx - d > 0) bound = min64(bound, req->x - (int64_t)(bx - d) * QUERY_BUCKET_SIZE + 1);
+        if (bx + d < s->cols - 1) bound = min64(bound, (int64_t)(bx + d + 1) * QUERY_BUCKET_SIZE - req->x);
+        if (by - d > 0) bound = min64(bound, req->y - (int64_t)(by - d) * QUERY_BUCKET_SIZE + 1);
+        if (by + d < s->rows - 1) bound = min64(bound, (int64_t)(by + d + 1) * QUERY_BUCKET_SIZE - req->y);
+        if (bound == INT64_MAX) break;
+        if (n == req->limit && bound > 0 && hits[0].distance2 <= bound * bound) break;
+    }
+    qsort(hits, n, sizeof(QueryHit), compare_hits);
+    return n;
+}
+
+// Runs req against s, filling hits with up to req->limit results. Returns
+// how many entities match (for nearest, how many were found).
+int query_run(const QuerySnapshot *s, const QueryRequest *req, QueryHit *hits) {
+    const QueryIndex *ix = req->target == QUERY_DRONES ? &s->drone_index : &s->survivor_index;
+    if (req->limit <= 0) return 0;
+    if (req->shape == QUERY_NEAREST) return run_nearest(ix, s, req, hits);
+
+    int x0, y0, x1, y1;  // inclusive cell bounds
+    if (req->shape == QUERY_RADIUS) {
+        x0 = req->x - req->r;
+        y0 = req->y - req->r;
+        x1 = req->x + req->r;
+        y1 = req->y + req->r;
+    } else {
+        x0 = req->x0;
+        y0 = req->y0;
+        x1 = req->x1 - 1;
+        y1 = req->y1 - 1;
+    }
+    if (x1 < x0 || y1 < y0) return 0;
+    int64_t r2 = (int64_t)req->r * req->r;
+    int count = 0;
+    for (int row = bucket_row(s, y0); row <= bucket_row(s, y1); row++) {
+        for (int col = bucket_col(s, x0); col <= bucket_col(s, x1); col++) {
+            int b = row * s->cols + col;
+            for (uint32_t i = ix->start[b]; i < ix->start[b + 1]; i++) {
+                const QueryPoint *p = &ix->points[i];
+                if (p->x < x0 || p->x > x1 || p->y < y0 || p->y > y1 || !matches_status(req, p)) continue;
+                int64_t dx = p->x - req->x, dy = p->y - req->y;
+                int64_t d2 = req->shape == QUERY_RADIUS ? dx * dx + dy * dy : 0;
+                if (d2 > r2) continue;
+                if (count < req->limit) hits[count] = (QueryHit){.item = p->item, .distance2 = d2};
+                count++;
+            }
+        }
+    }
+    return count;
+}
+
+/* ---- snapshots ---- */
+
+static QuerySnapshot *snapshot_acquire() {
+    LOCK(&q.lock);
+    QuerySnapshot *s = q.current;
+    if (s) s->refs++;
+    UNLOCK(&q.lock);
+    return s;
+}
+
+// Like snapshot_acquire(), but a snapshot older than QUERY_SNAPSHOT_MS (the
+// one left over from before this client connected) is first replaced by
+// the builder, waiting up to QUERY_FRESH_WAIT_MS for it.
+static QuerySnapshot *snapshot_acquire_fresh() {
+    LOCK(&q.lock);
+    uint64_t stale_ns = QUERY_SNAPSHOT_MS * 1000000ULL;
+    if (!q.current || metrics_now_ns() - q.current->built_ns > stale_ns) {
+        uint64_t seq = q.current ? q.current->seq : 0;
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += QUERY_FRESH_WAIT_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_signal(&q.wake);
+        while (!q.stopping && (!q.current || q.current->seq == seq)) {
+            if (pthread_cond_timedwait(&q.built, &q.lock, &until) == ETIMEDOUT) break;
+        }
+    }
+    QuerySnapshot *s = q.current;
+    if (s) s->refs++;
+    UNLOCK(&q.lock);
+    return s;
+}
+
+static void snapshot_release(QuerySnapshot *s) {
+    if (!s) return;
+    LOCK(&q.lock);
+    int last = --s->refs == 0;
+    UNLOCK(&q.lock);
+    if (last) query_snapshot_free(s);
+}
+
+// Copies the live drones and waiting survivors and indexes the copy.
+static QuerySnapshot *snapshot_world(uint64_t seq) {
+    int drone_cap = drones->capacity;
+    int survivor_cap = q.survivor_hint + q.survivor_hint / 4 + REGION_SURVIVOR_CAPACITY;
+    QueryDrone *ds = malloc(sizeof(QueryDrone) * drone_cap);
+    QuerySurvivor *ss = malloc(sizeof(QuerySurvivor) * survivor_cap);
+    if (!ds || !ss) {
+        free(ds);
+        free(ss);
+        return NULL;
+    }
+    uint64_t start = metrics_now_ns();
+    int drone_count = 0, survivor_count = 0;
+    metrics_lock(&drones->lock, LOCK_DRONES);
+    for (Node *node = drones->head; node != NULL && drone_count < drone_cap; node = node->next) {
+        Drone *d = (Drone *)node->data;
+        LOCK(&d->lock);
+        ds[drone_count++] = (QueryDrone){.id = d->id, .coord = d->coord, .status = d->status,
+                                         .payload = d->payload, .battery = d->battery};
+        UNLOCK(&d->lock);
+    }
+    UNLOCK(&drones->lock);
+    for (int i = 0; i < region_count; i++) {
+        List *waiting = regions[i].survivors;
+        LOCK(&waiting->lock);
+        if (survivor_count + waiting->number_of_elements > survivor_cap) {
+            survivor_cap = (survivor_count + waiting->number_of_elements) * 2;
+            QuerySurvivor *grown = realloc(ss, sizeof(QuerySurvivor) * survivor_cap);
+            if (!grown) {
+                UNLOCK(&waiting->lock);
+                free(ds);
+                free(ss);
+                return NULL;
+            }
+            ss = grown;
+        }
+        for (Node *node = waiting->head; node != NULL; node = node->next) {
+            const Survivor *s = *(Survivor **)node->data;
+            uint64_t word = survivor_state(s);
+            if (SURVIVOR_STATE(word) == SURVIVOR_RESCUED) continue;
+            QuerySurvivor *out = &ss[survivor_count++];
+            *out = (QuerySurvivor){.id = s->id, .coord = s->coord, .need = s->need,
+                                   .state = SURVIVOR_STATE(word),
+                                   .drone = SURVIVOR_STATE(word) == SURVIVOR_OPEN ? -1 : SURVIVOR_DRONE(word)};
+            memcpy(out->info, s->info, sizeof(out->info));
+        }
+        UNLOCK(&waiting->lock);
+    }
+    q.survivor_hint = survivor_count;
+    QuerySnapshot *snap = query_snapshot_new(map.width, map.height, ds, drone_count, ss, survivor_count);
+    if (snap) {
+        snap->seq = seq;
+        snap->built_ns = start;
+    }
+    __atomic_store_n(&q.build_ns, metrics_now_ns() - start, __ATOMIC_RELAXED);
+    return snap;
+}
+
+static void *builder_main(void *arg) {
+    (void)arg;
+    uint64_t seq = 0;
+    LOCK(&q.lock);
+    while (!q.stopping) {
+        if (q.client_count > 0 || !q.current) {
+            UNLOCK(&q.lock);
+            QuerySnapshot *snap = snapshot_world(++seq);
+            LOCK(&q.lock);
+            if (snap) {
+                QuerySnapshot *old = q.current;
+                q.current = snap;
+                pthread_cond_broadcast(&q.built);
+                if (old && --old->refs == 0) {
+                    UNLOCK(&q.lock);
+                    query_snapshot_free(old);
+                    LOCK(&q.lock);
+                }
+            }
+        }
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += QUERY_SNAPSHOT_MS * 1000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&q.wake, &q.lock, &until);
+    }
+    UNLOCK(&q.lock);
+    return NULL;
+}
+
+/* ---- requests ---- */
+
+static int name_index(const char **names, int count, const char *name) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(names[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+static int field_int(struct json_object *obj, const char *key, int fallback) {
+    struct json_object *v;
+    return json_object_object_get_ex(obj, key, &v) ? json_object_get_int(v) : fallback;
+}
+
+static const char *parse_status(struct json_object *v, const char **names, int count, unsigned *mask) {
+    if (json_object_is_type(v, json_type_string)) {
+        int i = name_index(names, count, json_object_get_string(v));
+        if (i < 0) return "unknown status";
+        *mask |= 1u << i;
+        return NULL;
+    }
+    if (!json_object_is_type(v, json_type_array)) return "status must be a name or a list of names";
+    for (size_t i = 0; i < json_object_array_length(v); i++) {
+        const char *err = parse_status(json_object_array_get_idx(v, i), names, count, mask);
+        if (err) return err;
+    }
+    return NULL;
+}
+
+// Fills req from a request line. Returns an error message, or NULL.
+static const char *parse_request(struct json_object *msg, QueryRequest *req) {
+    struct json_object *v;
+    if (!json_object_is_type(msg, json_type_object)) return "request must be a JSON object";
+    const char *target = json_object_object_get_ex(msg, "target", &v) ? json_object_get_string(v) : "";
+    const char *shape = json_object_object_get_ex(msg, "query", &v) ? json_object_get_string(v) : "";
+    *req = (QueryRequest){.x = field_int(msg, "x", 0), .y = field_int(msg, "y", 0), .r = field_int(msg, "r", 0),
+                          .x0 = field_int(msg, "x0", 0), .y0 = field_int(msg, "y0", 0),
+                          .x1 = field_int(msg, "x1", 0), .y1 = field_int(msg, "y1", 0),
+                          .limit = field_int(msg, "limit", QUERY_DEFAULT_LIMIT)};
+    if (strcmp(target, "drones") == 0) req->target = QUERY_DRONES;
+    else if (strcmp(target, "survivors") == 0) req->target = QUERY_SURVIVORS;
+    else return "target must be drones or survivors";
+    if (strcmp(shape, "radius") == 0) req->shape = QUERY_RADIUS;
+    else if (strcmp(shape, "bbox") == 0) req->shape = QUERY_BBOX;
+    else if (strcmp(shape, "nearest") == 0) req->shape = QUERY_NEAREST;
+    else return "query must be radius, bbox or nearest";
+    if (req->shape == QUERY_RADIUS && (!json_object_object_get_ex(msg, "r", NULL) || req->r < 0)) {
+        return "radius needs r >= 0";
+    }
+    if (req->shape == QUERY_NEAREST) req->limit = field_int(msg, "k", 1);
+    if (req->limit < 1 || req->limit > QUERY_MAX_LIMIT) return "limit and k must be between 1 and 10000";
+    if (json_object_object_get_ex(msg, "status", &v)) {
+        return req->target == QUERY_DRONES ? parse_status(v, drone_status_names, 3, &req->status_mask)
+                                           : parse_status(v, survivor_state_names, 2, &req->status_mask);
+    }
+    return NULL;
+}
+
+static struct json_object *drone_json(const QueryDrone *d) {
+    struct json_object *obj = json_object_new_object();
+    json_object_object_add(obj, "id", json_object_new_int(d->id));
+    json_object_object_add(obj, "x", json_object_new_int(d->coord.x));
+    json_object_object_add(obj, "y", json_object_new_int(d->coord.y));
+    json_object_object_add(obj, "status", json_object_new_string(drone_status_names[d->status]));
+    json_object_object_add(obj, "payload", json_object_new_string(payload_name(d->payload)));
+    json_object_object_add(obj, "battery", json_object_new_int(d->battery));
+    return obj;
+}
+
+static struct json_object *survivor_json(const QuerySurvivor *s) {
+    struct json_object *obj = json_object_new_object();
+    json_object_object_add(obj, "id", json_object_new_int64((int64_t)s->id));
+    json_object_object_add(obj, "info", json_object_new_string(s->info));
+    json_object_object_add(obj, "x", json_object_new_int(s->coord.x));
+    json_object_object_add(obj, "y", json_object_new_int(s->coord.y));
+    json_object_object_add(obj, "need", json_object_new_string(payload_name(s->need)));
+    json_object_object_add(obj, "state", json_object_new_string(survivor_state_names[s->state]));
+    if (s->drone >= 0) json_object_object_add(obj, "drone", json_object_new_int(s->drone));
+    return obj;
+}
+
+static struct json_object *answer(struct json_object *msg) {
+    struct json_object *reply = json_object_new_object();
+    QueryRequest req;
+    const char *err = parse_request(msg, &req);
+    QuerySnapshot *s = err ? NULL : snapshot_acquire_fresh();
+    if (!err && !s) err = "no snapshot yet";
+    if (err) {
+        json_object_object_add(reply, "error", json_object_new_string(err));
+        return reply;
+    }
+    int count = query_run(s, &req, q.hits);
+    int returned = count < req.limit ? count : req.limit;
+    struct json_object *list = json_object_new_array();
+    for (int i = 0; i < returned; i++) {
+        const QueryHit *h = &q.hits[i];
+        struct json_object *obj = req.target == QUERY_DRONES ? drone_json(&s->drones[h->item])
+                                                             : survivor_json(&s->survivors[h->item]);
+        if (req.shape == QUERY_NEAREST) {
+            json_object_object_add(obj, "distance", json_object_new_double(sqrt((double)h->distance2)));
+        }
+        json_object_array_add(list, obj);
+    }
+    json_object_object_add(reply, "seq", json_object_new_int64((int64_t)s->seq));
+    json_object_object_add(reply, "age_ms", json_object_new_int64((int64_t)((metrics_now_ns() - s->built_ns) / 1000000)));
+    json_object_object_add(reply, "count", json_object_new_int(count));
+    json_object_object_add(reply, req.target == QUERY_DRONES ? "drones" : "survivors", list);
+    snapshot_release(s);
+    return reply;
+}
+
+static int send_line(int fd, const char *text) {
+    size_t len = strlen(text), done = 0;
+    while (done <= len) {
+        // The terminating NUL is sent as the newline
+        const char *from = done < len ? text + done : "\n";
+        size_t left = done < len ? len - done : 1;
+        ssize_t n = send(fd, from, left, MSG_NOSIGNAL);
+        if (n > 0) {
+            done += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            if (poll(&pfd, 1, QUERY_POLL_MS) <= 0) return -1;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Answers the complete lines a client has sent; returns -1 to drop it.
+static int client_read(QueryClient *c) {
+    ssize_t n = recv(c->fd, c->data + c->len, sizeof(c->data) - c->len - 1, MSG_DONTWAIT);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return 0;
+    if (n <= 0) return -1;
+    c->len += n;
+    c->data[c->len] = '\0';
+    char *start = c->data, *newline;
+    while ((newline = memchr(start, '\n', c->data + c->len - start)) != NULL) {
+        *newline = '\0';
+        struct json_object *msg = json_tokener_parse(start);
+        struct json_object *reply;
+        if (msg) {
+            reply = answer(msg);
+            json_object_put(msg);
+        } else {
+            reply = json_object_new_object();
+            json_object_object_add(reply, "error", json_object_new_string("not JSON"));
+        }
+        __atomic_add_fetch(&q.requests, 1, __ATOMIC_RELAXED);
+        int sent = send_line(c->fd, json_object_to_json_string_ext(reply, JSON_C_TO_STRING_PLAIN));
+        json_object_put(reply);
+        if (sent != 0) return -1;
+        start = newline + 1;
+    }
+    c->len -= start - c->data;
+    memmove(c->data, start, c->len);
+    if (c->len >= sizeof(c->data) - 1) return -1;  // longer than any request
+    return 0;
+}
+
+static void set_client_count(int count) {
+    LOCK(&q.lock);
+    int woke = q.client_count == 0 && count > 0;
+    q.client_count = count;
+    if (woke) pthread_cond_signal(&q.wake);
+    UNLOCK(&q.lock);
+}
+
+static void *server_main(void *arg) {
+    (void)arg;
+    int count = 0;
+    while (!__atomic_load_n(&q.stopping, __ATOMIC_ACQUIRE)) {
+        struct pollfd pfds[1 + QUERY_MAX_CLIENTS];
+        pfds[0] = (struct pollfd){.fd = q.listen_fd, .events = POLLIN};
+        for (int i = 0; i < count; i++) pfds[1 + i] = (struct pollfd){.fd = q.clients[i]->fd, .events = POLLIN};
+        if (poll(pfds, 1 + count, QUERY_POLL_MS) <= 0) continue;
+        for (int i = count - 1; i >= 0; i--) {
+            if (!pfds[1 + i].revents || client_read(q.clients[i]) == 0) continue;
+            close(q.clients[i]->fd);
+            free(q.clients[i]);
+            q.clients[i] = q.clients[--count];
+        }
+        int fd;
+        while (pfds[0].revents && (fd = accept4(q.listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+            QueryClient *c = count < QUERY_MAX_CLIENTS ? malloc(sizeof(QueryClient)) : NULL;
+            if (!c) {
+                close(fd);
+                continue;
+            }
+            c->fd = fd;
+            c->len = 0;
+            q.clients[count++] = c;
+        }
+        set_client_count(count);
+    }
+    for (int i = 0; i < count; i++) {
+        close(q.clients[i]->fd);
+        free(q.clients[i]);
+    }
+    set_client_count(0);
+    return NULL;
+}
+
+// Call with the regions started.
+int query_start(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Query socket path too long: %s\n", path);
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    strcpy(q.path, path);
+    unlink(path);
+    q.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (q.listen_fd < 0 || bind(q.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(q.listen_fd, 16) != 0) {
+        perror("Failed to listen for queries");
+        if (q.listen_fd >= 0) close(q.listen_fd);
+        q.listen_fd = -1;
+        return -1;
+    }
+    q.stopping = 0;
+    if (pthread_create(&q.builder, NULL, builder_main, NULL) != 0) {
+        perror("Failed to start query snapshot thread");
+        close(q.listen_fd);
+        return -1;
+    }
+    if (pthread_create(&q.server, NULL, server_main, NULL) != 0) {
+        perror("Failed to start query thread");
+        query_stop();
+        return -1;
+    }
+    q.active = 1;
+    printf("Answering spatial queries on %s\n", path);
+    return 0;
+}
+
+// Call before the regions are freed.
+void query_stop() {
+    if (q.listen_fd < 0) return;
+    LOCK(&q.lock);
+    __atomic_store_n(&q.stopping, 1, __ATOMIC_RELEASE);
+    pthread_cond_signal(&q.wake);
+    UNLOCK(&q.lock);
+    if (q.active) pthread_join(q.server, NULL);
+    pthread_join(q.builder, NULL);
+    q.active = 0;
+    close(q.listen_fd);
+    q.listen_fd = -1;
+    unlink(q.path);
+    snapshot_release(q.current);
+    q.current = NULL;
+}
+
+long query_requests() {
+    return __atomic_load_n(&q.requests, __ATOMIC_RELAXED);
+}
+
+// Seconds since the current snapshot was taken, 0 before the first.
+double query_snapshot_age() {
+    QuerySnapshot *s = snapshot_acquire();
+    double age = s ? (metrics_now_ns() - s->built_ns) / 1e9 : 0;
+    snapshot_release(s);
+    return age;
+}
+
+double query_build_seconds() {
+    return __atomic_load_n(&q.build_ns, __ATOMIC_RELAXED) / 1e9;
+}
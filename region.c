@@ -0,0 +1,784 @@
+/**
+ * @file region.c
+ * @brief Region-sharded world state, each region drained by one task at a time.
+ *
+ * Each region owns the waiting survivors inside its rectangle and the
+ * membership of the drones currently flying over it. Connection tasks,
+ * the survivor generator and neighbouring regions never touch that state
+ * directly: they post messages to the region's lock-free MPSC inbox, and the
+ * first post to an idle region submits a drain task to the work pool that
+ * applies them in order. Drones that fly across a boundary are handed off to
+ * the neighbouring region. The only shared locks left on the hot path are
+ * the per-drone mutex and the map's striped cell locks.
+ */
+#include "headers/region.h"
+#include "headers/globals.h"
+#include "headers/map.h"
+#include "headers/ai.h"
+#include "headers/archive.h"
+#include "headers/metrics.h"
+#include "headers/server.h"
+#include "headers/workpool.h"
+#include "headers/deadreckon.h"
+#include "headers/admission.h"
+#include "headers/span.h"
+#include "headers/lockprof.h"
+#include "headers/federation.h"
+#include "headers/replication.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <json-c/json.h>
+
+Region *regions = NULL;
+int region_count = 0;
+
+static int region_cols, region_rows;
+static int region_w, region_h;
+
+static void region_drain(void *arg);
+
+// Span names, indexed by RegionMsgType
+static const char *region_span_names[] = {
+    "region JOIN", "region HANDOFF", "region STATUS", "region MISSION_COMPLETE", "region HEARTBEAT",
+    "region SURVIVOR", "region RESCUED"};
+
+// Distance between predicted and reported positions, summed over status
+// updates from drones on a mission
+static uint64_t position_error_cells = 0;
+static uint64_t position_error_reports = 0;
+
+/* ---- MPSC inbox ---- */
+
+static void inbox_init(Region *r) {
+    r->stub.next = NULL;
+    r->head = &r->stub;
+    r->tail = &r->stub;
+    r->depth = 0;
+}
+
+static void inbox_push(Region *r, RegionMsg *m) {
+    m->next = NULL;
+    RegionMsg *prev = __atomic_exchange_n(&r->head, m, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, m, __ATOMIC_RELEASE);
+}
+
+// Owner only. Returns NULL when empty, or while a producer is between its
+// exchange and its link store; the depth counter tells the two apart.
+static RegionMsg *inbox_pop(Region *r) {
+    RegionMsg *tail = r->tail;
+    RegionMsg *next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (tail == &r->stub) {
+        if (!next) return NULL;
+        r->tail = next;
+        tail = next;
+        next = __atomic_load_n(&next->next, __ATOMIC_ACQUIRE);
+    }
+    if (next) {
+        r->tail = next;
+        return tail;
+    }
+    if (tail != __atomic_load_n(&r->head, __ATOMIC_ACQUIRE)) return NULL;
+    inbox_push(r, &r->stub);
+    next = __atomic_load_n(&tail->next, __ATOMIC_ACQUIRE);
+    if (next) {
+        r->tail = next;
+        return tail;
+    }
+    return NULL;
+}
+
+RegionMsg *region_msg_new(RegionMsgType type, Drone *drone) {
+    RegionMsg *m = calloc(1, sizeof(RegionMsg));
+    if (!m) {
+        perror("Failed to allocate region message");
+        return NULL;
+    }
+    m->type = type;
+    m->drone = drone;
+    m->metric_type = -1;
+    return m;
+}
+
+// Submits a drain task unless one is already queued or running.
+static void region_schedule(Region *r) {
+    int idle = 0;
+    if (!__atomic_compare_exchange_n(&r->scheduled, &idle, 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) return;
+    if (workpool_submit(region_drain, r) != 0) {
+        region_drain(r);
+    }
+}
+
+void region_post(Region *r, RegionMsg *m) {
+    inbox_push(r, m);
+    // Pairs with the scheduled/depth check at the end of region_drain()
+    __atomic_add_fetch(&r->depth, 1, __ATOMIC_SEQ_CST);
+    region_schedule(r);
+}
+
+// Posts the messages first..last, already linked through next, with one
+// exchange on the inbox.
+void region_post_batch(Region *r, RegionMsg *first, RegionMsg *last, int count) {
+    last->next = NULL;
+    RegionMsg *prev = __atomic_exchange_n(&r->head, last, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&prev->next, first, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&r->depth, count, __ATOMIC_SEQ_CST);
+    region_schedule(r);
+}
+
+Region *region_at(int x, int y) {
+    int col = x / region_w, row = y / region_h;
+    if (col < 0) col = 0;
+    if (col >= region_cols) col = region_cols - 1;
+    if (row < 0) row = 0;
+    if (row >= region_rows) row = region_rows - 1;
+    return &regions[row * region_cols + col];
+}
+
+// Posts to the drone's current owner; before it has joined, to the region under it.
+void region_post_drone(Drone *d, RegionMsg *m) {
+    int id = __atomic_load_n(&d->region, __ATOMIC_ACQUIRE);
+    region_post(id >= 0 ? &regions[id] : region_at(d->coord.x, d->coord.y), m);
+}
+
+double regions_position_error() {
+    uint64_t reports = __atomic_load_n(&position_error_reports, __ATOMIC_RELAXED);
+    if (reports == 0) return 0;
+    return (double)__atomic_load_n(&position_error_cells, __ATOMIC_RELAXED) / reports;
+}
+
+long regions_queued_messages() {
+    long total = 0;
+    for (int i = 0; i < region_count; i++) {
+        total += __atomic_load_n(&regions[i].depth, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+long regions_waiting_survivors() {
+    long total = 0;
+    for (int i = 0; i < region_count; i++) {
+        total += regions[i].survivors->number_of_elements;
+    }
+    return total;
+}
+
+/* ---- owner-side handlers ---- */
+
+static void observe_rescue(const Survivor *s) {
+    uint64_t now = metrics_now_ns();
+    uint64_t assigned = __atomic_load_n(&s->assigned_ns, __ATOMIC_RELAXED);
+    metrics_observe(HIST_DISCOVERY_TO_RESCUE, now - s->discovered_ns);
+    if (assigned) {
+        metrics_observe(HIST_ASSIGN_TO_RESCUE, now - assigned);
+    }
+}
+
+typedef struct archive_job {
+    Survivor survivor;
+    int drone_id;
+} ArchiveJob;
+
+static void archive_job_run(void *arg) {
+    ArchiveJob *job = (ArchiveJob *)arg;
+    // A failure is logged once by the archive and counted in edcs_archive_skipped
+    (void)archive_helped_survivor(&job->survivor, job->drone_id);
+    free(job);
+}
+
+// Drops a rescued survivor from the region's queue and frees it.
+static void release_survivor(Region *r, Survivor *s) {
+    replicate_survivor_removed(s);
+    r->survivors->removedata(r->survivors, &s);
+    free(s);
+}
+
+// The claim decides the rescue, so this is safe even when c lies in another
+// region; that region is told to release the survivor afterwards.
+// reported_ns is when the report that showed the drone at c came in, 0 if
+// it was predicted.
+static void rescue_at(Region *r, Drone *d, Coord c, int notify_drone, uint64_t reported_ns) {
+    LOCK(&d->lock);
+    Payload carried = d->payload;
+    UNLOCK(&d->lock);
+    Survivor *s = map_claim_survivor(c.x, c.y, d->id, carried);
+    if (!s) {
+        printf("[DEBUG] No survivor found at drone position (%d,%d)\n", c.x, c.y);
+        return;
+    }
+    printf("[DEBUG] Region %d: drone %d rescued %s at (%d,%d)\n", r->id, d->id, s->info, c.x, c.y);
+    replicate_survivor(s);
+    span_async("survivor mission", s->trace_id, __atomic_load_n(&s->assigned_ns, __ATOMIC_RELAXED),
+               reported_ns ? reported_ns : metrics_now_ns());
+    Span sp;
+    span_begin_trace(&sp, "rescue", s->trace_id);
+
+    if (notify_drone) {
+        char drone_id[16];
+        snprintf(drone_id, sizeof(drone_id), "D%d", d->id);
+        struct json_object *complete_msg = json_object_new_object();
+        json_object_object_add(complete_msg, "type", json_object_new_string("MISSION_COMPLETE"));
+        json_object_object_add(complete_msg, "drone_id", json_object_new_string(drone_id));
+        json_object_object_add(complete_msg, "mission_id", json_object_new_string(s->info));
+        json_object_object_add(complete_msg, "success", json_object_new_boolean(1));
+        json_object_object_add(complete_msg, "details", json_object_new_string("Delivered aid to survivor"));
+        // Under the drone's lock, so the socket cannot be closed and its fd
+        // reused by another connection while we write to it
+        LOCK(&d->lock);
+        if (d->sock < 0 || send_json(d->sock, complete_msg) != 0) {
+            fprintf(stderr, "MISSION_COMPLETE for %s not delivered to drone %d\n", s->info, d->id);
+        }
+        UNLOCK(&d->lock);
+        json_object_put(complete_msg);
+    }
+
+    // Stream the rescue into the archive off the region's drain task
+    observe_rescue(s);
+    ArchiveJob *job = malloc(sizeof(ArchiveJob));
+    if (job) {
+        job->survivor = *s;
+        job->drone_id = d->id;
+        if (workpool_submit(archive_job_run, job) != 0) archive_job_run(job);
+    } else {
+        perror("Failed to allocate archive job");
+    }
+
+    // A drone part way through a tour keeps flying it
+    LOCK(&d->lock);
+    if (d->tour_len == 0) d->status = IDLE;
+    replicate_drone(d);
+    UNLOCK(&d->lock);
+    span_end(&sp);
+
+    Region *owner = region_at(c.x, c.y);
+    if (owner == r) {
+        release_survivor(r, s);
+    } else {
+        RegionMsg *m = region_msg_new(REGION_MSG_RESCUED, NULL);
+        if (m) {
+            m->survivor = s;
+            region_post(owner, m);
+        }
+    }
+}
+
+// Moves d to the region under `at` if that is no longer r. Returns 1 if it left.
+static int region_follow(Region *r, Drone *d, Coord at, int predicted) {
+    if (!map_in_bounds(at.x, at.y)) return 0;
+    Region *dest = region_at(at.x, at.y);
+    if (dest == r) return 0;
+    // Post the handoff before publishing the new owner, so anything
+    // sent straight to dest is queued behind it
+    r->drones->removedata(r->drones, &d);
+    RegionMsg *h = region_msg_new(REGION_MSG_HANDOFF, d);
+    if (h) {
+        h->coord = at;
+        h->predicted = predicted;
+        region_post(dest, h);
+    }
+    __atomic_store_n(&d->region, dest->id, __ATOMIC_RELEASE);
+    return 1;
+}
+
+static void handle_status(Region *r, RegionMsg *m) {
+    Drone *d = m->drone;
+    time_t now = time(NULL);
+    LOCK(&d->lock);
+    if (d->status == ON_MISSION && d->speed > 0) {
+        Coord predicted = drone_position(d, m->received_ns);
+        __atomic_add_fetch(&position_error_cells, deadreckon_deviation(predicted, m->coord), __ATOMIC_RELAXED);
+        __atomic_add_fetch(&position_error_reports, 1, __ATOMIC_RELAXED);
+    }
+    drone_reanchor(d, m->coord, m->received_ns);
+    d->status = m->status;
+    if (d->status == IDLE) d->repositioning = 0;
+    if (m->battery >= 0) d->battery = m->battery;
+    if (m->speed >= 0) d->reported_speed = m->speed;
+    if (!d->has_home && map_in_bounds(m->coord.x, m->coord.y)) {
+        // Drones that gave no home recharge where they first reported from
+        d->home = m->coord;
+        d->has_home = 1;
+    }
+    localtime_r(&now, &d->last_update);
+    replicate_drone(d);
+    UNLOCK(&d->lock);
+
+    if (!map_in_bounds(m->coord.x, m->coord.y)) return;
+    if (region_follow(r, d, m->coord, 0)) return;
+    rescue_at(r, d, m->coord, 1, m->received_ns);
+    federation_redirect(d, m->coord);
+}
+
+// Each stop of a tour is reported on its own; the drone stays on its
+// mission until the last one.
+static void handle_mission_complete(Region *r, RegionMsg *m) {
+    Drone *d = m->drone;
+    if (!m->success) {
+        // The survivors stay assigned until the redispatch timeout hands them on
+        printf("Drone %d failed its mission.\n", d->id);
+        LOCK(&d->lock);
+        d->tour_len = 0;
+        d->repositioning = 0;
+        d->status = IDLE;
+        replicate_drone(d);
+        UNLOCK(&d->lock);
+        return;
+    }
+    LOCK(&d->lock);
+    Coord at = map_in_bounds(m->coord.x, m->coord.y) ? m->coord : d->coord;
+    if (d->sock >= 0) {
+        // Simulated drones (sock -1) advance their own tours
+        drone_reanchor(d, at, m->received_ns);
+        if (!drone_next_stop(d)) d->status = IDLE;
+        replicate_drone(d);
+    }
+    UNLOCK(&d->lock);
+    rescue_at(r, d, at, 0, m->received_ns);
+    federation_redirect(d, at);
+}
+
+// Returns 0 if the message was consumed, 1 if it was forwarded to another region.
+static int region_handle(Region *r, RegionMsg *m) {
+    if (m->drone && m->type != REGION_MSG_JOIN && m->type != REGION_MSG_HANDOFF) {
+        int owner = __atomic_load_n(&m->drone->region, __ATOMIC_ACQUIRE);
+        if (owner >= 0 && owner != r->id) {
+            region_post(&regions[owner], m);
+            return 1;
+        }
+    }
+
+    Span sp;
+    span_begin_trace(&sp, region_span_names[m->type], m->trace_id);
+    span_async("region inbox", m->trace_id, m->received_ns, sp.start_ns);
+    switch (m->type) {
+        case REGION_MSG_JOIN:
+        case REGION_MSG_HANDOFF:
+            r->drones->add(r->drones, &m->drone);
+            __atomic_store_n(&m->drone->region, r->id, __ATOMIC_RELEASE);
+            if (m->type == REGION_MSG_HANDOFF && !m->predicted) {
+                rescue_at(r, m->drone, m->coord, 1, m->received_ns);
+                federation_redirect(m->drone, m->coord);
+            }
+            break;
+        case REGION_MSG_STATUS:
+            handle_status(r, m);
+            break;
+        case REGION_MSG_MISSION_COMPLETE:
+            handle_mission_complete(r, m);
+            break;
+        case REGION_MSG_HEARTBEAT: {
+            time_t now = time(NULL);
+            LOCK(&m->drone->lock);
+            localtime_r(&now, &m->drone->last_update);
+            UNLOCK(&m->drone->lock);
+            break;
+        }
+        case REGION_MSG_SURVIVOR: {
+            Survivor *s = m->survivor;
+            if (map_add_survivor(s) != 0) {
+                printf("Map cell (%d,%d) is full, dropping survivor %s\n", s->coord.x, s->coord.y, s->info);
+                free(s);
+                break;
+            }
+            if (r->survivors->add(r->survivors, &s) == NULL) {
+                printf("Region %d survivor list is full, dropping %s\n", r->id, s->info);
+                map_remove_survivor(s);
+                free(s);
+                break;
+            }
+            replicate_survivor(s);
+            r->last_dispatch_ns = 0;  // dispatch right away
+            break;
+        }
+        case REGION_MSG_RESCUED:
+            release_survivor(r, m->survivor);
+            break;
+    }
+    span_end(&sp);
+
+    if (m->metric_type >= 0) {
+        uint64_t latency = metrics_now_ns() - m->received_ns;
+        metrics_observe(HIST_HANDLER + m->metric_type, latency);
+        admission_observe(latency);
+    }
+    return 0;
+}
+
+/* ---- dead reckoning ---- */
+
+// Drones on a mission report only when they stray from their predicted
+// path, so each tick moves members to where they should be by now and hands
+// over the ones that flew out of the region.
+static void region_advance(Region *r, uint64_t now) {
+    Node *node = r->drones->head;
+    while (node != NULL) {
+        Node *next = node->next;
+        Drone *d = *(Drone **)node->data;
+        LOCK(&d->lock);
+        Coord at = d->coord;
+        if (d->status == ON_MISSION && d->speed > 0) {
+            at = drone_position(d, now);
+            if (at.x != d->coord.x || at.y != d->coord.y) {
+                d->coord = at;
+                replicate_drone(d);
+            }
+        }
+        UNLOCK(&d->lock);
+        region_follow(r, d, at, 1);
+        node = next;
+    }
+}
+
+/* ---- report intervals ---- */
+
+double regions_desired_report_rate() {
+    uint64_t total = 0;
+    for (int i = 0; i < region_count; i++) {
+        total += __atomic_load_n(&regions[i].desired_mrate, __ATOMIC_RELAXED);
+    }
+    return total / 1000.0;
+}
+
+// How much every interval is stretched to keep the fleet within the budget.
+double regions_report_scale() {
+    double desired = regions_desired_report_rate();
+    if (config.update_budget <= 0 || desired <= config.update_budget) return 1;
+    return desired / config.update_budget;
+}
+
+static int nearest_open_survivor(Region *r, Coord from) {
+    int best = -1;
+    for (Node *node = r->survivors->head; node != NULL; node = node->next) {
+        Survivor *s = *(Survivor **)node->data;
+        if (SURVIVOR_STATE(survivor_state(s)) != SURVIVOR_OPEN) continue;
+        int dist = deadreckon_deviation(from, s->coord);
+        if (best < 0 || dist < best) best = dist;
+    }
+    return best;
+}
+
+// The interval a drone wants on its own: short as it closes on its target,
+// long while it idles with nothing to fly to. Call with d->lock held.
+static double wanted_interval(Region *r, Drone *d, uint64_t now) {
+    double interval = REPORT_HEARTBEAT_S;
+    if (d->status == ON_MISSION) {
+        double speed = d->speed > 0 ? d->speed : DEADRECKON_DEFAULT_SPEED;
+        interval = deadreckon_deviation(drone_position(d, now), d->target) / speed / 2;
+    } else if (d->status == IDLE) {
+        int near = nearest_open_survivor(r, d->coord);
+        if (near >= 0 && near <= REPORT_NEAR_CELLS) interval = REPORT_IDLE_NEAR_S;
+    }
+    if (interval < REPORT_MIN_S) interval = REPORT_MIN_S;
+    if (interval > REPORT_HEARTBEAT_S) interval = REPORT_HEARTBEAT_S;
+    return interval;
+}
+
+// Reviews the members' report intervals and pushes the ones that moved.
+// Every region scales by the fleet-wide total from the previous round, so
+// the planned inbound rate stays under config.update_budget.
+static void region_adapt(Region *r, uint64_t now) {
+    double scale = regions_report_scale();
+    double desired = 0;
+    for (Node *node = r->drones->head; node != NULL; node = node->next) {
+        Drone *d = *(Drone **)node->data;
+        LOCK(&d->lock);
+        if (d->status != DISCONNECTED && d->sock >= 0) {
+            double wanted = wanted_interval(r, d, now);
+            desired += 1 / wanted;
+            double status = wanted * scale;
+            double heartbeat = status > REPORT_HEARTBEAT_S ? status : REPORT_HEARTBEAT_S;
+            if (status >= d->status_interval * REPORT_CHANGE_FACTOR ||
+                status * REPORT_CHANGE_FACTOR <= d->status_interval) {
+                double old_status = d->status_interval, old_heartbeat = d->heartbeat_interval;
+                d->status_interval = status;
+                d->heartbeat_interval = heartbeat;
+                if (send_report_config(d) != 0) {
+                    // Keep what the drone last got, so the next pass sends it again once resumed
+                    fprintf(stderr, "CONFIG_UPDATE not delivered to drone %d\n", d->id);
+                    d->status_interval = old_status;
+                    d->heartbeat_interval = old_heartbeat;
+                }
+            }
+        }
+        UNLOCK(&d->lock);
+    }
+    __atomic_store_n(&r->desired_mrate, (uint64_t)(desired * 1000), __ATOMIC_RELAXED);
+    r->last_adapt_ns = now;
+}
+
+/* ---- dispatch ---- */
+
+static Drone *best_member_drone(Region *r, const Survivor *s) {
+    Drone *best = NULL;
+    double best_score = 0;
+    const PathField *field = path_field_acquire(&map_paths, s->coord);
+    for (Node *node = r->drones->head; node != NULL; node = node->next) {
+        Drone *d = *(Drone **)node->data;
+        LOCK(&d->lock);
+        double score = dispatch_score(d, s, field);
+        if (score >= 0 && (!best || score < best_score)) {
+            best_score = score;
+            best = d;
+        }
+        UNLOCK(&d->lock);
+    }
+    path_field_release(&map_paths, field);
+    return best;
+}
+
+// Reverts the assignments made for a tour that was not sent.
+static void tour_abandon(Survivor **stops, const uint64_t *was, int count, int drone_id) {
+    for (int i = 0; i < count; i++) {
+        survivor_transition(stops[i], SURVIVOR_WORD(SURVIVOR_ASSIGNED, drone_id), was[i]);
+        replicate_survivor(stops[i]);
+    }
+}
+
+// Fills out the tour that starts with stops[0], already assigned to d: open
+// survivors of this region within TOUR_RADIUS_CELLS of it that d can serve
+// join nearest first, up to d's capacity and as long as d can still fly the
+// tour and get home. Each is assigned to d as it joins. Returns the number
+// of stops, reordered into a short tour; was[] keeps each prior state word.
+static int region_build_tour(Region *r, Drone *d, Survivor **stops, uint64_t *was) {
+    LOCK(&d->lock);
+    Coord start = d->coord;
+    Coord home = d->has_home ? d->home : d->coord;
+    Payload carried = d->payload;
+    int limit = d->capacity > 0 ? d->capacity : 1;
+    double range = d->battery_capacity > 0 ? (double)d->battery * d->battery_capacity / 100 : 0;
+    UNLOCK(&d->lock);
+    if (limit > config.tour_stops) limit = config.tour_stops;
+    if (limit > DRONE_TOUR_MAX) limit = DRONE_TOUR_MAX;
+
+    // The nearest candidates, kept sorted by distance to the first stop
+    Survivor *near[DRONE_TOUR_MAX];
+    int near_dist[DRONE_TOUR_MAX];
+    int found = 0;
+    Coord first = stops[0]->coord;
+    for (Node *node = r->survivors->head; node != NULL && limit > 1; node = node->next) {
+        Survivor *s = *(Survivor **)node->data;
+        if (s == stops[0] || SURVIVOR_STATE(survivor_state(s)) != SURVIVOR_OPEN) continue;
+        if (!payload_serves(carried, s->need)) continue;
+        int dist = abs(s->coord.x - first.x) + abs(s->coord.y - first.y);
+        if (dist > TOUR_RADIUS_CELLS) continue;
+        if (found == limit - 1 && dist >= near_dist[found - 1]) continue;
+        int at = found < limit - 1 ? found++ : found - 1;
+        for (; at > 0 && near_dist[at - 1] > dist; at--) {
+            near[at] = near[at - 1];
+            near_dist[at] = near_dist[at - 1];
+        }
+        near[at] = s;
+        near_dist[at] = dist;
+    }
+
+    Coord coords[DRONE_TOUR_MAX];
+    int order[DRONE_TOUR_MAX];
+    coords[0] = first;
+    int count = 1;
+    for (int i = 0; i < found; i++) {
+        uint64_t word = survivor_state(near[i]);
+        if (SURVIVOR_STATE(word) != SURVIVOR_OPEN) continue;
+        if (survivor_transition(near[i], word, SURVIVOR_WORD(SURVIVOR_ASSIGNED, d->id)) != 0) continue;
+        coords[count] = near[i]->coord;
+        if (range > 0) {
+            int length = plan_tour(start, coords, count + 1, order);
+            Coord last = coords[order[count]];
+            int back = abs(last.x - home.x) + abs(last.y - home.y);
+            if (length + back + DISPATCH_RESERVE_CELLS > range) {
+                survivor_transition(near[i], SURVIVOR_WORD(SURVIVOR_ASSIGNED, d->id), word);
+                continue;
+            }
+        }
+        stops[count] = near[i];
+        was[count] = word;
+        count++;
+    }
+
+    plan_tour(start, coords, count, order);
+    Survivor *sorted[DRONE_TOUR_MAX];
+    uint64_t sorted_was[DRONE_TOUR_MAX];
+    for (int i = 0; i < count; i++) {
+        sorted[i] = stops[order[i]];
+        sorted_was[i] = was[order[i]];
+    }
+    memcpy(stops, sorted, sizeof(Survivor *) * count);
+    memcpy(was, sorted_was, sizeof(uint64_t) * count);
+    return count;
+}
+
+// Sends the best idle drone to s, on a tour of the open survivors around it.
+// Returns 0 if no idle drone of this server can serve s.
+static int dispatch_survivor(Region *r, Survivor *s, uint64_t word, uint64_t now) {
+    Drone *d = best_member_drone(r, s);
+    if (!d) d = find_best_idle_drone(s);
+    if (!d) return 0;  // nobody idle can serve this one; others may differ in need
+
+    // Reserve the survivors first so a concurrent rescue either wins or sees the assignment
+    if (survivor_transition(s, word, SURVIVOR_WORD(SURVIVOR_ASSIGNED, d->id)) != 0) return 1;
+    Survivor *stops[DRONE_TOUR_MAX] = {s};
+    uint64_t was[DRONE_TOUR_MAX] = {word};
+    int count = region_build_tour(r, d, stops, was);
+    Coord coords[DRONE_TOUR_MAX];
+    for (int i = 0; i < count; i++) coords[i] = stops[i]->coord;
+    Span sp;
+    span_begin(&sp, "assign_mission");
+    int assigned = assign_mission(d, coords, count, s->info);
+    span_end(&sp);
+    if (assigned != 0) {
+        tour_abandon(stops, was, count, d->id);  // another region got the drone first
+        return 1;
+    }
+
+    printf("Drone %d assigned to survivor %s at (%d, %d), %d stops\n", d->id, s->info, s->coord.x,
+           s->coord.y, count);
+    for (int i = 0; i < count; i++) {
+        if (stops[i]->assigned_ns == 0) {
+            metrics_observe(HIST_DISCOVERY_TO_ASSIGN, now - stops[i]->discovered_ns);
+            span_async("survivor waiting", stops[i]->trace_id, stops[i]->discovered_ns, now);
+        }
+        __atomic_store_n(&stops[i]->assigned_ns, now, __ATOMIC_RELAXED);
+        replicate_survivor(stops[i]);
+    }
+    return 1;
+}
+
+// Offers the region's oldest waiting survivors to the idle drones that can
+// reach them soonest, preferring drones over this region and borrowing from
+// elsewhere only when none of those can go. The drone also takes the open
+// survivors around the one it was picked for, as one tour. In a federation,
+// survivors no drone of this server has been able to serve for a while go to
+// the peer with the best idle drone for them.
+static void region_dispatch(Region *r) {
+    uint64_t now = metrics_now_ns();
+    Survivor *offered[FEDERATION_OFFERS_PER_PASS];
+    uint64_t offered_word[FEDERATION_OFFERS_PER_PASS];
+    int offered_to[FEDERATION_OFFERS_PER_PASS];
+    int offers = 0;
+    Span pass;
+    span_begin(&pass, "region dispatch");
+    for (Node *node = r->survivors->tail; node != NULL; node = node->prev) {
+        Survivor *s = *(Survivor **)node->data;
+        uint64_t word = survivor_state(s);
+        if (SURVIVOR_STATE(word) == SURVIVOR_RESCUED) continue;  // release is on its way
+        if (SURVIVOR_STATE(word) == SURVIVOR_ASSIGNED && now - s->assigned_ns < REGION_REDISPATCH_NS) continue;
+        Span sp;
+        span_begin_trace(&sp, "dispatch", s->trace_id);
+        int served = dispatch_survivor(r, s, word, now);
+        span_end(&sp);
+        if (!served && SURVIVOR_STATE(word) == SURVIVOR_OPEN && offers < FEDERATION_OFFERS_PER_PASS) {
+            int peer = federation_offer(s);
+            if (peer >= 0) {
+                offered[offers] = s;
+                offered_word[offers] = word;
+                offered_to[offers++] = peer;
+            }
+        }
+    }
+    // Handed over like a rescue, so a drone that reaches one meanwhile keeps it
+    for (int i = 0; i < offers; i++) {
+        if (survivor_transition(offered[i], offered_word[i], SURVIVOR_WORD(SURVIVOR_RESCUED, -1)) != 0) continue;
+        map_remove_survivor(offered[i]);
+        federation_transfer(offered_to[i], offered[i]);
+        release_survivor(r, offered[i]);
+    }
+    span_end(&pass);
+    r->last_dispatch_ns = now;
+}
+
+/* ---- drain task ---- */
+
+static void region_drain(void *arg) {
+    Region *r = (Region *)arg;
+    RegionMsg *m;
+    int handled = 0;
+    while (handled < REGION_DRAIN_BATCH && (m = inbox_pop(r)) != NULL) {
+        __atomic_sub_fetch(&r->depth, 1, __ATOMIC_RELAXED);
+        if (region_handle(r, m) == 0) free(m);
+        handled++;
+    }
+
+    uint64_t now = metrics_now_ns();
+    if (now - r->last_dispatch_ns >= REGION_TICK_MS * 1000000ULL) {
+        region_advance(r, now);
+        region_dispatch(r);
+    }
+    if (now - r->last_adapt_ns >= REGION_ADAPT_MS * 1000000ULL) {
+        region_adapt(r, now);
+    }
+
+    // More queued, or a producer is between its exchange and its link:
+    // give the worker back and come round again
+    if (__atomic_load_n(&r->depth, __ATOMIC_SEQ_CST) > 0) {
+        if (workpool_submit(region_drain, r) != 0) {
+            __atomic_store_n(&r->scheduled, 0, __ATOMIC_SEQ_CST);
+        }
+        return;
+    }
+    __atomic_store_n(&r->scheduled, 0, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&r->depth, __ATOMIC_SEQ_CST) > 0) region_schedule(r);
+}
+
+// Periodic dispatch for regions that receive no messages
+static void region_tick(void *arg) {
+    Region *r = (Region *)arg;
+    region_schedule(r);
+    workpool_after(REGION_TICK_MS * 1000000ULL, region_tick, r);
+}
+
+// Call with the work pool running; drain tasks and ticks run on its workers.
+int regions_start(int cols, int rows) {
+    region_cols = cols;
+    region_rows = rows;
+    region_w = (map.width + cols - 1) / cols;
+    region_h = (map.height + rows - 1) / rows;
+    region_count = cols * rows;
+    regions = calloc(region_count, sizeof(Region));
+    if (!regions) {
+        perror("Failed to allocate regions");
+        return -1;
+    }
+
+    for (int i = 0; i < region_count; i++) {
+        Region *r = &regions[i];
+        r->id = i;
+        r->x0 = (i % cols) * region_w;
+        r->y0 = (i / cols) * region_h;
+        r->x1 = r->x0 + region_w < map.width ? r->x0 + region_w : map.width;
+        r->y1 = r->y0 + region_h < map.height ? r->y0 + region_h : map.height;
+        inbox_init(r);
+        r->survivors = create_list(sizeof(Survivor *), REGION_SURVIVOR_CAPACITY);
+        r->drones = create_list(sizeof(Drone *), config.max_drones);
+        if (!r->survivors || !r->drones) {
+            fprintf(stderr, "Failed to allocate lists for region %d\n", i);
+            return -1;
+        }
+
+        workpool_after(REGION_TICK_MS * 1000000ULL, region_tick, r);
+    }
+    printf("Started %d regions (%dx%d) of %dx%d cells\n", region_count, cols, rows, region_w, region_h);
+    return 0;
+}
+
+// Call after workpool_stop(), once no drain task can run.
+void regions_stop() {
+    if (!regions) return;
+    for (int i = 0; i < region_count; i++) {
+        Region *r = &regions[i];
+        RegionMsg *m;
+        while ((m = inbox_pop(r)) != NULL) {
+            if (m->type == REGION_MSG_SURVIVOR) free(m->survivor);  // never queued
+            free(m);
+        }
+        if (r->survivors) {
+            for (Node *node = r->survivors->head; node != NULL; node = node->next) {
+                free(*(Survivor **)node->data);
+            }
+            r->survivors->destroy(r->survivors);
+        }
+        if (r->drones) r->drones->destroy(r->drones);
+    }
+    free(regions);
+    regions = NULL;
+    region_count = 0;
+}
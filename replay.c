@@ -0,0 +1,596 @@
+/**
+ * @file replay.c
+ * @brief Re-drives a recorded --trace against a server over loopback.
+ *
+ * Every connection in the trace is opened again, every chunk the drones
+ * sent is sent again on it at its recorded offset divided by --speed, and
+ * connections are closed where they were. --speed 0 drops the schedule and
+ * runs each connection closed-loop instead: its next chunk (or its close)
+ * goes out as soon as the reply to the one before has arrived, or once the
+ * time the trace left for that reply (up to REPLAY_REPLY_TIMEOUT_MS) has
+ * passed. The server's replies are read but not
+ * interpreted: a chunk that got a reply in the trace is timed until the
+ * first reply bytes arrive (or, as in the trace, until the drone's next
+ * chunk or close, after which it counts as unanswered), which gives the
+ * reply latency distribution
+ * next to the one recorded in the trace itself. The report has
+ * throughput, reply latency and how far sending fell behind schedule;
+ * with --baseline it also prints the change against an earlier report,
+ * e.g. of the previous server build.
+ * Everything after `--` is passed to the server started with --server.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <json-c/json.h>
+#include "headers/trace.h"
+
+#define REPLAY_MAX_CONNS (1 << 20)    // trace connection ids are descriptors
+#define REPLAY_BUFFER_SIZE 65536
+#define REPLAY_REPLY_TIMEOUT_MS 1000  // longest a connection waits for a reply at --speed 0
+
+typedef struct replay_event {
+    uint64_t ns;
+    uint32_t conn;
+    uint32_t kind;
+    uint32_t len;
+    int expects_reply;   // the server answered this chunk in the trace
+    uint64_t reply_ns;   // how long that answer took in the trace
+    char *data;          // NULL for OUT; replies are only counted
+} ReplayEvent;
+
+typedef struct replay_conn {
+    int fd;              // -1 when not open
+    uint64_t pending_ns; // send time of a chunk awaiting its reply, 0 if none
+    uint64_t wait_ns;    // --speed 0: how long that reply is waited for
+} ReplayConn;
+
+static struct {
+    const char *trace_path;
+    const char *server_path;
+    const char *out_path;
+    const char *baseline;
+    int port;
+    int metrics_port;
+    double speed;
+    int drain_ms;
+    char **server_args;
+    int server_argc;
+} opts = {
+    .out_path = "replay_report.json",
+    .port = 8080,
+    .metrics_port = 9100,
+    .speed = 1,
+    .drain_ms = 1000,
+};
+
+static ReplayEvent *events;
+static long event_count;
+static ReplayConn *conns;
+static uint32_t conn_limit;
+
+// Outcome
+static uint64_t *latencies;
+static long latency_count, latency_capacity;
+static uint64_t messages_sent, bytes_sent, messages_received, bytes_received, trace_out_messages;
+static uint64_t connect_failures, closed_by_server, unanswered;
+static uint64_t *recorded;          // reply latencies as recorded in the trace
+static long recorded_count;
+static uint64_t *lags;
+static long lag_count;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t count_lines(const char *data, size_t len) {
+    uint64_t lines = 0;
+    for (const char *p = data; (p = memchr(p, '\n', data + len - p)) != NULL; p++) lines++;
+    return lines;
+}
+
+static int load_trace(const char *path) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        perror("Failed to open trace");
+        return -1;
+    }
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, 8) != 0 ||
+        header.version != TRACE_VERSION) {
+        fprintf(stderr, "%s is not a version %d trace\n", path, TRACE_VERSION);
+        fclose(file);
+        return -1;
+    }
+    long capacity = 0;
+    TraceRecord r;
+    while (fread(&r, sizeof(r), 1, file) == 1) {
+        if (r.size != sizeof(r) + r.len || r.conn >= REPLAY_MAX_CONNS || r.kind > TRACE_OUT) {
+            fprintf(stderr, "%s: corrupt record after %ld events\n", path, event_count);
+            break;
+        }
+        if (event_count == capacity) {
+            capacity = capacity ? capacity * 2 : 4096;
+            ReplayEvent *grown = realloc(events, sizeof(ReplayEvent) * capacity);
+            if (!grown) {
+                perror("Failed to allocate events");
+                fclose(file);
+                return -1;
+            }
+            events = grown;
+        }
+        ReplayEvent *e = &events[event_count];
+        *e = (ReplayEvent){.ns = r.ns, .conn = r.conn, .kind = r.kind, .len = r.len};
+        if (r.kind == TRACE_IN) {
+            e->data = malloc(r.len ? r.len : 1);
+            if (!e->data || fread(e->data, 1, r.len, file) != r.len) {
+                free(e->data);
+                break;
+            }
+        } else if (r.len) {
+            char skip[4096];
+            for (uint32_t left = r.len; left > 0;) {
+                size_t chunk = left < sizeof(skip) ? left : sizeof(skip);
+                if (fread(skip, 1, chunk, file) != chunk) break;
+                if (r.kind == TRACE_OUT) trace_out_messages += count_lines(skip, chunk);
+                left -= chunk;
+            }
+        }
+        if (r.conn >= conn_limit) conn_limit = r.conn + 1;
+        event_count++;
+    }
+    fclose(file);
+
+    // A chunk expects a reply if the server sent something on that
+    // connection before the drone's next chunk
+    long *last_in = malloc(sizeof(long) * (conn_limit ? conn_limit : 1));
+    conns = malloc(sizeof(ReplayConn) * (conn_limit ? conn_limit : 1));
+    if (!last_in || !conns) {
+        perror("Failed to allocate connections");
+        free(last_in);
+        return -1;
+    }
+    for (uint32_t c = 0; c < conn_limit; c++) {
+        last_in[c] = -1;
+        conns[c] = (ReplayConn){.fd = -1};
+    }
+    recorded = malloc(sizeof(uint64_t) * (event_count ? event_count : 1));
+    lags = malloc(sizeof(uint64_t) * (event_count ? event_count : 1));
+    if (!recorded || !lags) {
+        free(last_in);
+        return -1;
+    }
+    for (long i = 0; i < event_count; i++) {
+        ReplayEvent *e = &events[i];
+        if (e->kind == TRACE_OUT && last_in[e->conn] >= 0) {
+            ReplayEvent *in = &events[last_in[e->conn]];
+            in->expects_reply = 1;
+            in->reply_ns = e->ns > in->ns ? e->ns - in->ns : 0;
+            recorded[recorded_count++] = in->reply_ns;
+        }
+        last_in[e->conn] = e->kind == TRACE_IN ? i : -1;
+    }
+    free(last_in);
+    printf("Loaded %ld events over %.1f s from %s\n", event_count,
+           event_count ? events[event_count - 1].ns / 1e9 : 0.0, path);
+    return 0;
+}
+
+static int connect_loopback(int port) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = {0};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static void send_all(int fd, const char *data, size_t len) {
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(fd, data + sent, len - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {.fd = fd, .events = POLLOUT};
+            if (poll(&pfd, 1, 100) <= 0) return;
+        } else {
+            return;
+        }
+    }
+}
+
+static void observe_latency(uint64_t ns) {
+    if (latency_count == latency_capacity) {
+        latency_capacity = latency_capacity ? latency_capacity * 2 : 4096;
+        uint64_t *grown = realloc(latencies, sizeof(uint64_t) * latency_capacity);
+        if (!grown) return;
+        latencies = grown;
+    }
+    latencies[latency_count++] = ns;
+}
+
+// Reads whatever the open connections have, waiting up to timeout_ms.
+static void pump(int timeout_ms) {
+    static struct pollfd *fds;
+    static uint32_t *ids;
+    static uint32_t capacity;
+    if (capacity < conn_limit) {
+        free(fds);
+        free(ids);
+        fds = malloc(sizeof(struct pollfd) * conn_limit);
+        ids = malloc(sizeof(uint32_t) * conn_limit);
+        capacity = fds && ids ? conn_limit : 0;
+        if (!capacity) return;
+    }
+    int nfds = 0;
+    for (uint32_t c = 0; c < conn_limit; c++) {
+        if (conns[c].fd < 0) continue;
+        fds[nfds] = (struct pollfd){.fd = conns[c].fd, .events = POLLIN};
+        ids[nfds++] = c;
+    }
+    if (nfds == 0) {
+        if (timeout_ms > 0) usleep(timeout_ms * 1000);
+        return;
+    }
+    if (poll(fds, nfds, timeout_ms) <= 0) return;
+    char buffer[REPLAY_BUFFER_SIZE];
+    for (int i = 0; i < nfds; i++) {
+        if (!(fds[i].revents & (POLLIN | POLLHUP | POLLERR))) continue;
+        ReplayConn *c = &conns[ids[i]];
+        for (;;) {
+            ssize_t n = recv(c->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+            if (n > 0) {
+                if (c->pending_ns) {
+                    observe_latency(now_ns() - c->pending_ns);
+                    c->pending_ns = 0;
+                }
+                bytes_received += n;
+                messages_received += count_lines(buffer, n);
+                continue;
+            }
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                close(c->fd);
+                c->fd = -1;
+                c->pending_ns = 0;
+                closed_by_server++;
+            }
+            break;
+        }
+    }
+}
+
+static void replay_event(ReplayEvent *e) {
+    ReplayConn *c = &conns[e->conn];
+    switch (e->kind) {
+        case TRACE_OPEN:
+            if (c->fd >= 0) close(c->fd);
+            c->fd = connect_loopback(opts.port);
+            c->pending_ns = 0;
+            if (c->fd < 0) connect_failures++;
+            else fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL) | O_NONBLOCK);
+            break;
+        case TRACE_IN:
+            if (c->fd < 0) break;
+            // As in the trace, a reply only counts before the drone's next chunk
+            if (c->pending_ns) unanswered++;
+            c->pending_ns = e->expects_reply ? now_ns() : 0;
+            send_all(c->fd, e->data, e->len);
+            bytes_sent += e->len;
+            messages_sent += count_lines(e->data, e->len);
+            break;
+        case TRACE_CLOSE:
+            if (c->pending_ns) unanswered++;
+            if (c->fd >= 0) close(c->fd);
+            c->fd = -1;
+            c->pending_ns = 0;
+            break;
+    }
+}
+
+// Replays the trace at --speed 0: connections advance independently, each
+// holding its next event until the previous chunk's reply arrives or the
+// gap to that event in the trace, within which the reply counted there,
+// has passed.
+static int replay_closed_loop() {
+    long *next = malloc(sizeof(long) * (event_count ? event_count : 1));  // next event on the same connection
+    long *cursor = malloc(sizeof(long) * (conn_limit ? conn_limit : 1));
+    uint32_t *active = malloc(sizeof(uint32_t) * (conn_limit ? conn_limit : 1));
+    if (!next || !cursor || !active) {
+        perror("Failed to allocate replay state");
+        free(next);
+        free(cursor);
+        free(active);
+        return -1;
+    }
+    for (uint32_t c = 0; c < conn_limit; c++) cursor[c] = -1;
+    for (long i = event_count - 1; i >= 0; i--) {
+        if (events[i].kind == TRACE_OUT) continue;
+        next[i] = cursor[events[i].conn];
+        cursor[events[i].conn] = i;
+    }
+    uint32_t nactive = 0;
+    for (uint32_t c = 0; c < conn_limit; c++) {
+        if (cursor[c] >= 0) active[nactive++] = c;
+    }
+
+    uint64_t timeout_ns = REPLAY_REPLY_TIMEOUT_MS * 1000000ULL;
+    while (nactive > 0) {
+        uint64_t now = now_ns();
+        for (uint32_t a = 0; a < nactive;) {
+            uint32_t id = active[a];
+            ReplayConn *c = &conns[id];
+            if (c->pending_ns && now - c->pending_ns < c->wait_ns) {
+                a++;
+                continue;
+            }
+            // Up to and including the next chunk that waits for a reply
+            long i = cursor[id];
+            while (i >= 0) {
+                ReplayEvent *e = &events[i];
+                replay_event(e);
+                i = next[i];
+                if (c->pending_ns) {
+                    uint64_t gap = i >= 0 && events[i].ns > e->ns ? events[i].ns - e->ns : timeout_ns;
+                    c->wait_ns = gap < timeout_ns ? gap : timeout_ns;
+                    break;
+                }
+            }
+            cursor[id] = i;
+            if (i < 0) active[a] = active[--nactive];
+            else a++;
+        }
+        if (nactive > 0) pump(1);
+    }
+    free(next);
+    free(cursor);
+    free(active);
+    return 0;
+}
+
+static int compare_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double quantile_ms(uint64_t *values, long count, double q) {
+    if (count == 0) return 0;
+    long index = (long)(q * (count - 1) + 0.5);
+    return values[index] / 1e6;
+}
+
+static pid_t start_server() {
+    char port[16], metrics_port[16], max_drones[16];
+    snprintf(port, sizeof(port), "%d", opts.port);
+    snprintf(metrics_port, sizeof(metrics_port), "%d", opts.metrics_port);
+    snprintf(max_drones, sizeof(max_drones), "%u", conn_limit + 16);
+    pid_t pid = fork();
+    if (pid == 0) {
+        int devnull = open("/dev/null", O_WRONLY);
+        if (devnull >= 0) {
+            dup2(devnull, STDOUT_FILENO);
+            dup2(devnull, STDERR_FILENO);
+        }
+        char **argv = calloc(opts.server_argc + 10, sizeof(char *));
+        if (!argv) _exit(127);
+        int argc = 0;
+        argv[argc++] = (char *)opts.server_path;
+        argv[argc++] = "--headless";
+        argv[argc++] = "--port";
+        argv[argc++] = port;
+        argv[argc++] = "--metrics-port";
+        argv[argc++] = metrics_port;
+        argv[argc++] = "--max-drones";
+        argv[argc++] = max_drones;
+        for (int i = 0; i < opts.server_argc; i++) argv[argc++] = opts.server_args[i];
+        execv(opts.server_path, argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop_server(pid_t pid) {
+    if (kill(pid, SIGTERM) != 0) return;  // already exited and reaped
+    for (int i = 0; i < 100; i++) {
+        if (waitpid(pid, NULL, WNOHANG) == pid) return;
+        usleep(100000);
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+static double baseline_number(struct json_object *root, const char *key, const char *sub) {
+    struct json_object *value;
+    if (!root || !json_object_object_get_ex(root, key, &value)) return -1;
+    if (sub && !json_object_object_get_ex(value, sub, &value)) return -1;
+    return json_object_get_double(value);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s --trace file [--port n] [--speed x] [--drain-ms n] [--out file] [--baseline report]\n"
+            "          [--server path [--metrics-port n] [-- server options...]]\n"
+            "  --speed x   replay x times faster than recorded, 0 for as fast as each connection's\n"
+            "              replies allow (default 1)\n",
+            prog);
+}
+
+static int parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--") == 0) {
+            opts.server_args = argv + i + 1;
+            opts.server_argc = argc - i - 1;
+            break;
+        }
+        const char *value = (i + 1 < argc) ? argv[++i] : NULL;
+        if (!value) return -1;
+        if (strcmp(arg, "--trace") == 0) opts.trace_path = value;
+        else if (strcmp(arg, "--server") == 0) opts.server_path = value;
+        else if (strcmp(arg, "--out") == 0) opts.out_path = value;
+        else if (strcmp(arg, "--baseline") == 0) opts.baseline = value;
+        else if (strcmp(arg, "--port") == 0) opts.port = atoi(value);
+        else if (strcmp(arg, "--metrics-port") == 0) opts.metrics_port = atoi(value);
+        else if (strcmp(arg, "--speed") == 0) opts.speed = atof(value);
+        else if (strcmp(arg, "--drain-ms") == 0) opts.drain_ms = atoi(value);
+        else return -1;
+    }
+    if (!opts.trace_path || opts.speed < 0 || opts.port <= 0 || opts.drain_ms < 0) return -1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (parse_args(argc, argv) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    if (load_trace(opts.trace_path) != 0) return 1;
+
+    pid_t server = -1;
+    if (opts.server_path) {
+        server = start_server();
+        if (server < 0) {
+            perror("fork");
+            return 1;
+        }
+        // Wait on the metrics port so the drone port only sees replayed connections
+        int probe = -1;
+        for (int i = 0; i < 50 && probe < 0; i++) {
+            usleep(100000);
+            probe = connect_loopback(opts.metrics_port);
+        }
+        if (probe < 0) {
+            fprintf(stderr, "server did not come up on metrics port %d\n", opts.metrics_port);
+            stop_server(server);
+            return 1;
+        }
+        close(probe);
+    }
+
+    uint64_t started = now_ns();
+    if (opts.speed == 0 && replay_closed_loop() != 0) {
+        if (server > 0) stop_server(server);
+        return 1;
+    }
+    for (long i = 0; opts.speed > 0 && i < event_count; i++) {
+        ReplayEvent *e = &events[i];
+        if (e->kind == TRACE_OUT) continue;
+        uint64_t due = started + (uint64_t)(e->ns / opts.speed);
+        for (uint64_t now; (now = now_ns()) < due;) pump((int)((due - now + 999999) / 1000000));
+        uint64_t now = now_ns();
+        lags[lag_count++] = now > due ? now - due : 0;
+        replay_event(e);
+    }
+    uint64_t sending_done = now_ns();
+    for (uint64_t now; (now = now_ns()) < sending_done + (uint64_t)opts.drain_ms * 1000000ULL;) pump(10);
+    double seconds = (sending_done - started) / 1e9;
+    for (uint32_t c = 0; c < conn_limit; c++) {
+        if (conns[c].fd >= 0) close(conns[c].fd);
+    }
+    if (server > 0) stop_server(server);
+
+    qsort(latencies, latency_count, sizeof(uint64_t), compare_u64);
+    qsort(lags, lag_count, sizeof(uint64_t), compare_u64);
+    qsort(recorded, recorded_count, sizeof(uint64_t), compare_u64);
+    double span = event_count ? events[event_count - 1].ns / 1e9 : 0;
+    double rate = seconds > 0 ? messages_sent / seconds : 0;
+    double p50 = quantile_ms(latencies, latency_count, 0.5), p90 = quantile_ms(latencies, latency_count, 0.9);
+    double p99 = quantile_ms(latencies, latency_count, 0.99), max = quantile_ms(latencies, latency_count, 1.0);
+    double lag_p99 = quantile_ms(lags, lag_count, 0.99);
+    double recorded_p50 = quantile_ms(recorded, recorded_count, 0.5);
+    double recorded_p99 = quantile_ms(recorded, recorded_count, 0.99);
+    printf("replayed %.1f s of trace in %.1f s: %llu messages sent (%.1f/s), %llu received (trace had %llu)\n",
+           span, seconds, (unsigned long long)messages_sent, rate, (unsigned long long)messages_received,
+           (unsigned long long)trace_out_messages);
+    printf("reply latency over %ld replies: p50 %.3f ms, p90 %.3f ms, p99 %.3f ms, max %.3f ms\n", latency_count,
+           p50, p90, p99, max);
+    printf("as recorded over %ld replies: p50 %.3f ms, p99 %.3f ms; unanswered this time: %llu\n", recorded_count,
+           recorded_p50, recorded_p99, (unsigned long long)unanswered);
+    printf("schedule lag p99 %.3f ms, connect failures %llu, closed by server %llu\n", lag_p99,
+           (unsigned long long)connect_failures, (unsigned long long)closed_by_server);
+
+    struct json_object *baseline = opts.baseline ? json_object_from_file(opts.baseline) : NULL;
+    if (opts.baseline && !baseline) fprintf(stderr, "Could not read baseline %s\n", opts.baseline);
+    struct {
+        const char *name, *key, *sub;
+        double value;
+    } compared[] = {
+        {"messages/s", "messages_per_sec", NULL, rate},
+        {"messages received", "messages_received", NULL, (double)messages_received},
+        {"reply p50 ms", "reply_latency_ms", "p50", p50},
+        {"reply p99 ms", "reply_latency_ms", "p99", p99},
+        {"schedule lag p99 ms", "schedule_lag_p99_ms", NULL, lag_p99},
+    };
+    int ncompared = sizeof(compared) / sizeof(compared[0]);
+    if (baseline) {
+        printf("\n%-22s %12s %12s %9s\n", "against baseline", "baseline", "this run", "change");
+        for (int i = 0; i < ncompared; i++) {
+            double old = baseline_number(baseline, compared[i].key, compared[i].sub);
+            if (old < 0) continue;
+            printf("%-22s %12.3f %12.3f %+8.1f%%\n", compared[i].name, old, compared[i].value,
+                   old > 0 ? (compared[i].value - old) / old * 100 : 0.0);
+        }
+    }
+
+    FILE *out = fopen(opts.out_path, "w");
+    if (out) {
+        fprintf(out, "{\n  \"trace\": \"%s\",\n  \"speed\": %g,\n", opts.trace_path, opts.speed);
+        fprintf(out, "  \"trace_seconds\": %.3f,\n  \"replay_seconds\": %.3f,\n", span, seconds);
+        fprintf(out, "  \"messages_sent\": %llu,\n  \"bytes_sent\": %llu,\n  \"messages_per_sec\": %.1f,\n",
+                (unsigned long long)messages_sent, (unsigned long long)bytes_sent, rate);
+        fprintf(out, "  \"messages_received\": %llu,\n  \"trace_messages_out\": %llu,\n",
+                (unsigned long long)messages_received, (unsigned long long)trace_out_messages);
+        fprintf(out, "  \"reply_latency_ms\": {\"count\": %ld, \"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f, "
+                     "\"max\": %.3f},\n", latency_count, p50, p90, p99, max);
+        fprintf(out, "  \"recorded_reply_latency_ms\": {\"count\": %ld, \"p50\": %.3f, \"p99\": %.3f},\n",
+                recorded_count, recorded_p50, recorded_p99);
+        fprintf(out, "  \"unanswered\": %llu,\n", (unsigned long long)unanswered);
+        fprintf(out, "  \"schedule_lag_p99_ms\": %.3f,\n", lag_p99);
+        fprintf(out, "  \"connect_failures\": %llu,\n  \"closed_by_server\": %llu", (unsigned long long)connect_failures,
+                (unsigned long long)closed_by_server);
+        if (baseline) {
+            fprintf(out, ",\n  \"baseline\": \"%s\",\n  \"change_percent\": {", opts.baseline);
+            const char *sep = "";
+            for (int i = 0; i < ncompared; i++) {
+                double old = baseline_number(baseline, compared[i].key, compared[i].sub);
+                if (old <= 0) continue;
+                fprintf(out, "%s\"%s\": %.2f", sep, compared[i].name, (compared[i].value - old) / old * 100);
+                sep = ", ";
+            }
+            fprintf(out, "}");
+        }
+        fprintf(out, "\n}\n");
+        fclose(out);
+        printf("report written to %s\n", opts.out_path);
+    } else {
+        perror("fopen report");
+    }
+    if (baseline) json_object_put(baseline);
+    return 0;
+}
@@ -0,0 +1,573 @@
+/**
+ * @file replica.c
+ * @brief Read-only replica of a server's drones and waiting survivors.
+ *
+ * Connects to a server started with --replicate, applies its snapshot and
+ * change stream to an in-memory copy of the world, and serves that copy
+ * over HTTP so viewers, dashboards and analytics never touch the primary's
+ * locks:
+ *
+ *     GET /world                      every drone and waiting survivor, as JSON
+ *     GET /survivors?x0=&y0=&x1=&y1=  waiting survivors in [x0,x1) x [y0,y1)
+ *     GET /metrics                    replication lag and world size
+ *
+ * One thread applies the stream under the write side of a rwlock, the HTTP
+ * threads render under the read side and send after releasing it. Lag is
+ * the primary's wall clock when it logged a change against this process's
+ * when it applied it (both processes on one host, or synchronised clocks),
+ * kept over the last REPLICA_LAG_WINDOW changes. Heartbeats every 100 ms
+ * carry the primary's log position, so idle streams are measured too; a
+ * replica that has not heard from the primary for REPLICA_STALE_MS reports
+ * itself stale. When the connection drops the last state stays served,
+ * marked stale, until a reconnect brings a fresh snapshot.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <json-c/json.h>
+#include "headers/replication.h"
+
+#define REPLICA_BUCKETS 65536             // hash buckets per table, power of two
+#define REPLICA_LAG_WINDOW 4096           // recent changes lag percentiles are taken over
+#define REPLICA_STALE_MS 1000
+#define REPLICA_RETRY_MS 1000
+#define REPLICA_REPORT_MS 5000
+#define REPLICA_READ_RECORDS 1024         // records applied per lock hold
+#define REPLICA_MAX_HTTP_THREADS 16
+
+typedef struct world_entry {
+    uint64_t key;
+    union {
+        ReplDrone drone;
+        ReplSurvivor survivor;
+    };
+    struct world_entry *next;
+} WorldEntry;
+
+typedef struct world_table {
+    WorldEntry *buckets[REPLICA_BUCKETS];
+    long count;
+} WorldTable;
+
+static struct {
+    const char *primary;
+    int port;
+    int http_port;
+    int http_threads;
+} opts = {"127.0.0.1", REPL_DEFAULT_PORT, 9200, 2};
+
+// Everything below is written by the apply thread under world_lock
+static pthread_rwlock_t world_lock = PTHREAD_RWLOCK_INITIALIZER;
+static WorldTable drones_table, survivors_table;
+static int connected = 0;
+static int synced = 0;                 // a snapshot has been applied since connecting
+static uint64_t applied_seq = 0;       // log position of the last change applied
+static uint64_t primary_seq = 0;       // next log position, from the last heartbeat
+static int64_t heard_unix_ns = 0;      // when the last record arrived
+static uint64_t applied = 0, resyncs = 0;
+static int64_t lag_ns[REPLICA_LAG_WINDOW];
+static uint64_t lag_count = 0;
+static int64_t lag_max_ns = 0;
+static uint64_t requests = 0;          // atomic
+
+static volatile sig_atomic_t stop_flag = 0;
+
+static const char *payload_names[] = {"general", "medical", "food", "water"};
+static const char *drone_status_names[] = {"idle", "on_mission", "disconnected"};
+static const char *survivor_state_names[] = {"open", "assigned", "rescued"};
+
+static int64_t unix_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static const char *name_of(const char **names, int count, int value) {
+    return value >= 0 && value < count ? names[value] : "unknown";
+}
+
+/* ---- world ---- */
+
+static WorldEntry *table_find(WorldTable *t, uint64_t key, int create) {
+    WorldEntry **slot = &t->buckets[(key * 0x9e3779b97f4a7c15ULL) >> 48 & (REPLICA_BUCKETS - 1)];
+    for (WorldEntry *e = *slot; e != NULL; e = e->next) {
+        if (e->key == key) return e;
+    }
+    if (!create) return NULL;
+    WorldEntry *e = calloc(1, sizeof(WorldEntry));
+    if (!e) return NULL;
+    e->key = key;
+    e->next = *slot;
+    *slot = e;
+    t->count++;
+    return e;
+}
+
+static void table_remove(WorldTable *t, uint64_t key) {
+    WorldEntry **slot = &t->buckets[(key * 0x9e3779b97f4a7c15ULL) >> 48 & (REPLICA_BUCKETS - 1)];
+    for (; *slot != NULL; slot = &(*slot)->next) {
+        if ((*slot)->key == key) {
+            WorldEntry *e = *slot;
+            *slot = e->next;
+            free(e);
+            t->count--;
+            return;
+        }
+    }
+}
+
+static void table_clear(WorldTable *t) {
+    for (int b = 0; b < REPLICA_BUCKETS; b++) {
+        while (t->buckets[b]) {
+            WorldEntry *e = t->buckets[b];
+            t->buckets[b] = e->next;
+            free(e);
+        }
+    }
+    t->count = 0;
+}
+
+// Call with world_lock held for writing.
+static void apply(const ReplRecord *r, int64_t now) {
+    WorldEntry *e;
+    heard_unix_ns = now;
+    switch (r->kind) {
+        case REPL_DRONE:
+            if ((e = table_find(&drones_table, (uint32_t)r->drone.id, 1)) != NULL) e->drone = r->drone;
+            break;
+        case REPL_SURVIVOR:
+            // A rescued survivor is removed by the record that follows
+            if ((e = table_find(&survivors_table, r->survivor.id, 1)) != NULL) e->survivor = r->survivor;
+            break;
+        case REPL_SURVIVOR_REMOVED:
+            table_remove(&survivors_table, r->survivor.id);
+            break;
+        case REPL_HEARTBEAT:
+            primary_seq = r->seq;
+            break;
+        case REPL_SNAPSHOT_BEGIN:
+            table_clear(&drones_table);
+            table_clear(&survivors_table);
+            synced = 0;
+            break;
+        case REPL_SNAPSHOT_END:
+            synced = 1;
+            resyncs++;
+            applied_seq = r->seq ? r->seq - 1 : 0;
+            printf("Synced at log position %llu: %ld drones, %ld survivors\n", (unsigned long long)r->seq,
+                   drones_table.count, survivors_table.count);
+            break;
+    }
+    if (r->kind == REPL_DRONE || r->kind == REPL_SURVIVOR || r->kind == REPL_SURVIVOR_REMOVED) {
+        applied++;
+        if (synced) {
+            // Snapshot records are stamped when the snapshot was taken; only changes count
+            int64_t lag = now - r->unix_ns;
+            lag_ns[lag_count++ % REPLICA_LAG_WINDOW] = lag;
+            if (lag > lag_max_ns) lag_max_ns = lag;
+            if (r->seq > applied_seq) applied_seq = r->seq;
+        }
+    }
+}
+
+static int compare_i64(const void *a, const void *b) {
+    int64_t x = *(const int64_t *)a, y = *(const int64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Lag percentiles over the window, in ms. Call with world_lock held.
+static void lag_percentiles(double *p50, double *p99) {
+    uint64_t n = lag_count < REPLICA_LAG_WINDOW ? lag_count : REPLICA_LAG_WINDOW;
+    *p50 = *p99 = 0;
+    if (n == 0) return;
+    int64_t sorted[REPLICA_LAG_WINDOW];
+    memcpy(sorted, lag_ns, n * sizeof(int64_t));
+    qsort(sorted, n, sizeof(int64_t), compare_i64);
+    *p50 = sorted[(n - 1) / 2] / 1e6;
+    *p99 = sorted[(n - 1) * 99 / 100] / 1e6;
+}
+
+// Milliseconds since the primary was last heard from. Call with world_lock held.
+static double silence_ms() {
+    return heard_unix_ns ? (unix_now_ns() - heard_unix_ns) / 1e6 : -1;
+}
+
+// Changes the primary had logged at its last heartbeat that are not applied yet.
+static uint64_t records_behind() {
+    return primary_seq > applied_seq + 1 ? primary_seq - applied_seq - 1 : 0;
+}
+
+static int stale() {
+    double silence = silence_ms();
+    return !connected || !synced || silence < 0 || silence > REPLICA_STALE_MS;
+}
+
+/* ---- apply thread ---- */
+
+static int connect_primary() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_port = htons(opts.port)};
+    if (inet_pton(AF_INET, opts.primary, &addr.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct timeval tv = {.tv_sec = 0, .tv_usec = 500000};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return fd;
+}
+
+static int read_full(int fd, void *buf, size_t len) {
+    size_t got = 0;
+    while (got < len && !stop_flag) {
+        ssize_t n = recv(fd, (char *)buf + got, len - got, 0);
+        if (n > 0) got += n;
+        else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) continue;
+        else return -1;
+    }
+    return got == len ? 0 : -1;
+}
+
+static void report() {
+    double p50, p99;
+    pthread_rwlock_rdlock(&world_lock);
+    lag_percentiles(&p50, &p99);
+    printf("Replica: log position %llu, %llu behind, %ld drones, %ld survivors, lag p50 %.2f ms p99 %.2f ms%s\n",
+           (unsigned long long)applied_seq, (unsigned long long)records_behind(), drones_table.count,
+           survivors_table.count, p50, p99, stale() ? " (stale)" : "");
+    pthread_rwlock_unlock(&world_lock);
+}
+
+// Follows the primary until stop_flag, reconnecting when it goes away.
+static void follow_primary() {
+    static ReplRecord batch[REPLICA_READ_RECORDS];
+    int64_t next_report = 0;
+    while (!stop_flag) {
+        int fd = connect_primary();
+        ReplHeader header;
+        if (fd >= 0 && read_full(fd, &header, sizeof(header)) != 0) {
+            close(fd);
+            fd = -1;
+        } else if (fd >= 0 && (memcmp(header.magic, REPL_MAGIC, sizeof(header.magic)) != 0 ||
+                               header.version != REPL_VERSION || header.record_size != sizeof(ReplRecord))) {
+            fprintf(stderr, "%s:%d is not a compatible replication stream\n", opts.primary, opts.port);
+            close(fd);
+            fd = -1;
+        }
+        if (fd < 0) {
+            usleep(REPLICA_RETRY_MS * 1000);
+            continue;
+        }
+        printf("Following %s:%d\n", opts.primary, opts.port);
+        pthread_rwlock_wrlock(&world_lock);
+        connected = 1;
+        pthread_rwlock_unlock(&world_lock);
+
+        size_t have = 0;
+        while (!stop_flag) {
+            ssize_t n = recv(fd, (char *)batch + have, sizeof(batch) - have, 0);
+            if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) break;
+            if (n > 0) have += n;
+            size_t records = have / sizeof(ReplRecord);
+            if (records > 0) {
+                int64_t now = unix_now_ns();
+                pthread_rwlock_wrlock(&world_lock);
+                for (size_t i = 0; i < records; i++) apply(&batch[i], now);
+                pthread_rwlock_unlock(&world_lock);
+                have -= records * sizeof(ReplRecord);
+                memmove(batch, (char *)batch + records * sizeof(ReplRecord), have);
+            }
+            int64_t now = unix_now_ns();
+            if (now >= next_report) {
+                if (next_report) report();
+                next_report = now + REPLICA_REPORT_MS * 1000000LL;
+            }
+        }
+        close(fd);
+        pthread_rwlock_wrlock(&world_lock);
+        connected = 0;
+        pthread_rwlock_unlock(&world_lock);
+        if (!stop_flag) printf("Lost %s:%d, serving the last state until it is back\n", opts.primary, opts.port);
+    }
+}
+
+/* ---- HTTP ---- */
+
+static struct json_object *drone_json(const ReplDrone *d) {
+    struct json_object *obj = json_object_new_object();
+    json_object_object_add(obj, "id", json_object_new_int(d->id));
+    json_object_object_add(obj, "x", json_object_new_int(d->x));
+    json_object_object_add(obj, "y", json_object_new_int(d->y));
+    json_object_object_add(obj, "status", json_object_new_string(name_of(drone_status_names, 3, d->status)));
+    json_object_object_add(obj, "payload", json_object_new_string(name_of(payload_names, 4, d->payload)));
+    json_object_object_add(obj, "battery", json_object_new_int(d->battery));
+    if (d->status == ON_MISSION) {
+        struct json_object *target = json_object_new_object();
+        json_object_object_add(target, "x", json_object_new_int(d->target_x));
+        json_object_object_add(target, "y", json_object_new_int(d->target_y));
+        json_object_object_add(obj, "target", target);
+        json_object_object_add(obj, "stops", json_object_new_int(d->stops));
+        json_object_object_add(obj, "repositioning", json_object_new_boolean(d->repositioning));
+    }
+    return obj;
+}
+
+static struct json_object *survivor_json(const ReplSurvivor *s) {
+    struct json_object *obj = json_object_new_object();
+    json_object_object_add(obj, "id", json_object_new_int64((int64_t)s->id));
+    json_object_object_add(obj, "info", json_object_new_string(s->info));
+    json_object_object_add(obj, "x", json_object_new_int(s->x));
+    json_object_object_add(obj, "y", json_object_new_int(s->y));
+    json_object_object_add(obj, "need", json_object_new_string(name_of(payload_names, 4, s->need)));
+    json_object_object_add(obj, "state", json_object_new_string(name_of(survivor_state_names, 3, s->state)));
+    if (s->drone >= 0) json_object_object_add(obj, "drone", json_object_new_int(s->drone));
+    return obj;
+}
+
+// Call with world_lock held.
+static void add_status(struct json_object *obj) {
+    json_object_object_add(obj, "seq", json_object_new_int64((int64_t)applied_seq));
+    json_object_object_add(obj, "records_behind", json_object_new_int64((int64_t)records_behind()));
+    json_object_object_add(obj, "silence_ms", json_object_new_double(silence_ms()));
+    json_object_object_add(obj, "stale", json_object_new_boolean(stale()));
+}
+
+static char *render_world(size_t *len) {
+    struct json_object *obj = json_object_new_object();
+    struct json_object *drones = json_object_new_array();
+    struct json_object *survivors = json_object_new_array();
+    pthread_rwlock_rdlock(&world_lock);
+    add_status(obj);
+    for (int b = 0; b < REPLICA_BUCKETS; b++) {
+        for (WorldEntry *e = drones_table.buckets[b]; e != NULL; e = e->next) {
+            json_object_array_add(drones, drone_json(&e->drone));
+        }
+        for (WorldEntry *e = survivors_table.buckets[b]; e != NULL; e = e->next) {
+            json_object_array_add(survivors, survivor_json(&e->survivor));
+        }
+    }
+    pthread_rwlock_unlock(&world_lock);
+    json_object_object_add(obj, "drones", drones);
+    json_object_object_add(obj, "survivors", survivors);
+    char *body = strdup(json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN));
+    json_object_put(obj);
+    *len = body ? strlen(body) : 0;
+    return body;
+}
+
+static int query_int(const char *query, const char *key, int fallback) {
+    char pattern[16];
+    snprintf(pattern, sizeof(pattern), "%s=", key);
+    for (const char *p = query; p && (p = strstr(p, pattern)) != NULL; p++) {
+        if (p == query || p[-1] == '?' || p[-1] == '&') return atoi(p + strlen(pattern));
+    }
+    return fallback;
+}
+
+static char *render_survivors(const char *query, size_t *len) {
+    int x0 = query_int(query, "x0", 0), y0 = query_int(query, "y0", 0);
+    int x1 = query_int(query, "x1", INT32_MAX), y1 = query_int(query, "y1", INT32_MAX);
+    struct json_object *obj = json_object_new_object();
+    struct json_object *survivors = json_object_new_array();
+    pthread_rwlock_rdlock(&world_lock);
+    add_status(obj);
+    for (int b = 0; b < REPLICA_BUCKETS; b++) {
+        for (WorldEntry *e = survivors_table.buckets[b]; e != NULL; e = e->next) {
+            const ReplSurvivor *s = &e->survivor;
+            if (s->x >= x0 && s->x < x1 && s->y >= y0 && s->y < y1) {
+                json_object_array_add(survivors, survivor_json(s));
+            }
+        }
+    }
+    pthread_rwlock_unlock(&world_lock);
+    json_object_object_add(obj, "survivors", survivors);
+    char *body = strdup(json_object_to_json_string_ext(obj, JSON_C_TO_STRING_PLAIN));
+    json_object_put(obj);
+    *len = body ? strlen(body) : 0;
+    return body;
+}
+
+static char *render_metrics(size_t *len) {
+    double p50, p99;
+    size_t cap = 4096;
+    char *body = malloc(cap);
+    if (!body) return NULL;
+    pthread_rwlock_rdlock(&world_lock);
+    lag_percentiles(&p50, &p99);
+    int n = snprintf(body, cap,
+                     "# HELP edcs_replica_lag_seconds Primary change to replica apply, over the last %d changes.\n"
+                     "# TYPE edcs_replica_lag_seconds summary\n"
+                     "edcs_replica_lag_seconds{quantile=\"0.5\"} %.6f\n"
+                     "edcs_replica_lag_seconds{quantile=\"0.99\"} %.6f\n"
+                     "# HELP edcs_replica_lag_max_seconds Largest lag since start.\n"
+                     "# TYPE edcs_replica_lag_max_seconds gauge\n"
+                     "edcs_replica_lag_max_seconds %.6f\n"
+                     "# HELP edcs_replica_silence_seconds Time since the last record from the primary.\n"
+                     "# TYPE edcs_replica_silence_seconds gauge\n"
+                     "edcs_replica_silence_seconds %.6f\n"
+                     "# HELP edcs_replica_records_behind Changes the primary has logged that are not applied.\n"
+                     "# TYPE edcs_replica_records_behind gauge\n"
+                     "edcs_replica_records_behind %llu\n"
+                     "# HELP edcs_replica_stale 1 if disconnected, not synced, or silent too long.\n"
+                     "# TYPE edcs_replica_stale gauge\n"
+                     "edcs_replica_stale %d\n"
+                     "# HELP edcs_replica_applied Drone and survivor records applied since start, snapshots included.\n"
+                     "# TYPE edcs_replica_applied counter\n"
+                     "edcs_replica_applied %llu\n"
+                     "# HELP edcs_replica_syncs Snapshots applied since start.\n"
+                     "# TYPE edcs_replica_syncs counter\n"
+                     "edcs_replica_syncs %llu\n"
+                     "# HELP edcs_replica_drones Drones in the replicated world.\n"
+                     "# TYPE edcs_replica_drones gauge\n"
+                     "edcs_replica_drones %ld\n"
+                     "# HELP edcs_replica_survivors Waiting survivors in the replicated world.\n"
+                     "# TYPE edcs_replica_survivors gauge\n"
+                     "edcs_replica_survivors %ld\n"
+                     "# HELP edcs_replica_requests HTTP requests served since start.\n"
+                     "# TYPE edcs_replica_requests counter\n"
+                     "edcs_replica_requests %llu\n",
+                     REPLICA_LAG_WINDOW, p50 / 1e3, p99 / 1e3, lag_max_ns / 1e9,
+                     silence_ms() > 0 ? silence_ms() / 1e3 : 0,
+                     (unsigned long long)records_behind(), stale(),
+                     (unsigned long long)applied, (unsigned long long)resyncs, drones_table.count,
+                     survivors_table.count, (unsigned long long)__atomic_load_n(&requests, __ATOMIC_RELAXED));
+    pthread_rwlock_unlock(&world_lock);
+    *len = n < (int)cap ? (size_t)n : cap - 1;
+    return body;
+}
+
+static void write_all(int fd, const char *data, size_t len) {
+    while (len > 0) {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return;
+        data += n;
+        len -= n;
+    }
+}
+
+static void serve_request(int sock) {
+    char request[1024];
+    struct timeval tv = {.tv_sec = 1, .tv_usec = 0};
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&tv, sizeof tv);
+    ssize_t n = recv(sock, request, sizeof(request) - 1, 0);
+    if (n <= 0) return;
+    request[n] = '\0';
+    __atomic_add_fetch(&requests, 1, __ATOMIC_RELAXED);
+
+    size_t body_len = 0;
+    char *body;
+    const char *type = "application/json";
+    if (strncmp(request, "GET /world", 10) == 0) {
+        body = render_world(&body_len);
+    } else if (strncmp(request, "GET /survivors", 14) == 0) {
+        char *end = strchr(request + 4, ' ');
+        if (end) *end = '\0';
+        body = render_survivors(strchr(request, '?'), &body_len);
+    } else if (strncmp(request, "GET /metrics", 12) == 0) {
+        body = render_metrics(&body_len);
+        type = "text/plain; version=0.0.4";
+    } else {
+        const char *not_found = "HTTP/1.0 404 Not Found\r\nContent-Length: 0\r\n\r\n";
+        write_all(sock, not_found, strlen(not_found));
+        return;
+    }
+    char header[128];
+    int header_len = snprintf(header, sizeof(header), "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                              type, body_len);
+    write_all(sock, header, header_len);
+    if (body) write_all(sock, body, body_len);
+    free(body);
+}
+
+static void *http_thread(void *arg) {
+    int listen_fd = *(int *)arg;
+    while (!stop_flag) {
+        struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+        if (poll(&pfd, 1, 1000) <= 0) continue;
+        int sock = accept(listen_fd, NULL, NULL);
+        if (sock < 0) continue;  // another thread took it
+        serve_request(sock);
+        close(sock);
+    }
+    return NULL;
+}
+
+static void handle_signal(int sig) {
+    (void)sig;
+    stop_flag = 1;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--primary ip] [--port n] [--http-port n] [--http-threads n]\n"
+            "  --primary ip      server started with --replicate (default 127.0.0.1)\n"
+            "  --port n          its --replicate port (default %d)\n"
+            "  --http-port n     serve /world, /survivors and /metrics here (default 9200)\n"
+            "  --http-threads n  threads serving HTTP (default 2, max %d)\n",
+            prog, REPL_DEFAULT_PORT, REPLICA_MAX_HTTP_THREADS);
+}
+
+int main(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = i + 1 < argc ? argv[++i] : NULL;
+        if (value && strcmp(arg, "--primary") == 0) opts.primary = value;
+        else if (value && strcmp(arg, "--port") == 0) opts.port = atoi(value);
+        else if (value && strcmp(arg, "--http-port") == 0) opts.http_port = atoi(value);
+        else if (value && strcmp(arg, "--http-threads") == 0) opts.http_threads = atoi(value);
+        else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (opts.port <= 0 || opts.http_port <= 0 || opts.http_threads < 1 ||
+        opts.http_threads > REPLICA_MAX_HTTP_THREADS) {
+        usage(argv[0]);
+        return 1;
+    }
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_ANY),
+                               .sin_port = htons(opts.http_port)};
+    if (listen_fd < 0 || setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 64) != 0) {
+        perror("Failed to listen for HTTP");
+        return 1;
+    }
+    pthread_t threads[REPLICA_MAX_HTTP_THREADS];
+    for (int i = 0; i < opts.http_threads; i++) {
+        if (pthread_create(&threads[i], NULL, http_thread, &listen_fd) != 0) {
+            perror("Failed to start HTTP thread");
+            return 1;
+        }
+    }
+    printf("Replica serving http://0.0.0.0:%d/world\n", opts.http_port);
+
+    follow_primary();
+
+    for (int i = 0; i < opts.http_threads; i++) pthread_join(threads[i], NULL);
+    close(listen_fd);
+    table_clear(&drones_table);
+    table_clear(&survivors_table);
+    return 0;
+}
@@ -0,0 +1,361 @@
+/**
+ * @file replication.c
+ * @brief Streams drone and survivor changes from the primary to read replicas.
+ *
+ * The log is a bounded array of record slots, each with a turn counter:
+ * a producer claims the next position with one compare-and-swap on the
+ * head, copies its record into the slot and publishes it by advancing the
+ * turn, and the replication thread reads slots in position order. Callers
+ * log a change while they still hold the lock (or run on the thread) that
+ * orders changes to that entity, so a replica sees each entity's changes in
+ * the order they were made. A producer that finds the slot a lap behind
+ * drops its record and flags a resync instead of waiting.
+ *
+ * The replication thread owns the listener and every replica socket. It
+ * sends a new replica a header and a snapshot (drones under their locks,
+ * survivors from each region's list under the list lock, as the SDL view
+ * reads them), then every record it drains, through a per-replica buffer
+ * written without blocking. Records already drained before the snapshot
+ * are in it; those still in the log follow it and, being upserts, at worst
+ * replay a change the snapshot already shows.
+ */
+#define _GNU_SOURCE
+#include "headers/replication.h"
+#include "headers/globals.h"
+#include "headers/region.h"
+#include "headers/metrics.h"
+#include "headers/lockprof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define REPL_MASK (REPL_LOG_RECORDS - 1)
+#define REPL_DRAIN_BATCH 4096    // records per pass between accepts and flushes
+
+typedef struct repl_slot {
+    uint64_t turn;       // position once free for it, position + 1 once written
+    ReplRecord record;
+} ReplSlot;
+
+typedef struct replica {
+    int fd;
+    int needs_snapshot;
+    char *out;           // REPL_REPLICA_BUFFER bytes
+    size_t start, len;   // unsent bytes
+} Replica;
+
+static struct {
+    ReplSlot *slots;
+    uint64_t head;       // positions claimed
+    uint64_t tail;       // positions read; replication thread only
+    int active;
+    int stopping;
+    int resync;          // a record was dropped; every replica needs a new snapshot
+    int listen_fd;
+    pthread_t thread;
+    Replica replicas[REPL_MAX_REPLICAS];
+    int replica_count;
+    uint64_t records;
+    uint64_t dropped;
+} repl;
+
+static int64_t unix_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* ---- records ---- */
+
+static void fill_drone(ReplRecord *r, const Drone *d) {
+    r->kind = REPL_DRONE;
+    r->drone = (ReplDrone){
+        .id = d->id,
+        .x = d->coord.x,
+        .y = d->coord.y,
+        .status = d->status,
+        .payload = d->payload,
+        .battery = d->battery,
+        .target_x = d->target.x,
+        .target_y = d->target.y,
+        .stops = d->status == ON_MISSION ? d->tour_len - d->tour_stop : 0,
+        .repositioning = d->repositioning,
+    };
+}
+
+static void fill_survivor(ReplRecord *r, const Survivor *s, ReplKind kind) {
+    uint64_t word = survivor_state(s);
+    r->kind = kind;
+    r->survivor = (ReplSurvivor){
+        .id = s->id,
+        .x = s->coord.x,
+        .y = s->coord.y,
+        .need = s->need,
+        .state = SURVIVOR_STATE(word),
+        .drone = SURVIVOR_STATE(word) == SURVIVOR_OPEN ? -1 : SURVIVOR_DRONE(word),
+    };
+    snprintf(r->survivor.info, sizeof(r->survivor.info), "%s", s->info);
+}
+
+static void log_push(const ReplRecord *r) {
+    uint64_t pos = __atomic_load_n(&repl.head, __ATOMIC_RELAXED);
+    ReplSlot *slot;
+    for (;;) {
+        slot = &repl.slots[pos & REPL_MASK];
+        uint64_t turn = __atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE);
+        if (turn == pos) {
+            if (__atomic_compare_exchange_n(&repl.head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+        } else if (turn < pos) {
+            // Still holds the record of the previous lap: the log is full
+            __atomic_add_fetch(&repl.dropped, 1, __ATOMIC_RELAXED);
+            __atomic_store_n(&repl.resync, 1, __ATOMIC_RELEASE);
+            return;
+        } else {
+            pos = __atomic_load_n(&repl.head, __ATOMIC_RELAXED);
+        }
+    }
+    slot->record = *r;
+    slot->record.seq = pos;
+    slot->record.unix_ns = unix_now_ns();
+    __atomic_store_n(&slot->turn, pos + 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&repl.records, 1, __ATOMIC_RELAXED);
+}
+
+// Call with d->lock held.
+void replicate_drone(const Drone *d) {
+    if (!__atomic_load_n(&repl.active, __ATOMIC_ACQUIRE)) return;
+    ReplRecord r;
+    fill_drone(&r, d);
+    log_push(&r);
+}
+
+// Call from the survivor's region, or right after changing its state.
+void replicate_survivor(const Survivor *s) {
+    if (!__atomic_load_n(&repl.active, __ATOMIC_ACQUIRE)) return;
+    ReplRecord r;
+    fill_survivor(&r, s, REPL_SURVIVOR);
+    log_push(&r);
+}
+
+// Call from the survivor's region before it is freed.
+void replicate_survivor_removed(const Survivor *s) {
+    if (!__atomic_load_n(&repl.active, __ATOMIC_ACQUIRE)) return;
+    ReplRecord r;
+    fill_survivor(&r, s, REPL_SURVIVOR_REMOVED);
+    log_push(&r);
+}
+
+static int log_pop(ReplRecord *r) {
+    ReplSlot *slot = &repl.slots[repl.tail & REPL_MASK];
+    if (__atomic_load_n(&slot->turn, __ATOMIC_ACQUIRE) != repl.tail + 1) return 0;
+    *r = slot->record;
+    __atomic_store_n(&slot->turn, repl.tail + REPL_LOG_RECORDS, __ATOMIC_RELEASE);
+    repl.tail++;
+    return 1;
+}
+
+/* ---- replicas ---- */
+
+static void drop_replica(int i, const char *why) {
+    Replica *rep = &repl.replicas[i];
+    printf("Replica on socket %d dropped: %s\n", rep->fd, why);
+    close(rep->fd);
+    free(rep->out);
+    repl.replicas[i] = repl.replicas[--repl.replica_count];
+}
+
+static int append(Replica *rep, const void *data, size_t n) {
+    if (rep->len + n > REPL_REPLICA_BUFFER) return -1;
+    if (rep->start + rep->len + n > REPL_REPLICA_BUFFER) {
+        memmove(rep->out, rep->out + rep->start, rep->len);
+        rep->start = 0;
+    }
+    memcpy(rep->out + rep->start + rep->len, data, n);
+    rep->len += n;
+    return 0;
+}
+
+// Queues r for every replica, or only those waiting for a snapshot.
+static void broadcast(const ReplRecord *r, int snapshot_only) {
+    for (int i = repl.replica_count - 1; i >= 0; i--) {
+        Replica *rep = &repl.replicas[i];
+        if (snapshot_only ? !rep->needs_snapshot : rep->needs_snapshot) continue;
+        if (append(rep, r, sizeof(*r)) != 0) drop_replica(i, "too far behind");
+    }
+}
+
+static void send_snapshot() {
+    ReplRecord r = {.kind = REPL_SNAPSHOT_BEGIN, .seq = __atomic_load_n(&repl.head, __ATOMIC_ACQUIRE),
+                    .unix_ns = unix_now_ns()};
+    broadcast(&r, 1);
+    long drone_count = 0, survivor_count = 0;
+    metrics_lock(&drones->lock, LOCK_DRONES);
+    for (Node *node = drones->head; node != NULL; node = node->next) {
+        Drone *d = (Drone *)node->data;
+        LOCK(&d->lock);
+        fill_drone(&r, d);
+        UNLOCK(&d->lock);
+        broadcast(&r, 1);
+        drone_count++;
+    }
+    UNLOCK(&drones->lock);
+    for (int i = 0; i < region_count; i++) {
+        List *waiting = regions[i].survivors;
+        LOCK(&waiting->lock);
+        for (Node *node = waiting->head; node != NULL; node = node->next) {
+            fill_survivor(&r, *(Survivor **)node->data, REPL_SURVIVOR);
+            broadcast(&r, 1);
+            survivor_count++;
+        }
+        UNLOCK(&waiting->lock);
+    }
+    r = (ReplRecord){.kind = REPL_SNAPSHOT_END, .seq = r.seq, .unix_ns = unix_now_ns()};
+    broadcast(&r, 1);
+    for (int i = 0; i < repl.replica_count; i++) {
+        if (!repl.replicas[i].needs_snapshot) continue;
+        repl.replicas[i].needs_snapshot = 0;
+        printf("Replica on socket %d synced: %ld drones, %ld survivors\n", repl.replicas[i].fd, drone_count,
+               survivor_count);
+    }
+}
+
+static void accept_replicas() {
+    int fd;
+    while ((fd = accept4(repl.listen_fd, NULL, NULL, SOCK_NONBLOCK)) >= 0) {
+        char *out = repl.replica_count < REPL_MAX_REPLICAS ? malloc(REPL_REPLICA_BUFFER) : NULL;
+        if (!out) {
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Replica *rep = &repl.replicas[repl.replica_count++];
+        *rep = (Replica){.fd = fd, .needs_snapshot = 1, .out = out};
+        ReplHeader header = {.version = REPL_VERSION, .record_size = sizeof(ReplRecord)};
+        memcpy(header.magic, REPL_MAGIC, sizeof(header.magic));
+        append(rep, &header, sizeof(header));
+        printf("Replica connected on socket %d\n", fd);
+    }
+}
+
+static void flush_replicas() {
+    for (int i = repl.replica_count - 1; i >= 0; i--) {
+        Replica *rep = &repl.replicas[i];
+        while (rep->len > 0) {
+            ssize_t n = send(rep->fd, rep->out + rep->start, rep->len, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if (n > 0) {
+                rep->start += n;
+                rep->len -= n;
+            } else if (n < 0 && errno == EINTR) {
+                continue;
+            } else {
+                if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+                drop_replica(i, "connection closed");
+                break;
+            }
+        }
+        if (i < repl.replica_count && repl.replicas[i].len == 0) repl.replicas[i].start = 0;
+    }
+}
+
+static void *replication_main(void *arg) {
+    (void)arg;
+    uint64_t next_heartbeat = 0;
+    for (;;) {
+        int stopping = __atomic_load_n(&repl.stopping, __ATOMIC_ACQUIRE);
+        if (!stopping) accept_replicas();
+        if (__atomic_exchange_n(&repl.resync, 0, __ATOMIC_ACQ_REL)) {
+            for (int i = 0; i < repl.replica_count; i++) repl.replicas[i].needs_snapshot = 1;
+        }
+        for (int i = 0; i < repl.replica_count; i++) {
+            if (repl.replicas[i].needs_snapshot) {
+                send_snapshot();
+                break;
+            }
+        }
+
+        ReplRecord r;
+        int drained = 0;
+        while (drained < REPL_DRAIN_BATCH && log_pop(&r)) {
+            broadcast(&r, 0);
+            drained++;
+        }
+        uint64_t now = metrics_now_ns();
+        if (now >= next_heartbeat) {
+            r = (ReplRecord){.kind = REPL_HEARTBEAT, .seq = __atomic_load_n(&repl.head, __ATOMIC_ACQUIRE),
+                             .unix_ns = unix_now_ns()};
+            broadcast(&r, 0);
+            next_heartbeat = now + REPL_HEARTBEAT_MS * 1000000ULL;
+        }
+        flush_replicas();
+        if (stopping && drained == 0) break;
+        if (drained == 0) usleep(REPL_IDLE_US);
+    }
+    return NULL;
+}
+
+int replication_start(int port) {
+    repl.slots = malloc(sizeof(ReplSlot) * REPL_LOG_RECORDS);
+    if (!repl.slots) {
+        perror("Failed to allocate replication log");
+        return -1;
+    }
+    for (uint64_t i = 0; i < REPL_LOG_RECORDS; i++) repl.slots[i].turn = i;
+    repl.head = repl.tail = 0;
+    repl.listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+    struct sockaddr_in addr = {.sin_family = AF_INET, .sin_addr.s_addr = INADDR_ANY, .sin_port = htons(port)};
+    if (repl.listen_fd < 0 || setsockopt(repl.listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) != 0 ||
+        bind(repl.listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(repl.listen_fd, 16) != 0) {
+        perror("Failed to listen for replicas");
+        if (repl.listen_fd >= 0) close(repl.listen_fd);
+        free(repl.slots);
+        return -1;
+    }
+    // Active before the thread starts, so no change made after this is missed
+    __atomic_store_n(&repl.active, 1, __ATOMIC_RELEASE);
+    if (pthread_create(&repl.thread, NULL, replication_main, NULL) != 0) {
+        perror("Failed to start replication thread");
+        __atomic_store_n(&repl.active, 0, __ATOMIC_RELEASE);
+        close(repl.listen_fd);
+        free(repl.slots);
+        return -1;
+    }
+    printf("Replicating to read replicas on port %d\n", port);
+    return 0;
+}
+
+// Sends what is still logged and disconnects the replicas. Call once
+// nothing changes any more (after the work pool has stopped) and before
+// the regions are freed.
+void replication_stop() {
+    if (!repl.active) return;
+    __atomic_store_n(&repl.active, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&repl.stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(repl.thread, NULL);
+    while (repl.replica_count > 0) drop_replica(repl.replica_count - 1, "primary shutting down");
+    close(repl.listen_fd);
+    free(repl.slots);
+    repl.slots = NULL;
+    printf("Replication stopped: %llu records, %llu dropped\n", (unsigned long long)repl.records,
+           (unsigned long long)repl.dropped);
+}
+
+uint64_t replication_records() {
+    return __atomic_load_n(&repl.records, __ATOMIC_RELAXED);
+}
+
+uint64_t replication_dropped() {
+    return __atomic_load_n(&repl.dropped, __ATOMIC_RELAXED);
+}
+
+int replication_replicas() {
+    return __atomic_load_n(&repl.replica_count, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,299 @@
+/**
+ * @file scenario.c
+ * @brief Seeded survivor workloads: arrival processes and spatial distributions.
+ *
+ * A scenario file holds one directive per line ('#' starts a comment):
+ *
+ *   tick-ms 50
+ *   loop
+ *   phase 60 poisson rate=200 uniform
+ *   phase 30 bursty rate=5000 on=2 off=8 clusters=4 sigma=3 share=85 shift=40
+ *   phase 120 poisson rate=500..20000 front=east speed=0.5 sigma=4
+ *
+ * `phase <seconds> steady|poisson|bursty` is followed by key=value options:
+ * rate (survivors/s, `a..b` ramps linearly over the phase), on/off (bursty
+ * cycle in seconds), clusters/sigma/share/shift (gaussian clusters whose
+ * centres jump every `shift` arrivals) or front/speed/sigma (a gaussian band
+ * around a line sweeping east, west, south or north). Without clusters or
+ * front, placement is uniform. `loop` restarts after the last phase.
+ *
+ * The generator only counts ticks, never reads the clock, and draws
+ * everything from one rand_r() stream.
+ */
+#define _GNU_SOURCE
+#include "headers/scenario.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+static const char *arrival_names[] = {"steady", "poisson", "bursty"};
+static const char *front_names[] = {"east", "west", "south", "north"};
+
+static void phase_defaults(ScenarioPhase *p) {
+    memset(p, 0, sizeof(*p));
+    p->rate_from = p->rate_to = 1;
+    p->on = p->off = 1;
+    p->placement = PLACE_UNIFORM;
+    p->sigma = 2;
+    p->share = 100;
+    p->front_speed = 1;
+}
+
+static int parse_name(const char *value, const char **names, int count) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(value, names[i]) == 0) return i;
+    }
+    return -1;
+}
+
+// Applies one key=value option to p. Returns -1 if it is not understood.
+static int parse_option(ScenarioPhase *p, char *token) {
+    if (strcmp(token, "uniform") == 0) {
+        p->placement = PLACE_UNIFORM;
+        return 0;
+    }
+    char *value = strchr(token, '=');
+    if (!value) return -1;
+    *value++ = '\0';
+    char *end;
+    if (strcmp(token, "rate") == 0) {
+        char *ramp = strstr(value, "..");
+        if (ramp) *ramp = '\0';
+        p->rate_from = p->rate_to = strtod(value, &end);
+        if (*end != '\0') return -1;
+        if (ramp) p->rate_to = strtod(ramp + 2, &end);
+        return *end == '\0' && p->rate_from >= 0 && p->rate_to >= 0 ? 0 : -1;
+    }
+    if (strcmp(token, "front") == 0) {
+        int direction = parse_name(value, front_names, 4);
+        if (direction < 0) return -1;
+        p->placement = PLACE_FRONT;
+        p->direction = (FrontDirection)direction;
+        return 0;
+    }
+    double number = strtod(value, &end);
+    if (*end != '\0' || number < 0) return -1;
+    if (strcmp(token, "on") == 0) p->on = number;
+    else if (strcmp(token, "off") == 0) p->off = number;
+    else if (strcmp(token, "sigma") == 0) p->sigma = number;
+    else if (strcmp(token, "speed") == 0) p->front_speed = number;
+    else if (strcmp(token, "share") == 0 && number <= 100) p->share = (int)number;
+    else if (strcmp(token, "shift") == 0) p->shift_every = (int)number;
+    else if (strcmp(token, "clusters") == 0 && number >= 1) {
+        p->placement = PLACE_CLUSTERS;
+        p->clusters = number < SCENARIO_MAX_CLUSTERS ? (int)number : SCENARIO_MAX_CLUSTERS;
+    } else return -1;
+    return 0;
+}
+
+int scenario_load(Scenario *sc, const char *path) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        perror("Failed to open scenario file");
+        return -1;
+    }
+    memset(sc, 0, sizeof(*sc));
+    sc->tick_ms = SCENARIO_TICK_MS;
+    char line[512];
+    int line_no = 0;
+    while (fgets(line, sizeof(line), file)) {
+        line_no++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        char *save;
+        char *word = strtok_r(line, " \t\r\n", &save);
+        if (!word) continue;  // blank or comment
+        const char *error = NULL;
+        if (strcmp(word, "loop") == 0) {
+            sc->loop = 1;
+        } else if (strcmp(word, "tick-ms") == 0) {
+            char *value = strtok_r(NULL, " \t\r\n", &save);
+            sc->tick_ms = value ? atof(value) : 0;
+            if (sc->tick_ms <= 0) error = "expected \"tick-ms <ms>\"";
+        } else if (strcmp(word, "phase") == 0) {
+            ScenarioPhase *p = &sc->phases[sc->count < SCENARIO_MAX_PHASES ? sc->count : 0];
+            char *seconds = strtok_r(NULL, " \t\r\n", &save);
+            char *process = strtok_r(NULL, " \t\r\n", &save);
+            int arrivals = process ? parse_name(process, arrival_names, 3) : -1;
+            if (sc->count == SCENARIO_MAX_PHASES) {
+                error = "too many phases";
+            } else if (!seconds || atof(seconds) <= 0 || arrivals < 0) {
+                error = "expected \"phase <seconds> steady|poisson|bursty [options]\"";
+            } else {
+                phase_defaults(p);
+                p->seconds = atof(seconds);
+                p->arrivals = (ArrivalProcess)arrivals;
+                for (char *token; !error && (token = strtok_r(NULL, " \t\r\n", &save));) {
+                    if (parse_option(p, token) != 0) error = "bad phase option";
+                }
+                if (!error && p->arrivals == ARRIVAL_BURSTY && p->on + p->off <= 0) error = "bursty needs on + off > 0";
+                if (!error) sc->count++;
+            }
+        } else {
+            error = "unknown directive";
+        }
+        if (error) {
+            fprintf(stderr, "%s:%d: %s\n", path, line_no, error);
+            fclose(file);
+            return -1;
+        }
+    }
+    fclose(file);
+    if (sc->count == 0) {
+        fprintf(stderr, "%s: no phases\n", path);
+        return -1;
+    }
+    printf("Loaded scenario %s: %d phases%s, %.0f ms ticks\n", path, sc->count, sc->loop ? " (looping)" : "",
+           sc->tick_ms);
+    return 0;
+}
+
+// The workload the plain command line asks for: steady at `rate`, or about
+// one survivor every 3s when rate is 0, clustered around `hotspots` centres
+// that move every 40 arrivals.
+void scenario_default(Scenario *sc, double rate, int hotspots) {
+    memset(sc, 0, sizeof(*sc));
+    sc->tick_ms = SCENARIO_TICK_MS;
+    sc->loop = 1;
+    sc->count = 1;
+    ScenarioPhase *p = &sc->phases[0];
+    phase_defaults(p);
+    p->seconds = 3600;
+    p->arrivals = rate > 0 ? ARRIVAL_STEADY : ARRIVAL_POISSON;
+    p->rate_from = p->rate_to = rate > 0 ? rate : 1.0 / 3;
+    if (hotspots > 0) {
+        p->placement = PLACE_CLUSTERS;
+        p->clusters = hotspots < SCENARIO_MAX_CLUSTERS ? hotspots : SCENARIO_MAX_CLUSTERS;
+        p->share = 85;
+        p->shift_every = 40;
+    }
+}
+
+static double uniform(Scenario *sc) {
+    return (rand_r(&sc->seed) + 0.5) / ((double)RAND_MAX + 1);
+}
+
+static double gaussian(Scenario *sc) {
+    double u = uniform(sc), v = uniform(sc);
+    return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+static long poisson(Scenario *sc, double lambda) {
+    if (lambda <= 0) return 0;
+    if (lambda > SCENARIO_NORMAL_LAMBDA) {
+        long n = lround(lambda + sqrt(lambda) * gaussian(sc));
+        return n > 0 ? n : 0;
+    }
+    double limit = exp(-lambda), p = 1;
+    long k = -1;
+    do {
+        k++;
+        p *= uniform(sc);
+    } while (p > limit);
+    return k;
+}
+
+static Coord random_cell(Scenario *sc) {
+    Coord c = {rand_r(&sc->seed) % sc->width, rand_r(&sc->seed) % sc->height};
+    return c;
+}
+
+static int clamp(int v, int limit) {
+    return v < 0 ? 0 : v >= limit ? limit - 1 : v;
+}
+
+static void enter_phase(Scenario *sc) {
+    ScenarioPhase *p = &sc->phases[sc->phase];
+    sc->phase_tick = sc->tick;
+    sc->placed = 0;
+    sc->owed = 0;
+    for (int i = 0; i < p->clusters; i++) sc->centres[i] = random_cell(sc);
+}
+
+void scenario_start(Scenario *sc, int width, int height, unsigned int seed) {
+    sc->width = width;
+    sc->height = height;
+    sc->seed = seed;
+    sc->tick = 0;
+    sc->phase = 0;
+    sc->generated = 0;
+    enter_phase(sc);
+}
+
+int scenario_done(const Scenario *sc) {
+    return sc->phase >= sc->count;
+}
+
+// Advances one tick and returns how many survivors arrive in it; place
+// each with scenario_place().
+int scenario_tick(Scenario *sc) {
+    if (scenario_done(sc)) return 0;
+    double dt = sc->tick_ms / 1000.0;
+    double t = (sc->tick - sc->phase_tick) * dt;
+    if (t >= sc->phases[sc->phase].seconds) {
+        if (++sc->phase == sc->count) {
+            if (!sc->loop) return 0;
+            sc->phase = 0;
+        }
+        enter_phase(sc);
+        t = 0;
+    }
+    ScenarioPhase *p = &sc->phases[sc->phase];
+    double rate = p->rate_from + (p->rate_to - p->rate_from) * t / p->seconds;
+    long count = 0;
+    switch (p->arrivals) {
+        case ARRIVAL_STEADY:
+            sc->owed += rate * dt;
+            count = (long)sc->owed;
+            sc->owed -= count;
+            break;
+        case ARRIVAL_POISSON:
+            count = poisson(sc, rate * dt);
+            break;
+        case ARRIVAL_BURSTY:
+            if (fmod(t, p->on + p->off) < p->on) count = poisson(sc, rate * dt);
+            break;
+    }
+    sc->tick++;
+    return (int)count;
+}
+
+// Draws where the next survivor of the current tick appears and what it
+// needs. Obstacles may be NULL.
+void scenario_place(Scenario *sc, ObstacleGrid *obstacles, ScenarioArrival *out) {
+    // Half need medical aid, the rest food or water
+    static const Payload needs[] = {PAYLOAD_MEDICAL, PAYLOAD_MEDICAL, PAYLOAD_FOOD, PAYLOAD_WATER};
+    ScenarioPhase *p = &sc->phases[sc->phase < sc->count ? sc->phase : sc->count - 1];
+    if (p->placement == PLACE_CLUSTERS && p->shift_every > 0 && sc->placed > 0 &&
+        sc->placed % p->shift_every == 0) {
+        sc->centres[(sc->placed / p->shift_every) % p->clusters] = random_cell(sc);
+    }
+    // The front has moved on for as long as the phase has run
+    double front = p->front_speed * (sc->tick - 1 - sc->phase_tick) * sc->tick_ms / 1000.0;
+    Coord c = {0, 0};
+    // Survivors are not placed inside obstacles while an open cell turns up
+    for (int tries = 0; tries < SCENARIO_PLACEMENT_TRIES; tries++) {
+        if (p->placement == PLACE_CLUSTERS && (int)(rand_r(&sc->seed) % 100) < p->share) {
+            Coord h = sc->centres[rand_r(&sc->seed) % p->clusters];
+            c.x = clamp(h.x + (int)lround(gaussian(sc) * p->sigma), sc->width);
+            c.y = clamp(h.y + (int)lround(gaussian(sc) * p->sigma), sc->height);
+        } else if (p->placement == PLACE_FRONT) {
+            int horizontal = p->direction == FRONT_EAST || p->direction == FRONT_WEST;
+            int extent = horizontal ? sc->width : sc->height;
+            int line = (int)fmod(front > 0 ? front : 0, extent);
+            if (p->direction == FRONT_WEST || p->direction == FRONT_NORTH) line = extent - 1 - line;
+            int across = clamp(line + (int)lround(gaussian(sc) * p->sigma), extent);
+            if (horizontal) c = (Coord){across, rand_r(&sc->seed) % sc->height};
+            else c = (Coord){rand_r(&sc->seed) % sc->width, across};
+        } else {
+            c = random_cell(sc);
+        }
+        if (!obstacles || !obstacles_blocked(obstacles, c.x, c.y)) break;
+    }
+    out->coord = c;
+    out->need = needs[rand_r(&sc->seed) % 4];
+    out->tag = rand_r(&sc->seed) % 10000;
+    sc->placed++;
+    sc->generated++;
+}
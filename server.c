@@ -1,282 +1,731 @@
+#define _GNU_SOURCE  // accept4
 #include <sys/socket.h>
+#include <sys/epoll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pthread.h>
 #include <json-c/json.h>
 #include <time.h>
 #include <errno.h>
 #include <signal.h>
 #include <stdbool.h>
+#include <sys/random.h>
 #include "headers/globals.h"
+#include "headers/trace.h"
+#include "headers/span.h"
+#include "headers/lockprof.h"
 #include "headers/ai.h"
 #include "headers/map.h"
 #include "headers/drone.h"
+#include "headers/deadreckon.h"
 #include "headers/survivor.h"
 #include "headers/list.h"
 #include "headers/server.h"
+#include "headers/archive.h"
+#include "headers/metrics.h"
+#include "headers/region.h"
+#include "headers/workpool.h"
+#include "headers/admission.h"
+#include "headers/heatmap.h"
+#include "headers/federation.h"
+#include "headers/replication.h"
+#include "headers/query.h"
 
 // Forward declaration
 Drone* find_drone_by_id(int id);
 
 extern volatile sig_atomic_t global_shutdown_flag;
 
-#define PORT 8080
 #define MAX_DRONES 10
 #define BUFFER_SIZE 4096
 #define MAX_CLIENTS 10
+#define REACTOR_EVENTS 64
+#define CONN_READS_PER_TASK 16   // recv() calls before a connection yields its worker
 
-void *handle_drone(void *arg);
-void send_json(int sock, struct json_object *jobj);
-struct json_object *receive_json(int sock);
-void process_handshake(int sock, struct json_object *jobj, const char* client_ip);
-void process_status_update(int sock, struct json_object *jobj);
-void process_mission_complete(int sock, struct json_object *jobj);
-void process_heartbeat_response(int sock, struct json_object *jobj);
+// Bytes received on a socket that do not form a complete line yet
+typedef struct line_buffer {
+    char data[BUFFER_SIZE * 2];
+    size_t len;
+} LineBuffer;
 
-// Structure to pass arguments to handle_drone thread
-typedef struct {
+// One accepted drone connection. The socket is registered EPOLLONESHOT, so
+// at most one conn_task runs for it at a time and its messages stay in order.
+typedef struct conn {
     int sock;
     char client_ip[INET_ADDRSTRLEN];
-} handle_drone_args_t;
+    LineBuffer in;
+    Drone *drone;              // set by the handshake
+    TokenBucket bucket;
+    struct json_object *deferred;  // newest STATUS_UPDATE not admitted yet
+    struct conn *prev, *next;  // open connection registry
+} Conn;
 
-void *run_server_loop(void *args) {
-    int server_fd;
+struct json_object *receive_json(int sock);
+Drone *process_handshake(int sock, struct json_object *jobj, const char* client_ip);
+static Drone *process_resume(int sock, struct json_object *jobj);
+static Drone *register_drone(Drone *fresh, int *created);
+static void new_session(Drone *d);
+static void drone_rebind(Drone *d, int sock);
+int process_status_update(int sock, struct json_object *jobj, uint64_t received_ns);
+int process_mission_complete(int sock, struct json_object *jobj, uint64_t received_ns);
+int process_heartbeat_response(int sock, struct json_object *jobj, uint64_t received_ns);
+static void register_server_gauges();
+static void accept_connections(int server_fd);
+static void conn_open(int new_socket, const struct sockaddr_in *client_addr);
+static void conn_task(void *arg);
+static void drain_connections();
+
+// Span names, indexed by MetricMsgType
+static const char *handler_span_names[MSG_TYPE_COUNT] = {
+    "handle HANDSHAKE", "handle STATUS_UPDATE", "handle MISSION_COMPLETE", "handle HEARTBEAT_RESPONSE",
+    "handle RESUME", "handle invalid"};
+
+static int reactor_fd = -1;
+static pthread_mutex_t conns_lock = PTHREAD_MUTEX_INITIALIZER;
+static Conn *conns = NULL;
+static int conn_count = 0;
+
+// Threads that accept on listeners of their own (--acceptors n)
+typedef struct acceptor {
+    pthread_t thread;
+    int fd;
+} Acceptor;
+
+static Acceptor *acceptors = NULL;
+static int acceptor_count = 0;
+static long connections_accepted = 0;
+
+// Opens a drone listener on config.port. With reuseport several listeners
+// share the port and the kernel spreads new connections over them.
+static int open_listener(int flags, int reuseport) {
     struct sockaddr_in address;
     int opt = 1;
-
-    if ((server_fd = socket(AF_INET, SOCK_STREAM, 0)) == 0) {
+    int fd = socket(AF_INET, SOCK_STREAM | flags, 0);
+    if (fd < 0) {
         perror("socket failed");
-        return NULL;
+        return -1;
     }
-
-    if (setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt))) {
+    if (setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) ||
+        (reuseport && setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)))) {
         perror("setsockopt");
-        close(server_fd);
-        return NULL;
+        close(fd);
+        return -1;
     }
     address.sin_family = AF_INET;
     address.sin_addr.s_addr = INADDR_ANY;
-    address.sin_port = htons(PORT);
+    address.sin_port = htons(config.port);
 
-    if (bind(server_fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
         perror("bind failed");
-        close(server_fd);
-        return NULL;
+        close(fd);
+        return -1;
     }
-    if (listen(server_fd, 3) < 0) {
+    if (listen(fd, config.backlog) < 0) {
         perror("listen");
-        close(server_fd);
-        return NULL;
+        close(fd);
+        return -1;
     }
+    return fd;
+}
 
-    printf("Server listening on port %d\n", PORT);
-
+// Blocks in accept4 and hands each connection straight to the reactor's
+// epoll set; the reactor thread never sees the listener. Returns once
+// acceptors_stop shuts the listener down.
+static void *acceptor_loop(void *arg) {
+    Acceptor *a = (Acceptor *)arg;
     while (!global_shutdown_flag) {
-        fd_set readfds;
-        struct timeval tv;
-        FD_ZERO(&readfds);
-        FD_SET(server_fd, &readfds);
-        tv.tv_sec = 1;  // 1 second timeout
-        tv.tv_usec = 0;
-
-        int activity = select(server_fd + 1, &readfds, NULL, NULL, &tv);
-        if (activity < 0) {
-            if (errno == EINTR) continue;
-            perror("select error");
-            break;
-        }
-        
-        if (activity == 0) continue;  // Timeout, check shutdown flag
-        
-        if (FD_ISSET(server_fd, &readfds)) {
-            int new_socket;
-            struct sockaddr_in client_addr;
-            socklen_t client_len = sizeof(client_addr);
-
-            if ((new_socket = accept(server_fd, (struct sockaddr *)&client_addr, &client_len)) < 0) {
-                if (errno == EINTR) continue;
-                perror("accept");
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int new_socket = accept4(a->fd, (struct sockaddr *)&client_addr, &client_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (new_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                // Out of descriptors: the backlog holds the rest until some close
+                perror("accept4");
+                usleep(10000);
                 continue;
             }
+            break;
+        }
+        conn_open(new_socket, &client_addr);
+    }
+    return NULL;
+}
 
-            char client_ip_str[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &client_addr.sin_addr, client_ip_str, INET_ADDRSTRLEN);
-            printf("Connection accepted from %s:%d on socket %d\n", 
-                   client_ip_str, ntohs(client_addr.sin_port), new_socket);
+static int acceptors_start(int count) {
+    acceptors = calloc(count, sizeof(Acceptor));
+    if (!acceptors) return -1;
+    for (; acceptor_count < count; acceptor_count++) {
+        Acceptor *a = &acceptors[acceptor_count];
+        a->fd = open_listener(SOCK_CLOEXEC, 1);
+        if (a->fd < 0) return -1;
+        if (pthread_create(&a->thread, NULL, acceptor_loop, a) != 0) {
+            perror("Failed to start acceptor");
+            close(a->fd);
+            return -1;
+        }
+    }
+    return 0;
+}
 
-            handle_drone_args_t *thread_args = malloc(sizeof(handle_drone_args_t));
-            if (!thread_args) {
-                perror("Failed to allocate memory for thread args");
-                close(new_socket);
-                continue;
+// Shutting a listener down wakes the accept4 blocked on it.
+static void acceptors_stop() {
+    for (int i = 0; i < acceptor_count; i++) shutdown(acceptors[i].fd, SHUT_RDWR);
+    for (int i = 0; i < acceptor_count; i++) {
+        pthread_join(acceptors[i].thread, NULL);
+        close(acceptors[i].fd);
+    }
+    free(acceptors);
+    acceptors = NULL;
+    acceptor_count = 0;
+}
+
+// The server thread is the only reactor: it turns readable sockets into
+// conn_task submissions; all parsing and handling runs on the work pool.
+// Unless --acceptors gives accepting threads of their own, it accepts too.
+void *run_server_loop(void *args) {
+    int server_fd = -1;
+
+    reactor_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (reactor_fd < 0) {
+        perror("epoll");
+        return NULL;
+    }
+    if (config.acceptors > 0) {
+        if (acceptors_start(config.acceptors) != 0) {
+            acceptors_stop();
+            close(reactor_fd);
+            reactor_fd = -1;
+            return NULL;
+        }
+    } else {
+        struct epoll_event listen_ev = {.events = EPOLLIN, .data.ptr = NULL};
+        server_fd = open_listener(SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (server_fd >= 0 && epoll_ctl(reactor_fd, EPOLL_CTL_ADD, server_fd, &listen_ev) < 0) {
+            perror("epoll");
+            close(server_fd);
+            server_fd = -1;
+        }
+        if (server_fd < 0) {
+            close(reactor_fd);
+            reactor_fd = -1;
+            return NULL;
+        }
+    }
+
+    printf("Server listening on port %d", config.port);
+    if (config.acceptors > 0) printf(" with %d acceptors", config.acceptors);
+    printf("\n");
+    register_server_gauges();
+
+    struct epoll_event events[REACTOR_EVENTS];
+    int listening = 1;
+    uint64_t drain_deadline = 0;
+    while (1) {
+        if (global_shutdown_flag && listening) {
+            // Stop accepting and wake every connection so its task sees EOF
+            printf("Server shutting down...\n");
+            if (server_fd >= 0) {
+                epoll_ctl(reactor_fd, EPOLL_CTL_DEL, server_fd, NULL);
+                close(server_fd);
             }
-            thread_args->sock = new_socket;
-            strncpy(thread_args->client_ip, client_ip_str, INET_ADDRSTRLEN);
-            
-            pthread_t thread_id;
-            if (pthread_create(&thread_id, NULL, handle_drone, thread_args) != 0) {
-                perror("pthread_create failed for handle_drone");
-                free(thread_args);
-                close(new_socket);
+            acceptors_stop();
+            listening = 0;
+            drain_connections();
+            drain_deadline = metrics_now_ns() + 7000000000ULL;
+        }
+        if (!listening && (__atomic_load_n(&conn_count, __ATOMIC_ACQUIRE) == 0 ||
+                           metrics_now_ns() > drain_deadline)) {
+            break;
+        }
+
+        int n = epoll_wait(reactor_fd, events, REACTOR_EVENTS, listening ? 1000 : 100);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            Conn *c = (Conn *)events[i].data.ptr;
+            if (!c) {
+                accept_connections(server_fd);
+            } else if (workpool_submit(conn_task, c) != 0) {
+                conn_task(c);
             }
-            pthread_detach(thread_id);  // Automatically clean up thread when it exits
         }
     }
 
-    printf("Server shutting down...\n");
-    close(server_fd);
+    if (listening) {
+        if (server_fd >= 0) close(server_fd);
+        acceptors_stop();
+    }
+    close(reactor_fd);
+    reactor_fd = -1;
     return NULL;
 }
 
-void *handle_drone(void *arg) {
-    handle_drone_args_t *thread_args = (handle_drone_args_t*)arg;
-    int sock = thread_args->sock;
-    char client_ip[INET_ADDRSTRLEN];
-    strncpy(client_ip, thread_args->client_ip, INET_ADDRSTRLEN);
-    free(thread_args);
+// Tells a drone to come back later, as an ERROR with code 503.
+static void send_overloaded(int sock, const char *message) {
+    struct json_object *error = json_object_new_object();
+    json_object_object_add(error, "type", json_object_new_string("ERROR"));
+    json_object_object_add(error, "code", json_object_new_int(503));
+    json_object_object_add(error, "message", json_object_new_string(message));
+    json_object_object_add(error, "retry_after", json_object_new_int(admission_retry_after()));
+    json_object_object_add(error, "timestamp", json_object_new_int64(time(NULL)));
+    // The caller closes the connection whether or not the drone got this
+    (void)send_json(sock, error);
+    json_object_put(error);
+}
 
-    // Set socket timeout
-    struct timeval tv;
-    tv.tv_sec = 5;  // 5 second timeout
-    tv.tv_usec = 0;
-    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv);
+// Accepts at most ADMIT_ACCEPT_BATCH per wakeup so a connection storm
+// cannot starve the sockets already being served; the listener is level
+// triggered and comes straight back.
+static void accept_connections(int server_fd) {
+    for (int accepted = 0; accepted < ADMIT_ACCEPT_BATCH; accepted++) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        int new_socket = accept4(server_fd, (struct sockaddr *)&client_addr, &client_len,
+                                 SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (new_socket < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) perror("accept4");
+            return;
+        }
+        conn_open(new_socket, &client_addr);
+    }
+}
 
-    Drone *current_drone = NULL;  // Keep track of the drone for cleanup
+// Registers a non-blocking socket just accepted, or refuses it with a 503
+// past the connection limit. Safe on any thread: the reactor's epoll set
+// takes it from here.
+static void conn_open(int new_socket, const struct sockaddr_in *client_addr) {
+    __atomic_add_fetch(&connections_accepted, 1, __ATOMIC_RELAXED);
+    trace_record(TRACE_OPEN, new_socket, NULL, 0);
 
-    while (!global_shutdown_flag) {
-        struct json_object *jobj = receive_json(sock);
-        if (!jobj) {
-            printf("Client disconnected or error on socket %d\n", sock);
-            if (current_drone) {
-                pthread_mutex_lock(&current_drone->lock);
-                current_drone->status = DISCONNECTED;
-                pthread_mutex_unlock(&current_drone->lock);
-            }
-            close(sock);
-            break;
+    if (__atomic_load_n(&conn_count, __ATOMIC_ACQUIRE) >= config.max_drones + ADMIT_CONN_SLACK) {
+        send_overloaded(new_socket, "Server overloaded: connection limit reached");
+        admission_count_refused();
+        trace_record(TRACE_CLOSE, new_socket, NULL, 0);
+        close(new_socket);
+        return;
+    }
+
+    Conn *c = calloc(1, sizeof(Conn));
+    if (!c) {
+        perror("Failed to allocate connection");
+        trace_record(TRACE_CLOSE, new_socket, NULL, 0);
+        close(new_socket);
+        return;
+    }
+    c->sock = new_socket;
+    token_bucket_init(&c->bucket, metrics_now_ns());
+    inet_ntop(AF_INET, &client_addr->sin_addr, c->client_ip, INET_ADDRSTRLEN);
+    printf("Connection accepted from %s:%d on socket %d\n",
+           c->client_ip, ntohs(client_addr->sin_port), new_socket);
+
+    LOCK(&conns_lock);
+    c->next = conns;
+    if (conns) conns->prev = c;
+    conns = c;
+    __atomic_add_fetch(&conn_count, 1, __ATOMIC_RELEASE);
+    UNLOCK(&conns_lock);
+    metrics_connection_opened();
+
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, .data.ptr = c};
+    if (epoll_ctl(reactor_fd, EPOLL_CTL_ADD, new_socket, &ev) < 0) {
+        perror("epoll_ctl add");
+        shutdown(new_socket, SHUT_RDWR);
+        if (workpool_submit(conn_task, c) != 0) conn_task(c);
+    }
+}
+
+// Shuts every open socket down so the next read on it returns EOF.
+static void drain_connections() {
+    LOCK(&conns_lock);
+    for (Conn *c = conns; c != NULL; c = c->next) {
+        shutdown(c->sock, SHUT_RDWR);
+    }
+    UNLOCK(&conns_lock);
+}
+
+static void conn_close(Conn *c) {
+    printf("Client disconnected or error on socket %d\n", c->sock);
+    if (c->drone) {
+        // A drone that has resumed on another connection is not ours to mark
+        LOCK(&c->drone->lock);
+        if (c->drone->sock == c->sock) {
+            c->drone->status = DISCONNECTED;
+            c->drone->sock = -1;  // the descriptor is about to be reused
+            replicate_drone(c->drone);
         }
+        UNLOCK(&c->drone->lock);
+    }
+    LOCK(&conns_lock);
+    if (c->prev) c->prev->next = c->next;
+    else conns = c->next;
+    if (c->next) c->next->prev = c->prev;
+    UNLOCK(&conns_lock);
 
-        const char *type = json_object_get_string(json_object_object_get(jobj, "type"));
-        printf("Received message on sock %d: type=%s\n", sock, type ? type : "NULL");
-        
-        if (!type) {
-            struct json_object *error = json_object_new_object();
-            json_object_object_add(error, "type", json_object_new_string("ERROR"));
-            json_object_object_add(error, "code", json_object_new_int(400));
-            json_object_object_add(error, "message", json_object_new_string("Missing message type"));
-            send_json(sock, error);
-            json_object_put(error);
-        } else if (strcmp(type, "HANDSHAKE") == 0) {
-            process_handshake(sock, jobj, client_ip);
-            // After handshake, get the drone object for this connection
-            struct json_object *drone_id_obj;
-            if (json_object_object_get_ex(jobj, "drone_id", &drone_id_obj)) {
-                const char *drone_id_str = json_object_get_string(drone_id_obj);
-                int id_val;
-                if (sscanf(drone_id_str, "D%d", &id_val) == 1) {
-                    current_drone = find_drone_by_id(id_val);
-                }
+    // Recorded before close() so the descriptor cannot be reused in between
+    trace_record(TRACE_CLOSE, c->sock, NULL, 0);
+    close(c->sock);  // also drops it from the epoll set
+    metrics_connection_closed();
+    if (c->deferred) json_object_put(c->deferred);
+    free(c);
+    __atomic_sub_fetch(&conn_count, 1, __ATOMIC_RELEASE);
+}
+
+// Returns -1 when the connection should be closed.
+static int handle_message(Conn *c, struct json_object *jobj) {
+    int sock = c->sock;
+    uint64_t handler_start = metrics_now_ns();
+    const char *type = json_object_get_string(json_object_object_get(jobj, "type"));
+    MetricMsgType metric_type = metrics_msg_type(type);
+    int posted = 0;  // handed to a region, which observes the handler latency
+    int closing = 0; // a reply could not be sent and the socket is shut down
+    Span sp;
+    span_begin(&sp, handler_span_names[metric_type]);
+    printf("Received message on sock %d: type=%s\n", sock, type ? type : "NULL");
+
+    if (!type) {
+        struct json_object *error = json_object_new_object();
+        json_object_object_add(error, "type", json_object_new_string("ERROR"));
+        json_object_object_add(error, "code", json_object_new_int(400));
+        json_object_object_add(error, "message", json_object_new_string("Missing message type"));
+        if (send_json(sock, error) != 0) closing = 1;
+        json_object_put(error);
+    } else if (strcmp(type, "HANDSHAKE") == 0) {
+        if (!admission_accept_handshake()) {
+            send_overloaded(sock, "Server overloaded");
+            admission_count_refused();
+            metrics_count_message(metric_type);
+            span_end(&sp);
+            return -1;
+        }
+        Drone *registered = process_handshake(sock, jobj, c->client_ip);
+        if (registered) c->drone = registered;
+    } else if (strcmp(type, "RESUME") == 0) {
+        if (!admission_accept_handshake()) {
+            send_overloaded(sock, "Server overloaded");
+            admission_count_refused();
+            metrics_count_message(metric_type);
+            span_end(&sp);
+            return -1;
+        }
+        Drone *resumed = process_resume(sock, jobj);
+        if (resumed) c->drone = resumed;
+    } else if (strcmp(type, "STATUS_UPDATE") == 0) {
+        posted = process_status_update(sock, jobj, handler_start) == 0;
+    } else if (strcmp(type, "MISSION_COMPLETE") == 0) {
+        posted = process_mission_complete(sock, jobj, handler_start) == 0;
+    } else if (strcmp(type, "HEARTBEAT_RESPONSE") == 0) {
+        posted = process_heartbeat_response(sock, jobj, handler_start) == 0;
+    } else {
+        struct json_object *error = json_object_new_object();
+        json_object_object_add(error, "type", json_object_new_string("ERROR"));
+        json_object_object_add(error, "code", json_object_new_int(400));
+        json_object_object_add(error, "message", json_object_new_string("Invalid message type"));
+        if (send_json(sock, error) != 0) closing = 1;
+        json_object_put(error);
+    }
+
+    metrics_count_message(metric_type);
+    if (!posted) {
+        uint64_t latency = metrics_now_ns() - handler_start;
+        metrics_observe(HIST_HANDLER + metric_type, latency);
+        admission_observe(latency);
+    }
+    span_end(&sp);
+    return closing ? -1 : 0;
+}
+
+static int conn_flush_deferred(Conn *c) {
+    struct json_object *deferred = c->deferred;
+    if (!deferred) return 0;
+    c->deferred = NULL;
+    int result = handle_message(c, deferred);
+    json_object_put(deferred);
+    return result;
+}
+
+// Admission for one incoming message. A STATUS_UPDATE that is not admitted
+// is held back, replacing any older one, and goes out ahead of the next
+// admitted message so the region still sees the drone's latest report in
+// order. Returns -1 when the connection should be closed.
+static int conn_message(Conn *c, struct json_object *jobj) {
+    const char *type = json_object_get_string(json_object_object_get(jobj, "type"));
+    AdmitClass cls = admission_class(type);
+    if (!admission_admit(cls, &c->bucket, metrics_now_ns())) {
+        if (cls == ADMIT_BULK) {
+            if (c->deferred) {
+                json_object_put(c->deferred);
+                admission_count_coalesced();
             }
-        } else if (strcmp(type, "STATUS_UPDATE") == 0) {
-            process_status_update(sock, jobj);
-        } else if (strcmp(type, "MISSION_COMPLETE") == 0) {
-            process_mission_complete(sock, jobj);
-        } else if (strcmp(type, "HEARTBEAT_RESPONSE") == 0) {
-            process_heartbeat_response(sock, jobj);
+            c->deferred = json_object_get(jobj);
         } else {
-            struct json_object *error = json_object_new_object();
-            json_object_object_add(error, "type", json_object_new_string("ERROR"));
-            json_object_object_add(error, "code", json_object_new_int(400));
-            json_object_object_add(error, "message", json_object_new_string("Invalid message type"));
-            send_json(sock, error);
-            json_object_put(error);
+            admission_count_dropped();
+        }
+        return 0;
+    }
+    if (cls == ADMIT_BULK && c->deferred) {
+        // Superseded by this newer report
+        json_object_put(c->deferred);
+        c->deferred = NULL;
+        admission_count_coalesced();
+    }
+    if (conn_flush_deferred(c) != 0) return -1;
+    return handle_message(c, jobj);
+}
+
+// Takes one newline-terminated message off the buffer. Returns 0 when no
+// complete line is buffered; *out is NULL for a line that is not valid JSON.
+static int line_buffer_take(LineBuffer *lb, struct json_object **out) {
+    char *newline = memchr(lb->data, '\n', lb->len);
+    if (!newline) return 0;
+    *newline = '\0';
+    *out = json_tokener_parse(lb->data);
+    if (!*out) {
+        printf("Failed to parse JSON: %s\n", lb->data);
+    }
+    size_t len = newline - lb->data + 1;
+    memmove(lb->data, newline + 1, lb->len - len);
+    lb->len -= len;
+    return 1;
+}
+
+// One recv() into the buffer; the return value is recv()'s.
+static ssize_t line_buffer_fill(LineBuffer *lb, int sock) {
+    if (lb->len >= sizeof(lb->data) - 1) {
+        printf("Dropping oversized message on sock %d\n", sock);
+        lb->len = 0;
+    }
+    ssize_t bytes = recv(sock, lb->data + lb->len, sizeof(lb->data) - lb->len - 1, 0);
+    if (bytes > 0) {
+        lb->len += bytes;
+        lb->data[lb->len] = '\0';
+        printf("Received %zd bytes on sock %d: %s\n", bytes, sock, lb->data + lb->len - bytes);
+    }
+    return bytes;
+}
+
+// Reads what the socket has, handles every complete message, then re-arms
+// the socket, or closes the connection on EOF or error.
+static void conn_task(void *arg) {
+    Conn *c = (Conn *)arg;
+    int open = 1;
+    int eof = 0;
+    Span sp;
+    span_begin(&sp, "connection read");
+    for (int reads = 0; reads < CONN_READS_PER_TASK; reads++) {
+        ssize_t bytes = line_buffer_fill(&c->in, c->sock);
+        if (bytes > 0) trace_record(TRACE_IN, c->sock, c->in.data + c->in.len - bytes, bytes);
+        if (bytes < 0 && errno == EINTR) continue;
+        if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+        if (bytes <= 0) {
+            // A last message without its newline still counts
+            if (c->in.len > 0) {
+                c->in.data[c->in.len++] = '\n';
+            }
+            eof = 1;
         }
 
-        json_object_put(jobj);
+        // Everything buffered is handled, EOF or not, unless a message
+        // says the connection has to go
+        struct json_object *jobj;
+        while (open && line_buffer_take(&c->in, &jobj)) {
+            if (jobj) {
+                if (conn_message(c, jobj) != 0) open = 0;
+                json_object_put(jobj);
+            }
+        }
+        if (eof) open = 0;
+        if (!open) break;
     }
+    // A held-back report goes out as soon as the drone's bucket allows
+    if (open && c->deferred && admission_admit(ADMIT_BULK, &c->bucket, metrics_now_ns())) {
+        if (conn_flush_deferred(c) != 0) open = 0;
+    }
+    span_end(&sp);
 
-    // Cleanup on thread exit
-    if (current_drone) {
-        pthread_mutex_lock(&current_drone->lock);
-        current_drone->status = DISCONNECTED;
-        pthread_mutex_unlock(&current_drone->lock);
+    struct epoll_event ev = {.events = EPOLLIN | EPOLLRDHUP | EPOLLONESHOT, .data.ptr = c};
+    if (!open || epoll_ctl(reactor_fd, EPOLL_CTL_MOD, c->sock, &ev) < 0) {
+        conn_close(c);
     }
-    close(sock);
-    return NULL;
 }
 
-void send_json(int sock, struct json_object *jobj) {
+// Sockets are non-blocking, so wait briefly for room rather than drop a message.
+// A frame is never left half written: if the drone does not take it in time
+// the socket is shut down, so the reactor closes the connection and the
+// drone RESUMEs on a new one. Returns 0 once the whole line is sent.
+int send_json(int sock, struct json_object *jobj) {
     const char *json_str = json_object_to_json_string_ext(jobj, JSON_C_TO_STRING_PLAIN);
     size_t len = strlen(json_str);
     char *msg = malloc(len + 2);
+    if (!msg) return -1;
+    Span sp;
+    span_begin(&sp, "send_json");
     snprintf(msg, len + 2, "%s\n", json_str);
-    send(sock, msg, strlen(msg), 0);
+    trace_record(TRACE_OUT, sock, msg, len + 1);
+    size_t sent = 0;
+    while (sent < len + 1) {
+        ssize_t n = send(sock, msg + sent, len + 1 - sent, MSG_NOSIGNAL);
+        if (n > 0) {
+            sent += n;
+        } else if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            struct pollfd pfd = {.fd = sock, .events = POLLOUT};
+            if (poll(&pfd, 1, 100) <= 0) break;
+        } else {
+            break;
+        }
+    }
+    int result = 0;
+    if (sent < len + 1) {
+        fprintf(stderr, "Send on socket %d stalled after %zu of %zu bytes, closing it\n", sock, sent, len + 1);
+        if (sock >= 0) shutdown(sock, SHUT_RDWR);
+        result = -1;
+    }
+    span_end(&sp);
     free(msg);
+    return result;
 }
 
+// Blocking read of the next message, for callers that own a blocking socket.
 struct json_object *receive_json(int sock) {
-    static char buffer[BUFFER_SIZE * 2];
-    static size_t buf_pos = 0;
-
+    static __thread LineBuffer buffer;
+    struct json_object *jobj;
     while (1) {
-        char *newline = strchr(buffer, '\n');
-        if (newline) {
-            *newline = '\0';
-            struct json_object *jobj = json_tokener_parse(buffer);
-            if (!jobj) {
-                printf("Failed to parse JSON: %s\n", buffer);
-            }
-            size_t len = newline - buffer + 1;
-            memmove(buffer, newline + 1, buf_pos - len);
-            buf_pos -= len;
-            return jobj;
-        }
-
-        int bytes = recv(sock, buffer + buf_pos, BUFFER_SIZE - buf_pos - 1, 0);
+        if (line_buffer_take(&buffer, &jobj)) return jobj;
+        ssize_t bytes = line_buffer_fill(&buffer, sock);
+        if (bytes < 0 && errno == EINTR) continue;
         if (bytes <= 0) {
-            if (buf_pos > 0) {
-                buffer[buf_pos] = '\0';
-                struct json_object *jobj = json_tokener_parse(buffer);
-                buf_pos = 0;
+            if (buffer.len > 0) {
+                buffer.data[buffer.len] = '\0';
+                jobj = json_tokener_parse(buffer.data);
+                buffer.len = 0;
                 return jobj;
             }
             return NULL;
         }
-        buf_pos += bytes;
-        buffer[buf_pos] = '\0';
-        printf("Received %d bytes on sock %d: %s\n", bytes, sock, buffer + buf_pos - bytes);
     }
 }
 
-void process_handshake(int sock, struct json_object *jobj, const char* client_ip) {
+// The intervals a drone should report at, as sent in HANDSHAKE_ACK and
+// CONFIG_UPDATE. Call with d->lock held.
+static struct json_object *report_config(const Drone *d) {
+    struct json_object *config = json_object_new_object();
+    json_object_object_add(config, "status_update_interval", json_object_new_double(d->status_interval));
+    json_object_object_add(config, "heartbeat_interval", json_object_new_double(d->heartbeat_interval));
+    struct json_object *reckoning = json_object_new_object();
+    json_object_object_add(reckoning, "deviation_threshold", json_object_new_int(DEADRECKON_DEVIATION_CELLS));
+    json_object_object_add(config, "dead_reckoning", reckoning);
+    return config;
+}
+
+int send_report_config(Drone *d) {
+    struct json_object *msg = json_object_new_object();
+    json_object_object_add(msg, "type", json_object_new_string("CONFIG_UPDATE"));
+    json_object_object_add(msg, "config", report_config(d));
+    int result = send_json(d->sock, msg);
+    json_object_put(msg);
+    return result;
+}
+
+// Drones route around the obstacles themselves, so they get the whole list
+// on HANDSHAKE_ACK and again whenever it changes. The drones are collected
+// first so no send, which may wait on a full socket, runs under the list
+// lock; each goes out under its drone's lock only, which keeps conn_close
+// from closing the descriptor, and letting it be reused, mid-send.
+void broadcast_obstacles() {
+    struct json_object *msg = json_object_new_object();
+    struct json_object *config = json_object_new_object();
+    json_object_object_add(config, "obstacles", obstacles_json(&map.obstacles));
+    json_object_object_add(msg, "type", json_object_new_string("CONFIG_UPDATE"));
+    json_object_object_add(msg, "config", config);
+    LOCK(&drones->lock);
+    int count = 0;
+    Drone **targets = malloc(sizeof(Drone *) * (drones->number_of_elements + 1));
+    for (Node *node = drones->head; targets && node != NULL; node = node->next) {
+        targets[count++] = (Drone *)node->data;
+    }
+    UNLOCK(&drones->lock);
+    if (!targets) {
+        perror("Failed to allocate obstacle broadcast");
+        json_object_put(msg);
+        return;
+    }
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        Drone *d = targets[i];
+        LOCK(&d->lock);
+        if (d->sock >= 0 && send_json(d->sock, msg) == 0) sent++;
+        UNLOCK(&d->lock);
+    }
+    free(targets);
+    json_object_put(msg);
+    printf("Sent new obstacles to %d of %d drones\n", sent, count);
+}
+
+// Registers the drone a HANDSHAKE names, or binds an existing record to this
+// connection. Returns the drone, or NULL if the HANDSHAKE was refused.
+Drone *process_handshake(int sock, struct json_object *jobj, const char* client_ip) {
     printf("[DEBUG Handshake] Processing HANDSHAKE from %s\n", client_ip);
     struct json_object *drone_id_obj, *capabilities_obj;
     if (!json_object_object_get_ex(jobj, "drone_id", &drone_id_obj) ||
         !json_object_object_get_ex(jobj, "capabilities", &capabilities_obj)) {
         fprintf(stderr, "HANDSHAKE from %s missing fields.\n", client_ip);
-        return;
+        return NULL;
     }
     const char *drone_id_str = json_object_get_string(drone_id_obj);
     int new_drone_id_val;
     if (sscanf(drone_id_str, "D%d", &new_drone_id_val) != 1) {
         fprintf(stderr, "Invalid drone_id format in HANDSHAKE from %s: %s\n", client_ip, drone_id_str);
-        return;
+        return NULL;
     }
     printf("[DEBUG Handshake] Parsed drone_id_str: %s to ID: %d\n", drone_id_str, new_drone_id_val);
 
-    Drone *existing_drone = find_drone_by_id(new_drone_id_val);
-    if (existing_drone) {
-        printf("[DEBUG Handshake] Drone ID: %d is an existing drone. Socket: %d\n", new_drone_id_val, existing_drone->sock);
-    } else {
+    // Ground speed lets the server predict positions between status updates
+    double speed = DEADRECKON_DEFAULT_SPEED;
+    struct json_object *value;
+    if (json_object_object_get_ex(capabilities_obj, "cells_per_second", &value)) {
+        speed = json_object_get_double(value);
+        if (speed < 0) speed = 0;
+    }
+    double max_speed = json_object_get_double(json_object_object_get(capabilities_obj, "max_speed"));
+    int battery_capacity = json_object_get_int(json_object_object_get(capabilities_obj, "battery_capacity"));
+    if (battery_capacity < 0) battery_capacity = 0;
+    Payload payload = payload_parse(json_object_get_string(json_object_object_get(capabilities_obj, "payload")));
+    // Survivors one sortie can serve; drones that do not say take a full tour
+    int capacity = DRONE_TOUR_MAX;
+    if (json_object_object_get_ex(capabilities_obj, "capacity", &value)) {
+        capacity = json_object_get_int(value);
+        if (capacity < 1) capacity = 1;
+        if (capacity > DRONE_TOUR_MAX) capacity = DRONE_TOUR_MAX;
+    }
+    Coord home = {0, 0};
+    int has_home = json_object_object_get_ex(jobj, "home", &value) &&
+                   json_object_object_get_ex(value, "x", NULL) && json_object_object_get_ex(value, "y", NULL);
+    if (has_home) {
+        home.x = json_object_get_int(json_object_object_get(value, "x"));
+        home.y = json_object_get_int(json_object_object_get(value, "y"));
+        has_home = map_in_bounds(home.x, home.y);
+    }
+
+    Drone *registered = find_drone_by_id(new_drone_id_val);
+    int created = 0;
+    if (!registered) {
         printf("[DEBUG Handshake] Drone ID: %d is a new drone. Creating.\n", new_drone_id_val);
-        Drone *new_drone = (Drone *)malloc(sizeof(Drone));
+        Drone *new_drone = (Drone *)calloc(1, sizeof(Drone));
         if (!new_drone) {
             perror("Failed to allocate memory for new drone");
-            return;
+            return NULL;
         }
         printf("[DEBUG Handshake] Memory allocated for new drone ID: %d.\n", new_drone_id_val);
         new_drone->id = new_drone_id_val;
@@ -299,6 +748,28 @@ void process_handshake(int sock, struct json_object *jobj, const char* client_ip
         
         new_drone->target.x = 0;
         new_drone->target.y = 0;
+        new_drone->region = -1;
+        new_drone->anchor = new_drone->coord;
+        new_drone->anchor_ns = metrics_now_ns();
+        new_drone->speed = speed;
+        new_drone->max_speed = max_speed;
+        new_drone->battery_capacity = battery_capacity;
+        new_drone->battery = 100;
+        new_drone->reported_speed = 0;
+        new_drone->payload = payload;
+        new_drone->capacity = capacity;
+        new_drone->tour_len = 0;
+        new_drone->repositioning = 0;
+        new_drone->repositioned_ns = 0;
+        new_drone->home = home;
+        new_drone->has_home = has_home;
+        if (has_home) {
+            // A drone that says where it launched from starts there
+            new_drone->coord = home;
+            new_drone->anchor = home;
+        }
+        new_drone->status_interval = REPORT_STATUS_DEFAULT_S;
+        new_drone->heartbeat_interval = REPORT_HEARTBEAT_S;
         
         time_t now;
         time(&now);
@@ -307,372 +778,430 @@ void process_handshake(int sock, struct json_object *jobj, const char* client_ip
         if (pthread_mutex_init(&new_drone->lock, NULL) != 0) {
             perror("Failed to initialize drone mutex");
             free(new_drone);
-            return;
+            return NULL;
         }
         printf("[DEBUG Handshake] Mutex initialized for new drone ID: %d.\n", new_drone_id_val);
         
-        if (drones->add(drones, new_drone) == NULL) {
+        registered = register_drone(new_drone, &created);
+        if (!created) pthread_mutex_destroy(&new_drone->lock);
+        free(new_drone);  // the list keeps its own copy
+        if (registered == NULL) {
             fprintf(stderr, "Failed to add drone %s to list from %s.\n", drone_id_str, client_ip);
-            pthread_mutex_destroy(&new_drone->lock);
-            free(new_drone);
-            return;
+            send_overloaded(sock, "Server overloaded: drone registry full");
+            admission_count_refused();
+            return NULL;
+        }
+        if (created) {
+            printf("Drone %s (ID: %d) from %s registered successfully. Initial pos: (%d, %d)\n", drone_id_str,
+                   registered->id, client_ip, registered->coord.x, registered->coord.y);
         }
-        printf("[DEBUG Handshake] New drone ID: %d added to drones list.\n", new_drone_id_val);
-        printf("Drone %s (ID: %d) from %s registered successfully. Initial pos: (%d, %d)\n", drone_id_str, new_drone->id, client_ip, new_drone->coord.x, new_drone->coord.y);
+    }
+    if (!created) {
+        printf("[DEBUG Handshake] Drone ID: %d is an existing drone. Socket: %d\n", new_drone_id_val, registered->sock);
+        // Reconnect: missions and region membership carry over to the new socket
+        LOCK(&registered->lock);
+        if (registered->sock >= 0 && registered->sock != sock) {
+            // The ID is held by a live connection: a drone picking it up again
+            // proves it with a RESUME, so this is another drone using the same ID
+            UNLOCK(&registered->lock);
+            printf("HANDSHAKE for drone %d from %s refused, its connection is still open\n", registered->id,
+                   client_ip);
+            struct json_object *err = json_object_new_object();
+            json_object_object_add(err, "type", json_object_new_string("ERROR"));
+            json_object_object_add(err, "code", json_object_new_int(409));
+            json_object_object_add(err, "message", json_object_new_string("Drone ID in use"));
+            (void)send_json(sock, err);  // the drone picks another ID either way
+            json_object_put(err);
+            return NULL;
+        }
+        drone_rebind(registered, sock);
+        registered->speed = speed;
+        registered->max_speed = max_speed;
+        registered->battery_capacity = battery_capacity;
+        registered->payload = payload;
+        registered->capacity = capacity;
+        if (has_home) {
+            registered->home = home;
+            registered->has_home = 1;
+        }
+        if (registered->status_interval <= 0) {
+            registered->status_interval = REPORT_STATUS_DEFAULT_S;
+            registered->heartbeat_interval = REPORT_HEARTBEAT_S;
+        }
+        if (registered->status == DISCONNECTED) {
+            registered->status = IDLE;
+            registered->tour_len = 0;
+            registered->repositioning = 0;
+        }
+        UNLOCK(&registered->lock);
     }
 
+    // Sent under the drone lock so it goes out before any mission or config update
     struct json_object *ack = json_object_new_object();
     json_object_object_add(ack, "type", json_object_new_string("HANDSHAKE_ACK"));
-    json_object_object_add(ack, "session_id", json_object_new_string("S123"));
-    struct json_object *config = json_object_new_object();
-    json_object_object_add(config, "status_update_interval", json_object_new_int(5));
-    json_object_object_add(config, "heartbeat_interval", json_object_new_int(10));
-    json_object_object_add(ack, "config", config);
-    send_json(sock, ack);
+    LOCK(&registered->lock);
+    new_session(registered);
+    json_object_object_add(ack, "session_id", json_object_new_string(registered->session));
+    replicate_drone(registered);
+    struct json_object *ack_config = report_config(registered);
+    if (obstacles_active(&map.obstacles)) {
+        json_object_object_add(ack_config, "obstacles", obstacles_json(&map.obstacles));
+    }
+    json_object_object_add(ack, "config", ack_config);
+    if (send_json(sock, ack) != 0) {
+        // The connection is being torn down; the drone registers or resumes again
+        fprintf(stderr, "HANDSHAKE_ACK to drone %d not delivered\n", registered->id);
+    }
+    UNLOCK(&registered->lock);
     json_object_put(ack);
-}
 
-void process_status_update(int sock, struct json_object *jobj) {
-    const char *drone_id = json_object_get_string(json_object_object_get(jobj, "drone_id"));
-    struct json_object *loc = json_object_object_get(jobj, "location");
-    int new_x = json_object_get_int(json_object_object_get(loc, "x"));
-    int new_y = json_object_get_int(json_object_object_get(loc, "y"));
-    const char *status_str = json_object_get_string(json_object_object_get(jobj, "status"));
-    DroneStatus new_status = strcmp(status_str, "idle") == 0 ? IDLE : ON_MISSION;
-    
-    // Extract drone ID number
-    int drone_num;
-    sscanf(drone_id + 1, "%d", &drone_num);
-    
-    pthread_mutex_lock(&drones->lock);
-    Node *current = drones->head;
-    Drone *drone = NULL;
-    
-    while (current != NULL) {
-        Drone *d = (Drone *)current->data;
-        if (d->id == drone_num) {
-            drone = d;
-            break;
-        }
-        current = current->next;
-    }
-    
-    if (drone) {
-        pthread_mutex_lock(&drone->lock);
-        printf("[DEBUG] Drone %d position update: (%d,%d) -> (%d,%d)\n",
-               drone->id, drone->coord.x, drone->coord.y, new_x, new_y);
-        drone->coord.x = new_x;
-        drone->coord.y = new_y;
-        drone->status = new_status;
-        printf("[DEBUG] Drone %s (ID: %d) final state: loc=(%d,%d), status=%s\n",
-               drone_id, drone->id, drone->coord.x, drone->coord.y,
-               drone->status == IDLE ? "idle" : "busy");
-        pthread_mutex_unlock(&drone->lock);
-    }
-    pthread_mutex_unlock(&drones->lock);
-    
-    // Check if drone is at a survivor's position
-    printf("[DEBUG] Checking if drone %s is at a survivor position (%d,%d)\n", drone_id, new_x, new_y);
-    
-    // Acquire all locks needed in the correct order to prevent deadlocks
-    // First lock map cell if coordinates are valid
-    if (new_x >= 0 && new_x < map.width && new_y >= 0 && new_y < map.height) {
-        pthread_mutex_lock(&map.cells[new_y][new_x].survivors->lock);
-    }
-    
-    pthread_mutex_lock(&survivors->lock);
-    pthread_mutex_lock(&helpedsurvivors->lock);
-    
-    Node* survivor_current = survivors->head;
-    Node* prev = NULL;
-    bool found_survivor = false;
-    
-    // Debug info - print all survivors
-    printf("[DEBUG] Current survivors in global list:\n");
-    Node* debug_node = survivors->head;
-    while (debug_node != NULL) {
-        Survivor* s = (Survivor*)debug_node->data;
-        printf("[DEBUG] - Survivor at (%d,%d), info=%s\n", s->coord.x, s->coord.y, s->info);
-        debug_node = debug_node->next;
-    }
-    
-    while (survivor_current != NULL && !found_survivor) {
-        Survivor* s = (Survivor*)survivor_current->data;
-        printf("[DEBUG] Checking survivor position (%d,%d) against drone position (%d,%d)\n", 
-               s->coord.x, s->coord.y, new_x, new_y);
-        
-        if (new_x == s->coord.x && new_y == s->coord.y) {
-            printf("[DEBUG] Found survivor %s at (%d,%d) for removal.\n", 
-                   s->info, s->coord.x, s->coord.y);
-            
-            // Create mission complete message
-            struct json_object *complete_msg = json_object_new_object();
-            json_object_object_add(complete_msg, "type", json_object_new_string("MISSION_COMPLETE"));
-            json_object_object_add(complete_msg, "drone_id", json_object_new_string(drone_id));
-            json_object_object_add(complete_msg, "mission_id", json_object_new_string(s->info));
-            json_object_object_add(complete_msg, "success", json_object_new_boolean(true));
-            json_object_object_add(complete_msg, "details", json_object_new_string("Delivered aid to survivor"));
-            
-            // Send mission complete message
-            send_json(sock, complete_msg);
-            json_object_put(complete_msg);
-            
-            // Create a copy for helped survivors list
-            Survivor* helped_survivor = (Survivor*)malloc(sizeof(Survivor));
-            if (!helped_survivor) {
-                perror("Failed to allocate memory for helped survivor");
-            } else {
-                memcpy(helped_survivor, s, sizeof(Survivor));
-                helped_survivor->status = 1; // Mark as helped
-                time_t now;
-                time(&now);
-                helped_survivor->helped_time = *localtime(&now);
-                
-                // Add to helped survivors list
-                Node* added = add(helpedsurvivors, helped_survivor);
-                if (added) {
-                    printf("[DEBUG] Added survivor %s to helped list\n", s->info);
-                } else {
-                    printf("[ERROR] Failed to add survivor to helped list\n");
-                    free(helped_survivor);
-                }
-            }
-            
-            // Remove from map cell if coordinates are valid
-            if (s->coord.x >= 0 && s->coord.x < map.width && 
-                s->coord.y >= 0 && s->coord.y < map.height) {
-                
-                List* cell_list = map.cells[s->coord.y][s->coord.x].survivors;
-                Node* cell_node = cell_list->head;
-                
-                printf("[DEBUG] Attempting to remove survivor from map cell (%d,%d)\n", s->coord.x, s->coord.y);
-                while (cell_node != NULL) {
-                    Survivor* cell_surv = (Survivor*)cell_node->data;
-                    if (cell_surv == s) {
-                        printf("[DEBUG] Found survivor in map cell, removing directly\n");
-                        int result = cell_list->removenode(cell_list, cell_node);
-                        printf("[DEBUG] Remove from map cell result: %d\n", result);
-                        break;
-                    }
-                    cell_node = cell_node->next;
-                }
-            }
-            
-            // Remove the survivor from the global list
-            if (prev == NULL) {
-                survivors->head = survivor_current->next;
-            } else {
-                prev->next = survivor_current->next;
-            }
-            
-            // Free the survivor node but not the data (it's now in helped survivors list)
-            printf("[DEBUG] Freeing survivor node from global list\n");
-            free(survivor_current);
-            
-            // Update drone status to idle if we have a drone reference
-            if (drone) {
-                pthread_mutex_lock(&drone->lock);
-                drone->status = IDLE;
-                pthread_mutex_unlock(&drone->lock);
-                printf("[DEBUG] Updated drone %d status to IDLE\n", drone_num);
-            }
-            
-            found_survivor = true;
-            
-            // Spawn a new survivor immediately
-            printf("[DEBUG] Spawning a new survivor after rescue\n");
-            pthread_t temp_thread;
-            pthread_create(&temp_thread, NULL, survivor_generator, NULL);
-            pthread_detach(temp_thread);
-        } else {
-            prev = survivor_current;
-            survivor_current = survivor_current->next;
-        }
-    }
-    
-    // Release locks in the reverse order
-    pthread_mutex_unlock(&helpedsurvivors->lock);
-    pthread_mutex_unlock(&survivors->lock);
-    
-    if (new_x >= 0 && new_x < map.width && new_y >= 0 && new_y < map.height) {
-        pthread_mutex_unlock(&map.cells[new_y][new_x].survivors->lock);
-    }
-    
-    if (found_survivor) {
-        printf("[DEBUG] Successfully processed survivor rescue at position (%d,%d)\n", new_x, new_y);
-    } else {
-        printf("[DEBUG] No survivor found at drone position (%d,%d)\n", new_x, new_y);
+    if (created) {
+        // Hand the registered drone to the region it spawned in
+        RegionMsg *join = region_msg_new(REGION_MSG_JOIN, registered);
+        if (join) region_post_drone(registered, join);
     }
+    return registered;
 }
 
-void process_mission_complete(int sock, struct json_object *jobj) {
-    struct json_object *drone_id_obj, *mission_id_obj, *success_obj;
-    if (!json_object_object_get_ex(jobj, "drone_id", &drone_id_obj) ||
-        !json_object_object_get_ex(jobj, "mission_id", &mission_id_obj) ||
-        !json_object_object_get_ex(jobj, "success", &success_obj)) {
-        fprintf(stderr, "MISSION_COMPLETE missing fields.\n");
-        return;
+// Looks up the drone a message names; returns NULL and logs if there is none.
+static Drone *message_drone(struct json_object *jobj, const char *what) {
+    struct json_object *drone_id_obj;
+    if (!json_object_object_get_ex(jobj, "drone_id", &drone_id_obj)) {
+        fprintf(stderr, "%s missing drone_id.\n", what);
+        return NULL;
     }
     const char *drone_id_str = json_object_get_string(drone_id_obj);
-    const char *mission_id = json_object_get_string(mission_id_obj);
-    int success = json_object_get_boolean(success_obj);
-
     int id_val;
-    if (sscanf(drone_id_str, "D%d", &id_val) != 1) {
-        fprintf(stderr, "Invalid drone_id format in MISSION_COMPLETE: %s\n", drone_id_str);
-        return;
+    if (!drone_id_str || sscanf(drone_id_str, "D%d", &id_val) != 1) {
+        fprintf(stderr, "Invalid drone_id format in %s: %s\n", what, drone_id_str ? drone_id_str : "NULL");
+        return NULL;
     }
-    
     Drone *drone = find_drone_by_id(id_val);
     if (!drone) {
-        fprintf(stderr, "Drone %s not found for MISSION_COMPLETE.\n", drone_id_str);
-        return;
+        fprintf(stderr, "Drone %s not found for %s.\n", drone_id_str, what);
     }
+    return drone;
+}
 
-    printf("[DEBUG] Processing MISSION_COMPLETE for drone %s, mission %s\n", drone_id_str, mission_id);
-    printf("[DEBUG] Drone position is (%d,%d)\n", drone->coord.x, drone->coord.y);
-    
-    // FIX: Lock order to prevent deadlock
-    pthread_mutex_lock(&map.cells[drone->coord.y][drone->coord.x].survivors->lock);
-    pthread_mutex_lock(&survivors->lock);
-    pthread_mutex_lock(&helpedsurvivors->lock);
-    pthread_mutex_lock(&drone->lock);
+// The region that owns the drone applies the update and checks for a rescue.
+int process_status_update(int sock, struct json_object *jobj, uint64_t received_ns) {
+    Drone *drone = message_drone(jobj, "STATUS_UPDATE");
+    if (!drone) return -1;
+    struct json_object *loc = json_object_object_get(jobj, "location");
+    const char *status_str = json_object_get_string(json_object_object_get(jobj, "status"));
 
-    if (success) {
-        printf("Drone %s (ID: %d) completed mission %s successfully.\n", drone_id_str, drone->id, mission_id);
-        
-        // Set drone to IDLE immediately
-        drone->status = IDLE;
-        printf("[DEBUG] Drone %d set to IDLE at (%d, %d).\n", drone->id, drone->coord.x, drone->coord.y);
+    RegionMsg *m = region_msg_new(REGION_MSG_STATUS, drone);
+    if (!m) return -1;
+    m->coord.x = json_object_get_int(json_object_object_get(loc, "x"));
+    m->coord.y = json_object_get_int(json_object_object_get(loc, "y"));
+    m->status = status_str && strcmp(status_str, "idle") == 0 ? IDLE : ON_MISSION;
+    struct json_object *value;
+    m->battery = json_object_object_get_ex(jobj, "battery", &value) ? json_object_get_int(value) : -1;
+    m->speed = json_object_object_get_ex(jobj, "speed", &value) ? json_object_get_double(value) : -1;
+    m->metric_type = MSG_STATUS_UPDATE;
+    m->received_ns = received_ns;
+    m->trace_id = span_current();
+    printf("[DEBUG] Drone %d position update: (%d,%d)\n", drone->id, m->coord.x, m->coord.y);
+    region_post_drone(drone, m);
+    return 0;
+}
 
-        // Find the survivor at the drone's current position
-        Survivor* found_survivor = NULL;
-        Node* current = survivors->head;
-        
-        printf("[DEBUG] Searching for survivor at coordinates (%d,%d)\n", drone->coord.x, drone->coord.y);
-        
-        while (current != NULL) {
-            Survivor* s = (Survivor*)current->data;
-            printf("[DEBUG] Checking survivor at (%d,%d), info=%s\n", s->coord.x, s->coord.y, s->info);
-            
-            if (s->coord.x == drone->coord.x && s->coord.y == drone->coord.y) {
-                found_survivor = s;
-                printf("[DEBUG] FOUND MATCHING SURVIVOR at (%d,%d)\n", s->coord.x, s->coord.y);
-                break;
-            }
-            current = current->next;
-        }
+int process_mission_complete(int sock, struct json_object *jobj, uint64_t received_ns) {
+    struct json_object *mission_id_obj, *success_obj;
+    if (!json_object_object_get_ex(jobj, "mission_id", &mission_id_obj) ||
+        !json_object_object_get_ex(jobj, "success", &success_obj)) {
+        fprintf(stderr, "MISSION_COMPLETE missing fields.\n");
+        return -1;
+    }
+    Drone *drone = message_drone(jobj, "MISSION_COMPLETE");
+    if (!drone) return -1;
+
+    RegionMsg *m = region_msg_new(REGION_MSG_MISSION_COMPLETE, drone);
+    if (!m) return -1;
+    m->success = json_object_get_boolean(success_obj);
+    // Where the drone made the stop; older clients leave it to the last status
+    struct json_object *loc;
+    m->coord = (Coord){-1, -1};
+    if (json_object_object_get_ex(jobj, "location", &loc)) {
+        m->coord.x = json_object_get_int(json_object_object_get(loc, "x"));
+        m->coord.y = json_object_get_int(json_object_object_get(loc, "y"));
+    }
+    m->metric_type = MSG_MISSION_COMPLETE;
+    m->received_ns = received_ns;
+    m->trace_id = span_current();
+    printf("[DEBUG] Processing MISSION_COMPLETE for drone %d, mission %s\n",
+           drone->id, json_object_get_string(mission_id_obj));
+    region_post_drone(drone, m);
+    return 0;
+}
+
+int process_heartbeat_response(int sock, struct json_object *jobj, uint64_t received_ns) {
+    Drone *drone = message_drone(jobj, "HEARTBEAT_RESPONSE");
+    if (!drone) return -1;
+    printf("Received HEARTBEAT_RESPONSE from D%d\n", drone->id);
+
+    RegionMsg *m = region_msg_new(REGION_MSG_HEARTBEAT, drone);
+    if (!m) return -1;
+    m->metric_type = MSG_HEARTBEAT_RESPONSE;
+    m->received_ns = received_ns;
+    m->trace_id = span_current();
+    region_post_drone(drone, m);
+    return 0;
+}
+
+// Drones by id, open addressing over the drones list. Drones are never
+// removed and list slots never move, so entries stay valid; the table is
+// sized for the list's capacity and guarded by the drones lock.
+static Drone **drone_ids = NULL;
+static unsigned drone_ids_mask = 0;
 
-        if (found_survivor) {
-            printf("[DEBUG] Found survivor at drone's position: %s at (%d,%d)\n", 
-                   found_survivor->info, found_survivor->coord.x, found_survivor->coord.y);
-
-            // Create a copy for the helped survivors list
-            Survivor* helped_survivor = (Survivor*)malloc(sizeof(Survivor));
-            if (helped_survivor) {
-                memcpy(helped_survivor, found_survivor, sizeof(Survivor));
-                helped_survivor->status = 1;
-                time_t now;
-                time(&now);
-                helped_survivor->helped_time = *localtime(&now);
-                
-                // Add to helped survivors list
-                Node* added = helpedsurvivors->add(helpedsurvivors, helped_survivor);
-                if (added != NULL) {
-                    printf("[DEBUG] Survivor %s added to helped list.\n", found_survivor->info);
-                    
-                    // First, remove from map cell using direct removal
-                    List* cell_list = map.cells[found_survivor->coord.y][found_survivor->coord.x].survivors;
-                    Node* cell_node = cell_list->head;
-                    while (cell_node != NULL) {
-                        Survivor* cell_surv = (Survivor*)cell_node->data;
-                        if (cell_surv == found_survivor) {
-                            printf("[DEBUG] Found survivor in map cell, removing directly\n");
-                            int result = cell_list->removenode(cell_list, cell_node);
-                            printf("[DEBUG] Remove from map cell result: %d\n", result);
-                            break;
-                        }
-                        cell_node = cell_node->next;
-                    }
-                    
-                    // Then remove from global survivors list
-                    int result = survivors->removedata(survivors, found_survivor);
-                    if (result == 0) {
-                        printf("[DEBUG] Successfully removed survivor %s from global list\n", found_survivor->info);
-                        free(found_survivor); // Free original after successful removal
-                    } else {
-                        printf("[ERROR] Failed to remove survivor from global list\n");
-                    }
-                    
-                } else {
-                    fprintf(stderr, "[DEBUG] Failed to add survivor %s to helped list.\n", found_survivor->info);
-                    free(helped_survivor);
-                }
+static Drone *drone_ids_get(int id) {
+    if (!drone_ids) return NULL;
+    for (unsigned i = ((unsigned)id * 2654435761u) & drone_ids_mask;; i = (i + 1) & drone_ids_mask) {
+        if (!drone_ids[i] || drone_ids[i]->id == id) return drone_ids[i];
+    }
+}
+
+static int drone_ids_put(Drone *d) {
+    if (!drone_ids) {
+        unsigned size = 64;
+        while (size < 2u * (unsigned)drones->capacity) size <<= 1;
+        drone_ids = calloc(size, sizeof(Drone *));
+        if (!drone_ids) return -1;
+        drone_ids_mask = size - 1;
+    }
+    unsigned i = ((unsigned)d->id * 2654435761u) & drone_ids_mask;
+    while (drone_ids[i]) i = (i + 1) & drone_ids_mask;
+    drone_ids[i] = d;
+    return 0;
+}
+
+Drone* find_drone_by_id(int id) {
+    Span sp;
+    span_begin(&sp, "drones lock");
+    metrics_lock(&drones->lock, LOCK_DRONES);
+    span_end(&sp);
+    Drone *found_drone = drone_ids_get(id);
+    UNLOCK(&drones->lock);
+    return found_drone;
+}
+
+// Adds a drone unless one with its id got in first, which a burst of
+// reconnects can race for. Returns the drone on the list, or NULL when it
+// is full; *created says whether this call added it.
+static Drone *register_drone(Drone *fresh, int *created) {
+    *created = 0;
+    metrics_lock(&drones->lock, LOCK_DRONES);
+    Drone *d = drone_ids_get(fresh->id);
+    if (!d) {
+        Node *node = drones->add(drones, fresh);
+        if (node) {
+            d = (Drone *)node->data;
+            if (drone_ids_put(d) != 0) {
+                perror("Failed to allocate drone index");
+                drones->removenode(drones, node);
+                d = NULL;
             } else {
-                perror("Failed to allocate memory for helped survivor");
-            }
-        } else {
-            printf("[DEBUG] No survivor found at drone's position (%d,%d)\n", drone->coord.x, drone->coord.y);
-            
-            // Additional debugging - print all survivors
-            Node* debug_node = survivors->head;
-            printf("[DEBUG] All survivors in global list:\n");
-            while (debug_node != NULL) {
-                Survivor* s = (Survivor*)debug_node->data;
-                printf("[DEBUG] - Survivor at (%d,%d), info=%s\n", s->coord.x, s->coord.y, s->info);
-                debug_node = debug_node->next;
+                *created = 1;
             }
         }
-
-        // Immediately spawn a new survivor
-        printf("[DEBUG] Spawning a new survivor after mission complete.\n");
-        pthread_t temp_thread;
-        pthread_create(&temp_thread, NULL, survivor_generator, NULL);
-        pthread_detach(temp_thread);
-    } else {
-        printf("Drone %s (ID: %d) failed mission %s.\n", drone_id_str, drone->id, mission_id);
     }
-    
-    pthread_mutex_unlock(&drone->lock);
-    pthread_mutex_unlock(&helpedsurvivors->lock);
-    pthread_mutex_unlock(&survivors->lock);
-    pthread_mutex_unlock(&map.cells[drone->coord.y][drone->coord.x].survivors->lock);
+    UNLOCK(&drones->lock);
+    return d;
 }
 
-void process_heartbeat_response(int sock, struct json_object *jobj) {
-    struct json_object *drone_id_obj;
-    if (!json_object_object_get_ex(jobj, "drone_id", &drone_id_obj)) {
-        fprintf(stderr, "HEARTBEAT_RESPONSE missing drone_id.\n");
-        return;
+// Every HANDSHAKE starts a new session; the token is what a RESUME must show.
+// Call with the drone lock held.
+static void new_session(Drone *d) {
+    unsigned char bytes[DRONE_SESSION_BYTES];
+    if (getrandom(bytes, sizeof(bytes), 0) != (ssize_t)sizeof(bytes)) {
+        for (size_t i = 0; i < sizeof(bytes); i++) bytes[i] = (unsigned char)rand();
     }
-    const char *drone_id_str = json_object_get_string(drone_id_obj);
-    printf("Received HEARTBEAT_RESPONSE from %s\n", drone_id_str);
+    for (size_t i = 0; i < sizeof(bytes); i++) {
+        snprintf(d->session + 2 * i, 3, "%02x", bytes[i]);
+    }
+}
 
-    int id_val;
-    if (sscanf(drone_id_str, "D%d", &id_val) != 1) return;
-    
-    Drone *drone = find_drone_by_id(id_val);
-    if (drone) {
-        pthread_mutex_lock(&drone->lock);
-        time_t now;
-        time(&now);
-        drone->last_update = *localtime(&now);
-        pthread_mutex_unlock(&drone->lock);
+// Moves a drone to a new connection. The old one is shut down so the reactor
+// closes it now rather than when TCP notices the peer is gone; its conn_close
+// sees the drone has moved on. Call with the drone lock held.
+static void drone_rebind(Drone *d, int sock) {
+    if (d->sock >= 0 && d->sock != sock) {
+        shutdown(d->sock, SHUT_RDWR);
     }
+    d->sock = sock;
 }
 
-Drone* find_drone_by_id(int id) {
-    pthread_mutex_lock(&drones->lock);
-    Node *current = drones->head;
-    Drone *found_drone = NULL;
-    while (current != NULL) {
-        Drone *d = (Drone *)current->data;
-        if (d->id == id) {
-            found_drone = d;
-            break;
+static long sessions_resumed = 0;
+
+// RESUME picks a session back up: the connection is bound to the drone's
+// record, which kept its region, mission and tour while it was away, and
+// the ack carries no config or obstacles. The mission is sent again only if
+// the drone does not already hold it.
+static Drone *process_resume(int sock, struct json_object *jobj) {
+    Drone *d = message_drone(jobj, "RESUME");
+    const char *session = json_object_get_string(json_object_object_get(jobj, "session_id"));
+    const char *held = json_object_get_string(json_object_object_get(jobj, "mission_id"));
+    if (d) {
+        LOCK(&d->lock);
+        if (!session || d->session[0] == '\0' || strcmp(session, d->session) != 0) {
+            UNLOCK(&d->lock);
+            d = NULL;
         }
-        current = current->next;
     }
-    pthread_mutex_unlock(&drones->lock);
-    return found_drone;
-}
\ No newline at end of file
+    if (!d) {
+        // The drone falls back to a HANDSHAKE
+        struct json_object *err = json_object_new_object();
+        json_object_object_add(err, "type", json_object_new_string("ERROR"));
+        json_object_object_add(err, "code", json_object_new_int(401));
+        json_object_object_add(err, "message", json_object_new_string("Unknown session"));
+        (void)send_json(sock, err);  // on failure the drone just tries again
+        json_object_put(err);
+        return NULL;
+    }
+
+    drone_rebind(d, sock);
+    if (d->status == DISCONNECTED) {
+        // drone_next_stop clears the tour when it ends, so a tour left means
+        // the mission is still flying
+        d->status = d->tour_len > 0 ? ON_MISSION : IDLE;
+    }
+    replicate_drone(d);
+    struct json_object *ack = json_object_new_object();
+    json_object_object_add(ack, "type", json_object_new_string("RESUME_ACK"));
+    json_object_object_add(ack, "session_id", json_object_new_string(d->session));
+    json_object_object_add(ack, "mission_id",
+                           d->status == ON_MISSION ? json_object_new_string(d->mission_id) : NULL);
+    int delivered = send_json(sock, ack) == 0;
+    json_object_put(ack);
+    // Without the ack the connection is going away and the drone resumes again
+    if (delivered && d->status == ON_MISSION && (!held || strcmp(held, d->mission_id) != 0)) {
+        send_mission(d);
+    }
+    UNLOCK(&d->lock);
+    __atomic_add_fetch(&sessions_resumed, 1, __ATOMIC_RELAXED);
+    printf("Drone %d resumed its session on socket %d\n", d->id, sock);
+    return d;
+}
+
+static double count_drones_with_status(int status) {
+    int count = 0;
+    LOCK(&drones->lock);
+    for (Node *node = drones->head; node != NULL; node = node->next) {
+        if (((Drone *)node->data)->status == status) count++;
+    }
+    UNLOCK(&drones->lock);
+    return count;
+}
+
+static double gauge_idle_drones(void) { return count_drones_with_status(IDLE); }
+static double gauge_busy_drones(void) { return count_drones_with_status(ON_MISSION); }
+static double gauge_disconnected_drones(void) { return count_drones_with_status(DISCONNECTED); }
+static double gauge_waiting_survivors(void) { return regions_waiting_survivors(); }
+static double gauge_map_tiles(void) { return __atomic_load_n(&map.live_tiles, __ATOMIC_RELAXED); }
+static double gauge_tasks_queued(void) { return workpool_queued(); }
+static double gauge_task_steals(void) { return workpool_steals(); }
+static double gauge_position_error(void) { return regions_position_error(); }
+static double gauge_admission_load(void) { return admission_load(); }
+static double gauge_admission_refused(void) { return admission_refused(); }
+static double gauge_admission_coalesced(void) { return admission_coalesced(); }
+static double gauge_admission_dropped(void) { return admission_dropped(); }
+static double gauge_report_rate(void) { return regions_desired_report_rate(); }
+static double gauge_report_scale(void) { return regions_report_scale(); }
+static double gauge_rebalance_moves(void) { return rebalance_moves(); }
+static double gauge_heat(void) { return heatmap_total(metrics_now_ns()); }
+static double gauge_survivors_generated(void) { return survivors_generated(); }
+static double gauge_trace_records(void) { return trace_records(); }
+static double gauge_trace_dropped(void) { return trace_dropped(); }
+static double gauge_archive_skipped(void) { return archive_skipped(); }
+static double gauge_federation_sent(void) { return federation_sent(); }
+static double gauge_federation_received(void) { return federation_received(); }
+static double gauge_federation_redirects(void) { return federation_redirects(); }
+static double gauge_federation_peers(void) { return federation_peers_connected(); }
+static double gauge_replication_records(void) { return replication_records(); }
+static double gauge_replication_dropped(void) { return replication_dropped(); }
+static double gauge_replicas(void) { return replication_replicas(); }
+static double gauge_query_requests(void) { return query_requests(); }
+static double gauge_query_age(void) { return query_snapshot_age(); }
+static double gauge_query_build(void) { return query_build_seconds(); }
+static double gauge_connections_accepted(void) {
+    return __atomic_load_n(&connections_accepted, __ATOMIC_RELAXED);
+}
+static double gauge_sessions_resumed(void) { return __atomic_load_n(&sessions_resumed, __ATOMIC_RELAXED); }
+static double gauge_path_builds(void) { return __atomic_load_n(&map_paths.builds, __ATOMIC_RELAXED); }
+static double gauge_path_hits(void) { return __atomic_load_n(&map_paths.hits, __ATOMIC_RELAXED); }
+
+static void register_server_gauges() {
+    metrics_register_gauge("edcs_drones_idle", "Registered drones that are idle.", gauge_idle_drones);
+    metrics_register_gauge("edcs_drones_busy", "Registered drones that are on a mission.", gauge_busy_drones);
+    metrics_register_gauge("edcs_drones_disconnected", "Registered drones whose connection dropped.",
+                           gauge_disconnected_drones);
+    metrics_register_gauge("edcs_connections_accepted", "Drone connections accepted since start.",
+                           gauge_connections_accepted);
+    metrics_register_gauge("edcs_sessions_resumed", "Reconnected drones that resumed their session since start.",
+                           gauge_sessions_resumed);
+    metrics_register_gauge("edcs_survivors_waiting", "Survivors queued for dispatch.", gauge_waiting_survivors);
+    metrics_register_gauge("edcs_map_tiles_allocated", "Map tiles holding at least one survivor.", gauge_map_tiles);
+    metrics_register_gauge("edcs_workpool_tasks_queued", "Tasks waiting in worker deques.", gauge_tasks_queued);
+    metrics_register_gauge("edcs_workpool_steals", "Tasks taken from another worker's deque since start.",
+                           gauge_task_steals);
+    metrics_register_gauge("edcs_position_error_mean_cells",
+                           "Mean distance between predicted and reported positions of drones on a mission.",
+                           gauge_position_error);
+    metrics_register_gauge("edcs_report_rate_desired",
+                           "STATUS_UPDATE/s the drones' own report intervals add up to, before the budget.",
+                           gauge_report_rate);
+    metrics_register_gauge("edcs_report_interval_scale",
+                           "Factor stretching every report interval to stay within --update-budget.",
+                           gauge_report_scale);
+    metrics_register_gauge("edcs_admission_load", "Queued work or handler latency relative to its limit.",
+                           gauge_admission_load);
+    metrics_register_gauge("edcs_admission_refused", "Connections and handshakes refused with 503 since start.",
+                           gauge_admission_refused);
+    metrics_register_gauge("edcs_admission_coalesced",
+                           "STATUS_UPDATEs superseded by a newer one while held back since start.",
+                           gauge_admission_coalesced);
+    metrics_register_gauge("edcs_admission_dropped", "Non-critical messages shed since start.",
+                           gauge_admission_dropped);
+    metrics_register_gauge("edcs_rebalance_moves", "Idle drones sent to reposition since start.",
+                           gauge_rebalance_moves);
+    metrics_register_gauge("edcs_survivors_generated", "Survivors the workload generator has posted since start.",
+                           gauge_survivors_generated);
+    metrics_register_gauge("edcs_heatmap_total", "Decayed survivor arrivals summed over the heatmap.", gauge_heat);
+    metrics_register_gauge("edcs_path_fields_built", "Distance fields computed around obstacles since start.",
+                           gauge_path_builds);
+    metrics_register_gauge("edcs_path_field_hits", "Distance field lookups served from the cache since start.",
+                           gauge_path_hits);
+    metrics_register_gauge("edcs_trace_records", "Records appended to the --trace ring since start.",
+                           gauge_trace_records);
+    metrics_register_gauge("edcs_trace_dropped", "Trace records dropped because the ring was full.",
+                           gauge_trace_dropped);
+    metrics_register_gauge("edcs_archive_skipped", "Rescues not archived because no segment could be opened.",
+                           gauge_archive_skipped);
+    if (federation_active()) {
+        metrics_register_gauge("edcs_federation_survivors_sent", "Survivors handed to peer servers since start.",
+                               gauge_federation_sent);
+        metrics_register_gauge("edcs_federation_survivors_received",
+                               "Survivors handed over by peer servers since start.", gauge_federation_received);
+        metrics_register_gauge("edcs_federation_redirects", "Drones redirected to the server owning their area.",
+                               gauge_federation_redirects);
+        metrics_register_gauge("edcs_federation_peers", "Peer servers this one has a link to.",
+                               gauge_federation_peers);
+    }
+    if (config.replicate_port) {
+        metrics_register_gauge("edcs_replication_records", "State changes logged for read replicas since start.",
+                               gauge_replication_records);
+        metrics_register_gauge("edcs_replication_dropped",
+                               "State changes dropped because the replication log was full; replicas resync.",
+                               gauge_replication_dropped);
+        metrics_register_gauge("edcs_replicas", "Read replicas connected.", gauge_replicas);
+    }
+    if (config.query_socket) {
+        metrics_register_gauge("edcs_query_requests", "Spatial queries answered since start.",
+                               gauge_query_requests);
+        metrics_register_gauge("edcs_query_snapshot_age_seconds", "Age of the snapshot queries are answered from.",
+                               gauge_query_age);
+        metrics_register_gauge("edcs_query_snapshot_build_seconds", "Time the last query snapshot took to build.",
+                               gauge_query_build);
+    }
+}
@@ -0,0 +1,319 @@
+/**
+ * @file sim.c
+ * @brief Tick-based fleet simulation over contiguous arrays.
+ *
+ * Replaces the old thread-per-drone simulator: instead of one thread per
+ * drone spinning on usleep() and locks, one loop advances every drone by a
+ * fixed timestep. A tick runs four phases:
+ *   1. spawn    - survivors arrive at the configured rate (seeded rand_r), or
+ *                 as a scenario (scenario.c) says
+ *   2. dispatch - the oldest waiting survivor goes to the nearest idle drone,
+ *                 found by searching the idle buckets ring by ring
+ *   3. move     - busy drones fly x then y; workers each take an index range
+ *                 and only write their own drones and arrival list
+ *   4. commit   - arrivals are applied in drone index order, so rescues and
+ *                 the idle index come out the same for any worker count
+ */
+#include "headers/sim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int bucket_of(const SimWorld *w, int x, int y) {
+    return (y >> SIM_BUCKET_SHIFT) * w->buckets_x + (x >> SIM_BUCKET_SHIFT);
+}
+
+static void idle_insert(SimWorld *w, int d) {
+    int b = bucket_of(w, w->x[d], w->y[d]);
+    w->idle_prev[d] = -1;
+    w->idle_next[d] = w->bucket_head[b];
+    if (w->bucket_head[b] >= 0) w->idle_prev[w->bucket_head[b]] = d;
+    w->bucket_head[b] = d;
+    w->idle++;
+}
+
+static void idle_remove(SimWorld *w, int d) {
+    if (w->idle_prev[d] >= 0) w->idle_next[w->idle_prev[d]] = w->idle_next[d];
+    else w->bucket_head[bucket_of(w, w->x[d], w->y[d])] = w->idle_next[d];
+    if (w->idle_next[d] >= 0) w->idle_prev[w->idle_next[d]] = w->idle_prev[d];
+    w->idle--;
+}
+
+// The idle drone nearest to (x, y), searching the buckets in rings around
+// its own until no further ring can hold anything closer. -1 if none.
+static int nearest_idle(const SimWorld *w, int x, int y) {
+    int cx = x >> SIM_BUCKET_SHIFT, cy = y >> SIM_BUCKET_SHIFT;
+    int rings = w->buckets_x > w->buckets_y ? w->buckets_x : w->buckets_y;
+    int best = -1, best_dist = 0;
+    for (int r = 0; r < rings; r++) {
+        // Every cell of ring r is at least this far off along one axis
+        if (best >= 0 && r > 0 && ((r - 1) << SIM_BUCKET_SHIFT) + 1 > best_dist) break;
+        for (int by = cy - r; by <= cy + r; by++) {
+            if (by < 0 || by >= w->buckets_y) continue;
+            int edge = by == cy - r || by == cy + r;
+            for (int bx = cx - r; bx <= cx + r; bx += edge ? 1 : 2 * r) {
+                if (bx >= 0 && bx < w->buckets_x) {
+                    for (int d = w->bucket_head[by * w->buckets_x + bx]; d >= 0; d = w->idle_next[d]) {
+                        int dist = abs(w->x[d] - x) + abs(w->y[d] - y);
+                        if (best < 0 || dist < best_dist) {
+                            best = d;
+                            best_dist = dist;
+                        }
+                    }
+                }
+                if (r == 0) break;
+            }
+        }
+    }
+    return best;
+}
+
+static void move_range(SimWorker *k) {
+    SimWorld *w = k->world;
+    k->count = 0;
+    for (int i = k->from; i < k->to; i++) {
+        if (w->mission[i] < 0) continue;
+        float progress = w->progress[i] + w->speed[i] * (float)w->dt;
+        int x = w->x[i], y = w->y[i], tx = w->tx[i], ty = w->ty[i];
+        for (; progress >= 1 && (x != tx || y != ty); progress -= 1) {
+            if (x != tx) x += x < tx ? 1 : -1;
+            else y += y < ty ? 1 : -1;
+        }
+        w->x[i] = x;
+        w->y[i] = y;
+        w->progress[i] = progress;
+        if (x == tx && y == ty) k->arrived[k->count++] = i;
+    }
+}
+
+static void *worker_loop(void *arg) {
+    SimWorker *k = (SimWorker *)arg;
+    SimWorld *w = k->world;
+    // The barriers exist only once sim_init has started every worker
+    pthread_mutex_lock(&w->starting);
+    pthread_mutex_unlock(&w->starting);
+    if (w->stopping) return NULL;
+    for (;;) {
+        pthread_barrier_wait(&w->start);
+        if (w->stopping) break;
+        move_range(k);
+        pthread_barrier_wait(&w->done);
+    }
+    return NULL;
+}
+
+int sim_init(SimWorld *w, int width, int height, int drones, double speed, double dt,
+             double survivors_per_second, int max_waiting, unsigned int seed, int workers) {
+    memset(w, 0, sizeof(*w));
+    if (width <= 0 || height <= 0 || drones <= 0 || max_waiting <= 0 || dt <= 0) return -1;
+    if (workers < 1) workers = 1;
+    if (workers > SIM_MAX_WORKERS) workers = SIM_MAX_WORKERS;
+    w->width = width;
+    w->height = height;
+    w->dt = dt;
+    w->drones = drones;
+    w->buckets_x = ((width - 1) >> SIM_BUCKET_SHIFT) + 1;
+    w->buckets_y = ((height - 1) >> SIM_BUCKET_SHIFT) + 1;
+    w->survivors = max_waiting + drones;  // waiting, plus one in flight per drone
+    w->rate = survivors_per_second * dt;
+    w->seed = seed;
+
+    size_t n = drones, s = w->survivors;
+    w->x = malloc(sizeof(int) * n);
+    w->y = malloc(sizeof(int) * n);
+    w->tx = malloc(sizeof(int) * n);
+    w->ty = malloc(sizeof(int) * n);
+    w->speed = malloc(sizeof(float) * n);
+    w->progress = calloc(n, sizeof(float));
+    w->mission = malloc(sizeof(int) * n);
+    w->idle_next = malloc(sizeof(int) * n);
+    w->idle_prev = malloc(sizeof(int) * n);
+    w->bucket_head = malloc(sizeof(int) * w->buckets_x * w->buckets_y);
+    w->sx = malloc(sizeof(int) * s);
+    w->sy = malloc(sizeof(int) * s);
+    w->born = malloc(sizeof(long) * s);
+    w->free_list = malloc(sizeof(int) * s);
+    w->queue = malloc(sizeof(int) * max_waiting);
+    if (!w->x || !w->y || !w->tx || !w->ty || !w->speed || !w->progress || !w->mission || !w->idle_next ||
+        !w->idle_prev || !w->bucket_head || !w->sx || !w->sy || !w->born || !w->free_list || !w->queue) {
+        perror("Failed to allocate simulation");
+        sim_free(w);
+        return -1;
+    }
+    for (int b = 0; b < w->buckets_x * w->buckets_y; b++) w->bucket_head[b] = -1;
+    for (int i = 0; i < drones; i++) {
+        w->x[i] = w->tx[i] = rand_r(&w->seed) % width;
+        w->y[i] = w->ty[i] = rand_r(&w->seed) % height;
+        w->speed[i] = (float)speed;
+        w->mission[i] = -1;
+        idle_insert(w, i);
+    }
+    for (int i = 0; i < w->survivors; i++) w->free_list[i] = w->survivors - 1 - i;
+    w->free_count = w->survivors;
+
+    // Worker k moves drones [k * n / workers, (k + 1) * n / workers). The
+    // barriers are sized once every worker is running; one that fails to
+    // start sends the others home before they reach a barrier.
+    if (workers > 1) {
+        pthread_mutex_init(&w->starting, NULL);
+        pthread_mutex_lock(&w->starting);
+    }
+    int k;
+    for (k = 0; k < workers; k++) {
+        SimWorker *worker = &w->workers[k];
+        worker->world = w;
+        worker->from = (int)((long)k * drones / workers);
+        worker->to = (int)((long)(k + 1) * drones / workers);
+        worker->arrived = malloc(sizeof(int) * (worker->to - worker->from + 1));
+        if (!worker->arrived || (k > 0 && pthread_create(&worker->thread, NULL, worker_loop, worker) != 0)) break;
+    }
+    if (k < workers) {
+        fprintf(stderr, "Failed to start simulation worker %d\n", k);
+        if (workers > 1) {
+            w->stopping = 1;
+            pthread_mutex_unlock(&w->starting);
+            for (int j = 1; j < k; j++) pthread_join(w->workers[j].thread, NULL);
+            pthread_mutex_destroy(&w->starting);
+        }
+        sim_free(w);
+        return -1;
+    }
+    w->nworkers = workers;
+    if (workers > 1) {
+        pthread_barrier_init(&w->start, NULL, workers);
+        pthread_barrier_init(&w->done, NULL, workers);
+        pthread_mutex_unlock(&w->starting);
+    }
+    return 0;
+}
+
+static void spawn(SimWorld *w) {
+    int max_waiting = w->survivors - w->drones;
+    long count;
+    if (w->scenario) {
+        count = scenario_tick(w->scenario);
+    } else {
+        w->owed += w->rate;
+        count = (long)w->owed;
+        w->owed -= count;
+    }
+    for (; count > 0; count--) {
+        int x, y;
+        if (w->scenario) {
+            ScenarioArrival a;
+            scenario_place(w->scenario, NULL, &a);
+            x = a.coord.x;
+            y = a.coord.y;
+        } else {
+            x = rand_r(&w->seed) % w->width;
+            y = rand_r(&w->seed) % w->height;
+        }
+        if (w->queue_count == max_waiting || w->free_count == 0) {
+            w->dropped++;
+            continue;
+        }
+        int s = w->free_list[--w->free_count];
+        w->sx[s] = x;
+        w->sy[s] = y;
+        w->born[s] = w->tick;
+        w->queue[(w->queue_head + w->queue_count++) % max_waiting] = s;
+        w->spawned++;
+    }
+}
+
+static void dispatch(SimWorld *w) {
+    int max_waiting = w->survivors - w->drones;
+    while (w->queue_count > 0 && w->idle > 0) {
+        int s = w->queue[w->queue_head];
+        int d = nearest_idle(w, w->sx[s], w->sy[s]);
+        if (d < 0) break;
+        w->queue_head = (w->queue_head + 1) % max_waiting;
+        w->queue_count--;
+        idle_remove(w, d);
+        w->mission[d] = s;
+        w->tx[d] = w->sx[s];
+        w->ty[d] = w->sy[s];
+        w->progress[d] = 0;
+    }
+}
+
+static void commit(SimWorld *w) {
+    for (int k = 0; k < w->nworkers; k++) {
+        SimWorker *worker = &w->workers[k];
+        for (int i = 0; i < worker->count; i++) {
+            int d = worker->arrived[i];
+            int s = w->mission[d];
+            long waited = w->tick - w->born[s];
+            w->wait[waited < SIM_WAIT_SLOTS ? waited : SIM_WAIT_SLOTS - 1]++;
+            w->rescued++;
+            w->free_list[w->free_count++] = s;
+            w->mission[d] = -1;
+            w->progress[d] = 0;
+            idle_insert(w, d);
+        }
+    }
+}
+
+void sim_step(SimWorld *w) {
+    spawn(w);
+    dispatch(w);
+    w->busy_ticks += w->drones - w->idle;
+    if (w->nworkers > 1) pthread_barrier_wait(&w->start);
+    move_range(&w->workers[0]);
+    if (w->nworkers > 1) pthread_barrier_wait(&w->done);
+    commit(w);
+    w->tick++;
+}
+
+void sim_free(SimWorld *w) {
+    if (w->nworkers > 1) {
+        w->stopping = 1;
+        pthread_barrier_wait(&w->start);
+        for (int k = 1; k < w->nworkers; k++) pthread_join(w->workers[k].thread, NULL);
+        pthread_barrier_destroy(&w->start);
+        pthread_barrier_destroy(&w->done);
+        pthread_mutex_destroy(&w->starting);
+    }
+    for (int k = 0; k < SIM_MAX_WORKERS; k++) free(w->workers[k].arrived);
+    free(w->x);
+    free(w->y);
+    free(w->tx);
+    free(w->ty);
+    free(w->speed);
+    free(w->progress);
+    free(w->mission);
+    free(w->idle_next);
+    free(w->idle_prev);
+    free(w->bucket_head);
+    free(w->sx);
+    free(w->sy);
+    free(w->born);
+    free(w->free_list);
+    free(w->queue);
+    memset(w, 0, sizeof(*w));
+}
+
+// Arrival-to-rescue time in simulated seconds at quantile q.
+double sim_wait_quantile(const SimWorld *w, double q) {
+    long target = (long)(q * w->rescued + 0.5), seen = 0;
+    if (w->rescued == 0) return 0;
+    if (target < 1) target = 1;
+    for (int t = 0; t < SIM_WAIT_SLOTS; t++) {
+        seen += w->wait[t];
+        if (seen >= target) return t * w->dt;
+    }
+    return (SIM_WAIT_SLOTS - 1) * w->dt;
+}
+
+// FNV-1a over every drone's position and mission, to compare runs.
+uint64_t sim_checksum(const SimWorld *w) {
+    uint64_t h = 1469598103934665603ULL;
+    for (int i = 0; i < w->drones; i++) {
+        uint32_t v[3] = {(uint32_t)w->x[i], (uint32_t)w->y[i], (uint32_t)w->mission[i]};
+        for (int j = 0; j < 3; j++) {
+            h ^= v[j];
+            h *= 1099511628211ULL;
+        }
+    }
+    return h ^ (uint64_t)w->rescued;
+}
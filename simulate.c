@@ -0,0 +1,144 @@
+/**
+ * @file simulate.c
+ * @brief Offline capacity planning with the tick-based fleet simulation.
+ *
+ * Runs sim.c for a fixed number of ticks with no server, sockets or drone
+ * threads, then reports how fast it ran and what the fleet achieved:
+ * survivors spawned, rescued and dropped (queue full), drone utilisation
+ * and arrival-to-rescue wait quantiles in simulated seconds. The checksum
+ * covers every drone's final state; the same seed gives the same checksum
+ * for any --workers, which is how the parallel move phase is checked.
+ * --scenario file takes arrivals and placement from a scenario (scenario.c)
+ * instead of the flat --survivor-rate, ticking at --tick-ms.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include "headers/sim.h"
+
+static struct {
+    int drones;
+    int width, height;
+    long ticks;
+    double tick_ms;
+    double speed;
+    double survivor_rate;
+    int max_waiting;
+    unsigned int seed;
+    int workers;
+    const char *scenario;
+    const char *out_path;
+} opts = {
+    .drones = 100000,
+    .width = 2000,
+    .height = 2000,
+    .ticks = 1000,
+    .tick_ms = 100,
+    .speed = 2,
+    .survivor_rate = 5000,
+    .max_waiting = 0,
+    .seed = 1,
+    .workers = 1,
+    .out_path = "sim_report.json",
+};
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [--drones n] [--map WxH] [--ticks n] [--tick-ms x] [--speed cells/s]\n"
+            "          [--survivor-rate r] [--scenario file] [--max-waiting n] [--seed n] [--workers n]\n"
+            "          [--out file]\n", prog);
+}
+
+static int parse_args(int argc, char **argv) {
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[++i] : NULL;
+        if (!value) return -1;
+        if (strcmp(arg, "--drones") == 0) opts.drones = atoi(value);
+        else if (strcmp(arg, "--map") == 0) {
+            if (sscanf(value, "%dx%d", &opts.width, &opts.height) != 2) return -1;
+        } else if (strcmp(arg, "--ticks") == 0) opts.ticks = atol(value);
+        else if (strcmp(arg, "--tick-ms") == 0) opts.tick_ms = atof(value);
+        else if (strcmp(arg, "--speed") == 0) opts.speed = atof(value);
+        else if (strcmp(arg, "--survivor-rate") == 0) opts.survivor_rate = atof(value);
+        else if (strcmp(arg, "--max-waiting") == 0) opts.max_waiting = atoi(value);
+        else if (strcmp(arg, "--seed") == 0) opts.seed = (unsigned int)strtoul(value, NULL, 10);
+        else if (strcmp(arg, "--workers") == 0) opts.workers = atoi(value);
+        else if (strcmp(arg, "--scenario") == 0) opts.scenario = value;
+        else if (strcmp(arg, "--out") == 0) opts.out_path = value;
+        else return -1;
+    }
+    if (opts.max_waiting <= 0) opts.max_waiting = opts.drones * 4;
+    if (opts.drones < 1 || opts.width < 1 || opts.height < 1 || opts.ticks < 1 || opts.tick_ms <= 0) return -1;
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (parse_args(argc, argv) != 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    static SimWorld world;
+    static Scenario scenario;
+    if (opts.scenario && scenario_load(&scenario, opts.scenario) != 0) return 1;
+    if (sim_init(&world, opts.width, opts.height, opts.drones, opts.speed, opts.tick_ms / 1000.0,
+                 opts.survivor_rate, opts.max_waiting, opts.seed, opts.workers) != 0) {
+        fprintf(stderr, "Failed to set up the simulation\n");
+        return 1;
+    }
+    if (opts.scenario) {
+        // The scenario advances with the simulation's ticks, not its own
+        scenario.tick_ms = opts.tick_ms;
+        scenario_start(&scenario, opts.width, opts.height, opts.seed);
+        world.scenario = &scenario;
+    }
+    printf("Simulating %d drones on %dx%d for %ld ticks of %.0f ms (%d workers, seed %u)\n", opts.drones,
+           opts.width, opts.height, opts.ticks, opts.tick_ms, world.nworkers, opts.seed);
+
+    double started = now_seconds();
+    for (long t = 0; t < opts.ticks; t++) sim_step(&world);
+    double wall = now_seconds() - started;
+
+    double simulated = world.tick * world.dt;
+    double utilisation = (double)world.busy_ticks / ((double)world.tick * world.drones);
+    double p50 = sim_wait_quantile(&world, 0.5), p90 = sim_wait_quantile(&world, 0.9);
+    double p99 = sim_wait_quantile(&world, 0.99);
+    uint64_t checksum = sim_checksum(&world);
+    printf("%.1f ticks/s, %.1f simulated seconds per second\n", world.tick / wall, simulated / wall);
+    printf("survivors: %ld spawned, %ld rescued, %ld dropped, %d waiting\n", world.spawned, world.rescued,
+           world.dropped, world.queue_count);
+    printf("utilisation: %.1f%%, wait p50 %.1fs p90 %.1fs p99 %.1fs\n", utilisation * 100, p50, p90, p99);
+    printf("checksum: %016" PRIx64 "\n", checksum);
+
+    FILE *out = fopen(opts.out_path, "w");
+    if (out) {
+        fprintf(out, "{\n  \"drones\": %d,\n  \"width\": %d,\n  \"height\": %d,\n", opts.drones, opts.width,
+                opts.height);
+        fprintf(out, "  \"ticks\": %ld,\n  \"tick_ms\": %g,\n  \"speed\": %g,\n  \"survivor_rate\": %g,\n",
+                world.tick, opts.tick_ms, opts.speed, opts.survivor_rate);
+        fprintf(out, "  \"seed\": %u,\n  \"workers\": %d,\n", opts.seed, world.nworkers);
+        if (opts.scenario) fprintf(out, "  \"scenario\": \"%s\",\n", opts.scenario);
+        fprintf(out, "  \"ticks_per_sec\": %.1f,\n  \"simulated_seconds_per_sec\": %.1f,\n", world.tick / wall,
+                simulated / wall);
+        fprintf(out, "  \"spawned\": %ld,\n  \"rescued\": %ld,\n  \"dropped\": %ld,\n  \"waiting\": %d,\n",
+                world.spawned, world.rescued, world.dropped, world.queue_count);
+        fprintf(out, "  \"utilisation\": %.4f,\n", utilisation);
+        fprintf(out, "  \"wait_s\": {\"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f},\n", p50, p90, p99);
+        fprintf(out, "  \"checksum\": \"%016" PRIx64 "\"\n}\n", checksum);
+        fclose(out);
+        printf("Report written to %s\n", opts.out_path);
+    } else {
+        perror("fopen report");
+    }
+    sim_free(&world);
+    return 0;
+}
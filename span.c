@@ -0,0 +1,269 @@
+/**
+ * @file span.c
+ * @brief Sampled latency spans in per-thread buffers, dumped as Chrome trace JSON.
+ *
+ * Every thread that records gets a ring of SPAN_BUFFER_EVENTS events, found
+ * through a thread-local pointer and guarded by its own mutex, which only a
+ * dump ever contends for. Disabled, a span costs one load and a branch;
+ * enabled, an unsampled root span costs a thread-local countdown. The dump
+ * copies every buffer, writes complete ("X") events for spans and
+ * begin/end ("b"/"e") pairs for the async waits between threads, and joins
+ * the spans of each trace id with flow events so the viewer draws arrows
+ * from a survivor's creation to its dispatch, the mission send and the
+ * rescue. It writes to a temporary file and renames it over the output, so
+ * a dump taken with SIGUSR1 while the server runs is never half written.
+ */
+#define _GNU_SOURCE
+#include "headers/span.h"
+#include "headers/metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/syscall.h>
+
+typedef struct span_event {
+    const char *name;
+    uint64_t trace_id;
+    uint64_t start_ns;
+    uint64_t end_ns;
+    int async;
+    int tid;             // filled in when a dump copies the event
+} SpanEvent;
+
+typedef struct span_buffer {
+    pthread_mutex_t lock;
+    int tid;
+    uint64_t written;    // events ever recorded; the ring keeps the last SPAN_BUFFER_EVENTS
+    SpanEvent events[SPAN_BUFFER_EVENTS];
+    struct span_buffer *next;
+} SpanBuffer;
+
+int span_enabled = 0;
+
+static const char *out_path;
+static int sample_every = SPAN_DEFAULT_SAMPLE;
+static uint64_t origin_ns;
+static uint64_t next_trace_id = 0;
+static pthread_mutex_t buffers_lock = PTHREAD_MUTEX_INITIALIZER;
+static SpanBuffer *buffers = NULL;
+
+static __thread SpanBuffer *local;
+static __thread uint64_t current_id;   // trace id of the innermost recorded span
+static __thread int depth;             // spans open on this thread, recorded or not
+static __thread int countdown;         // roots until the next sampled one
+
+static SpanBuffer *local_buffer() {
+    if (local) return local;
+    SpanBuffer *b = calloc(1, sizeof(SpanBuffer));
+    if (!b) return NULL;
+    pthread_mutex_init(&b->lock, NULL);
+    b->tid = (int)syscall(SYS_gettid);
+    pthread_mutex_lock(&buffers_lock);
+    b->next = buffers;
+    buffers = b;
+    pthread_mutex_unlock(&buffers_lock);
+    local = b;
+    return b;
+}
+
+static void push(const char *name, uint64_t trace_id, uint64_t start_ns, uint64_t end_ns, int async) {
+    SpanBuffer *b = local_buffer();
+    if (!b) return;
+    pthread_mutex_lock(&b->lock);
+    b->events[b->written % SPAN_BUFFER_EVENTS] =
+        (SpanEvent){.name = name, .trace_id = trace_id, .start_ns = start_ns, .end_ns = end_ns, .async = async};
+    b->written++;
+    pthread_mutex_unlock(&b->lock);
+}
+
+int span_open(const char *path, int sample) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror("Failed to open span file");
+        return -1;
+    }
+    fclose(file);
+    out_path = path;
+    sample_every = sample > 0 ? sample : 1;
+    origin_ns = metrics_now_ns();
+    __atomic_store_n(&span_enabled, 1, __ATOMIC_RELEASE);
+    printf("Recording 1 in %d spans to %s (SIGUSR1 dumps)\n", sample_every, path);
+    return 0;
+}
+
+// Writes the last dump. Call once nothing records any more.
+void span_close() {
+    if (!span_enabled) return;
+    span_dump();
+    __atomic_store_n(&span_enabled, 0, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&buffers_lock);
+    while (buffers) {
+        SpanBuffer *next = buffers->next;
+        pthread_mutex_destroy(&buffers->lock);
+        free(buffers);
+        buffers = next;
+    }
+    pthread_mutex_unlock(&buffers_lock);
+    local = NULL;
+}
+
+// A fresh trace id for one in --span-sample calls on this thread, else 0.
+uint64_t span_new_trace() {
+    if (!__atomic_load_n(&span_enabled, __ATOMIC_RELAXED)) return 0;
+    if (--countdown > 0) return 0;
+    countdown = sample_every;
+    return __atomic_add_fetch(&next_trace_id, 1, __ATOMIC_RELAXED);
+}
+
+// The trace id of the innermost recorded span on this thread, 0 if none.
+uint64_t span_current() {
+    return current_id;
+}
+
+// Recorded inside a recorded span, whose trace id it joins, or as a
+// sampled root; not recorded inside an unsampled one.
+void span_begin(Span *sp, const char *name) {
+    sp->name = NULL;
+    sp->start_ns = 0;
+    if (!__atomic_load_n(&span_enabled, __ATOMIC_RELAXED)) return;
+    sp->name = name;
+    uint64_t id = current_id ? current_id : depth == 0 ? span_new_trace() : 0;
+    depth++;
+    if (!id) return;
+    sp->trace_id = id;
+    sp->parent_id = current_id;
+    current_id = id;
+    sp->start_ns = metrics_now_ns();
+}
+
+// Recorded exactly when trace_id is not 0, whatever encloses it.
+void span_begin_trace(Span *sp, const char *name, uint64_t trace_id) {
+    sp->name = NULL;
+    sp->start_ns = 0;
+    if (!__atomic_load_n(&span_enabled, __ATOMIC_RELAXED)) return;
+    sp->name = name;
+    depth++;
+    if (!trace_id) return;
+    sp->trace_id = trace_id;
+    sp->parent_id = current_id;
+    current_id = trace_id;
+    sp->start_ns = metrics_now_ns();
+}
+
+void span_end(Span *sp) {
+    if (!sp->name) return;
+    depth--;
+    if (!sp->start_ns) return;
+    current_id = sp->parent_id;
+    push(sp->name, sp->trace_id, sp->start_ns, metrics_now_ns(), 0);
+}
+
+// A wait that starts on one thread and ends on another, e.g. in a queue.
+void span_async(const char *name, uint64_t trace_id, uint64_t start_ns, uint64_t end_ns) {
+    if (!trace_id || !start_ns || !__atomic_load_n(&span_enabled, __ATOMIC_RELAXED)) return;
+    push(name, trace_id, start_ns, end_ns > start_ns ? end_ns : start_ns, 1);
+}
+
+static int compare_flow(const void *a, const void *b) {
+    const SpanEvent *x = *(SpanEvent *const *)a, *y = *(SpanEvent *const *)b;
+    if (x->trace_id != y->trace_id) return x->trace_id < y->trace_id ? -1 : 1;
+    if (x->start_ns != y->start_ns) return x->start_ns < y->start_ns ? -1 : 1;
+    // Enclosing spans first
+    if (x->end_ns != y->end_ns) return x->end_ns > y->end_ns ? -1 : 1;
+    return 0;
+}
+
+static double micros(uint64_t ns) {
+    return ns > origin_ns ? (ns - origin_ns) / 1000.0 : 0;
+}
+
+// Returns the number of spans written, or -1.
+int span_dump() {
+    if (!span_enabled) return -1;
+    size_t capacity = 0;
+    pthread_mutex_lock(&buffers_lock);
+    for (SpanBuffer *b = buffers; b != NULL; b = b->next) capacity += SPAN_BUFFER_EVENTS;
+    SpanEvent *events = malloc(sizeof(SpanEvent) * (capacity ? capacity : 1));
+    SpanEvent **flows = malloc(sizeof(SpanEvent *) * (capacity ? capacity : 1));
+    size_t count = 0;
+    for (SpanBuffer *b = buffers; events && flows && b != NULL; b = b->next) {
+        pthread_mutex_lock(&b->lock);
+        uint64_t first = b->written > SPAN_BUFFER_EVENTS ? b->written - SPAN_BUFFER_EVENTS : 0;
+        for (uint64_t i = first; i < b->written; i++) {
+            events[count] = b->events[i % SPAN_BUFFER_EVENTS];
+            events[count++].tid = b->tid;
+        }
+        pthread_mutex_unlock(&b->lock);
+    }
+    pthread_mutex_unlock(&buffers_lock);
+    if (!events || !flows) {
+        perror("Failed to allocate span dump");
+        free(events);
+        free(flows);
+        return -1;
+    }
+
+    char tmp[1024];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", out_path);
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        perror("Failed to write spans");
+        free(events);
+        free(flows);
+        return -1;
+    }
+    int pid = (int)getpid();
+    size_t flow_count = 0;
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"edcs server\"}}", pid);
+    for (size_t i = 0; i < count; i++) {
+        SpanEvent *e = &events[i];
+        if (e->async) {
+            fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"wait\", \"ph\": \"b\", \"id\": \"0x%llx\", "
+                         "\"ts\": %.3f, \"pid\": %d, \"tid\": %d}",
+                    e->name, (unsigned long long)e->trace_id, micros(e->start_ns), pid, e->tid);
+            fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"wait\", \"ph\": \"e\", \"id\": \"0x%llx\", "
+                         "\"ts\": %.3f, \"pid\": %d, \"tid\": %d}",
+                    e->name, (unsigned long long)e->trace_id, micros(e->end_ns), pid, e->tid);
+        } else {
+            fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"span\", \"ph\": \"X\", \"ts\": %.3f, \"dur\": %.3f, "
+                         "\"pid\": %d, \"tid\": %d, \"args\": {\"trace_id\": \"0x%llx\"}}",
+                    e->name, micros(e->start_ns), (e->end_ns - e->start_ns) / 1000.0, pid, e->tid,
+                    (unsigned long long)e->trace_id);
+            flows[flow_count++] = e;
+        }
+    }
+
+    // One flow per trace id through its spans in time order, skipping
+    // spans nested in the previous point on the same thread
+    qsort(flows, flow_count, sizeof(SpanEvent *), compare_flow);
+    for (size_t i = 0; i < flow_count;) {
+        size_t end = i;
+        while (end < flow_count && flows[end]->trace_id == flows[i]->trace_id) end++;
+        size_t kept = i;
+        for (size_t j = i + 1; j < end; j++) {
+            SpanEvent *prev = flows[kept];
+            if (flows[j]->tid == prev->tid && flows[j]->end_ns <= prev->end_ns) continue;
+            flows[++kept] = flows[j];
+        }
+        for (size_t j = i; kept > i && j <= kept; j++) {
+            const char *ph = j == i ? "s" : j == kept ? "f" : "t";
+            fprintf(out, ",\n{\"name\": \"trace\", \"cat\": \"flow\", \"ph\": \"%s\", \"bp\": \"e\", "
+                         "\"id\": \"0x%llx\", \"ts\": %.3f, \"pid\": %d, \"tid\": %d}",
+                    ph, (unsigned long long)flows[j]->trace_id, micros(flows[j]->start_ns), pid, flows[j]->tid);
+        }
+        i = end;
+    }
+    fprintf(out, "\n]}\n");
+    int failed = fclose(out) != 0;
+    free(events);
+    free(flows);
+    if (failed || rename(tmp, out_path) != 0) {
+        perror("Failed to write spans");
+        return -1;
+    }
+    printf("Wrote %zu spans to %s\n", count, out_path);
+    return (int)count;
+}
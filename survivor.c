@@ -4,13 +4,30 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <unistd.h>
 #include "headers/globals.h"
 #include "headers/map.h"
+#include "headers/metrics.h"
+#include "headers/region.h"
+#include "headers/workpool.h"
+#include "headers/ai.h"
+#include "headers/heatmap.h"
+#include "headers/scenario.h"
+#include "headers/span.h"
+#include "headers/federation.h"
 #include <signal.h>
 
 extern volatile sig_atomic_t global_shutdown_flag;
 
+// One generator task per tick posts that tick's arrivals, so the workload
+// depends only on the scenario and seed, never on timing.
+#define SURVIVOR_LOG_BATCH 8     // larger batches are logged as one line
+
+static Scenario scenario;
+static uint64_t generator_started_ns;
+static uint64_t generator_tick_ns;
+static long generated = 0;
+static uint64_t next_id = 0;
+
 Survivor *create_survivor(Coord *coord, char *info, struct tm *discovery_time) {
     Survivor *s = malloc(sizeof(Survivor));
     if (!s) return NULL;
@@ -19,57 +36,146 @@ Survivor *create_survivor(Coord *coord, char *info, struct tm *discovery_time) {
     memcpy(&s->discovery_time, discovery_time, sizeof(struct tm));
     strncpy(s->info, info, sizeof(s->info) - 1);
     s->info[sizeof(s->info) - 1] = '\0';
-    s->status = 0;
+    s->state = SURVIVOR_WORD(SURVIVOR_OPEN, -1);
+    s->id = __atomic_add_fetch(&next_id, 1, __ATOMIC_RELAXED);
+    s->discovered_ns = metrics_now_ns();
+    s->need = PAYLOAD_ANY;
     return s;
 }
 
-void *survivor_generator(void *args) {
-    printf("Survivor generator thread running!\n");
-    (void)args;
+uint64_t survivor_state(const Survivor *s) {
+    return __atomic_load_n(&s->state, __ATOMIC_ACQUIRE);
+}
+
+// Returns 0 if the word still held expected and now holds desired.
+int survivor_transition(Survivor *s, uint64_t expected, uint64_t desired) {
+    return __atomic_compare_exchange_n(&s->state, &expected, desired, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE) ? 0 : -1;
+}
+
+// Marks the survivor rescued by drone_id. Exactly one caller wins; everyone
+// else, including later callers, gets -1.
+int survivor_claim(Survivor *s, int drone_id) {
+    uint64_t word = survivor_state(s);
+    while (SURVIVOR_STATE(word) != SURVIVOR_RESCUED) {
+        if (__atomic_compare_exchange_n(&s->state, &word, SURVIVOR_WORD(SURVIVOR_RESCUED, drone_id), 0,
+                                        __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+// Creates one tick's survivors and posts them, one chain of messages per
+// region, to the regions that own them.
+static void generate_batch(int count) {
+    RegionMsg **first = calloc(region_count, sizeof(RegionMsg *));
+    RegionMsg **last = calloc(region_count, sizeof(RegionMsg *));
+    int *queued = calloc(region_count, sizeof(int));
+    if (!first || !last || !queued) {
+        perror("Failed to allocate survivor batch");
+        free(first);
+        free(last);
+        free(queued);
+        return;
+    }
     time_t t;
     struct tm discovery_time;
-    srand(time(NULL));
-
-    while (!global_shutdown_flag) {
-        Coord coord = {.x = rand() % map.width, .y = rand() % map.height};
-        
-        if (coord.x < 0 || coord.x >= map.width || coord.y < 0 || coord.y >= map.height) {
-            printf("Generated invalid coordinates (%d, %d), retrying...\n", coord.x, coord.y);
+    time(&t);
+    localtime_r(&t, &discovery_time);
+    int posted = 0;
+    Span batch;
+    span_begin(&batch, "survivor batch");
+    for (int i = 0; i < count; i++) {
+        Span sp;
+        uint64_t trace_id = span_new_trace();
+        span_begin_trace(&sp, "survivor created", trace_id);
+        ScenarioArrival a;
+        scenario_place(&scenario, &map.obstacles, &a);
+        if (!federation_local(a.coord.x, a.coord.y)) {
+            // Another server of the federation generates this one from the same seed
+            span_end(&sp);
             continue;
         }
-        
         char info[25];
-        snprintf(info, sizeof(info), "SURV-%04d", rand() % 10000);
-        time(&t);
-        localtime_r(&t, &discovery_time);
-
-        printf("Attempting to create survivor at (%d, %d)\n", coord.x, coord.y);
-        Survivor *s = create_survivor(&coord, info, &discovery_time);
-        if (!s) {
+        snprintf(info, sizeof(info), "SURV-%04d", a.tag);
+        Survivor *s = create_survivor(&a.coord, info, &discovery_time);
+        RegionMsg *m = s ? region_msg_new(REGION_MSG_SURVIVOR, NULL) : NULL;
+        if (!m) {
             printf("create_survivor failed!\n");
+            free(s);
+            span_end(&sp);
             continue;
         }
-        printf("create_survivor succeeded: %p\n", (void*)s);
-
-        printf("survivors->add pointer: %p\n", (void*)survivors->add);
-        survivors->add(survivors, s);
-        printf("After adding survivor to global list\n");
-        printf("Added survivor to global list at (%d, %d): %s\n", coord.x, coord.y, info);
+        s->need = a.need;
+        s->trace_id = trace_id;
+        heatmap_record(a.coord, s->discovered_ns);
+        m->survivor = s;
+        m->trace_id = trace_id;
+        int r = region_at(a.coord.x, a.coord.y) - regions;
+        if (last[r]) last[r]->next = m;
+        else first[r] = m;
+        last[r] = m;
+        queued[r]++;
+        posted++;
+        if (count <= SURVIVOR_LOG_BATCH) {
+            printf("New survivor at (%d,%d): %s needs %s\n", a.coord.x, a.coord.y, info, payload_name(a.need));
+        }
+        span_end(&sp);
+    }
+    // The owning region queues each survivor, puts it on the map and frees it once rescued
+    for (int r = 0; r < region_count; r++) {
+        if (first[r]) region_post_batch(&regions[r], first[r], last[r], queued[r]);
+    }
+    span_end(&batch);
+    __atomic_add_fetch(&generated, posted, __ATOMIC_RELAXED);
+    if (count > SURVIVOR_LOG_BATCH) printf("%d new survivors\n", posted);
+    free(first);
+    free(last);
+    free(queued);
+}
 
-        pthread_mutex_lock(&map.cells[coord.y][coord.x].survivors->lock);
-        map.cells[coord.y][coord.x].survivors->add(map.cells[coord.y][coord.x].survivors, s);
-        pthread_mutex_unlock(&map.cells[coord.y][coord.x].survivors->lock);
+// Generates one scenario tick and re-arms itself on schedule until shutdown
+// or the end of the scenario.
+static void generator_tick(void *arg) {
+    (void)arg;
+    if (global_shutdown_flag) return;
+    int count = scenario_tick(&scenario);
+    if (count > 0) generate_batch(count);
+    if (scenario_done(&scenario)) {
+        printf("Scenario finished: %ld survivors generated\n", survivors_generated());
+        return;
+    }
+    // A late tick shortens the next delay rather than shifting the schedule
+    uint64_t due = generator_started_ns + (uint64_t)scenario.tick * generator_tick_ns;
+    uint64_t now = metrics_now_ns();
+    workpool_after(due > now ? due - now : 0, generator_tick, NULL);
+}
 
-        printf("New survivor at (%d,%d): %s\n", coord.x, coord.y, info);
-        sleep(rand() % 3 + 2);
+// Call with the regions started. Returns -1 if the scenario cannot be loaded.
+int survivor_start() {
+    if (config.scenario) {
+        if (scenario_load(&scenario, config.scenario) != 0) return -1;
+    } else {
+        scenario_default(&scenario, config.survivor_rate, config.hotspots);
+    }
+    unsigned int seed = config.seed ? config.seed : (unsigned int)time(NULL);
+    scenario_start(&scenario, map.width, map.height, seed);
+    generator_tick_ns = (uint64_t)(scenario.tick_ms * 1e6);
+    generator_started_ns = metrics_now_ns();
+    if (workpool_after(generator_tick_ns, generator_tick, NULL) != 0) {
+        fprintf(stderr, "Failed to schedule survivor generation\n");
+        return -1;
     }
-    printf("Survivor generator thread exiting.\n");
-    return NULL;
+    printf("Survivor generation scheduled (seed %u).\n", seed);
+    return 0;
+}
+
+long survivors_generated() {
+    return __atomic_load_n(&generated, __ATOMIC_RELAXED);
 }
 
 void survivor_cleanup(Survivor *s) {
-    pthread_mutex_lock(&map.cells[s->coord.y][s->coord.x].survivors->lock);
-    map.cells[s->coord.y][s->coord.x].survivors->removedata(map.cells[s->coord.y][s->coord.x].survivors, s);
-    pthread_mutex_unlock(&map.cells[s->coord.y][s->coord.x].survivors->lock);
+    map_remove_survivor(s);
     free(s);
 }
\ No newline at end of file
@@ -0,0 +1,155 @@
+/**
+ * @file trace.c
+ * @brief Binary traffic recorder with a lock-free ring and a writer thread.
+ *
+ * Producers (connection tasks, region drains, the reactor) reserve space in
+ * a byte ring with one compare-and-swap on the head, copy their record in
+ * and publish it by storing its size last. The writer thread follows the
+ * tail: it waits for each record's size word, writes the record to the
+ * file, zeroes the space and releases it. A record that would run past the
+ * end of the ring is preceded by a skip marker and starts again at offset
+ * 0, so every record is contiguous. When the ring is full the record is
+ * dropped and counted rather than making the hot path wait.
+ */
+#include "headers/trace.h"
+#include "headers/metrics.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#define TRACE_ALIGN(n) (((uint64_t)(n) + 7) & ~(uint64_t)7)
+#define TRACE_SKIP 0x80000000u   // size word of a skip marker: the rest is the bytes to skip
+#define TRACE_MASK (TRACE_RING_BYTES - 1)
+
+static struct {
+    char *ring;
+    uint64_t head;       // bytes reserved since start
+    uint64_t tail;       // bytes written out and released
+    int active;
+    int stopping;
+    FILE *file;
+    pthread_t writer;
+    uint64_t started_ns;
+    uint64_t records;
+    uint64_t dropped;
+} trace;
+
+static void *trace_writer(void *arg) {
+    (void)arg;
+    for (;;) {
+        uint64_t tail = trace.tail;
+        char *at = trace.ring + (tail & TRACE_MASK);
+        uint32_t size = __atomic_load_n((uint32_t *)at, __ATOMIC_ACQUIRE);
+        if (size == 0) {
+            if (__atomic_load_n(&trace.stopping, __ATOMIC_ACQUIRE) &&
+                __atomic_load_n(&trace.head, __ATOMIC_ACQUIRE) == tail) {
+                break;
+            }
+            fflush(trace.file);
+            usleep(TRACE_IDLE_US);
+            continue;
+        }
+        uint64_t advance;
+        if (size & TRACE_SKIP) {
+            advance = size & ~TRACE_SKIP;
+        } else {
+            if (fwrite(at, 1, size, trace.file) != size) perror("Failed to write trace");
+            advance = TRACE_ALIGN(size);
+        }
+        // Stale bytes could otherwise look like a published size word later
+        memset(at, 0, advance);
+        __atomic_store_n(&trace.tail, tail + advance, __ATOMIC_RELEASE);
+    }
+    fflush(trace.file);
+    return NULL;
+}
+
+int trace_open(const char *path) {
+    trace.file = fopen(path, "wb");
+    if (!trace.file) {
+        perror("Failed to open trace file");
+        return -1;
+    }
+    trace.ring = calloc(1, TRACE_RING_BYTES);
+    if (!trace.ring) {
+        perror("Failed to allocate trace ring");
+        fclose(trace.file);
+        return -1;
+    }
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    TraceHeader header = {.version = TRACE_VERSION};
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.started_unix_ns = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    fwrite(&header, sizeof(header), 1, trace.file);
+
+    trace.head = trace.tail = 0;
+    trace.stopping = 0;
+    trace.started_ns = metrics_now_ns();
+    if (pthread_create(&trace.writer, NULL, trace_writer, NULL) != 0) {
+        perror("Failed to start trace writer");
+        free(trace.ring);
+        fclose(trace.file);
+        return -1;
+    }
+    __atomic_store_n(&trace.active, 1, __ATOMIC_RELEASE);
+    printf("Recording traffic to %s\n", path);
+    return 0;
+}
+
+// Call once nothing records any more (after the work pool has stopped).
+void trace_close() {
+    if (!trace.active) return;
+    __atomic_store_n(&trace.active, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&trace.stopping, 1, __ATOMIC_RELEASE);
+    pthread_join(trace.writer, NULL);
+    fclose(trace.file);
+    free(trace.ring);
+    trace.ring = NULL;
+    printf("Trace closed: %llu records, %llu dropped\n", (unsigned long long)trace.records,
+           (unsigned long long)trace.dropped);
+}
+
+void trace_record(TraceKind kind, int conn, const void *data, size_t len) {
+    if (!__atomic_load_n(&trace.active, __ATOMIC_ACQUIRE)) return;
+    uint64_t need = TRACE_ALIGN(sizeof(TraceRecord) + len);
+    if (need > TRACE_MAX_RECORD) {
+        __atomic_add_fetch(&trace.dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+    uint64_t head = __atomic_load_n(&trace.head, __ATOMIC_RELAXED);
+    uint64_t gap;
+    do {
+        uint64_t pos = head & TRACE_MASK;
+        gap = pos + need > TRACE_RING_BYTES ? TRACE_RING_BYTES - pos : 0;
+        if (head + gap + need - __atomic_load_n(&trace.tail, __ATOMIC_ACQUIRE) > TRACE_RING_BYTES) {
+            __atomic_add_fetch(&trace.dropped, 1, __ATOMIC_RELAXED);
+            return;
+        }
+    } while (!__atomic_compare_exchange_n(&trace.head, &head, head + gap + need, 1, __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+    uint64_t pos = head & TRACE_MASK;
+    if (gap) {
+        __atomic_store_n((uint32_t *)(trace.ring + pos), TRACE_SKIP | (uint32_t)gap, __ATOMIC_RELEASE);
+        pos = 0;
+    }
+    TraceRecord *r = (TraceRecord *)(trace.ring + pos);
+    r->conn = (uint32_t)conn;
+    r->ns = metrics_now_ns() - trace.started_ns;
+    r->kind = kind;
+    r->len = (uint32_t)len;
+    if (len) memcpy(r + 1, data, len);
+    __atomic_store_n(&r->size, (uint32_t)(sizeof(TraceRecord) + len), __ATOMIC_RELEASE);
+    __atomic_add_fetch(&trace.records, 1, __ATOMIC_RELAXED);
+}
+
+uint64_t trace_records() {
+    return __atomic_load_n(&trace.records, __ATOMIC_RELAXED);
+}
+
+uint64_t trace_dropped() {
+    return __atomic_load_n(&trace.dropped, __ATOMIC_RELAXED);
+}
@@ -4,6 +4,9 @@
 #include "headers/survivor.h"
 #include "headers/view.h"
 #include "headers/globals.h"
+#include "headers/region.h"
+#include "headers/metrics.h"
+#include "headers/lockprof.h"
 #include <SDL2/SDL_rect.h>
 #include <SDL2/SDL_render.h>
 #include <stdio.h>
@@ -13,6 +16,7 @@
 
 #define GRID_SIZE 30
 #define CELL_SIZE 20
+#define MAX_WINDOW_SIZE 4096  // larger maps have to run --headless
 #define GRID_COLOR 128, 128, 128, 255
 #define SURVIVOR_COLOR 255, 0, 0, 255
 #define DRONE_IDLE_COLOR 0, 0, 255, 255
@@ -47,6 +51,11 @@ int init_sdl_window() {
         window_width = 800;
         window_height = 600;
     }
+    if (window_width > MAX_WINDOW_SIZE || window_height > MAX_WINDOW_SIZE) {
+        fprintf(stderr, "Map %dx%d is too large to display; run with --headless\n", map.width, map.height);
+        SDL_Quit();
+        return -1;
+    }
 
     window = SDL_CreateWindow("Drone Simulator", SDL_WINDOWPOS_UNDEFINED,
                              SDL_WINDOWPOS_UNDEFINED, window_width,
@@ -114,64 +123,72 @@ void draw_drone(SDL_Renderer *renderer, int x, int y, DroneStatus status) {
 void draw_drones() {
     if (!drones || !renderer) return;
 
-    pthread_mutex_lock(&drones->lock);
+    uint64_t now = metrics_now_ns();
+    LOCK(&drones->lock);
     Node *current = drones->head;
     int drone_count = 0;
     while (current != NULL) {
         Drone *drone = (Drone *)current->data;
         if (drone) {
-            pthread_mutex_lock(&drone->lock);
+            LOCK(&drone->lock);
+            Coord at = drone_position(drone, now);
 
-            draw_drone(renderer, drone->coord.x, drone->coord.y, drone->status);
+            draw_drone(renderer, at.x, at.y, drone->status);
 
             if (drone->status == ON_MISSION) {
-                if (drone->target.x >= 0 && drone->target.x < map.width &&
-                    drone->target.y >= 0 && drone->target.y < map.height) {
-                    SDL_SetRenderDrawColor(renderer, GREEN.r, GREEN.g, GREEN.b, 200);
-                    SDL_RenderDrawLine(renderer, 
-                                     drone->coord.x * CELL_SIZE + CELL_SIZE / 2, 
-                                     drone->coord.y * CELL_SIZE + CELL_SIZE / 2, 
-                                     drone->target.x * CELL_SIZE + CELL_SIZE / 2, 
-                                     drone->target.y * CELL_SIZE + CELL_SIZE / 2);
+                // The leg in flight, then the rest of the tour
+                Coord from = at;
+                Coord to = drone->target;
+                int stop = drone->tour_stop;
+                SDL_SetRenderDrawColor(renderer, GREEN.r, GREEN.g, GREEN.b, 200);
+                while (map_in_bounds(to.x, to.y)) {
+                    SDL_RenderDrawLine(renderer,
+                                     from.x * CELL_SIZE + CELL_SIZE / 2,
+                                     from.y * CELL_SIZE + CELL_SIZE / 2,
+                                     to.x * CELL_SIZE + CELL_SIZE / 2,
+                                     to.y * CELL_SIZE + CELL_SIZE / 2);
+                    if (++stop >= drone->tour_len) break;
+                    from = to;
+                    to = drone->tour[stop];
                 }
             }
-            pthread_mutex_unlock(&drone->lock);
+            UNLOCK(&drone->lock);
         }
         drone_count++;
         current = current->next;
     }
     printf("[VIEW DEBUG] Total drones drawn: %d\n", drone_count);
-    pthread_mutex_unlock(&drones->lock);
+    UNLOCK(&drones->lock);
 }
 
 void draw_survivors() {
     static int last_count = -1;
-    if (!survivors || !renderer) return;
+    if (!regions || !renderer) return;
 
-    pthread_mutex_lock(&survivors->lock);
-    Node *current = survivors->head;
+    // Owners only mutate their own list under its lock, so drawing each one is safe
     int count = 0;
-    while (current != NULL) {
-        count++;
-        Survivor *s = (Survivor *)current->data;
-        if (s) {
+    for (int i = 0; i < region_count; i++) {
+        List *waiting = regions[i].survivors;
+        LOCK(&waiting->lock);
+        for (Node *current = waiting->head; current != NULL; current = current->next) {
+            count++;
+            Survivor *s = *(Survivor **)current->data;
             if (s->coord.x >= 0 && s->coord.x < map.width &&
                 s->coord.y >= 0 && s->coord.y < map.height) {
                 printf("[VIEW DEBUG] Drawing survivor at (%d, %d)\n", s->coord.x, s->coord.y);
                 draw_cell(s->coord.x, s->coord.y, RED);
             }
         }
-        current = current->next;
+        UNLOCK(&waiting->lock);
     }
     if (count != last_count) {
-        printf("draw_survivors: survivors in list = %d\n", count);
+        printf("draw_survivors: survivors waiting = %d\n", count);
         last_count = count;
     }
-    pthread_mutex_unlock(&survivors->lock);
 
     if (!helpedsurvivors || !renderer) return;
-    pthread_mutex_lock(&helpedsurvivors->lock);
-    current = helpedsurvivors->head;
+    LOCK(&helpedsurvivors->lock);
+    Node *current = helpedsurvivors->head;
     int helped_count = 0;
     while(current != NULL) {
         Survivor* s = (Survivor*)current->data;
@@ -187,7 +204,7 @@ void draw_survivors() {
         current = current->next;
     }
     printf("[VIEW DEBUG] Total helped survivors drawn: %d\n", helped_count);
-    pthread_mutex_unlock(&helpedsurvivors->lock);
+    UNLOCK(&helpedsurvivors->lock);
 }
 
 void draw_grid() {
@@ -204,6 +221,23 @@ void draw_grid() {
     }
 }
 
+// Each no-fly area as one filled rectangle
+void draw_obstacles() {
+    ObstacleGrid *g = &map.obstacles;
+    if (!obstacles_active(g)) return;
+    SDL_SetRenderDrawColor(renderer, GRAY.r, GRAY.g, GRAY.b, GRAY.a);
+    pthread_rwlock_rdlock(&g->lock);
+    for (int i = 0; i < g->count; i++) {
+        Rect a = g->areas[i];
+        int x0 = a.from.x < a.to.x ? a.from.x : a.to.x;
+        int y0 = a.from.y < a.to.y ? a.from.y : a.to.y;
+        SDL_Rect rect = {x0 * CELL_SIZE, y0 * CELL_SIZE, (abs(a.to.x - a.from.x) + 1) * CELL_SIZE,
+                         (abs(a.to.y - a.from.y) + 1) * CELL_SIZE};
+        SDL_RenderFillRect(renderer, &rect);
+    }
+    pthread_rwlock_unlock(&g->lock);
+}
+
 int draw_map() {
     if (!renderer) return -1;
 
@@ -211,6 +245,7 @@ int draw_map() {
     SDL_RenderClear(renderer);
 
     draw_grid();
+    draw_obstacles();
     draw_survivors();
     draw_drones();
 
@@ -0,0 +1,374 @@
+/**
+ * @file workpool.c
+ * @brief Fixed-size work-stealing worker pool with one-shot timers.
+ *
+ * All server work — parsing connection input, draining region inboxes,
+ * generating survivors, archiving rescues — runs as short tasks on a fixed
+ * set of worker threads, so the thread count does not grow with load.
+ * Each worker runs the oldest task of its own deque first; when that is
+ * empty it steals the newest task from another worker before going to
+ * sleep. Work queued behind one busy worker is therefore picked up by
+ * whichever cores are idle. A single timer thread turns workpool_after()
+ * deadlines into ordinary submissions.
+ */
+#define _GNU_SOURCE
+#include "headers/workpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+typedef struct timer_entry {
+    uint64_t due_ns;
+    Task task;
+} TimerEntry;
+
+static Worker *workers = NULL;
+static int worker_count = 0;
+static __thread Worker *current_worker = NULL;  // set on pool threads only
+static unsigned int submit_cursor = 0;
+
+static int running = 0;
+static long queued = 0;        // tasks sitting in deques
+static long outstanding = 0;   // submitted and not finished yet
+static long steals = 0;
+static int idle_workers = 0;
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+
+static pthread_t timer_thread;
+static int timers_accepting = 0;
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;   // on CLOCK_MONOTONIC
+static TimerEntry *timers = NULL;   // min-heap on due_ns
+static int timer_count = 0, timer_capacity = 0;
+
+static uint64_t monotonic_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* ---- per-worker deques ---- */
+
+static int deque_push(Worker *w, Task t) {
+    pthread_mutex_lock(&w->lock);
+    if (w->count == w->capacity) {
+        int capacity = w->capacity * 2;
+        Task *grown = malloc(capacity * sizeof(Task));
+        if (!grown) {
+            pthread_mutex_unlock(&w->lock);
+            perror("Failed to grow worker deque");
+            return -1;
+        }
+        for (int i = 0; i < w->count; i++) {
+            grown[i] = w->tasks[(w->head + i) % w->capacity];
+        }
+        free(w->tasks);
+        w->tasks = grown;
+        w->capacity = capacity;
+        w->head = 0;
+    }
+    w->tasks[(w->head + w->count) % w->capacity] = t;
+    w->count++;
+    __atomic_add_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+// The owner runs its tasks oldest first, so a busy worker stays fair to its connections.
+static int deque_pop_front(Worker *w, Task *out) {
+    pthread_mutex_lock(&w->lock);
+    int found = w->count > 0;
+    if (found) {
+        *out = w->tasks[w->head];
+        w->head = (w->head + 1) % w->capacity;
+        w->count--;
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+// Thieves take from the other end, away from the owner.
+static int deque_pop_back(Worker *w, Task *out) {
+    if (__atomic_load_n(&w->count, __ATOMIC_RELAXED) == 0) return 0;
+    if (pthread_mutex_trylock(&w->lock) != 0) return 0;
+    int found = w->count > 0;
+    if (found) {
+        w->count--;
+        *out = w->tasks[(w->head + w->count) % w->capacity];
+        __atomic_sub_fetch(&queued, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+static int take_task(Worker *self, Task *out) {
+    if (deque_pop_front(self, out)) return 1;
+    for (int round = 0; round < WORKPOOL_STEAL_ROUNDS; round++) {
+        int start = rand_r(&self->seed) % worker_count;
+        for (int i = 0; i < worker_count; i++) {
+            Worker *victim = &workers[(start + i) % worker_count];
+            if (victim == self) continue;
+            if (deque_pop_back(victim, out)) {
+                __atomic_add_fetch(&steals, 1, __ATOMIC_RELAXED);
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void finish_task() {
+    if (__atomic_sub_fetch(&outstanding, 1, __ATOMIC_SEQ_CST) == 0) {
+        pthread_mutex_lock(&idle_lock);
+        pthread_cond_broadcast(&done_cond);
+        pthread_mutex_unlock(&idle_lock);
+    }
+}
+
+static void *worker_main(void *arg) {
+    Worker *self = (Worker *)arg;
+    current_worker = self;
+
+    while (1) {
+        Task task;
+        if (take_task(self, &task)) {
+            task.fn(task.arg);
+            finish_task();
+            continue;
+        }
+
+        // Pairs with the queued/idle_workers check in workpool_submit()
+        pthread_mutex_lock(&idle_lock);
+        __atomic_add_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&queued, __ATOMIC_SEQ_CST) <= 0 && running) {
+            pthread_cond_wait(&idle_cond, &idle_lock);
+        }
+        __atomic_sub_fetch(&idle_workers, 1, __ATOMIC_SEQ_CST);
+        int stop = !running && __atomic_load_n(&queued, __ATOMIC_SEQ_CST) <= 0;
+        pthread_mutex_unlock(&idle_lock);
+        if (stop) break;
+    }
+    return NULL;
+}
+
+int workpool_submit(workpool_fn fn, void *arg) {
+    if (!workers) return -1;
+    // Pool threads keep their own follow-up work; everyone else spreads it out
+    Worker *w = current_worker;
+    if (!w) {
+        unsigned int i = __atomic_fetch_add(&submit_cursor, 1, __ATOMIC_RELAXED);
+        w = &workers[i % worker_count];
+    }
+
+    __atomic_add_fetch(&outstanding, 1, __ATOMIC_SEQ_CST);
+    if (deque_push(w, (Task){fn, arg}) != 0) {
+        finish_task();
+        return -1;
+    }
+    if (__atomic_load_n(&idle_workers, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&idle_lock);
+        pthread_cond_signal(&idle_cond);
+        pthread_mutex_unlock(&idle_lock);
+    }
+    return 0;
+}
+
+/* ---- timers ---- */
+
+static void timer_swap(int a, int b) {
+    TimerEntry tmp = timers[a];
+    timers[a] = timers[b];
+    timers[b] = tmp;
+}
+
+static void timer_heap_push(TimerEntry e) {
+    int i = timer_count++;
+    timers[i] = e;
+    while (i > 0 && timers[(i - 1) / 2].due_ns > timers[i].due_ns) {
+        timer_swap(i, (i - 1) / 2);
+        i = (i - 1) / 2;
+    }
+}
+
+static TimerEntry timer_heap_pop() {
+    TimerEntry top = timers[0];
+    timers[0] = timers[--timer_count];
+    int i = 0;
+    while (1) {
+        int l = 2 * i + 1, r = l + 1, min = i;
+        if (l < timer_count && timers[l].due_ns < timers[min].due_ns) min = l;
+        if (r < timer_count && timers[r].due_ns < timers[min].due_ns) min = r;
+        if (min == i) break;
+        timer_swap(i, min);
+        i = min;
+    }
+    return top;
+}
+
+int workpool_after(uint64_t delay_ns, workpool_fn fn, void *arg) {
+    pthread_mutex_lock(&timer_lock);
+    if (!timers_accepting) {
+        pthread_mutex_unlock(&timer_lock);
+        return -1;
+    }
+    if (timer_count == timer_capacity) {
+        int capacity = timer_capacity ? timer_capacity * 2 : WORKPOOL_TIMER_INITIAL;
+        TimerEntry *grown = realloc(timers, capacity * sizeof(TimerEntry));
+        if (!grown) {
+            pthread_mutex_unlock(&timer_lock);
+            perror("Failed to grow timer heap");
+            return -1;
+        }
+        timers = grown;
+        timer_capacity = capacity;
+    }
+    uint64_t due = monotonic_ns() + delay_ns;
+    int earliest = timer_count == 0 || due < timers[0].due_ns;
+    timer_heap_push((TimerEntry){due, {fn, arg}});
+    if (earliest) pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+    return 0;
+}
+
+static void *timer_main(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&timer_lock);
+    while (timers_accepting) {
+        if (timer_count == 0) {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+            continue;
+        }
+        uint64_t due = timers[0].due_ns;
+        if (due > monotonic_ns()) {
+            struct timespec deadline = {(time_t)(due / 1000000000ULL), (long)(due % 1000000000ULL)};
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &deadline);
+            continue;
+        }
+        TimerEntry e = timer_heap_pop();
+        pthread_mutex_unlock(&timer_lock);
+        if (workpool_submit(e.task.fn, e.task.arg) != 0) {
+            e.task.fn(e.task.arg);
+        }
+        pthread_mutex_lock(&timer_lock);
+    }
+    pthread_mutex_unlock(&timer_lock);
+    return NULL;
+}
+
+/* ---- lifecycle ---- */
+
+int workpool_start(int count, int pin_cpus) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (count <= 0) count = ncpu > 0 ? (int)ncpu : 4;
+    workers = calloc(count, sizeof(Worker));
+    if (!workers) {
+        perror("Failed to allocate workers");
+        return -1;
+    }
+    worker_count = count;
+
+    // Every deque exists before the first worker starts stealing
+    for (int i = 0; i < count; i++) {
+        Worker *w = &workers[i];
+        w->id = i;
+        w->capacity = WORKPOOL_DEQUE_INITIAL;
+        w->tasks = malloc(w->capacity * sizeof(Task));
+        w->seed = 2654435761u * (i + 1);
+        pthread_mutex_init(&w->lock, NULL);
+        if (!w->tasks) {
+            perror("Failed to allocate worker deque");
+            return -1;
+        }
+    }
+
+    running = 1;
+    for (int i = 0; i < count; i++) {
+        Worker *w = &workers[i];
+        if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+            perror("Failed to create worker thread");
+            return -1;
+        }
+        if (pin_cpus && ncpu > 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(i % ncpu, &set);
+            if (pthread_setaffinity_np(w->thread, sizeof(set), &set) != 0) {
+                fprintf(stderr, "Could not pin worker %d to CPU %ld\n", i, i % ncpu);
+            }
+        }
+    }
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&timer_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    timers_accepting = 1;
+    if (pthread_create(&timer_thread, NULL, timer_main, NULL) != 0) {
+        perror("Failed to create timer thread");
+        timers_accepting = 0;
+        return -1;
+    }
+
+    printf("Work pool started: %d workers%s\n", count, pin_cpus ? ", pinned" : "");
+    return 0;
+}
+
+// Drops pending timers, runs everything already submitted (and whatever that
+// submits in turn) to completion, then joins the workers.
+void workpool_stop() {
+    if (!workers) return;
+
+    pthread_mutex_lock(&timer_lock);
+    int had_timers = timers_accepting;
+    timers_accepting = 0;
+    pthread_cond_signal(&timer_cond);
+    pthread_mutex_unlock(&timer_lock);
+    if (had_timers) pthread_join(timer_thread, NULL);
+    free(timers);
+    timers = NULL;
+    timer_count = timer_capacity = 0;
+    pthread_cond_destroy(&timer_cond);
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += 10;
+    pthread_mutex_lock(&idle_lock);
+    while (__atomic_load_n(&outstanding, __ATOMIC_SEQ_CST) > 0) {
+        if (pthread_cond_timedwait(&done_cond, &idle_lock, &deadline) != 0) {
+            fprintf(stderr, "Work pool stopping with %ld tasks unfinished\n", outstanding);
+            break;
+        }
+    }
+    running = 0;
+    pthread_cond_broadcast(&idle_cond);
+    pthread_mutex_unlock(&idle_lock);
+
+    for (int i = 0; i < worker_count; i++) {
+        if (workers[i].thread) pthread_join(workers[i].thread, NULL);
+        pthread_mutex_destroy(&workers[i].lock);
+        free(workers[i].tasks);
+    }
+    free(workers);
+    workers = NULL;
+    worker_count = 0;
+    printf("Work pool stopped (%ld steals)\n", steals);
+}
+
+int workpool_size() {
+    return worker_count;
+}
+
+long workpool_queued() {
+    return __atomic_load_n(&queued, __ATOMIC_RELAXED);
+}
+
+long workpool_steals() {
+    return __atomic_load_n(&steals, __ATOMIC_RELAXED);
+}